@@ -0,0 +1,88 @@
+CONFIG_LOCALVERSION=""
+CONFIG_DEFAULT_HOSTNAME="zkernel"
+CONFIG_USE_GRUB=1
+CONFIG_ENABLE_BIN=1
+CONFIG_GENERATE_MAP=1
+CONFIG_BOOT_BANNER=1
+CONFIG_LOG_ROOTFS=1
+CONFIG_CUSTOM_CFLAGS=""
+CONFIG_OPT_LEVEL="O2"
+CONFIG_LTO=0
+CONFIG_LD_DEAD_CODE_DATA_ELIMINATION=0
+CONFIG_PGO=0
+CONFIG_PGO_NONE=1
+CONFIG_PGO_GENERATE=0
+CONFIG_PGO_USE=0
+CONFIG_MODULES=0
+CONFIG_BLOCK=1
+CONFIG_VIRTIO_BLK=1
+CONFIG_PAGE_CACHE_BENCH=0
+CONFIG_HELLO=1
+CONFIG_LANG_EN=1
+CONFIG_LANG_DE=0
+CONFIG_ENABLE_PAGING=0
+CONFIG_SMP=1
+CONFIG_LOG_MEMORY_MAP=1
+CONFIG_HEAP_DEMO=1
+CONFIG_MEM_TEST_PATTERN=0
+CONFIG_PM_STUB=1
+CONFIG_PCI=1
+CONFIG_FS_STUB=1
+CONFIG_RAMFS_SUPPORT=1
+CONFIG_EXT2=1
+CONFIG_EXT2_BENCH=0
+CONFIG_VIRTIO_NET=1
+CONFIG_VIRTIO_NET_BENCH=0
+CONFIG_NET_LOOPBACK=1
+CONFIG_NET_LOOPBACK_BENCH=0
+CONFIG_NET_IPV4=1
+CONFIG_NET_IPV4_ADDR="10.0.2.15"
+CONFIG_NET_IPV4_PREFIX="24"
+CONFIG_NET_IPV4_GATEWAY="10.0.2.2"
+CONFIG_NET_IPV4_BENCH=0
+CONFIG_NET_TCP=1
+CONFIG_NET_PING_TRACE=1
+CONFIG_NET_PACKET_ANALYZER=1
+CONFIG_NET_PACKET_ANALYZER_BENCH=0
+CONFIG_NET_CONGESTION_SUITE=1
+CONFIG_TCP_CONG_DEFAULT_CUBIC=1
+CONFIG_TCP_CONG_DEFAULT_RENO=0
+CONFIG_NET_WOL_UTILS=0
+CONFIG_NET_ROUTING_HELPERS=0
+CONFIG_NET_SPEEDTEST_CLI=0
+CONFIG_SECURITY_STUB=0
+CONFIG_SECURITY_FIREWALL_HELPERS=0
+CONFIG_SECURITY_IDS_COMPONENTS=0
+CONFIG_SECURITY_SANDBOX_HELPERS=1
+CONFIG_SECURITY_SECURE_RANDOM=0
+CONFIG_SECURITY_PASSWORD_HASHING=1
+CONFIG_ENABLE_DEBUG=0
+CONFIG_DEBUG_LOG_ROOTFS=0
+CONFIG_LOG_LEVEL_DEBUG=0
+CONFIG_LOG_LEVEL_INFO=1
+CONFIG_LOG_LEVEL_NOTICE=0
+CONFIG_LOG_LEVEL_WARN=0
+CONFIG_LOG_LEVEL_ERR=0
+CONFIG_DEBUG_KERNEL_PANIC_TOOLS=0
+CONFIG_DEBUG_PERF_ANALYSIS=0
+CONFIG_DEBUG_TRACING_SUBSYSTEM=0
+CONFIG_BOOT_ANALYZE=1
+CONFIG_MICROBENCH=0
+CONFIG_VIRT_STUB=0
+CONFIG_VIRT_CONTAINER_HELPERS=0
+CONFIG_HW_CPU_SENSORS=1
+CONFIG_HW_FAN_CONTROL=1
+CONFIG_HW_THERMAL_CALIBRATION=0
+CONFIG_HW_BATTERY_DIAGNOSTICS=0
+CONFIG_ENABLE_SERIAL_DEBUG=0
+CONFIG_ENABLE_KEYBOARD_ECHO=1
+CONFIG_FRAMEBUFFER_ENABLE=1
+CONFIG_FRAMEBUFFER_BG_COLOR=0x000000
+CONFIG_FRAMEBUFFER_TEST_PATTERN=0
+CONFIG_VGA_CONSOLE=1
+CONFIG_VGA_COLOR=0x0700
+CONFIG_USERLAND=1
+CONFIG_USERLAND_BASE_TOOLS=1
+CONFIG_USERLAND_SERVICE_WRAPPERS=0
+CONFIG_USERLAND_LOG_COLLECTOR=0
+CONFIG_USERLAND_RESCUE_SHELL=1
@@ -0,0 +1,95 @@
+#ifndef ACPI_H
+#define ACPI_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "stivale2.h"
+
+struct acpi_rsdp {
+    char signature[8];
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_address;
+    /* ACPI 2.0+ */
+    uint32_t length;
+    uint64_t xsdt_address;
+    uint8_t extended_checksum;
+    uint8_t reserved[3];
+} __attribute__((packed));
+
+struct acpi_sdt_header {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed));
+
+struct acpi_mcfg_allocation {
+    uint64_t base_address;
+    uint16_t segment;
+    uint8_t start_bus;
+    uint8_t end_bus;
+    uint32_t reserved;
+} __attribute__((packed));
+
+struct acpi_mcfg {
+    struct acpi_sdt_header header;
+    uint64_t reserved;
+    struct acpi_mcfg_allocation entries[];
+} __attribute__((packed));
+
+struct acpi_madt {
+    struct acpi_sdt_header header;
+    uint32_t lapic_address;
+    uint32_t flags;
+    uint8_t entries[];
+} __attribute__((packed));
+
+/* Generic address structure */
+struct acpi_gas {
+    uint8_t space_id;
+    uint8_t bit_width;
+    uint8_t bit_offset;
+    uint8_t access_size;
+    uint64_t address;
+} __attribute__((packed));
+
+struct acpi_hpet {
+    struct acpi_sdt_header header;
+    uint32_t event_timer_block_id;
+    struct acpi_gas base;
+    uint8_t hpet_number;
+    uint16_t min_tick;
+    uint8_t page_protection;
+} __attribute__((packed));
+
+struct acpi_srat {
+    struct acpi_sdt_header header;
+    uint32_t reserved1;
+    uint64_t reserved2;
+    uint8_t entries[];
+} __attribute__((packed));
+
+#define ACPI_SRAT_CPU_AFFINITY    0
+#define ACPI_SRAT_MEMORY_AFFINITY 1
+#define ACPI_SRAT_X2APIC_AFFINITY 2
+
+#define ACPI_MADT_LAPIC         0
+#define ACPI_MADT_X2APIC        9
+#define ACPI_MADT_LAPIC_ENABLED 0x1
+
+/* Find the RSDP, checksum every table the XSDT (or RSDT) and the FADT
+   point at and index the good ones by signature. */
+void acpi_init(struct stivale2_struct *boot_info);
+/* First table with this 4-character signature, from the index built by
+   acpi_init(); 0 when absent or its checksum failed. */
+const struct acpi_sdt_header *acpi_find_table(const char *signature);
+size_t acpi_cpu_apic_ids(uint32_t *ids, size_t max);
+
+#endif /* ACPI_H */
@@ -0,0 +1,31 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+/*
+ * In-kernel microbenchmarks. fn runs the measured operation `loops` times;
+ * the runner grows loops until one sample spans about 10 us of TSC, warms
+ * up, then reports min/median/p99 per operation over BENCH_SAMPLES samples.
+ */
+struct bench {
+    const char *suite;
+    const char *name;
+    void (*fn)(uint64_t loops);
+};
+
+/* BENCH(string, strlen_64, fn) registers "string.strlen_64" for bench=. */
+#define BENCH(suite_name, bench_name, bench_fn)                                          \
+    static const struct bench bench_##suite_name##_##bench_name                          \
+        __attribute__((used, section(".bench"), aligned(8))) = { #suite_name, #bench_name, bench_fn }
+
+/* Keep the compiler from dropping or hoisting work on p out of the loop. */
+static inline void bench_clobber(const void *p) {
+    __asm__ volatile ("" : : "r"(p) : "memory");
+}
+
+/* Run the benchmarks selected by a comma-separated list of suites,
+   suite.name pairs or "all"; returns how many ran. */
+uint32_t bench_run(const char *spec);
+
+#endif /* BENCH_H */
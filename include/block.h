@@ -0,0 +1,47 @@
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "vfs.h"
+
+#define BLOCK_MAX_DEVICES 8
+
+struct block_vec {
+    void *buf;
+    uint32_t len; /* multiple of the sector size */
+};
+
+struct block_device;
+
+struct block_device_ops {
+    /* One device request covering consecutive sectors starting at sector;
+       the vecs are scattered in memory but contiguous on disk. */
+    bool (*submit)(struct block_device *dev, uint64_t sector, const struct block_vec *vecs,
+                   size_t count, bool write);
+};
+
+struct block_device {
+    char name[8];
+    uint32_t sector_size;
+    uint64_t sectors;
+    uint32_t max_vecs;     /* scatter entries per request */
+    const struct block_device_ops *ops;
+    void *priv;
+    struct inode inode;    /* raw device contents, cached like a file */
+    uint64_t read_requests;
+    uint64_t write_requests;
+    uint64_t read_bytes;
+    uint64_t write_bytes;
+};
+
+bool block_register(struct block_device *dev);
+struct block_device *block_find(const char *name);
+struct block_device *block_first(void);
+struct block_device *block_device_at(size_t index);
+bool block_rw(struct block_device *dev, uint64_t sector, const struct block_vec *vecs, size_t count, bool write);
+bool block_read(struct block_device *dev, uint64_t sector, void *buf, uint32_t len);
+void block_log_stats(const struct block_device *dev);
+
+#endif /* BLOCK_H */
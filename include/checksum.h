@@ -0,0 +1,39 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Internet (RFC 1071) one's-complement checksums. csum_partial()
+ * accumulates into an unfolded 32-bit sum so pieces can be chained; every
+ * piece but the last must have even length. csum_fold() turns the sum
+ * into the 16-bit field value, already in network byte order.
+ */
+uint32_t csum_partial(const void *buf, size_t len, uint32_t sum);
+
+static inline uint16_t csum_fold(uint32_t sum) {
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    return (uint16_t)~sum;
+}
+
+static inline uint32_t csum_add(uint32_t a, uint32_t b) {
+    uint32_t r = a + b;
+    return r + (r < a);
+}
+
+/* saddr/daddr in network byte order, len and proto in host order */
+static inline uint32_t csum_tcpudp_nofold(uint32_t saddr, uint32_t daddr, uint16_t len, uint8_t proto,
+                                          uint32_t sum) {
+    uint64_t s = (uint64_t)sum + saddr + daddr + __builtin_bswap16(len) + ((uint32_t)proto << 8);
+    s = (s & 0xFFFFFFFF) + (s >> 32);
+    s = (s & 0xFFFFFFFF) + (s >> 32);
+    return (uint32_t)s;
+}
+
+static inline uint16_t ip_fast_csum(const void *iph, uint32_t ihl) {
+    return csum_fold(csum_partial(iph, ihl * 4, 0));
+}
+
+#endif /* CHECKSUM_H */
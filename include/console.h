@@ -9,6 +9,6 @@
 void console_init(struct stivale2_struct *boot_info);
 void console_putc(char c);
 void console_write(const char *s);
-void kprint(const char *fmt, ...);
+void kprint(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
 
 #endif
@@ -16,9 +16,60 @@ struct cpu_info {
     bool sse3;
     bool avx;
     bool avx2;
+    bool hypervisor;
+    bool pcid;          /* process-context identifiers in CR3 */
+    bool rdtscp;
+    bool tsc_invariant; /* constant rate in every P- and C-state */
+    bool monitor;       /* MONITOR/MWAIT */
+    uint32_t mwait_substates; /* CPUID leaf 5 EDX: 4 bits of sub-state count per C0..C7 */
+    /* architectural performance monitoring, CPUID leaf 0xA */
+    uint8_t pmu_version;        /* 0: none */
+    uint8_t pmu_gp_counters;
+    uint8_t pmu_gp_width;
+    uint8_t pmu_fixed_counters;
+    uint8_t pmu_fixed_width;
+    uint8_t pmu_event_bits;     /* valid bits in pmu_events_missing */
+    uint32_t pmu_events_missing; /* set bit: architectural event not available */
 };
 
+static inline void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *d) {
+    __asm__ volatile ("cpuid" : "=a" (*a), "=b" (*b), "=c" (*c), "=d" (*d) : "a" (leaf), "c" (subleaf));
+}
+
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/* rdtsc that does not run ahead of earlier loads */
+static inline uint64_t rdtsc_ordered(void) {
+    uint32_t lo, hi;
+    __asm__ volatile ("lfence; rdtsc" : "=a"(lo), "=d"(hi) : : "memory");
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline uint64_t rdmsr(uint32_t msr) {
+    uint32_t lo, hi;
+    __asm__ volatile ("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t value) {
+    __asm__ volatile ("wrmsr" : : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
+static inline void cpu_relax(void) {
+    __asm__ volatile ("pause" ::: "memory");
+}
+
 void cpu_detect(struct cpu_info *info);
 void cpu_log(const struct cpu_info *info);
 
+/* Bracket kernel code that uses SSE registers, which the interrupt stubs
+   do not save: interrupts stay off in between, and the registers are put
+   back as they were. The kernel is otherwise built without SSE. */
+uint64_t kernel_fpu_begin(void);
+void kernel_fpu_end(uint64_t flags);
+
 #endif /* CPU_H */
@@ -0,0 +1,8 @@
+#ifndef CPU_SENSORS_H
+#define CPU_SENSORS_H
+
+/* Print each online CPU's digital thermal sensor reading. Built as a
+   module under HW_CPU_SENSORS=m; callers then go through module_symbol(). */
+void cpu_sensors_report(void);
+
+#endif /* CPU_SENSORS_H */
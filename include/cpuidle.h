@@ -0,0 +1,31 @@
+#ifndef CPUIDLE_H
+#define CPUIDLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "cpu.h"
+
+/*
+ * Idle states. A caller disables interrupts, finds nothing to do and
+ * calls cpuidle_enter(); it returns with interrupts on once an interrupt
+ * or an smp_kick() arrived, and the caller checks again. Without
+ * PM_STUB that is plain "sti; hlt".
+ */
+#ifdef CONFIG_PM_STUB
+/* HLT, or MWAIT C-states from CPUID leaf 5; force_hlt is "idle=hlt". */
+void cpuidle_init(const struct cpu_info *cpu, bool force_hlt);
+/* expected_ns: how long the caller expects to sleep, 0 when unknown */
+void cpuidle_enter(uint64_t expected_ns);
+/* For smp_kick(): wakes cpu through its monitored line and returns true
+   when it sleeps in MWAIT; false means an IPI is still needed. */
+bool cpuidle_kick(uint32_t cpu);
+/* Residency and wake latency per state, summed over CPUs. */
+void cpuidle_report(void);
+#else
+static inline void cpuidle_enter(uint64_t expected_ns) {
+    (void)expected_ns;
+    __asm__ volatile ("sti; hlt" ::: "memory");
+}
+#endif
+
+#endif /* CPUIDLE_H */
@@ -0,0 +1,9 @@
+#ifndef EXT2_H
+#define EXT2_H
+
+void ext2_init(void);
+void ext2_log_stats(void);
+/* Lookup and streaming read of CONFIG_EXT2_BENCH_FILE, printed. */
+void ext2_bench(void);
+
+#endif /* EXT2_H */
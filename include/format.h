@@ -0,0 +1,34 @@
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <stdarg.h>
+#include <stddef.h>
+
+/*
+ * printf-compatible formatting that never allocates. Supported: the flags
+ * "-+ #0", width and precision (either may be "*"), the hh/h/l/ll/z/t/j
+ * length modifiers and %d %i %u %o %x %X %c %s %p %%. %s of NULL prints
+ * "(null)", %p prints 0x and 16 hex digits, anything else prints '?'.
+ * Widths and precisions are capped at FORMAT_WIDTH_MAX so a bad one cannot
+ * stall a CPU that formats with interrupts off.
+ */
+#define FORMAT_WIDTH_MAX 4096
+
+/* Output lands in data[0..size). When it fills, flush (if set) drains it
+   and resets len; without one the rest is counted but dropped. */
+struct format_buf {
+    char *data;
+    size_t size;
+    size_t len;
+    void (*flush)(struct format_buf *b);
+};
+
+/* Returns the number of characters produced, dropped ones included. */
+size_t vformat(struct format_buf *b, const char *fmt, va_list args);
+
+/* C semantics: buf is always terminated when size is non-zero and the
+   return value is the untruncated length. */
+int vsnprintf(char *buf, size_t size, const char *fmt, va_list args) __attribute__((format(printf, 3, 0)));
+int snprintf(char *buf, size_t size, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+
+#endif /* FORMAT_H */
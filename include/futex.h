@@ -0,0 +1,48 @@
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Futexes: sleep on a 32-bit word until someone wakes that word. Waiters
+ * hang off hashed buckets keyed by the word's physical address, so a
+ * process and the kernel (or two address spaces) sharing a page meet in
+ * the same queue. A sleeping CPU halts until the waker interrupts it.
+ */
+
+/* Sleep while *word == expected, until futex_wake() on the same word.
+   Returns false at once when the value differs. Interrupts must be on. */
+bool futex_wait(uint32_t *word, uint32_t expected);
+/* Wake up to n waiters of word, oldest first; returns how many. */
+uint32_t futex_wake(uint32_t *word, uint32_t n);
+
+/* 0 free, 1 locked, 2 locked and maybe waited on: lock and unlock only
+   reach futex_wait()/futex_wake() under contention. */
+struct mutex {
+    uint32_t state;
+};
+
+#define MUTEX_INIT { 0 }
+
+void mutex_lock_slow(struct mutex *m);
+
+static inline void mutex_lock(struct mutex *m) {
+    uint32_t expected = 0;
+    if (!__atomic_compare_exchange_n(&m->state, &expected, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        mutex_lock_slow(m);
+    }
+}
+
+static inline bool mutex_trylock(struct mutex *m) {
+    uint32_t expected = 0;
+    return __atomic_compare_exchange_n(&m->state, &expected, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+static inline void mutex_unlock(struct mutex *m) {
+    if (__atomic_exchange_n(&m->state, 0, __ATOMIC_RELEASE) == 2) {
+        futex_wake(&m->state, 1);
+    }
+}
+
+#endif /* FUTEX_H */
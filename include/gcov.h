@@ -0,0 +1,30 @@
+#ifndef GCOV_H
+#define GCOV_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PGO_MAGIC "ZKGCDA01"
+
+/*
+ * Profile dump layout, little endian: pgo_file_header, then nr_files
+ * times a pgo_record_header, the .gcda path (name_len bytes, no NUL) and
+ * data_len bytes of .gcda contents. scripts/pgo/pgo2gcda.c mirrors these.
+ */
+struct pgo_file_header {
+    char magic[8];
+    uint32_t nr_files;
+    uint32_t reserved;
+};
+
+struct pgo_record_header {
+    uint32_t name_len;
+    uint32_t data_len;
+};
+
+/* Run the compiler's constructors, which register each object's counters. */
+void gcov_init(void);
+/* Stream every object's counters to COM2 for scripts/pgo/pgo2gcda. */
+void gcov_dump(void);
+
+#endif /* GCOV_H */
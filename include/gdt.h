@@ -0,0 +1,41 @@
+#ifndef GDT_H
+#define GDT_H
+
+#ifndef __ASSEMBLER__
+#include <stdint.h>
+#endif
+
+/*
+ * Kernel-owned descriptor table. The order is the one SYSCALL/SYSRET
+ * expect: kernel code and data, then the user data and 64-bit code
+ * selectors SYSRET derives from STAR[63:48] (an unused 32-bit user code
+ * slot sits in front of them), then one TSS per CPU.
+ */
+#define GDT_KERNEL_CS 0x08
+#define GDT_KERNEL_DS 0x10
+#define GDT_USER_CS32 0x18
+#define GDT_USER_DS   (0x20 | 3)
+#define GDT_USER_CS   (0x28 | 3)
+#define GDT_TSS       0x30
+
+/* Interrupt stack table slots. NMI, #DB and #MC can arrive between
+   SYSCALL and the switch to the kernel stack, or after the switch back;
+   #DF must not depend on the stack that faulted. */
+#define IST_NMI 1
+#define IST_DF  2
+#define IST_MC  3
+#define IST_DB  4
+#define IST_COUNT 4
+#define IST_STACK_SIZE 8192
+
+#ifndef __ASSEMBLER__
+/* Replace the loader's GDT on the boot CPU; must run before the IDT is
+   built, which records the code selector in use. */
+void gdt_init(void);
+/* Load the calling CPU's TSS; APs pick up the table itself from smp.c. */
+void gdt_load_tss(uint32_t cpu);
+/* Stack the CPU switches to when an interrupt or exception leaves ring 3. */
+void tss_set_kernel_stack(uint32_t cpu, uint64_t rsp0);
+#endif
+
+#endif /* GDT_H */
@@ -10,19 +10,41 @@
 #define CONFIG_LOG_ROOTFS 1
 #define CONFIG_CUSTOM_CFLAGS ""
 #define CONFIG_OPT_LEVEL "O2"
+#define CONFIG_PGO_NONE 1
 #define CONFIG_BLOCK 1
+#define CONFIG_VIRTIO_BLK 1
 #define CONFIG_HELLO 1
 #define CONFIG_LANG_EN 1
+#define CONFIG_SMP 1
 #define CONFIG_LOG_MEMORY_MAP 1
 #define CONFIG_HEAP_DEMO 1
+#define CONFIG_PM_STUB 1
+#define CONFIG_PCI 1
 #define CONFIG_FS_STUB 1
 #define CONFIG_RAMFS_SUPPORT 1
+#define CONFIG_EXT2 1
+#define CONFIG_VIRTIO_NET 1
 #define CONFIG_NET_LOOPBACK 1
+#define CONFIG_NET_IPV4 1
+#define CONFIG_NET_IPV4_ADDR "10.0.2.15"
+#define CONFIG_NET_IPV4_PREFIX "24"
+#define CONFIG_NET_IPV4_GATEWAY "10.0.2.2"
+#define CONFIG_NET_TCP 1
 #define CONFIG_NET_PING_TRACE 1
-#define CONFIG_ELF_STUB 1
+#define CONFIG_NET_PACKET_ANALYZER 1
+#define CONFIG_NET_CONGESTION_SUITE 1
+#define CONFIG_TCP_CONG_DEFAULT_CUBIC 1
+#define CONFIG_SECURITY_SANDBOX_HELPERS 1
+#define CONFIG_SECURITY_PASSWORD_HASHING 1
+#define CONFIG_LOG_LEVEL_INFO 1
+#define CONFIG_BOOT_ANALYZE 1
+#define CONFIG_HW_CPU_SENSORS 1
+#define CONFIG_HW_FAN_CONTROL 1
 #define CONFIG_ENABLE_KEYBOARD_ECHO 1
 #define CONFIG_FRAMEBUFFER_ENABLE 1
-#define CONFIG_FRAMEBUFFER_BG_COLOR "0x000000"
-#define CONFIG_VGA_COLOR "0x0700"
+#define CONFIG_FRAMEBUFFER_BG_COLOR 0x000000
+#define CONFIG_VGA_CONSOLE 1
+#define CONFIG_VGA_COLOR 0x0700
+#define CONFIG_USERLAND 1
 #define CONFIG_USERLAND_BASE_TOOLS 1
 #define CONFIG_USERLAND_RESCUE_SHELL 1
@@ -0,0 +1,85 @@
+#ifndef INET_H
+#define INET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "netdev.h"
+#include "skbuff.h"
+
+#define IPPROTO_ICMP 1
+#define IPPROTO_TCP  6
+#define IPPROTO_UDP  17
+
+#define IP_DEFAULT_TTL 64
+#define INADDR_BROADCAST 0xFFFFFFFFu
+#define INADDR_LOOPBACK  0x7F000001u
+
+struct iphdr {
+    uint8_t ihl_version; /* version in the high nibble */
+    uint8_t tos;
+    uint16_t tot_len;
+    uint16_t id;
+    uint16_t frag_off;
+    uint8_t ttl;
+    uint8_t protocol;
+    uint16_t check;
+    uint32_t saddr;
+    uint32_t daddr;
+} __attribute__((packed));
+
+#define IP_MF     0x2000
+#define IP_OFFSET 0x1FFF
+
+struct icmphdr {
+    uint8_t type;
+    uint8_t code;
+    uint16_t checksum;
+    uint16_t id;
+    uint16_t sequence;
+} __attribute__((packed));
+
+#define ICMP_ECHOREPLY 0
+#define ICMP_ECHO      8
+
+/* Addresses are kept in network byte order everywhere below. */
+struct inet_route {
+    struct net_device *dev;
+    uint32_t saddr;
+    uint32_t nexthop;
+};
+
+struct inet_stats {
+    uint64_t ip_in;
+    uint64_t ip_in_dropped;
+    uint64_t ip_out;
+    uint64_t arp_queued;
+    uint64_t arp_dropped;
+    uint64_t icmp_echo_replies_sent;
+    uint64_t udp_no_port;
+};
+
+extern struct inet_stats inet_stats; /* updated by arp.c, icmp.c and udp.c too */
+
+/* Transport receive hook; skb->data points at the transport header. */
+typedef void (*inet_protocol_handler_t)(struct sk_buff *skb);
+
+void inet_init(void);
+bool inet_parse_addr(const char *text, uint32_t *addr);
+void inet_set_addr(struct net_device *dev, uint32_t addr, uint32_t prefix_len, uint32_t gateway);
+bool inet_add_protocol(uint8_t protocol, inet_protocol_handler_t handler);
+bool ip_route_output(uint32_t daddr, struct inet_route *rt);
+bool ip_send(struct sk_buff *skb, const struct inet_route *rt, uint32_t daddr, uint8_t protocol);
+uint32_t skb_checksum(const struct sk_buff *skb, uint32_t offset, uint32_t len, uint32_t sum);
+void inet_get_stats(struct inet_stats *out);
+
+void arp_init(void);
+bool arp_output(struct sk_buff *skb, struct net_device *dev, uint32_t nexthop);
+
+void icmp_init(void);
+bool net_ping(uint32_t daddr, uint16_t seq, uint32_t payload, uint64_t timeout_us, uint64_t *rtt_ns);
+/* ICMP echo round trips with a 56 B payload, like ping(8); prints the
+   latency percentiles prefixed with tag. */
+void ping_bench(const char *tag, uint32_t daddr);
+
+#endif /* INET_H */
@@ -0,0 +1,56 @@
+#ifndef INITCALL_H
+#define INITCALL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Boot work in levels. A level starts once the one before it is done;
+ * inside a level every CPU takes whichever call has all its dependencies
+ * finished, so independent calls run side by side.
+ */
+enum initcall_level {
+    INITCALL_EARLY,     /* boot CPU, before the APs exist */
+    INITCALL_CORE,
+    INITCALL_DRIVER,
+    INITCALL_SUBSYS,
+    INITCALL_LATE,
+    INITCALL_DEFERRED,  /* after the ready message, behind the boot work */
+    INITCALL_NR_LEVELS,
+};
+
+#define INITCALL_MAX 64
+#define INITCALL_BSP 0x1    /* must run on the boot CPU */
+
+struct initcall {
+    const char *name;
+    void (*fn)(void);
+    uint8_t level;
+    uint8_t flags;
+    const char *deps;       /* comma-separated names; calls not built in are ignored */
+    /* filled in by the runner */
+    volatile uint32_t state;
+    uint32_t cpu;
+    uint64_t start_tsc;
+    uint64_t end_tsc;
+    uint64_t dep_mask;
+};
+
+/* INITCALL(pci, pci_init, INITCALL_DRIVER, INITCALL_BSP, "acpi") */
+#define INITCALL(call_name, call_fn, lvl, flag_bits, dep_list) \
+    { .name = #call_name, .fn = (call_fn), .level = (lvl), .flags = (flag_bits), .deps = (dep_list) }
+
+/* Adopt a table; false when it is too large or a dependency cycles. */
+bool initcall_init(struct initcall *calls, size_t count);
+/* Run levels first..last to completion on every online CPU. */
+void initcall_run(enum initcall_level first, enum initcall_level last);
+/* Hand a level to the APs and return; initcall_wait() joins it. Without
+   APs the level runs in initcall_wait(). */
+void initcall_start_async(enum initcall_level level);
+void initcall_wait(enum initcall_level level);
+/* systemd-analyze style summary: where the time from reset went, then
+   every call by duration. */
+void initcall_report(uint64_t entry_tsc, uint64_t ready_tsc);
+
+#endif /* INITCALL_H */
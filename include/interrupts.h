@@ -0,0 +1,53 @@
+#ifndef INTERRUPTS_H
+#define INTERRUPTS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define IRQ_VECTOR_BASE    0x30 /* first vector handed out by irq_alloc_vector() */
+#define IRQ_VECTOR_LIMIT   0xF0 /* vectors above this are reserved for the LAPIC */
+#define IRQ_VECTOR_SPURIOUS 0xFF
+
+struct interrupt_frame {
+    uint64_t r15, r14, r13, r12, r11, r10, r9, r8;
+    uint64_t rbp, rdi, rsi, rdx, rcx, rbx, rax;
+    uint64_t vector;
+    uint64_t error_code;
+    uint64_t rip;
+    uint64_t cs;
+    uint64_t rflags;
+    uint64_t rsp;
+    uint64_t ss;
+};
+
+typedef void (*irq_handler_t)(struct interrupt_frame *frame, void *ctx);
+
+void interrupts_init(void);
+/* Load the shared IDT and enable the calling CPU's LAPIC; application
+   processors call this, interrupts_init() does it for the boot CPU. */
+void interrupts_init_ap(void);
+int irq_alloc_vector(void);
+bool irq_register(uint8_t vector, irq_handler_t handler, void *ctx);
+
+static inline void interrupts_enable(void) {
+    __asm__ volatile ("sti" ::: "memory");
+}
+
+static inline void interrupts_disable(void) {
+    __asm__ volatile ("cli" ::: "memory");
+}
+
+/* Disable interrupts, returning the previous RFLAGS for irq_restore(). */
+static inline uint64_t irq_save(void) {
+    uint64_t flags;
+    __asm__ volatile ("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+    return flags;
+}
+
+static inline void irq_restore(uint64_t flags) {
+    if (flags & 0x200) {
+        __asm__ volatile ("sti" ::: "memory");
+    }
+}
+
+#endif /* INTERRUPTS_H */
@@ -13,4 +13,49 @@ static inline uint8_t inb(uint16_t port) {
     return ret;
 }
 
+static inline void outw(uint16_t port, uint16_t val) {
+    __asm__ volatile ("outw %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static inline uint16_t inw(uint16_t port) {
+    uint16_t ret;
+    __asm__ volatile ("inw %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+static inline void outl(uint16_t port, uint32_t val) {
+    __asm__ volatile ("outl %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static inline uint32_t inl(uint16_t port) {
+    uint32_t ret;
+    __asm__ volatile ("inl %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+/* MMIO accessors; volatile keeps the compiler from merging device accesses. */
+static inline uint32_t mmio_read32(volatile void *addr) {
+    return *(volatile uint32_t *)addr;
+}
+
+static inline void mmio_write32(volatile void *addr, uint32_t val) {
+    *(volatile uint32_t *)addr = val;
+}
+
+static inline uint16_t mmio_read16(volatile void *addr) {
+    return *(volatile uint16_t *)addr;
+}
+
+static inline void mmio_write16(volatile void *addr, uint16_t val) {
+    *(volatile uint16_t *)addr = val;
+}
+
+static inline uint8_t mmio_read8(volatile void *addr) {
+    return *(volatile uint8_t *)addr;
+}
+
+static inline void mmio_write8(volatile void *addr, uint8_t val) {
+    *(volatile uint8_t *)addr = val;
+}
+
 #endif
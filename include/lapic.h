@@ -0,0 +1,27 @@
+#ifndef LAPIC_H
+#define LAPIC_H
+
+#include <stdint.h>
+
+#define LAPIC_MSI_ADDR_BASE 0xFEE00000ULL
+
+#define LAPIC_LVT_NMI    (4u << 8)  /* delivery mode */
+#define LAPIC_LVT_MASKED (1u << 16)
+
+/* Interrupt command register, low word */
+#define LAPIC_ICR_FIXED   (0u << 8)
+#define LAPIC_ICR_INIT    (5u << 8)
+#define LAPIC_ICR_STARTUP (6u << 8)
+#define LAPIC_ICR_ASSERT  (1u << 14)
+
+/* Enable the calling CPU's LAPIC; the boot CPU also maps the registers. */
+void lapic_init(void);
+uint32_t lapic_id(void);
+void lapic_eoi(void);
+/* Performance counter overflow entry; the CPU masks it on every PMI. */
+void lapic_set_lvt_pmc(uint32_t value);
+/* Send icr_low (delivery mode | vector) to one xAPIC ID and wait until
+   the LAPIC has accepted it. */
+void lapic_send_ipi(uint32_t apic_id, uint32_t icr_low);
+
+#endif /* LAPIC_H */
@@ -0,0 +1,90 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "console.h"
+#include "spinlock.h"
+
+/*
+ * Leveled logging on top of kprint. A message is printed when its level
+ * is at or above the runtime threshold ("loglevel=" on the command line,
+ * "quiet" for warnings and errors only). Levels less severe than the
+ * Kconfig LOG_LEVEL_* choice are compiled out, arguments included.
+ *
+ * kprint itself stays unfiltered for output that was asked for, such as
+ * benchmark results and profiles.
+ */
+enum log_level {
+    LOG_ERR = 3,
+    LOG_WARN = 4,
+    LOG_NOTICE = 5,
+    LOG_INFO = 6,
+    LOG_DEBUG = 7,
+};
+
+#if defined(CONFIG_LOG_LEVEL_DEBUG)
+#define LOG_COMPILE_LEVEL LOG_DEBUG
+#elif defined(CONFIG_LOG_LEVEL_NOTICE)
+#define LOG_COMPILE_LEVEL LOG_NOTICE
+#elif defined(CONFIG_LOG_LEVEL_WARN)
+#define LOG_COMPILE_LEVEL LOG_WARN
+#elif defined(CONFIG_LOG_LEVEL_ERR)
+#define LOG_COMPILE_LEVEL LOG_ERR
+#else
+#define LOG_COMPILE_LEVEL LOG_INFO
+#endif
+
+/* Hot-path warnings: a call site prints at most BURST messages per
+   INTERVAL, then reports how many it dropped once the window rolls over. */
+#define LOG_RATELIMIT_INTERVAL_MS 5000
+#define LOG_RATELIMIT_BURST 10
+
+struct ratelimit {
+    spinlock_t lock;
+    const char *where;
+    uint64_t begin;
+    uint32_t printed;
+    uint32_t missed;
+};
+
+extern uint8_t log_level;
+
+/* Apply "loglevel=err|warn|notice|info|debug" (or 3-7) and "quiet". */
+void log_setup(const char *cmdline);
+/* true when the caller may print; never waits for another CPU */
+bool log_ratelimit(struct ratelimit *rs);
+
+#define LOG_STR_(x) #x
+#define LOG_STR(x) LOG_STR_(x)
+
+#define log_enabled(level) ((level) <= LOG_COMPILE_LEVEL && (level) <= log_level)
+
+#define pr_log(level, ...)                                                   \
+    do {                                                                     \
+        if (log_enabled(level)) {                                            \
+            kprint(__VA_ARGS__);                                             \
+        }                                                                    \
+    } while (0)
+
+#define pr_log_ratelimited(level, ...)                                       \
+    do {                                                                     \
+        static struct ratelimit log_rs_ = {                                  \
+            SPINLOCK_INIT, __FILE__ ":" LOG_STR(__LINE__), 0, 0, 0           \
+        };                                                                   \
+        if (log_enabled(level) && log_ratelimit(&log_rs_)) {                 \
+            kprint(__VA_ARGS__);                                             \
+        }                                                                    \
+    } while (0)
+
+#define pr_err(...) pr_log(LOG_ERR, __VA_ARGS__)
+#define pr_warn(...) pr_log(LOG_WARN, __VA_ARGS__)
+#define pr_notice(...) pr_log(LOG_NOTICE, __VA_ARGS__)
+#define pr_info(...) pr_log(LOG_INFO, __VA_ARGS__)
+#define pr_debug(...) pr_log(LOG_DEBUG, __VA_ARGS__)
+
+#define pr_err_ratelimited(...) pr_log_ratelimited(LOG_ERR, __VA_ARGS__)
+#define pr_warn_ratelimited(...) pr_log_ratelimited(LOG_WARN, __VA_ARGS__)
+
+#endif /* LOG_H */
@@ -1,8 +1,10 @@
 #ifndef MEMORY_H
 #define MEMORY_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include "spinlock.h"
 #include "stivale2.h"
 
 void *memset(void *dest, int c, size_t n);
@@ -12,5 +14,47 @@ int memcmp(const void *a, const void *b, size_t n);
 void memory_init(struct stivale2_struct *boot_info);
 void *bump_alloc(size_t size, size_t align);
 const struct stivale2_mmap_tag *memory_get_mmap(void);
+/* Boot command line (QEMU -append); empty when the loader passed none. */
+const char *memory_get_cmdline(void);
+/* First Stivale2 tag with this identifier, or 0; usable before
+   memory_init(). */
+const struct stivale2_tag *memory_find_tag(struct stivale2_struct *info, uint64_t id);
+/* Copy the value of "key=value" on the command line into buf. */
+bool memory_cmdline_arg(const char *key, char *buf, size_t len);
+/* A decimal "key=N", or fallback when absent or malformed. */
+uint32_t memory_cmdline_u32(const char *key, uint32_t fallback);
+
+#define MAX_BOOT_MODULES 16
+
+/* A file the loader placed in memory next to the kernel (Multiboot module,
+   QEMU -initrd); path is the loader's string, which may carry arguments. */
+struct boot_module {
+    uint64_t base;
+    uint64_t size;
+    char path[64];
+};
+
+const struct boot_module *memory_boot_modules(size_t *count);
+
+/* 4 KiB physical pages, identity mapped. Freed pages are recycled before
+   the bump region is touched again. */
+void *page_alloc(void);
+void page_free(void *page);
+uint64_t memory_free_pages(void);
+
+/* Fixed-size object pool carved out of whole pages; objects must be at
+   least pointer sized and a divisor-friendly fraction of a page. */
+struct object_pool {
+    const char *name;
+    size_t object_size;
+    void *free_list;
+    size_t in_use;
+    spinlock_t lock;
+};
+
+#define OBJECT_POOL(pool_name, type) { (pool_name), (sizeof(type) + 15) & ~(size_t)15, 0, 0, SPINLOCK_INIT }
+
+void *pool_alloc(struct object_pool *pool);
+void pool_free(struct object_pool *pool, void *obj);
 
 #endif
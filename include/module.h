@@ -0,0 +1,56 @@
+#ifndef MODULE_H
+#define MODULE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Loadable modules: tristate drivers set to m are linked with ld -r into
+ * ET_REL objects, handed to the kernel as boot modules (or found under
+ * /lib/modules on the root filesystem) and loaded the first time
+ * something asks for one of their symbols.
+ */
+
+#define MODULE_NAME_LEN 32
+
+struct kernel_symbol {
+    const char *name;
+    uintptr_t value;
+};
+
+/* The section name carries the symbol name, so the SORT() in link.ld
+   leaves __ksymtab_start..__ksymtab_end ordered for binary search. */
+#if defined(CONFIG_MODULES) && !defined(MODULE)
+#define EXPORT_SYMBOL(sym)                                                   \
+    static const struct kernel_symbol __ksymtab_##sym                       \
+        __attribute__((used, aligned(8), section("___ksymtab+" #sym))) = { #sym, (uintptr_t)&(sym) }
+#else
+#define EXPORT_SYMBOL(sym)
+#endif
+
+/* What a module's object carries about itself; the loader calls init
+   once relocation is done and drops the module if it fails. */
+struct module_info {
+    const char *name;
+    int (*init)(void);
+};
+
+#ifdef MODULE
+#define module_init(fn) const struct module_info __this_module = { KBUILD_MODNAME, (fn) }
+#else
+#define module_init(fn)
+#endif
+
+#ifdef CONFIG_MODULES
+/* Exported kernel symbol by name, 0 when there is none. */
+uintptr_t ksym_lookup(const char *name);
+/* Load a module unless it is loaded already; false if it failed, now or
+   on an earlier attempt. */
+bool request_module(const char *name);
+/* Address of a symbol a module defines, loading the module first. */
+void *module_symbol(const char *module, const char *symbol);
+void module_log(void);
+#endif
+
+#endif /* MODULE_H */
@@ -0,0 +1,111 @@
+#ifndef NETDEV_H
+#define NETDEV_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "skbuff.h"
+
+#define NETDEV_MAX_DEVICES 8
+#define NET_MAX_PROTOCOLS  8
+#define NET_BACKLOG_MAX    1024
+#define NAPI_WEIGHT        64
+
+#define ETH_ALEN  6
+#define ETH_HLEN  14
+#define ETH_P_IP    0x0800
+#define ETH_P_ARP   0x0806
+#define ETH_P_BENCH 0x88B5 /* IEEE local experimental ethertype */
+
+struct ethhdr {
+    uint8_t dest[ETH_ALEN];
+    uint8_t source[ETH_ALEN];
+    uint16_t proto; /* network byte order */
+} __attribute__((packed));
+
+static inline uint16_t htons(uint16_t v) {
+    return __builtin_bswap16(v);
+}
+
+static inline uint16_t ntohs(uint16_t v) {
+    return __builtin_bswap16(v);
+}
+
+static inline uint32_t htonl(uint32_t v) {
+    return __builtin_bswap32(v);
+}
+
+static inline uint32_t ntohl(uint32_t v) {
+    return __builtin_bswap32(v);
+}
+
+struct net_device;
+
+struct net_device_ops {
+    /* Takes ownership of skb whether or not it was sent. */
+    bool (*xmit)(struct net_device *dev, struct sk_buff *skb);
+};
+
+struct net_device_stats {
+    uint64_t rx_packets;
+    uint64_t rx_bytes;
+    uint64_t rx_dropped;
+    uint64_t tx_packets;
+    uint64_t tx_bytes;
+    uint64_t tx_dropped;
+};
+
+#define NETDEV_F_LOOPBACK 0x1
+
+struct net_device {
+    char name[8];
+    uint32_t ifindex;      /* 1-based registration order */
+    uint8_t mac[ETH_ALEN];
+    uint32_t mtu;
+    uint32_t flags;
+    uint32_t ipv4_addr;    /* network byte order; 0 when unconfigured */
+    uint32_t ipv4_mask;
+    uint32_t ipv4_gateway;
+    const struct net_device_ops *ops;
+    void *priv;
+    struct net_device_stats stats;
+};
+
+/* Receive handler for one ethertype; skb->data points past the Ethernet
+   header and the handler owns the skb. */
+struct packet_type {
+    uint16_t type;
+    void (*func)(struct sk_buff *skb, struct net_device *dev);
+};
+
+/*
+ * Budgeted polling context. A driver's interrupt handler masks the
+ * device and calls napi_schedule(); poll() then runs from net_rx_action()
+ * and returns the packets it handled. Returning less than budget means
+ * the queue ran dry: poll must then call napi_complete() and unmask.
+ */
+struct napi_struct {
+    struct napi_struct *next;
+    int (*poll)(struct napi_struct *napi, int budget);
+    struct net_device *dev;
+    bool scheduled;
+    uint64_t polls;
+};
+
+bool netdev_register(struct net_device *dev);
+struct net_device *netdev_find(const char *name);
+struct net_device *netdev_at(size_t index);
+bool net_register_protocol(const struct packet_type *pt);
+
+bool dev_queue_xmit(struct sk_buff *skb);
+void netif_rx(struct sk_buff *skb);
+void netif_receive_skb(struct sk_buff *skb);
+size_t net_rx_action(size_t budget);
+void napi_schedule(struct napi_struct *napi);
+void napi_complete(struct napi_struct *napi);
+
+void loopback_init(void);
+/* Frames per second through lo at 64 B and 1500 B, printed. */
+void loopback_bench(void);
+
+#endif /* NETDEV_H */
@@ -0,0 +1,173 @@
+#ifndef PACKET_H
+#define PACKET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "netdev.h"
+#include "skbuff.h"
+
+#define PACKET_RING_MAX_PAGES 512  /* 2 MiB of slots per capture socket */
+#define PACKET_SLOT_MIN 128
+#define PACKET_SLOT_MAX 4096
+#define BPF_MAXINSNS 256
+#define BPF_MEMWORDS 16
+
+/* Direction of a captured frame, as in sockaddr_ll.sll_pkttype. */
+#define PACKET_HOST     0
+#define PACKET_OUTGOING 4
+
+/*
+ * Classic BPF, encoded like linux/filter.h so the output of
+ * `tcpdump -dd` can be pasted in as is. A program returns the number
+ * of bytes to capture; 0 drops the frame before anything is copied.
+ */
+struct sock_filter {
+    uint16_t code;
+    uint8_t jt;
+    uint8_t jf;
+    uint32_t k;
+};
+
+#define BPF_CLASS(code) ((code) & 0x07)
+#define BPF_LD   0x00
+#define BPF_LDX  0x01
+#define BPF_ST   0x02
+#define BPF_STX  0x03
+#define BPF_ALU  0x04
+#define BPF_JMP  0x05
+#define BPF_RET  0x06
+#define BPF_MISC 0x07
+
+#define BPF_SIZE(code) ((code) & 0x18)
+#define BPF_W 0x00
+#define BPF_H 0x08
+#define BPF_B 0x10
+
+#define BPF_MODE(code) ((code) & 0xe0)
+#define BPF_IMM 0x00
+#define BPF_ABS 0x20
+#define BPF_IND 0x40
+#define BPF_MEM 0x60
+#define BPF_LEN 0x80
+#define BPF_MSH 0xa0
+
+#define BPF_OP(code) ((code) & 0xf0)
+#define BPF_ADD 0x00
+#define BPF_SUB 0x10
+#define BPF_MUL 0x20
+#define BPF_DIV 0x30
+#define BPF_OR  0x40
+#define BPF_AND 0x50
+#define BPF_LSH 0x60
+#define BPF_RSH 0x70
+#define BPF_NEG 0x80
+#define BPF_MOD 0x90
+#define BPF_XOR 0xa0
+
+#define BPF_JA   0x00
+#define BPF_JEQ  0x10
+#define BPF_JGT  0x20
+#define BPF_JGE  0x30
+#define BPF_JSET 0x40
+
+#define BPF_SRC(code) ((code) & 0x08)
+#define BPF_K 0x00
+#define BPF_X 0x08
+
+#define BPF_RVAL(code) ((code) & 0x18)
+#define BPF_A 0x10
+
+#define BPF_MISCOP(code) ((code) & 0xf8)
+#define BPF_TAX 0x00
+#define BPF_TXA 0x80
+
+#define BPF_STMT(code, k) { (uint16_t)(code), 0, 0, (k) }
+#define BPF_JUMP(code, k, jt, jf) { (uint16_t)(code), (jt), (jf), (k) }
+
+/*
+ * Header of one ring slot; the captured bytes follow it. seq tells
+ * producers and the consumer who owns the slot: it equals the ring
+ * position while the slot is free and position + 1 once it is filled.
+ */
+struct packet_frame {
+    uint64_t seq;
+    uint64_t tstamp_ns;   /* TSC time of capture */
+    uint32_t len;         /* length on the wire */
+    uint32_t snaplen;     /* bytes stored after this header */
+    uint32_t ifindex;
+    uint8_t pkttype;      /* PACKET_HOST or PACKET_OUTGOING */
+    uint8_t pad[3];
+};
+
+struct packet_filter;
+
+struct packet_stats {
+    uint64_t packets;     /* stored in the ring */
+    uint64_t drops;       /* ring full */
+    uint64_t filtered;    /* rejected by the filter */
+};
+
+/*
+ * Capture socket: a ring of fixed-size slots filled lock-free by the
+ * taps in dev_queue_xmit() and netif_receive_skb() on any CPU, and
+ * drained by one reader.
+ */
+struct packet_sock {
+    struct packet_sock *next;      /* walked under RCU by the taps */
+    struct net_device *dev;        /* 0 captures every device */
+    struct packet_filter *filter;  /* 0 accepts everything */
+    uint8_t **pages;
+    uint32_t slot_size;
+    uint32_t slot_count;
+    uint32_t snaplen;
+    bool bound;
+    uint64_t head __attribute__((aligned(64))); /* next position to fill */
+    uint64_t tail __attribute__((aligned(64))); /* next position to read */
+    struct packet_stats stats;
+};
+
+extern struct packet_sock *packet_socks;
+
+/* slot_size and slot_count are powers of two; snaplen 0 means as much as
+   a slot holds. */
+struct packet_sock *packet_socket(uint32_t slot_size, uint32_t slot_count, uint32_t snaplen);
+bool packet_attach_filter(struct packet_sock *sk, const struct sock_filter *prog, uint32_t len);
+bool packet_bind(struct packet_sock *sk, struct net_device *dev);
+void packet_close(struct packet_sock *sk);
+void packet_get_stats(const struct packet_sock *sk, struct packet_stats *out);
+
+/* Reader side: the oldest filled slot, or 0 if the ring is empty. It stays
+   valid until packet_ring_release(). */
+const struct packet_frame *packet_ring_peek(struct packet_sock *sk);
+void packet_ring_release(struct packet_sock *sk);
+
+static inline const uint8_t *packet_frame_data(const struct packet_frame *f) {
+    return (const uint8_t *)(f + 1);
+}
+
+bool bpf_check(const struct sock_filter *prog, uint32_t len);
+uint32_t bpf_run(const struct sock_filter *prog, const struct sk_buff *skb);
+
+/* Drain the ring as a pcap stream (nanosecond timestamps, Ethernet link
+   type) through write(); returns the number of records written. */
+typedef void (*pcap_write_t)(const void *data, size_t len, void *ctx);
+void pcap_write_header(pcap_write_t write, void *ctx, uint32_t snaplen);
+uint64_t packet_export_pcap(struct packet_sock *sk, pcap_write_t write, void *ctx);
+
+/* Throughput over lo with no capture, a full-frame ring, a header-only
+   ring behind a matching filter, and a filter that rejects everything;
+   then a short capture of ping and UDP traffic goes out on COM2. */
+void packet_bench(void);
+
+void __packet_capture(struct sk_buff *skb, uint8_t pkttype);
+
+/* Called with skb->data at the Ethernet header; costs one load when no
+   capture socket is open. */
+static inline void packet_capture(struct sk_buff *skb, uint8_t pkttype) {
+    if (__builtin_expect(__atomic_load_n(&packet_socks, __ATOMIC_RELAXED) != 0, 0)) {
+        __packet_capture(skb, pkttype);
+    }
+}
+
+#endif /* PACKET_H */
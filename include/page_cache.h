@@ -0,0 +1,36 @@
+#ifndef PAGE_CACHE_H
+#define PAGE_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "vfs.h"
+
+#define PAGE_CACHE_RA_INIT 4   /* first sequential window, in pages */
+#define PAGE_CACHE_RA_MAX  64  /* 256 KiB per readahead request */
+#define PAGE_CACHE_WB_MAX  64  /* dirty pages merged into one write */
+
+struct page_cache_stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t read_requests;
+    uint64_t ra_pages;      /* pages brought in speculatively */
+    uint64_t ra_hits;       /* speculative pages later read */
+    uint64_t evictions;
+    uint64_t wb_pages;
+    uint64_t wb_requests;
+    uint64_t cached;
+    uint64_t limit;
+};
+
+void page_cache_init(uint64_t max_pages);
+size_t page_cache_read(struct inode *inode, uint64_t offset, void *buf, size_t len);
+size_t page_cache_write(struct inode *inode, uint64_t offset, const void *buf, size_t len);
+bool page_cache_writeback(struct inode *inode);
+void page_cache_invalidate(struct inode *inode);
+void page_cache_get_stats(struct page_cache_stats *out);
+void page_cache_log_stats(void);
+/* Cold then warm sequential read of the first block device, printed. */
+void page_cache_bench(void);
+
+#endif /* PAGE_CACHE_H */
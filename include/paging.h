@@ -0,0 +1,33 @@
+#ifndef PAGING_H
+#define PAGING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PAGE_SIZE 4096ULL
+#define HUGE_PAGE_SIZE 0x200000ULL
+
+#define PTE_PRESENT   0x001ULL
+#define PTE_WRITABLE  0x002ULL
+#define PTE_USER      0x004ULL
+#define PTE_PWT       0x008ULL
+#define PTE_PCD       0x010ULL
+#define PTE_HUGE      0x080ULL
+#define PTE_GLOBAL    0x100ULL
+#define PTE_NX        (1ULL << 63)
+#define PTE_ADDR_MASK 0x000FFFFFFFFFF000ULL
+
+void paging_init(void);
+/* Physical address of the kernel's PML4, the one paging_init() found
+   loaded; process address spaces start as a copy of it. */
+uint64_t paging_kernel_cr3(void);
+/* Drop every TLB entry on this CPU, global ones and all PCIDs included. */
+void paging_flush_tlb(void);
+/* Identity-map [phys, phys + size) for normal memory such as firmware
+   tables; what is mapped already stays as it is. */
+void *paging_map_phys(uint64_t phys, uint64_t size);
+/* The same for device registers: the range ends up uncached even where
+   the low 4 GiB identity map already covers it. */
+void *paging_map_mmio(uint64_t phys, uint64_t size);
+
+#endif /* PAGING_H */
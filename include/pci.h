@@ -0,0 +1,104 @@
+#ifndef PCI_H
+#define PCI_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "interrupts.h"
+
+#define PCI_MAX_DEVICES 64
+#define PCI_MAX_DRIVERS 16
+#define PCI_ANY_ID 0xFFFF
+
+#define PCI_VENDOR_ID      0x00
+#define PCI_DEVICE_ID      0x02
+#define PCI_COMMAND        0x04
+#define PCI_STATUS         0x06
+#define PCI_REVISION       0x08
+#define PCI_HEADER_TYPE    0x0E
+#define PCI_BAR0           0x10
+#define PCI_SUBSYS_VENDOR  0x2C
+#define PCI_SUBSYS_ID      0x2E
+#define PCI_CAP_PTR        0x34
+#define PCI_IRQ_LINE       0x3C
+#define PCI_SECONDARY_BUS  0x19
+
+#define PCI_COMMAND_IO     0x0001
+#define PCI_COMMAND_MEMORY 0x0002
+#define PCI_COMMAND_MASTER 0x0004
+#define PCI_COMMAND_INTX_DISABLE 0x0400
+#define PCI_STATUS_CAP_LIST 0x0010
+
+#define PCI_CAP_ID_MSI     0x05
+#define PCI_CAP_ID_VNDR    0x09
+#define PCI_CAP_ID_MSIX    0x11
+
+struct pci_bar {
+    uint64_t phys;
+    uint64_t size;
+    void *virt;      /* identity mapping for memory BARs */
+    bool io;
+    bool is64;
+    bool prefetch;
+};
+
+struct pci_driver;
+
+struct pci_dev {
+    uint16_t segment;
+    uint8_t bus;
+    uint8_t slot;
+    uint8_t func;
+    uint16_t vendor_id;
+    uint16_t device_id;
+    uint16_t subsys_vendor;
+    uint16_t subsys_id;
+    uint8_t class_code;
+    uint8_t subclass;
+    uint8_t prog_if;
+    uint8_t revision;
+    uint8_t header_type;
+    uint8_t irq_line;
+    struct pci_bar bar[6];
+    uint8_t msi_cap;
+    uint8_t msix_cap;
+    uint16_t msix_entries;
+    volatile uint8_t *msix_table;
+    const struct pci_driver *driver;
+    void *driver_data;
+};
+
+struct pci_device_id {
+    uint16_t vendor;
+    uint16_t device;
+};
+
+struct pci_driver {
+    const char *name;
+    const struct pci_device_id *id_table; /* terminated by a zero vendor */
+    bool (*probe)(struct pci_dev *dev, const struct pci_device_id *id);
+};
+
+void pci_init(void);
+bool pci_register_driver(const struct pci_driver *driver);
+struct pci_dev *pci_devices(size_t *count);
+
+uint8_t pci_read8(const struct pci_dev *dev, uint16_t offset);
+uint16_t pci_read16(const struct pci_dev *dev, uint16_t offset);
+uint32_t pci_read32(const struct pci_dev *dev, uint16_t offset);
+void pci_write8(const struct pci_dev *dev, uint16_t offset, uint8_t value);
+void pci_write16(const struct pci_dev *dev, uint16_t offset, uint16_t value);
+void pci_write32(const struct pci_dev *dev, uint16_t offset, uint32_t value);
+
+void pci_enable_device(struct pci_dev *dev);
+uint8_t pci_find_capability(const struct pci_dev *dev, uint8_t cap_id, uint8_t start);
+
+/* MSI / MSI-X: every call allocates one IDT vector, installs the handler and
+   steers the message to the LAPIC identified by apic_id. Return the vector,
+   or -1 on failure. */
+int pci_msix_enable(struct pci_dev *dev);
+int pci_msix_route(struct pci_dev *dev, uint16_t entry, uint32_t apic_id, irq_handler_t handler, void *ctx);
+void pci_msix_mask(struct pci_dev *dev, uint16_t entry, bool masked);
+int pci_msi_route(struct pci_dev *dev, uint32_t apic_id, irq_handler_t handler, void *ctx);
+
+#endif /* PCI_H */
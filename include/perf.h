@@ -0,0 +1,61 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "cpu.h"
+
+#define PERF_MAX_STACK 16           /* return addresses kept per sample */
+#define PERF_SAMPLES_PER_CPU 8192
+#define PERF_DEFAULT_PERIOD 100000
+#define PERF_STACK_WINDOW 65536     /* frame pointers are trusted this far above rsp */
+
+enum perf_event_id {
+    PERF_COUNT_CYCLES,
+    PERF_COUNT_INSTRUCTIONS,
+    PERF_COUNT_CACHE_MISSES,
+    PERF_COUNT_BRANCH_MISSES,
+    PERF_COUNT_MAX,
+};
+
+#define PERF_EVENT_BIT(id) (1u << (id))
+
+/* One overflow: where the CPU was and the frame-pointer call chain,
+   innermost caller first. */
+struct perf_sample {
+    uint64_t rip;
+    uint8_t event;
+    uint8_t depth;
+    uint16_t cpu;
+    uint32_t pad;
+    uint64_t callchain[PERF_MAX_STACK];
+};
+
+struct perf_cpu_stats {
+    uint64_t counts[PERF_COUNT_MAX];
+    uint64_t samples;
+    uint64_t lost;      /* buffer full */
+    uint64_t nmis;
+};
+
+/* Claims the performance counters and the NMI; false without an
+   architectural PMU. */
+bool perf_init(const struct cpu_info *cpu);
+bool perf_event_available(enum perf_event_id id);
+const char *perf_event_name(enum perf_event_id id);
+bool perf_event_parse(const char *name, enum perf_event_id *id);
+
+/*
+ * Count every event in events on the calling CPU; those also in
+ * sample_events raise an NMI every period occurrences and record a
+ * sample. Each event takes one general-purpose counter.
+ */
+bool perf_start(uint32_t events, uint32_t sample_events, uint64_t period);
+void perf_stop(void);
+void perf_get_stats(uint32_t cpu, struct perf_cpu_stats *out);
+
+/* Print "perf-fold: <event>;<addr>;...;<rip> <count>" lines, root frame
+   first, for scripts/perf-fold.sh to symbolize. */
+void perf_dump_folded(void);
+
+#endif /* PERF_H */
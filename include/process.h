@@ -0,0 +1,59 @@
+#ifndef PROCESS_H
+#define PROCESS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cpu.h"
+#include "interrupts.h"
+
+/*
+ * User processes. The kernel keeps PML4 slot 0 (the identity map of the
+ * low 512 GiB) in every address space without PTE_USER; user mappings
+ * live in slots 1..255. A process runs on the CPU that calls
+ * process_run() until it yields or exits, on a kernel stack of its own
+ * that system calls and ring-3 interrupts also use.
+ */
+#define USER_BASE 0x0000008000000000ULL
+#define USER_END 0x0000800000000000ULL
+#define USER_STACK_TOP 0x00007FFFFFFFF000ULL
+#define USER_STACK_PAGES 4
+#define PROCESS_KSTACK_SIZE 16384
+#define PROCESS_NAME_LEN 16
+
+struct process {
+    uint32_t pid;
+    uint16_t pcid;          /* 0 without PCID support */
+    uint16_t tlb_cpus;      /* CPUs that have loaded this PCID since it was assigned */
+    uint64_t *pml4;
+    uint8_t *kstack;
+    uint64_t ksp;           /* process side of context_switch() */
+    uint64_t caller_sp;     /* kernel side, set by process_run() */
+    uint64_t resume_value;  /* what the pending SYS_yield returns */
+    int exit_status;
+    bool exited;
+    char name[PROCESS_NAME_LEN];
+};
+
+/* Boot CPU: system call MSRs and PCID; process_init_ap() on the others. */
+void process_init(const struct cpu_info *cpu);
+void process_init_ap(uint32_t cpu);
+
+/* Load a static ELF64 executable from the rootfs into a new address
+   space; argv ends with a null pointer. */
+struct process *process_spawn(const char *path, const char *const *argv);
+/* Run p until it yields or exits; value is what its pending SYS_yield
+   returns. False once p has exited. */
+bool process_run(struct process *p, uint64_t value);
+void process_destroy(struct process *p);
+struct process *process_current(void);
+
+/* System call side, always on the current process. */
+__attribute__((noreturn)) void process_exit(int status);
+uint64_t process_yield(void);
+bool user_copy_from(void *dst, uint64_t uaddr, size_t len);
+bool user_copy_to(uint64_t uaddr, const void *src, size_t len);
+/* Exception raised in ring 3: the process is killed, the kernel goes on. */
+__attribute__((noreturn)) void process_fault(const struct interrupt_frame *frame);
+
+#endif /* PROCESS_H */
@@ -0,0 +1,30 @@
+#ifndef RADIX_TREE_H
+#define RADIX_TREE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define RADIX_TREE_SHIFT 6
+#define RADIX_TREE_SLOTS (1u << RADIX_TREE_SHIFT)
+
+struct radix_node {
+    void *slots[RADIX_TREE_SLOTS];
+    uint32_t count;
+};
+
+/* Sparse index -> pointer map, 64-way per level; height grows with the
+   largest index stored so small files stay one node deep. */
+struct radix_tree {
+    struct radix_node *root;
+    unsigned height;
+    uint64_t items;
+};
+
+void *radix_tree_lookup(const struct radix_tree *tree, uint64_t index);
+bool radix_tree_insert(struct radix_tree *tree, uint64_t index, void *item);
+void *radix_tree_delete(struct radix_tree *tree, uint64_t index);
+size_t radix_tree_gang_lookup(const struct radix_tree *tree, uint64_t first, void **results,
+                              uint64_t *indices, size_t max);
+
+#endif /* RADIX_TREE_H */
@@ -0,0 +1,41 @@
+#ifndef RCU_H
+#define RCU_H
+
+#include <stdint.h>
+#include "smp.h"
+
+/*
+ * Read-copy-update for data that is read far more often than written.
+ * Readers never block or write shared cache lines: they bump a per-CPU
+ * nesting counter. Writers publish with rcu_assign_pointer() and call
+ * synchronize_rcu() before freeing what they unlinked.
+ */
+struct rcu_cpu {
+    volatile uint32_t nesting;
+    volatile uint64_t passes; /* completed outermost read sections */
+} __attribute__((aligned(64)));
+
+extern struct rcu_cpu rcu_cpus[NR_CPUS];
+
+static inline void rcu_read_lock(void) {
+    struct rcu_cpu *rc = &rcu_cpus[smp_processor_id()];
+    if (rc->nesting++ == 0) {
+        /* the counter must be visible before any protected load */
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    }
+}
+
+static inline void rcu_read_unlock(void) {
+    struct rcu_cpu *rc = &rcu_cpus[smp_processor_id()];
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    if (--rc->nesting == 0) {
+        rc->passes++;
+    }
+}
+
+#define rcu_dereference(p) __atomic_load_n(&(p), __ATOMIC_CONSUME)
+#define rcu_assign_pointer(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+
+void synchronize_rcu(void);
+
+#endif /* RCU_H */
@@ -2,9 +2,13 @@
 #define SERIAL_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 bool serial_init(void);
 void serial_write(char c);
+void serial_write_chars(const char *s, size_t len);
+bool serial_aux_init(void);
+void serial_aux_write(const void *data, size_t len);
 
 #endif
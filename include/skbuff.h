@@ -0,0 +1,124 @@
+#ifndef SKBUFF_H
+#define SKBUFF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SKB_BUF_SIZE   2048 /* one data buffer; two per page */
+#define NET_SKB_PAD    128  /* headroom reserved for headers pushed on TX */
+#define MAX_SKB_FRAGS  6
+
+struct net_device;
+
+/* A reference to part of another pooled data buffer. */
+struct skb_frag {
+    uint8_t *buf;
+    uint16_t offset;
+    uint16_t size;
+};
+
+/* Lives at the end of every data buffer and is shared by clones. */
+struct skb_shared_info {
+    uint32_t dataref;
+    uint8_t nr_frags;
+    struct skb_frag frags[MAX_SKB_FRAGS];
+};
+
+/*
+ * head ... data ... tail ... end [skb_shared_info]
+ * The linear part is data..tail; len also counts the fragment bytes
+ * (data_len), so skb_headlen() is what can be addressed directly.
+ */
+struct sk_buff {
+    struct sk_buff *next;
+    struct net_device *dev;
+    uint8_t *head;
+    uint8_t *data;
+    uint8_t *tail;
+    uint8_t *end;
+    uint32_t len;
+    uint32_t data_len;
+    uint32_t users;
+    uint16_t protocol;       /* ethertype, host byte order */
+    uint16_t mac_header;     /* offsets from head */
+    uint16_t network_header;
+    uint16_t transport_header;
+    uint8_t cb[32];          /* private to the current layer */
+};
+
+struct sk_buff_head {
+    struct sk_buff *head;
+    struct sk_buff *tail;
+    uint32_t qlen;
+};
+
+struct skb_pool_stats {
+    uint64_t skbs_in_use;
+    uint64_t bufs_in_use;
+    uint64_t alloc_failures;
+};
+
+/* Usable bytes in a data buffer, ahead of its shared info. */
+#define SKB_BUF_DATA (SKB_BUF_SIZE - ((sizeof(struct skb_shared_info) + 15) & ~(size_t)15))
+
+struct sk_buff *skb_alloc(uint32_t size);
+struct sk_buff *skb_build(uint8_t *buf, uint32_t headroom, uint32_t len);
+struct sk_buff *skb_clone(struct sk_buff *skb);
+struct sk_buff *skb_get(struct sk_buff *skb);
+void skb_free(struct sk_buff *skb);
+
+void *skb_put(struct sk_buff *skb, uint32_t len);
+void *skb_push(struct sk_buff *skb, uint32_t len);
+void *skb_pull(struct sk_buff *skb, uint32_t len);
+void skb_reserve(struct sk_buff *skb, uint32_t len);
+void skb_trim(struct sk_buff *skb, uint32_t len);
+
+uint8_t *skb_frag_alloc(void);
+void skb_frag_get(uint8_t *buf);
+void skb_frag_put(uint8_t *buf);
+bool skb_add_frag(struct sk_buff *skb, uint8_t *buf, uint16_t offset, uint16_t size);
+bool skb_copy_bits(const struct sk_buff *skb, uint32_t offset, void *to, uint32_t len);
+
+void skb_queue_init(struct sk_buff_head *q);
+void skb_queue_tail(struct sk_buff_head *q, struct sk_buff *skb);
+struct sk_buff *skb_dequeue(struct sk_buff_head *q);
+void skb_get_pool_stats(struct skb_pool_stats *out);
+
+static inline struct skb_shared_info *skb_shinfo(const struct sk_buff *skb) {
+    return (struct skb_shared_info *)skb->end;
+}
+
+static inline uint32_t skb_headlen(const struct sk_buff *skb) {
+    return skb->len - skb->data_len;
+}
+
+static inline uint32_t skb_headroom(const struct sk_buff *skb) {
+    return (uint32_t)(skb->data - skb->head);
+}
+
+static inline uint32_t skb_tailroom(const struct sk_buff *skb) {
+    return (uint32_t)(skb->end - skb->tail);
+}
+
+static inline void *skb_mac_header(const struct sk_buff *skb) {
+    return skb->head + skb->mac_header;
+}
+
+static inline void *skb_network_header(const struct sk_buff *skb) {
+    return skb->head + skb->network_header;
+}
+
+static inline void *skb_transport_header(const struct sk_buff *skb) {
+    return skb->head + skb->transport_header;
+}
+
+static inline void skb_reset_network_header(struct sk_buff *skb) {
+    skb->network_header = (uint16_t)(skb->data - skb->head);
+}
+
+static inline void skb_reset_transport_header(struct sk_buff *skb) {
+    skb->transport_header = (uint16_t)(skb->data - skb->head);
+}
+
+#endif /* SKBUFF_H */
@@ -0,0 +1,71 @@
+#ifndef SMP_H
+#define SMP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cpu.h"
+
+#define NR_CPUS 16
+#define SMP_TRAMPOLINE 0x8000   /* real-mode AP entry; page aligned, below 1 MiB */
+#define SMP_STACK_SIZE 16384
+#define MSR_GS_BASE 0xC0000101
+
+typedef void (*smp_call_fn_t)(void *arg);
+
+/*
+ * Per-CPU area, reached through GS on its own CPU. An AP parks in
+ * smp_ap_idle() and runs whatever smp_call() posts to it.
+ */
+struct smp_cpu {
+    uint32_t id;                /* gs:0, see smp_processor_id() */
+    uint32_t apic_id;
+    volatile uint32_t online;
+    volatile uint32_t call_seq; /* bumped by the poster */
+    volatile uint32_t done_seq; /* caught up by the AP */
+    smp_call_fn_t call_fn;
+    void *call_arg;
+    uint64_t kernel_rsp;        /* gs:SMP_CPU_KERNEL_RSP, loaded by syscall_entry */
+    uint64_t user_rsp;          /* gs:SMP_CPU_USER_RSP, the caller's stack meanwhile */
+    volatile uint32_t tlb_flushes; /* bumped by the AP for each flush IPI */
+} __attribute__((aligned(64)));
+
+/* offsets used from entry.S */
+#define SMP_CPU_KERNEL_RSP 40
+#define SMP_CPU_USER_RSP 48
+_Static_assert(offsetof(struct smp_cpu, kernel_rsp) == SMP_CPU_KERNEL_RSP, "entry.S offset");
+_Static_assert(offsetof(struct smp_cpu, user_rsp) == SMP_CPU_USER_RSP, "entry.S offset");
+
+static inline uint32_t smp_processor_id(void) {
+    uint32_t id;
+    __asm__ volatile ("movl %%gs:%c1, %0" : "=r"(id) : "i"(offsetof(struct smp_cpu, id)));
+    return id;
+}
+
+/* Stack syscall_entry switches to on the calling CPU. */
+static inline void smp_set_kernel_rsp(uint64_t rsp) {
+    __asm__ volatile ("movq %0, %%gs:%c1" : : "r"(rsp), "i"(SMP_CPU_KERNEL_RSP) : "memory");
+}
+
+/* Point GS at the boot CPU's area; must run before anything per-CPU. */
+void smp_early_init(void);
+/* Start every processor the MADT lists; returns how many CPUs are online. */
+uint32_t smp_boot_aps(const struct cpu_info *cpu);
+uint32_t smp_num_cpus(void);
+bool smp_cpu_online(uint32_t cpu);
+
+/* Run fn(arg) on another online CPU without waiting for it; an earlier
+   call to the same CPU is waited for first. Only the boot CPU posts. */
+bool smp_call(uint32_t cpu, smp_call_fn_t fn, void *arg);
+void smp_call_wait(uint32_t cpu);
+/* Make another online CPU re-check whatever it sleeps on: a store to
+   its monitored line when it waits in MWAIT, an IPI otherwise; a no-op
+   for the calling CPU. */
+void smp_kick(uint32_t cpu);
+/* Flush the TLB of every online CPU, the caller's included, and wait
+   until all have done it; for changes to present kernel mappings. Any
+   CPU may call it, with interrupts on so that two callers at once
+   answer each other's IPI. */
+void smp_flush_tlb_all(void);
+
+#endif /* SMP_H */
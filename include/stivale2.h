@@ -6,6 +6,10 @@
 #define STIVALE2_BOOTLOADER_BRAND_SIZE 64
 #define STIVALE2_BOOTLOADER_VERSION_SIZE 64
 #define STIVALE2_MMAP_USABLE 1
+#define STIVALE2_STRUCT_TAG_RSDP_ID 0x9e1786930a375e78ULL
+#define STIVALE2_STRUCT_TAG_CMDLINE_ID 0xe5e76a1b4597a781ULL
+#define STIVALE2_STRUCT_TAG_MODULES_ID 0x4b6fe466aade04ceULL
+#define STIVALE2_MODULE_STRING_SIZE 128
 
 struct stivale2_tag {
     uint64_t identifier;
@@ -47,4 +51,26 @@ struct stivale2_framebuffer_tag {
     uint8_t blue_mask_shift;
 } __attribute__((packed));
 
+struct stivale2_struct_tag_rsdp {
+    struct stivale2_tag tag;
+    uint64_t rsdp;
+} __attribute__((packed));
+
+struct stivale2_struct_tag_cmdline {
+    struct stivale2_tag tag;
+    uint64_t cmdline;
+} __attribute__((packed));
+
+struct stivale2_module {
+    uint64_t begin;
+    uint64_t end;
+    char string[STIVALE2_MODULE_STRING_SIZE];
+} __attribute__((packed));
+
+struct stivale2_struct_tag_modules {
+    struct stivale2_tag tag;
+    uint64_t module_count;
+    struct stivale2_module modules[];
+} __attribute__((packed));
+
 #endif
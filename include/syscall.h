@@ -0,0 +1,21 @@
+#ifndef SYSCALL_H
+#define SYSCALL_H
+
+/*
+ * System call numbers, shared with the programs under user/. The ABI is
+ * the SysV one: number in rax, arguments in rdi, rsi, rdx, r10, r8, r9,
+ * result in rax; rcx and r11 are clobbered by SYSCALL itself.
+ */
+#define SYS_exit   0   /* (status) */
+#define SYS_write  1   /* (fd, buf, len): fd 1 and 2 go to the console */
+#define SYS_getpid 2
+#define SYS_yield  3   /* hand the CPU back to whoever ran the process; returns the
+                          value it is resumed with */
+#define SYS_clock_gettime 4 /* monotonic ns; user/lib.h reads the vDSO page instead */
+#define NR_SYSCALLS 5
+
+#define SYSCALL_ENOSYS ((long)-38)
+#define SYSCALL_EFAULT ((long)-14)
+#define SYSCALL_EBADF  ((long)-9)
+
+#endif /* SYSCALL_H */
@@ -0,0 +1,212 @@
+#ifndef TCP_H
+#define TCP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "inet.h"
+#include "spinlock.h"
+
+#define TCP_HASH_SIZE 256
+#define TCP_RING_SIZE (256 * 1024) /* per-direction socket buffer, power of two */
+#define TCP_RING_PAGES (TCP_RING_SIZE / 4096)
+#define TCP_MAX_SACK 4             /* blocks per ACK without timestamps */
+#define TCP_OOO_RANGES 8           /* out-of-order ranges held by a receiver */
+#define TCP_SCOREBOARD 16          /* SACKed ranges tracked by a sender */
+#define TCP_RCV_WSCALE 7
+
+#define TCP_FIN 0x01
+#define TCP_SYN 0x02
+#define TCP_RST 0x04
+#define TCP_PSH 0x08
+#define TCP_ACK 0x10
+
+struct tcphdr {
+    uint16_t source;
+    uint16_t dest;
+    uint32_t seq;
+    uint32_t ack_seq;
+    uint8_t doff;  /* header length in words, high nibble */
+    uint8_t flags;
+    uint16_t window;
+    uint16_t check;
+    uint16_t urg_ptr;
+} __attribute__((packed));
+
+enum tcp_state {
+    TCP_CLOSED,
+    TCP_LISTEN,
+    TCP_SYN_SENT,
+    TCP_SYN_RECV,
+    TCP_ESTABLISHED,
+    TCP_FIN_WAIT1,
+    TCP_FIN_WAIT2,
+    TCP_CLOSE_WAIT,
+    TCP_CLOSING,
+    TCP_LAST_ACK,
+    TCP_TIME_WAIT,
+};
+
+/* Sequence-space range [start, end). */
+struct tcp_range {
+    uint32_t start;
+    uint32_t end;
+};
+
+/* Bytes for sequence number s live at offset s % TCP_RING_SIZE. */
+struct tcp_ring {
+    uint8_t *pages[TCP_RING_PAGES];
+};
+
+struct tcp_sock;
+
+/*
+ * Congestion control hooks; cwnd and ssthresh count segments. Algorithms
+ * keep their state in tcp_sock.ca_priv.
+ */
+struct tcp_congestion_ops {
+    const char *name;
+    void (*init)(struct tcp_sock *sk);
+    /* new ssthresh after a loss; cwnd is set from it by the caller */
+    uint32_t (*ssthresh)(struct tcp_sock *sk);
+    /* called for ACKs advancing snd_una outside recovery */
+    void (*cong_avoid)(struct tcp_sock *sk, uint32_t acked);
+};
+
+struct tcp_info {
+    uint64_t segs_in;
+    uint64_t segs_out;
+    uint64_t bytes_acked;
+    uint64_t bytes_received;
+    uint64_t retrans_segs;
+    uint64_t fast_recoveries;
+    uint64_t rto_expiries;
+    uint64_t sack_blocks_in;
+    uint64_t ooo_segs_in;
+};
+
+struct tcp_sock {
+    struct tcp_sock *hash_next; /* walked under RCU */
+    struct tcp_sock *all_next;  /* timer list */
+    struct tcp_sock *accept_next;
+    struct tcp_sock *parent;    /* listener until accepted */
+    spinlock_t lock;
+    uint8_t state;
+    bool sack_ok;
+    bool closed_by_app;
+    bool fin_queued;            /* send FIN once the send ring drains */
+    bool fin_received;
+    bool reset;
+    bool in_recovery;
+    bool dead;                  /* unhash and free from tcp_poll() */
+
+    uint32_t saddr;             /* network byte order */
+    uint32_t daddr;
+    uint16_t sport;             /* host byte order */
+    uint16_t dport;
+    struct inet_route rt;
+    uint32_t mss;
+
+    /* sender */
+    uint32_t iss;
+    uint32_t snd_una;
+    uint32_t snd_nxt;
+    uint32_t snd_max;           /* highest snd_nxt, survives go-back-N */
+    uint32_t snd_end;           /* next byte the application writes */
+    uint32_t snd_wnd;
+    uint32_t snd_wl1;
+    uint32_t snd_wl2;
+    uint8_t snd_wscale;
+    uint8_t rcv_wscale;         /* 0 unless the peer does window scaling */
+    uint32_t dupacks;
+    uint32_t recover;           /* snd_max when recovery began */
+    uint32_t high_rxt;          /* holes below this were retransmitted */
+    struct tcp_range sacked[TCP_SCOREBOARD];
+    uint32_t sacked_count;
+    struct tcp_ring sndbuf;
+
+    /* congestion control */
+    const struct tcp_congestion_ops *ca;
+    uint32_t cwnd;
+    uint32_t cwnd_cnt;
+    uint32_t ssthresh;
+    bool cwnd_limited;          /* the last push stopped on cwnd */
+    uint64_t ca_priv[8];
+
+    /* RTT and timers, in microseconds of TSC time */
+    uint32_t srtt_us;           /* 0 until the first sample */
+    uint32_t rttvar_us;
+    uint32_t rto_us;
+    uint32_t min_rtt_us;
+    uint32_t rtt_seq;
+    bool rtt_timing;
+    uint64_t rtt_start_us;
+    uint64_t rto_deadline;      /* 0 when not armed */
+    uint64_t delack_deadline;
+    uint32_t backoff;
+
+    /* receiver */
+    uint32_t irs;
+    uint32_t rcv_nxt;
+    uint32_t rcv_read;          /* next byte handed to the application */
+    uint32_t rcv_wup;           /* rcv_nxt + window at the last advertisement */
+    uint32_t acks_pending;
+    struct tcp_range ooo[TCP_OOO_RANGES]; /* most recent first */
+    uint32_t ooo_count;
+    struct tcp_ring rcvbuf;
+
+    /* listener */
+    struct tcp_sock *accept_head;
+    struct tcp_sock *accept_tail;
+
+    struct tcp_info info;
+};
+
+struct tcp_stats {
+    uint64_t active_opens;
+    uint64_t passive_opens;
+    uint64_t resets_sent;
+    uint64_t bad_segs;
+    uint64_t no_socket;
+};
+
+void tcp_init(void);
+struct tcp_sock *tcp_socket(void);
+bool tcp_listen(struct tcp_sock *sk, uint16_t port);
+struct tcp_sock *tcp_accept(struct tcp_sock *listener);
+bool tcp_connect(struct tcp_sock *sk, uint32_t daddr, uint16_t dport);
+bool tcp_established(const struct tcp_sock *sk);
+size_t tcp_send(struct tcp_sock *sk, const void *data, size_t len);
+int tcp_recv(struct tcp_sock *sk, void *buf, size_t len);
+void tcp_close(struct tcp_sock *sk);
+
+/* Run retransmit, delayed-ACK and TIME_WAIT timers; call from poll loops. */
+void tcp_poll(void);
+void tcp_get_stats(struct tcp_stats *out);
+
+bool tcp_register_congestion_control(const struct tcp_congestion_ops *ops);
+bool tcp_set_congestion_control(struct tcp_sock *sk, const char *name);
+uint32_t tcp_slow_start(struct tcp_sock *sk, uint32_t acked);
+void tcp_cong_avoid_ai(struct tcp_sock *sk, uint32_t w, uint32_t acked);
+void tcp_cong_init(void);
+/* Built in, or the tcp_cubic module that tcp_set_congestion_control()
+   loads the first time a socket asks for "cubic". */
+extern const struct tcp_congestion_ops tcp_cubic_ops;
+uint64_t tcp_now_us(void);
+
+/* Testing knob: drop about one in every n received data segments. */
+void tcp_set_rx_loss(uint32_t one_in);
+
+/* "speedtest=lo|server|client": bulk TCP over lo or between two guests,
+   reporting goodput, loss recovery and a cwnd trace. */
+void tcp_speedtest(void);
+
+static inline bool tcp_before(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) < 0;
+}
+
+static inline bool tcp_after(uint32_t a, uint32_t b) {
+    return tcp_before(b, a);
+}
+
+#endif /* TCP_H */
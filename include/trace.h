@@ -0,0 +1,84 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TRACE_RECORDS_PER_CPU 16384 /* power of two; oldest records are overwritten */
+#define TRACE_MAGIC "ZKTRACE1"
+
+enum trace_phase {
+    TRACE_INSTANT,
+    TRACE_BEGIN, /* opens a slice on the CPU's timeline */
+    TRACE_END,   /* closes the innermost open slice */
+};
+
+enum trace_event_id {
+#define TRACE_EVENT(name, phase, a0, a1, a2) TRACE_ID_##name,
+#include "trace_events.h"
+#undef TRACE_EVENT
+    TRACE_NR_EVENTS,
+};
+
+/* One ring slot; tsc is the raw counter, converted with the dump's tsc_khz. */
+struct trace_record {
+    uint64_t tsc;
+    uint32_t id;
+    uint32_t pad;
+    uint64_t args[3];
+};
+
+/*
+ * Dump layout, little endian: trace_file_header, nr_events
+ * trace_event_desc, then per CPU a trace_cpu_header followed by count
+ * records, oldest first. scripts/trace/trace2json.c mirrors these.
+ */
+struct trace_file_header {
+    char magic[8];
+    uint32_t nr_events;
+    uint32_t nr_cpus;
+    uint64_t tsc_khz;
+};
+
+struct trace_event_desc {
+    uint32_t id;
+    uint32_t phase;
+    char name[32];
+    char args[3][16];
+};
+
+struct trace_cpu_header {
+    uint32_t cpu;
+    uint32_t count;
+    uint64_t overwritten;
+};
+
+/* One byte per event, tested before any argument is evaluated. */
+extern volatile uint8_t trace_event_enabled[TRACE_NR_EVENTS];
+
+void trace_write(uint32_t id, uint64_t a0, uint64_t a1, uint64_t a2);
+
+#ifdef CONFIG_DEBUG_TRACING_SUBSYSTEM
+#define TRACE_ARGS3(a0, a1, a2, ...) (uint64_t)(a0), (uint64_t)(a1), (uint64_t)(a2)
+
+/* TRACE(irq_entry, vector): a predicted-not-taken branch while disabled. */
+#define TRACE(name, ...)                                                        \
+    do {                                                                        \
+        if (__builtin_expect(trace_event_enabled[TRACE_ID_##name], 0)) {        \
+            trace_write(TRACE_ID_##name, TRACE_ARGS3(__VA_ARGS__, 0, 0, 0));    \
+        }                                                                       \
+    } while (0)
+#else
+#define TRACE(name, ...) do { } while (0)
+#endif
+
+/* Allocate a CPU's ring; call it for every online CPU before enabling. */
+bool trace_cpu_init(uint32_t cpu);
+/* Enable events by comma-separated subsystem ("irq,net"), event name or
+   "all"; returns how many events were switched on. */
+uint32_t trace_enable(const char *spec);
+void trace_disable_all(void);
+/* Stream the dump to COM2; false when there is no second serial port. */
+bool trace_dump(void);
+
+#endif /* TRACE_H */
@@ -0,0 +1,21 @@
+/*
+ * Every tracepoint in the kernel: TRACE_EVENT(name, phase, arg0, arg1,
+ * arg2). The name's prefix up to the first '_' is its subsystem, which
+ * "trace=" on the command line enables as a group. Unused argument slots
+ * are "". No include guard: trace.h expands this list several times.
+ */
+TRACE_EVENT(kmem_page_alloc, TRACE_INSTANT, "page", "", "")
+TRACE_EVENT(kmem_page_free, TRACE_INSTANT, "page", "", "")
+TRACE_EVENT(kmem_pool_alloc, TRACE_INSTANT, "obj", "size", "")
+TRACE_EVENT(kmem_pool_free, TRACE_INSTANT, "obj", "size", "")
+TRACE_EVENT(irq_entry, TRACE_BEGIN, "vector", "", "")
+TRACE_EVENT(irq_exit, TRACE_END, "vector", "", "")
+TRACE_EVENT(sched_switch, TRACE_INSTANT, "prev", "next", "")
+TRACE_EVENT(block_rq_issue, TRACE_BEGIN, "sector", "bytes", "write")
+TRACE_EVENT(block_rq_complete, TRACE_END, "sector", "bytes", "ok")
+TRACE_EVENT(net_dev_xmit, TRACE_INSTANT, "ifindex", "len", "")
+TRACE_EVENT(net_receive_skb, TRACE_INSTANT, "ifindex", "len", "")
+TRACE_EVENT(net_rx_action, TRACE_BEGIN, "budget", "", "")
+TRACE_EVENT(net_rx_action_done, TRACE_END, "packets", "", "")
+TRACE_EVENT(initcall_start, TRACE_BEGIN, "index", "level", "")
+TRACE_EVENT(initcall_finish, TRACE_END, "index", "", "")
@@ -0,0 +1,22 @@
+#ifndef TSC_H
+#define TSC_H
+
+#include <stdint.h>
+#include "cpu.h"
+
+void tsc_init(void);
+uint64_t tsc_khz(void);
+uint64_t tsc_cycles_to_ns(uint64_t cycles);
+uint64_t tsc_cycles_to_us(uint64_t cycles);
+/* Busy-wait; only meaningful after tsc_init(). */
+void tsc_udelay(uint64_t us);
+/* Record the TSC at kernel entry and return it; tsc_boot() reads it back.
+   Under a hypervisor the TSC need not start at zero on reset. */
+uint64_t tsc_mark_boot(void);
+uint64_t tsc_boot(void);
+
+static inline uint64_t tsc_read(void) {
+    return rdtsc();
+}
+
+#endif /* TSC_H */
@@ -0,0 +1,58 @@
+#ifndef UDP_H
+#define UDP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "skbuff.h"
+#include "spinlock.h"
+
+#define UDP_HASH_SIZE 256
+#define UDP_RXQ_MAX   256
+#define UDP_EPHEMERAL_FIRST 49152
+
+struct udphdr {
+    uint16_t source;
+    uint16_t dest;
+    uint16_t len;
+    uint16_t check;
+} __attribute__((packed));
+
+/* Sender of a queued datagram, kept in skb->cb. */
+struct udp_skb_cb {
+    uint32_t saddr; /* network byte order */
+    uint16_t sport; /* host byte order */
+};
+
+struct udp_sock {
+    struct udp_sock *next;  /* hash chain, walked under RCU */
+    uint16_t port;          /* host byte order; 0 until bound */
+    spinlock_t lock;
+    struct sk_buff_head rxq;
+    /* called from the receive path after a datagram is queued */
+    void (*data_ready)(struct udp_sock *sk);
+    void *ctx;
+    uint64_t rx_packets;
+    uint64_t rx_dropped;
+};
+
+void udp_init(void);
+struct udp_sock *udp_socket(void);
+bool udp_bind(struct udp_sock *sk, uint16_t port);
+void udp_close(struct udp_sock *sk);
+
+bool udp_sendto(struct udp_sock *sk, uint32_t daddr, uint16_t dport, const void *data, size_t len);
+int udp_recvfrom(struct udp_sock *sk, void *buf, size_t len, uint32_t *saddr, uint16_t *sport);
+
+/* Zero-copy variants: skb->data is the payload in both directions. */
+bool udp_send_skb(struct udp_sock *sk, struct sk_buff *skb, uint32_t daddr, uint16_t dport);
+struct sk_buff *udp_recv_skb(struct udp_sock *sk);
+
+/* UDP echo throughput over lo, then ping latency to lo and the gateway. */
+void udp_bench(void);
+
+static inline struct udp_skb_cb *udp_cb(struct sk_buff *skb) {
+    return (struct udp_skb_cb *)skb->cb;
+}
+
+#endif /* UDP_H */
@@ -0,0 +1,56 @@
+#ifndef VDSO_H
+#define VDSO_H
+
+#include <stdint.h>
+#include "cpu.h"
+
+/*
+ * One read-only page the kernel maps into every process at VDSO_DATA_ADDR,
+ * shared with the programs under user/. It carries the TSC calibration,
+ * a seqlock-protected clock offset and the boot CPU's feature table, so
+ * time and CPU queries need no system call.
+ */
+#define VDSO_DATA_ADDR 0x0000008000000000ULL /* USER_BASE, below every program */
+#define VDSO_SHIFT 32
+
+struct vdso_data {
+    uint32_t seq;           /* odd while the kernel rewrites the clock */
+    uint32_t shift;
+    uint64_t mult;          /* ns = ((tsc - tsc_base) * mult) >> shift */
+    uint64_t tsc_base;
+    uint64_t ns_base;       /* monotonic time at tsc_base */
+    uint64_t tsc_khz;
+    struct cpu_info cpu;    /* cpu_detect() on the boot CPU */
+};
+
+/* Monotonic nanoseconds since kernel entry; the kernel's SYS_clock_gettime
+   reads the same page through this function. */
+static inline uint64_t vdso_clock_ns(const struct vdso_data *vd) {
+    uint32_t seq;
+    uint64_t ns;
+    do {
+        seq = __atomic_load_n(&vd->seq, __ATOMIC_ACQUIRE);
+        const uint64_t delta = rdtsc_ordered() - __atomic_load_n(&vd->tsc_base, __ATOMIC_RELAXED);
+        ns = __atomic_load_n(&vd->ns_base, __ATOMIC_RELAXED) +
+             (uint64_t)(((unsigned __int128)delta * vd->mult) >> vd->shift);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || seq != __atomic_load_n(&vd->seq, __ATOMIC_RELAXED));
+    return ns;
+}
+
+/* Seqlock writer, the other half of vdso_clock_ns(); one writer at a time. */
+static inline void vdso_write_clock(struct vdso_data *vd, uint64_t tsc, uint64_t ns) {
+    __atomic_store_n(&vd->seq, vd->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&vd->tsc_base, tsc, __ATOMIC_RELAXED);
+    __atomic_store_n(&vd->ns_base, ns, __ATOMIC_RELAXED);
+    __atomic_store_n(&vd->seq, vd->seq + 1, __ATOMIC_RELEASE);
+}
+
+/* Kernel side, src/vdso.c */
+void vdso_init(const struct cpu_info *cpu);
+/* Rebase the clock: ns is the monotonic time at TSC value tsc. */
+void vdso_set_clock(uint64_t tsc, uint64_t ns);
+const struct vdso_data *vdso_data(void);
+
+#endif /* VDSO_H */
@@ -0,0 +1,73 @@
+#ifndef VFS_H
+#define VFS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "radix_tree.h"
+
+#define VFS_NAME_MAX 255
+#define VFS_MAX_MOUNTS 8
+
+#define VFS_MODE_TYPE 0xF000
+#define VFS_MODE_DIR  0x4000
+#define VFS_MODE_REG  0x8000
+
+struct inode;
+struct block_device;
+
+struct inode_operations {
+    /* Resolve one path component inside dir; NULL when it does not exist. */
+    struct inode *(*lookup)(struct inode *dir, const char *name, size_t len);
+};
+
+/* Backing-store hooks used by the page cache. Both move count consecutive
+   4 KiB pages starting at file page index and should issue as few device
+   requests as the on-disk layout allows. */
+struct address_space_ops {
+    bool (*readpages)(struct inode *inode, uint64_t index, void *const *pages, size_t count);
+    bool (*writepages)(struct inode *inode, uint64_t index, void *const *pages, size_t count);
+};
+
+struct readahead_state {
+    uint64_t start;      /* first page of the current window */
+    uint32_t size;       /* window length in pages */
+    uint32_t async_size; /* trailing pages that trigger the next window */
+    uint64_t prev_index; /* last page handed to a reader */
+};
+
+struct inode {
+    uint64_t ino;
+    uint64_t size;
+    uint32_t mode;
+    const struct inode_operations *i_op;
+    const struct address_space_ops *a_ops;
+    struct radix_tree pages; /* page cache, keyed by file page index */
+    uint64_t nr_dirty;
+    struct readahead_state ra;
+    void *private;
+};
+
+struct filesystem_type {
+    const char *name;
+    struct inode *(*mount)(struct block_device *dev); /* returns the root inode */
+};
+
+struct vfs_stats {
+    uint64_t dcache_hits;
+    uint64_t dcache_misses;
+    uint64_t dentries;
+};
+
+bool vfs_register_filesystem(const struct filesystem_type *fs);
+bool vfs_mount(struct block_device *dev, const char *path);
+void vfs_automount(void);
+struct inode *vfs_lookup(const char *path);
+size_t vfs_read(struct inode *inode, uint64_t offset, void *buf, size_t len);
+void vfs_get_stats(struct vfs_stats *out);
+
+static inline bool vfs_is_dir(const struct inode *inode) {
+    return (inode->mode & VFS_MODE_TYPE) == VFS_MODE_DIR;
+}
+
+#endif /* VFS_H */
@@ -0,0 +1,106 @@
+#ifndef VIRTIO_H
+#define VIRTIO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "pci.h"
+
+#define VIRTIO_STATUS_ACKNOWLEDGE 0x01
+#define VIRTIO_STATUS_DRIVER      0x02
+#define VIRTIO_STATUS_DRIVER_OK   0x04
+#define VIRTIO_STATUS_FEATURES_OK 0x08
+#define VIRTIO_STATUS_FAILED      0x80
+
+#define VIRTIO_F_RING_INDIRECT_DESC (1ULL << 28)
+#define VIRTIO_F_RING_EVENT_IDX     (1ULL << 29)
+#define VIRTIO_F_VERSION_1          (1ULL << 32)
+
+#define VIRTQ_DESC_F_NEXT     1
+#define VIRTQ_DESC_F_WRITE    2
+#define VIRTQ_DESC_F_INDIRECT 4
+
+#define VIRTQ_AVAIL_F_NO_INTERRUPT 1
+#define VIRTQ_USED_F_NO_NOTIFY     1
+
+#define VIRTIO_NO_VECTOR 0xFFFF
+#define VIRTIO_MAX_QUEUE_SIZE 256
+
+struct virtq_desc {
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+} __attribute__((packed));
+
+struct virtq_avail {
+    uint16_t flags;
+    uint16_t idx;
+    uint16_t ring[];
+} __attribute__((packed));
+
+struct virtq_used_elem {
+    uint32_t id;
+    uint32_t len;
+} __attribute__((packed));
+
+struct virtq_used {
+    uint16_t flags;
+    uint16_t idx;
+    struct virtq_used_elem ring[];
+} __attribute__((packed));
+
+/* One scatter-gather element; device-writable buffers set write. */
+struct virtq_sg {
+    void *addr;
+    uint32_t len;
+    bool write;
+};
+
+struct virtqueue {
+    uint16_t index;
+    uint16_t size;
+    uint16_t free_head;
+    uint16_t num_free;
+    uint16_t last_used;
+    struct virtq_desc *desc;
+    struct virtq_avail *avail;
+    struct virtq_used *used;
+    void **tokens;
+    volatile uint16_t *notify;
+};
+
+struct virtio_device {
+    struct pci_dev *pci;
+    volatile uint8_t *common;
+    volatile uint8_t *notify_base;
+    volatile uint8_t *isr;
+    volatile uint8_t *device_cfg;
+    uint32_t notify_multiplier;
+    uint64_t features;
+};
+
+bool virtio_pci_init(struct virtio_device *vdev, struct pci_dev *pci);
+bool virtio_negotiate(struct virtio_device *vdev, uint64_t wanted);
+struct virtqueue *virtio_setup_queue(struct virtio_device *vdev, uint16_t index, uint16_t max_size, uint16_t msix_vector);
+uint16_t virtio_num_queues(const struct virtio_device *vdev);
+void virtio_driver_ok(struct virtio_device *vdev);
+void virtio_fail(struct virtio_device *vdev);
+
+uint8_t virtio_cfg_read8(const struct virtio_device *vdev, uint32_t offset);
+uint16_t virtio_cfg_read16(const struct virtio_device *vdev, uint32_t offset);
+uint32_t virtio_cfg_read32(const struct virtio_device *vdev, uint32_t offset);
+uint64_t virtio_cfg_read64(const struct virtio_device *vdev, uint32_t offset);
+
+/* Returns the head descriptor index, or -1 when the ring is full. */
+int virtq_add(struct virtqueue *vq, const struct virtq_sg *sg, size_t count, void *token);
+/* Same, but the chain lives in the caller's table and takes one ring slot. */
+int virtq_add_indirect(struct virtqueue *vq, const struct virtq_sg *sg, size_t count, void *token,
+                       struct virtq_desc *table);
+void virtq_kick(struct virtqueue *vq);
+void virtq_disable_cb(struct virtqueue *vq);
+bool virtq_enable_cb(struct virtqueue *vq);
+bool virtq_has_used(const struct virtqueue *vq);
+void *virtq_get_used(struct virtqueue *vq, uint32_t *len);
+
+#endif /* VIRTIO_H */
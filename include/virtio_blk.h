@@ -0,0 +1,6 @@
+#ifndef VIRTIO_BLK_H
+#define VIRTIO_BLK_H
+
+void virtio_blk_init(void);
+
+#endif /* VIRTIO_BLK_H */
@@ -0,0 +1,9 @@
+#ifndef VIRTIO_NET_H
+#define VIRTIO_NET_H
+
+void virtio_net_init(void);
+/* TX packet rate into the peer, then ping round trips to the gateway as
+   the latency probe. */
+void virtio_net_bench(void);
+
+#endif /* VIRTIO_NET_H */
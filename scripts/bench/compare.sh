@@ -0,0 +1,87 @@
+#!/bin/sh
+# Collect the "bench:" lines of a serial log into JSON and compare each
+# median against a baseline written by an earlier run:
+#   scripts/bench/compare.sh [-t percent] [-o results.json] baseline.json < serial.log
+# Exits 1 when the run did not finish or a median regressed by more than
+# the threshold (default 10%). A missing baseline only skips the compare.
+set -e
+
+threshold=10
+out=/dev/null
+while getopts t:o: opt; do
+    case $opt in
+    t) threshold=$OPTARG ;;
+    o) out=$OPTARG ;;
+    *) exit 2 ;;
+    esac
+done
+shift $((OPTIND - 1))
+if [ $# -ne 1 ]; then
+    echo "usage: $0 [-t percent] [-o results.json] baseline.json < serial.log" >&2
+    exit 2
+fi
+baseline=$1
+[ -f "$baseline" ] || baseline=/dev/null
+
+awk -v threshold="$threshold" -v out="$out" -v have_base="$([ "$baseline" = /dev/null ] && echo 0 || echo 1)" '
+function field(line, key,    m) {
+    if (match(line, "\"" key "\": *\"?[^,\"}]*")) {
+        m = substr(line, RSTART, RLENGTH)
+        sub(/^[^:]*: *"?/, "", m)
+        return m
+    }
+    return ""
+}
+FILENAME != "-" {
+    name = field($0, "name")
+    if (name != "") {
+        base[name] = field($0, "median_ps") + 0
+    }
+    next
+}
+$1 == "bench:" && $2 == "tsc_khz" {
+    khz = $3 + 0
+}
+$1 == "bench:" && $2 == "done" {
+    done = 1
+}
+$1 == "bench:" && $3 == "loops" && $11 == "ps" {
+    n++
+    names[n] = $2
+    loops[n] = $4 + 0
+    min[n] = $6 + 0
+    median[n] = $8 + 0
+    p99[n] = $10 + 0
+}
+END {
+    printf "{\n  \"tsc_khz\": %.0f,\n  \"benchmarks\": [\n", khz > out
+    for (i = 1; i <= n; i++) {
+        printf "    {\"name\": \"%s\", \"loops\": %.0f, \"min_ps\": %.0f, \"median_ps\": %.0f, \"p99_ps\": %.0f}%s\n",
+               names[i], loops[i], min[i], median[i], p99[i], i < n ? "," : "" > out
+    }
+    printf "  ]\n}\n" > out
+
+    if (!done) {
+        print "bench: run did not finish (is MICROBENCH enabled?)" > "/dev/stderr"
+        exit 1
+    }
+    if (!have_base) {
+        print "bench: no baseline, nothing compared"
+    }
+    failed = 0
+    for (i = 1; i <= n; i++) {
+        if (!have_base || !(names[i] in base) || base[names[i]] == 0) {
+            printf "%-28s %10.3f ns  (new)\n", names[i], median[i] / 1000
+            continue
+        }
+        delta = (median[i] - base[names[i]]) * 100 / base[names[i]]
+        verdict = delta > threshold ? "REGRESSED" : ""
+        printf "%-28s %10.3f ns  %+7.1f%%  %s\n", names[i], median[i] / 1000, delta, verdict
+        failed += delta > threshold
+    }
+    if (failed) {
+        printf "bench: %d regression(s) beyond %s%%\n", failed, threshold > "/dev/stderr"
+        exit 1
+    }
+}
+' "$baseline" -
@@ -0,0 +1,69 @@
+#!/bin/sh
+# Time conf on a synthetic Kconfig of N symbols, shaped like the generated
+# fleet fragments: bool/tristate/string options, dependency chains, selects
+# and the odd choice. Nothing outside a temporary directory is touched.
+#
+#   scripts/kconfig/bench.sh [symbols] [conf binary]
+set -e
+N=${1:-10000}
+CONF=${2:-scripts/kconfig/conf}
+RUNS=5
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+awk -v n="$N" 'BEGIN {
+    print "mainmenu \"synthetic\"\n"
+    print "config MODULES\n    bool \"Modules\"\n    default y\n"
+    for (i = 1; i <= n; i++) {
+        if (i % 500 == 0) {
+            printf "choice\n    prompt \"Choice %d\"\n    default SYM_%d_B\n\n", i, i
+            printf "config SYM_%d_A\n    bool \"A\"\n\nconfig SYM_%d_B\n    bool \"B\"\n\nendchoice\n\n", i, i
+            continue
+        }
+        printf "config SYM_%d\n", i
+        if (i % 13 == 0)
+            printf "    string \"Symbol %d\"\n    default \"value-%d\"\n", i, i
+        else if (i % 10 == 0)
+            printf "    tristate \"Symbol %d\"\n    default m\n", i
+        else
+            printf "    bool \"Symbol %d\"\n    default %s\n", i, i % 3 ? "y" : "n"
+        if (i % 5 == 0 && i > 1 && (i - 1) % 500)
+            printf "    depends on SYM_%d\n", i - 1
+        if (i % 7 == 0 && i + 3 <= n && (i + 3) % 13 && (i + 3) % 500)
+            printf "    select SYM_%d\n", i + 3
+        if (i % 50 == 0)
+            printf "    help\n      Help text for symbol %d,\n      two lines long.\n", i
+        print ""
+    }
+}' > "$dir/Kconfig"
+
+export KCONFIG_CONFIG="$dir/.config"
+export KCONFIG_AUTOCONFIG="$dir/include/config/auto.conf"
+export KCONFIG_AUTOHEADER="$dir/include/generated/autoconf.h"
+export KCONFIG_MK="$dir/config.mk"
+
+now_us() {
+    echo $(( $(date +%s%N) / 1000 ))
+}
+
+# best of RUNS, in microseconds
+best() {
+    best_us=
+    i=0
+    while [ $i -lt $RUNS ]; do
+        start=$(now_us)
+        "$CONF" "$@" "$dir/Kconfig" > /dev/null
+        us=$(( $(now_us) - start ))
+        if [ -z "$best_us" ] || [ $us -lt $best_us ]; then
+            best_us=$us
+        fi
+        i=$((i + 1))
+    done
+    echo $best_us
+}
+
+defconfig_us=$(best --defconfig)
+syncconfig_us=$(best --syncconfig)
+printf '%d symbols, %d Kconfig lines\n' "$N" "$(wc -l < "$dir/Kconfig")"
+printf '  defconfig   %8d us\n' "$defconfig_us"
+printf '  syncconfig  %8d us\n' "$syncconfig_us"
@@ -0,0 +1,138 @@
+/*
+ * fixdep: rewrite a gcc -MMD dependency file so an object depends on the
+ * per-symbol stamps (include/config/<symbol>.h, kept by conf) of every
+ * CONFIG_ symbol its source and headers mention, instead of on the
+ * autoconf.h that is force-included into every file.
+ *
+ *   fixdep <depfile> <autoconf.h> <stamp dir>   (result on stdout)
+ *
+ * Headers also get empty rules, as with -MP, so deleting one does not
+ * break the build.
+ */
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    char **items;
+    int count;
+} name_list;
+
+static void add_name(name_list *list, const char *s, size_t len) {
+    for (int i = 0; i < list->count; ++i) {
+        if (strlen(list->items[i]) == len && strncmp(list->items[i], s, len) == 0)
+            return;
+    }
+    char **items = realloc(list->items, sizeof(char *) * (list->count + 1));
+    char *copy = malloc(len + 1);
+    if (!items || !copy) {
+        fprintf(stderr, "fixdep: out of memory\n");
+        exit(1);
+    }
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    list->items = items;
+    list->items[list->count++] = copy;
+}
+
+static char *read_file(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return NULL;
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *buf = malloc((size_t)len + 1);
+    if (!buf || fread(buf, 1, (size_t)len, f) != (size_t)len) {
+        fclose(f);
+        free(buf);
+        return NULL;
+    }
+    buf[len] = '\0';
+    fclose(f);
+    return buf;
+}
+
+static bool is_ident(char c) {
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+static void scan_symbols(const char *path, name_list *symbols) {
+    char *text = read_file(path);
+    if (!text)
+        return;
+    for (const char *p = strstr(text, "CONFIG_"); p; p = strstr(p, "CONFIG_")) {
+        if (p > text && is_ident(p[-1])) {
+            p += 7;
+            continue;
+        }
+        p += 7;
+        const char *end = p;
+        while (is_ident(*end))
+            end++;
+        if (end > p)
+            add_name(symbols, p, (size_t)(end - p));
+        p = end;
+    }
+    free(text);
+}
+
+int main(int argc, char **argv) {
+    if (argc != 4) {
+        fprintf(stderr, "usage: fixdep <depfile> <autoconf.h> <stamp dir>\n");
+        return 2;
+    }
+    char *dep = read_file(argv[1]);
+    if (!dep) {
+        fprintf(stderr, "fixdep: cannot read %s\n", argv[1]);
+        return 1;
+    }
+
+    /* "target: prereq prereq \<newline> prereq ..." */
+    char *colon = strchr(dep, ':');
+    if (!colon) {
+        fprintf(stderr, "fixdep: %s has no rule\n", argv[1]);
+        return 1;
+    }
+    *colon = '\0';
+    char *target = dep;
+    while (isspace((unsigned char)*target))
+        target++;
+
+    name_list prereqs = { 0 };
+    name_list symbols = { 0 };
+    for (char *p = colon + 1; *p;) {
+        if (isspace((unsigned char)*p) || (*p == '\\' && (p[1] == '\n' || p[1] == '\r'))) {
+            p++;
+            continue;
+        }
+        char *end = p;
+        while (*end && !isspace((unsigned char)*end) && !(*end == '\\' && (end[1] == '\n' || end[1] == '\r')))
+            end++;
+        const char saved = *end;
+        *end = '\0';
+        if (strcmp(p, argv[2]) != 0) {
+            add_name(&prereqs, p, (size_t)(end - p));
+            scan_symbols(p, &symbols);
+        }
+        *end = saved;
+        p = end;
+    }
+
+    printf("%s: \\\n", target);
+    for (int i = 0; i < prereqs.count; ++i)
+        printf("  %s \\\n", prereqs.items[i]);
+    for (int i = 0; i < symbols.count; ++i) {
+        printf("  $(wildcard %s/", argv[3]);
+        for (const char *c = symbols.items[i]; *c; ++c)
+            putchar(tolower((unsigned char)*c));
+        printf(".h) \\\n");
+    }
+    printf("\n");
+    /* the first prerequisite is the source itself */
+    for (int i = 1; i < prereqs.count; ++i)
+        printf("%s:\n", prereqs.items[i]);
+    return 0;
+}
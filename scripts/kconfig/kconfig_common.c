@@ -2,40 +2,151 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 
+/* Parsed strings, options and expressions live until free_kconfig, so they
+   come from a bump arena instead of one malloc each. */
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+struct arena_block {
+    arena_block *next;
+    size_t used;
+    size_t size;
+    char data[];
+};
+
+typedef enum {
+    E_CONST,
+    E_SYMBOL,
+    E_NOT,
+    E_AND,
+    E_OR,
+    E_EQUAL,
+    E_UNEQUAL,
+} expr_kind;
+
+struct expr {
+    expr_kind kind;
+    expr_t *left;
+    expr_t *right;
+    char *name;             /* E_SYMBOL name or E_CONST text */
+    option_t *sym;          /* E_SYMBOL, looked up on first use */
+    bool resolved;
+};
+
+static void out_of_memory(void) {
+    fprintf(stderr, "kconfig: out of memory\n");
+    exit(1);
+}
+
+static void *arena_alloc(kconfig_t *kc, size_t size) {
+    size = (size + 7) & ~(size_t)7;
+    arena_block *b = kc->arena;
+    if (!b || b->size - b->used < size) {
+        size_t cap = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        b = malloc(sizeof(*b) + cap);
+        if (!b) out_of_memory();
+        b->next = kc->arena;
+        b->used = 0;
+        b->size = cap;
+        kc->arena = b;
+    }
+    void *p = b->data + b->used;
+    b->used += size;
+    memset(p, 0, size);
+    return p;
+}
+
+static char *arena_strndup(kconfig_t *kc, const char *s, size_t len) {
+    char *p = arena_alloc(kc, len + 1);
+    memcpy(p, s, len);
+    p[len] = '\0';
+    return p;
+}
+
 static char *xstrdup(const char *s) {
     if (!s) return NULL;
     size_t len = strlen(s) + 1;
     char *p = malloc(len);
-    if (p) memcpy(p, s, len);
+    if (!p) out_of_memory();
+    memcpy(p, s, len);
     return p;
 }
 
 static void append_option(option_list *list, option_t *opt) {
-    option_t **new_items = realloc(list->items, sizeof(option_t*) * (list->count + 1));
-    if (!new_items) return;
-    list->items = new_items;
+    if (list->count == list->cap) {
+        int cap = list->cap ? list->cap * 2 : 16;
+        option_t **items = realloc(list->items, sizeof(option_t *) * cap);
+        if (!items) out_of_memory();
+        list->items = items;
+        list->cap = cap;
+    }
     list->items[list->count++] = opt;
 }
 
-static option_t *find_option(kconfig_t *kc, const char *name) {
-    for (int i = 0; i < kc->options.count; ++i) {
-        option_t *opt = kc->options.items[i];
-        if (opt->name && strcmp(opt->name, name) == 0)
+/* FNV-1a */
+static size_t hash_name(const char *s) {
+    uint32_t h = 2166136261u;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+option_t *find_option(const kconfig_t *kc, const char *name) {
+    if (!kc->slot_count)
+        return NULL;
+    size_t mask = kc->slot_count - 1;
+    for (size_t i = hash_name(name) & mask;; i = (i + 1) & mask) {
+        option_t *opt = kc->slots[i];
+        if (!opt || strcmp(opt->name, name) == 0)
             return opt;
-        if (opt->type == OPT_CHOICE) {
-            for (int j = 0; j < opt->children.count; ++j) {
-                option_t *child = opt->children.items[j];
-                if (child->name && strcmp(child->name, name) == 0)
-                    return child;
-            }
+    }
+}
+
+static void symtab_insert(kconfig_t *kc, option_t *opt) {
+    /* keep the table at most half full so probes stay short */
+    if ((kc->symbol_count + 1) * 2 > kc->slot_count) {
+        size_t count = kc->slot_count ? kc->slot_count * 2 : 256;
+        option_t **slots = calloc(count, sizeof(option_t *));
+        if (!slots) out_of_memory();
+        for (size_t i = 0; i < kc->slot_count; ++i) {
+            option_t *old = kc->slots[i];
+            if (!old)
+                continue;
+            size_t j = hash_name(old->name) & (count - 1);
+            while (slots[j])
+                j = (j + 1) & (count - 1);
+            slots[j] = old;
         }
+        free(kc->slots);
+        kc->slots = slots;
+        kc->slot_count = count;
     }
-    return NULL;
+    size_t mask = kc->slot_count - 1;
+    size_t i = hash_name(opt->name) & mask;
+    while (kc->slots[i])
+        i = (i + 1) & mask;
+    kc->slots[i] = opt;
+    kc->symbol_count++;
+}
+
+/* A name seen twice reopens the first definition, as Kconfig allows. */
+static option_t *new_symbol(kconfig_t *kc, const char *name, bool *existed) {
+    option_t *opt = find_option(kc, name);
+    *existed = opt != NULL;
+    if (opt)
+        return opt;
+    opt = arena_alloc(kc, sizeof(option_t));
+    opt->name = arena_strndup(kc, name, strlen(name));
+    opt->type = OPT_BOOL; /* default until specified */
+    symtab_insert(kc, opt);
+    return opt;
 }
 
 static void trim(char *line) {
@@ -52,29 +163,43 @@ static bool starts_with(const char *s, const char *pref) {
     return strncmp(s, pref, strlen(pref)) == 0;
 }
 
-static char *dup_token(const char *start) {
-    while (isspace((unsigned char)*start)) start++;
+static const char *skip_space(const char *s) {
+    while (isspace((unsigned char)*s)) s++;
+    return s;
+}
+
+static char *dup_token(kconfig_t *kc, const char *start) {
+    start = skip_space(start);
     const char *end = start;
     while (*end && !isspace((unsigned char)*end)) end++;
-    size_t len = end - start;
-    char *out = malloc(len + 1);
-    if (!out) return NULL;
-    memcpy(out, start, len);
-    out[len] = '\0';
-    return out;
+    return arena_strndup(kc, start, end - start);
 }
 
-static char *dup_quoted(const char *start) {
-    while (isspace((unsigned char)*start)) start++;
+static char *dup_quoted(kconfig_t *kc, const char *start) {
+    start = skip_space(start);
     if (*start == '"') start++;
     const char *end = start;
     while (*end && *end != '"') end++;
-    size_t len = end - start;
-    char *out = malloc(len + 1);
-    if (!out) return NULL;
-    memcpy(out, start, len);
-    out[len] = '\0';
-    return out;
+    return arena_strndup(kc, start, end - start);
+}
+
+static bool has_hex_prefix(const char *s) {
+    return s[0] == '0' && (s[1] == 'x' || s[1] == 'X');
+}
+
+/* "-12" for int, "0x1f" or "1f" for hex */
+static bool valid_number(option_type type, const char *s) {
+    if (type == OPT_INT && *s == '-')
+        s++;
+    else if (type == OPT_HEX && has_hex_prefix(s))
+        s += 2;
+    if (!*s)
+        return false;
+    for (; *s; ++s) {
+        if (type == OPT_INT ? !isdigit((unsigned char)*s) : !isxdigit((unsigned char)*s))
+            return false;
+    }
+    return true;
 }
 
 static void rtrim(char *line) {
@@ -83,18 +208,280 @@ static void rtrim(char *line) {
         line[--len] = '\0';
 }
 
-static char *append_help(char *existing, const char *line) {
-    size_t old_len = existing ? strlen(existing) : 0;
+/* the first word of a line, compared whole so "menu" does not match
+   "menuconfig" */
+static bool keyword(const char *line, const char *word, const char **rest) {
+    size_t len = strlen(word);
+    if (strncmp(line, word, len) != 0 || (line[len] && !isspace((unsigned char)line[len])))
+        return false;
+    *rest = line + len;
+    return true;
+}
+
+/*
+ * Expressions: symbols and y/m/n combined with !, &&, ||, parentheses and
+ * = / != comparisons, as in "depends on PCI && (BLOCK || !NET)".
+ */
+typedef struct {
+    kconfig_t *kc;
+    const char *p;
+    bool error;
+} expr_parser;
+
+static expr_t *new_expr(kconfig_t *kc, expr_kind kind, expr_t *left, expr_t *right) {
+    expr_t *e = arena_alloc(kc, sizeof(expr_t));
+    e->kind = kind;
+    e->left = left;
+    e->right = right;
+    return e;
+}
+
+static bool is_symbol_char(char c) {
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+static expr_t *parse_or(expr_parser *ep);
+
+static expr_t *parse_leaf(expr_parser *ep) {
+    ep->p = skip_space(ep->p);
+    const char *start = ep->p;
+    expr_t *e;
+    if (*start == '"') {
+        const char *end = ++start;
+        while (*end && *end != '"') end++;
+        e = new_expr(ep->kc, E_CONST, NULL, NULL);
+        e->name = arena_strndup(ep->kc, start, end - start);
+        ep->p = *end ? end + 1 : end;
+        return e;
+    }
+    while (is_symbol_char(*ep->p))
+        ep->p++;
+    if (ep->p == start) {
+        ep->error = true;
+        e = new_expr(ep->kc, E_CONST, NULL, NULL);
+        e->name = arena_strndup(ep->kc, "n", 1);
+        return e;
+    }
+    char *name = arena_strndup(ep->kc, start, ep->p - start);
+    bool literal = strcmp(name, "y") == 0 || strcmp(name, "m") == 0 || strcmp(name, "n") == 0;
+    e = new_expr(ep->kc, literal ? E_CONST : E_SYMBOL, NULL, NULL);
+    e->name = name;
+    return e;
+}
+
+static expr_t *parse_unary(expr_parser *ep) {
+    ep->p = skip_space(ep->p);
+    if (*ep->p == '!' && ep->p[1] != '=') {
+        ep->p++;
+        return new_expr(ep->kc, E_NOT, parse_unary(ep), NULL);
+    }
+    if (*ep->p == '(') {
+        ep->p++;
+        expr_t *e = parse_or(ep);
+        ep->p = skip_space(ep->p);
+        if (*ep->p == ')')
+            ep->p++;
+        else
+            ep->error = true;
+        return e;
+    }
+    expr_t *left = parse_leaf(ep);
+    ep->p = skip_space(ep->p);
+    if (*ep->p == '=') {
+        ep->p++;
+        return new_expr(ep->kc, E_EQUAL, left, parse_leaf(ep));
+    }
+    if (ep->p[0] == '!' && ep->p[1] == '=') {
+        ep->p += 2;
+        return new_expr(ep->kc, E_UNEQUAL, left, parse_leaf(ep));
+    }
+    return left;
+}
+
+static expr_t *parse_and(expr_parser *ep) {
+    expr_t *e = parse_unary(ep);
+    for (;;) {
+        ep->p = skip_space(ep->p);
+        if (ep->p[0] != '&' || ep->p[1] != '&')
+            return e;
+        ep->p += 2;
+        e = new_expr(ep->kc, E_AND, e, parse_unary(ep));
+    }
+}
+
+static expr_t *parse_or(expr_parser *ep) {
+    expr_t *e = parse_and(ep);
+    for (;;) {
+        ep->p = skip_space(ep->p);
+        if (ep->p[0] != '|' || ep->p[1] != '|')
+            return e;
+        ep->p += 2;
+        e = new_expr(ep->kc, E_OR, e, parse_and(ep));
+    }
+}
+
+/* Parses text up to its end or an "if" that starts a condition, which is
+   returned through cond when the caller allows one. */
+static expr_t *parse_expr(kconfig_t *kc, const char *text, expr_t **cond, bool *error) {
+    expr_parser ep = { kc, text, false };
+    expr_t *e = parse_or(&ep);
+    ep.p = skip_space(ep.p);
+    const char *rest;
+    if (cond && keyword(ep.p, "if", &rest)) {
+        ep.p = rest;
+        *cond = parse_or(&ep);
+        ep.p = skip_space(ep.p);
+    }
+    if (*ep.p)
+        ep.error = true;
+    *error |= ep.error;
+    return e;
+}
+
+static const char *tristate_name(tristate t) {
+    return t == TRI_Y ? "y" : t == TRI_M ? "m" : "n";
+}
+
+static option_t *expr_symbol(const kconfig_t *kc, expr_t *e) {
+    if (!e->resolved) {
+        e->sym = find_option(kc, e->name);
+        e->resolved = true;
+    }
+    return e->sym;
+}
+
+/* the text a comparison sees: y/m/n for bool and tristate symbols */
+static const char *expr_string(const kconfig_t *kc, expr_t *e) {
+    if (e->kind == E_CONST)
+        return e->name;
+    option_t *sym = expr_symbol(kc, e);
+    if (!sym)
+        return "n";
+    if (option_has_text(sym))
+        return sym->str_val ? sym->str_val : "";
+    return tristate_name(sym->tri);
+}
+
+static tristate tri_min(tristate a, tristate b) {
+    return a < b ? a : b;
+}
+
+static tristate tri_max(tristate a, tristate b) {
+    return a > b ? a : b;
+}
+
+static tristate expr_eval(const kconfig_t *kc, expr_t *e) {
+    if (!e)
+        return TRI_Y;
+    switch (e->kind) {
+    case E_CONST:
+        return strcmp(e->name, "y") == 0 ? TRI_Y : strcmp(e->name, "m") == 0 ? TRI_M : TRI_N;
+    case E_SYMBOL: {
+        option_t *sym = expr_symbol(kc, e);
+        if (!sym || option_has_text(sym))
+            return TRI_N;
+        return sym->tri;
+    }
+    case E_NOT:
+        return TRI_Y - expr_eval(kc, e->left);
+    case E_AND:
+        return tri_min(expr_eval(kc, e->left), expr_eval(kc, e->right));
+    case E_OR:
+        return tri_max(expr_eval(kc, e->left), expr_eval(kc, e->right));
+    case E_EQUAL:
+        return strcmp(expr_string(kc, e->left), expr_string(kc, e->right)) == 0 ? TRI_Y : TRI_N;
+    case E_UNEQUAL:
+        return strcmp(expr_string(kc, e->left), expr_string(kc, e->right)) != 0 ? TRI_Y : TRI_N;
+    }
+    return TRI_N;
+}
+
+static expr_t *and_expr(kconfig_t *kc, expr_t *a, expr_t *b) {
+    if (!a) return b;
+    if (!b) return a;
+    return new_expr(kc, E_AND, a, b);
+}
+
+static void add_default(kconfig_t *kc, option_t *opt, const char *text, bool *error) {
+    default_value *d = arena_alloc(kc, sizeof(default_value));
+    const char *p = skip_space(text);
+    if (option_has_text(opt) || *p == '"') {
+        d->str = *p == '"' ? dup_quoted(kc, p) : dup_token(kc, p);
+        if ((opt->type == OPT_INT || opt->type == OPT_HEX) && !valid_number(opt->type, d->str))
+            *error = true;
+        if (opt->type == OPT_HEX && !has_hex_prefix(d->str)) {
+            char *prefixed = arena_alloc(kc, strlen(d->str) + 3);
+            sprintf(prefixed, "0x%s", d->str);
+            d->str = prefixed;
+        }
+        if (*p == '"') {
+            const char *end = strchr(p + 1, '"');
+            p = end ? end + 1 : p + strlen(p);
+        } else {
+            while (*p && !isspace((unsigned char)*p)) p++;
+        }
+        p = skip_space(p);
+        const char *rest;
+        if (keyword(p, "if", &rest))
+            d->cond = parse_expr(kc, rest, NULL, error);
+        else if (*p)
+            *error = true;
+    } else {
+        d->value = parse_expr(kc, p, &d->cond, error);
+    }
+    default_value **tail = &opt->defaults;
+    while (*tail)
+        tail = &(*tail)->next;
+    *tail = d;
+}
+
+static void add_select(kconfig_t *kc, option_t *opt, const char *text, bool *error) {
+    select_entry *s = arena_alloc(kc, sizeof(select_entry));
+    const char *p = skip_space(text);
+    const char *end = p;
+    while (is_symbol_char(*end)) end++;
+    if (end == p)
+        *error = true;
+    s->name = arena_strndup(kc, p, end - p);
+    p = skip_space(end);
+    const char *rest;
+    if (keyword(p, "if", &rest))
+        s->cond = parse_expr(kc, rest, NULL, error);
+    else if (*p)
+        *error = true;
+    s->next = opt->selects;
+    opt->selects = s;
+}
+
+/* Hook each select up to its target, which may be defined later. */
+static void link_selects(kconfig_t *kc, option_t *opt) {
+    for (select_entry *s = opt->selects; s; s = s->next) {
+        s->target = find_option(kc, s->name);
+        if (!s->target)
+            continue;
+        struct rev_dep *r = arena_alloc(kc, sizeof(struct rev_dep));
+        r->from = opt;
+        r->cond = s->cond;
+        r->next = s->target->selected_by;
+        s->target->selected_by = r;
+    }
+}
+
+static char *append_help(char *existing, size_t *len, const char *line) {
     size_t add_len = strlen(line);
-    char *buf = realloc(existing, old_len + add_len + 2);
-    if (!buf)
-        return existing;
-    memcpy(buf + old_len, line, add_len);
-    buf[old_len + add_len] = '\n';
-    buf[old_len + add_len + 1] = '\0';
+    char *buf = realloc(existing, *len + add_len + 2);
+    if (!buf) out_of_memory();
+    memcpy(buf + *len, line, add_len);
+    *len += add_len;
+    buf[(*len)++] = '\n';
+    buf[*len] = '\0';
     return buf;
 }
 
+/*
+ * One pass over the file, a line at a time. A help block ends at the first
+ * line that is not indented; that line is handed back to the main loop.
+ */
 int parse_kconfig(const char *path, kconfig_t *kc, char *err_buf, size_t err_len) {
     memset(kc, 0, sizeof(*kc));
     FILE *f = fopen(path, "r");
@@ -102,152 +489,284 @@ int parse_kconfig(const char *path, kconfig_t *kc, char *err_buf, size_t err_len
         snprintf(err_buf, err_len, "unable to open %s: %s", path, strerror(errno));
         return -1;
     }
-    char line[512];
-    char queued[512];
+    char *line = NULL;
+    size_t line_cap = 0;
     bool has_queued = false;
+    int lineno = 0;
     option_t *current = NULL;
     option_t *current_choice = NULL;
-    while (1) {
-        if (has_queued) {
-            strncpy(line, queued, sizeof(line));
-            has_queued = false;
-        } else if (!fgets(line, sizeof(line), f)) {
-            break;
-        }
+    int status = 0;
+    while (has_queued || getline(&line, &line_cap, f) >= 0) {
+        has_queued = false;
+        lineno++;
         rtrim(line);
-        char trimmed[512];
-        strncpy(trimmed, line, sizeof(trimmed));
-        trimmed[sizeof(trimmed)-1] = '\0';
-        trim(trimmed);
-        if (!trimmed[0] || starts_with(trimmed, "#"))
+        trim(line);
+        const char *rest;
+        bool error = false;
+        if (!line[0] || line[0] == '#')
             continue;
-        if (starts_with(trimmed, "mainmenu") || starts_with(trimmed, "menu"))
+        if (keyword(line, "mainmenu", &rest) || keyword(line, "menu", &rest) || keyword(line, "endmenu", &rest) ||
+            keyword(line, "comment", &rest))
             continue;
-        if (starts_with(trimmed, "choice")) {
-            current_choice = calloc(1, sizeof(option_t));
+        if (keyword(line, "choice", &rest)) {
+            current_choice = arena_alloc(kc, sizeof(option_t));
             current_choice->type = OPT_CHOICE;
             append_option(&kc->options, current_choice);
             current = NULL;
             continue;
         }
-        if (starts_with(trimmed, "endchoice")) {
+        if (keyword(line, "endchoice", &rest)) {
             current_choice = NULL;
             current = NULL;
             continue;
         }
-        if (starts_with(trimmed, "config")) {
-            char *name = dup_token(trimmed + strlen("config"));
-            option_t *opt = calloc(1, sizeof(option_t));
-            opt->name = name;
-            opt->type = OPT_BOOL; /* default until specified */
-            if (current_choice) {
-                opt->type = OPT_CHOICE_OPT;
-                opt->parent = current_choice;
-                append_option(&current_choice->children, opt);
-            } else {
-                append_option(&kc->options, opt);
+        if (keyword(line, "config", &rest) || keyword(line, "menuconfig", &rest)) {
+            bool existed;
+            option_t *opt = new_symbol(kc, dup_token(kc, rest), &existed);
+            if (!existed) {
+                if (current_choice) {
+                    opt->type = OPT_CHOICE_OPT;
+                    opt->parent = current_choice;
+                    append_option(&current_choice->children, opt);
+                } else {
+                    append_option(&kc->options, opt);
+                }
+                if (strcmp(opt->name, "MODULES") == 0)
+                    kc->modules = opt;
             }
             current = opt;
             continue;
         }
-        if (!current && !current_choice)
-            continue;
-        if (starts_with(trimmed, "prompt")) {
-            char *p = dup_quoted(trimmed + strlen("prompt"));
-            if (current_choice)
-                current_choice->prompt = p;
-            else if (current)
-                current->prompt = p;
-            continue;
-        }
-        if (starts_with(trimmed, "bool")) {
-            current->type = current->type == OPT_CHOICE_OPT ? OPT_CHOICE_OPT : OPT_BOOL;
-            if (!current->prompt)
-                current->prompt = dup_quoted(trimmed + strlen("bool"));
-            continue;
-        }
-        if (starts_with(trimmed, "string")) {
-            current->type = OPT_STRING;
-            if (!current->prompt)
-                current->prompt = dup_quoted(trimmed + strlen("string"));
-            continue;
-        }
-        if (starts_with(trimmed, "default")) {
-            if (current_choice && !current) {
-                kc->default_choice = dup_token(trimmed + strlen("default"));
-            } else if (current) {
-                if (current->type == OPT_STRING)
-                    current->def = dup_quoted(trimmed + strlen("default"));
-                else
-                    current->def = dup_token(trimmed + strlen("default"));
-            }
+        option_t *target = current ? current : current_choice;
+        if (!target)
             continue;
-        }
-        if (starts_with(trimmed, "help")) {
-            char *dest = NULL;
-            if (current_choice && !current)
-                dest = current_choice->help;
-            else if (current)
-                dest = current->help;
-            while (fgets(line, sizeof(line), f)) {
+        if (keyword(line, "prompt", &rest)) {
+            target->prompt = dup_quoted(kc, rest);
+        } else if (keyword(line, "bool", &rest) || keyword(line, "tristate", &rest) ||
+                   keyword(line, "string", &rest) || keyword(line, "int", &rest) ||
+                   keyword(line, "hex", &rest)) {
+            if (target->type != OPT_CHOICE && target->type != OPT_CHOICE_OPT)
+                target->type = line[0] == 'b' ? OPT_BOOL : line[0] == 't' ? OPT_TRISTATE :
+                               line[0] == 's' ? OPT_STRING : line[0] == 'i' ? OPT_INT : OPT_HEX;
+            if (!target->prompt && *skip_space(rest))
+                target->prompt = dup_quoted(kc, rest);
+        } else if (keyword(line, "default", &rest)) {
+            add_default(kc, target, rest, &error);
+        } else if (keyword(line, "depends", &rest)) {
+            rest = skip_space(rest);
+            if (!keyword(rest, "on", &rest))
+                error = true;
+            else
+                target->depends = and_expr(kc, target->depends, parse_expr(kc, rest, NULL, &error));
+        } else if (keyword(line, "select", &rest)) {
+            if (current)
+                add_select(kc, current, rest, &error);
+        } else if (keyword(line, "help", &rest) || keyword(line, "---help---", &rest)) {
+            char *help = NULL;
+            size_t help_len = 0;
+            while (getline(&line, &line_cap, f) >= 0) {
+                lineno++;
                 rtrim(line);
                 if (!(line[0] == ' ' || line[0] == '\t')) {
-                    strncpy(queued, line, sizeof(queued));
-                    queued[sizeof(queued)-1] = '\0';
                     has_queued = true;
+                    lineno--;
                     break;
                 }
-                char *p = line;
-                while (*p == ' ' || *p == '\t') p++;
-                dest = append_help(dest, p);
+                help = append_help(help, &help_len, skip_space(line));
+            }
+            if (help) {
+                target->help = arena_strndup(kc, help, help_len);
+                free(help);
             }
-            if (current_choice && !current)
-                current_choice->help = dest;
-            else if (current)
-                current->help = dest;
-            continue;
+        }
+        if (error) {
+            snprintf(err_buf, err_len, "%s:%d: cannot parse \"%s\"", path, lineno, line);
+            status = -1;
+            break;
         }
     }
+    free(line);
     fclose(f);
-    return 0;
-}
+    if (status != 0) {
+        free_kconfig(kc);
+        return status;
+    }
 
-void free_kconfig(kconfig_t *kc) {
     for (int i = 0; i < kc->options.count; ++i) {
         option_t *opt = kc->options.items[i];
-        free(opt->name);
-        free(opt->prompt);
-        free(opt->help);
-        free(opt->def);
-        free(opt->str_val);
+        link_selects(kc, opt);
         for (int j = 0; j < opt->children.count; ++j)
-            free(opt->children.items[j]);
-        free(opt->children.items);
-        free(opt);
+            link_selects(kc, opt->children.items[j]);
     }
+    return 0;
+}
+
+static void free_option(option_t *opt) {
+    free(opt->str_val);
+    for (int j = 0; j < opt->children.count; ++j)
+        free(opt->children.items[j]->str_val);
+    free(opt->children.items);
+}
+
+void free_kconfig(kconfig_t *kc) {
+    for (int i = 0; i < kc->options.count; ++i)
+        free_option(kc->options.items[i]);
     free(kc->options.items);
-    free(kc->default_choice);
+    free(kc->slots);
+    while (kc->arena) {
+        arena_block *next = kc->arena->next;
+        free(kc->arena);
+        kc->arena = next;
+    }
+    memset(kc, 0, sizeof(*kc));
+}
+
+bool modules_enabled(const kconfig_t *kc) {
+    return kc->modules && kc->modules->tri == TRI_Y;
+}
+
+void set_user_value(option_t *opt, tristate value) {
+    opt->user_tri = value;
+    opt->user_set = true;
 }
 
+/* Forget any .config values; calc_values then yields the defaults. */
 void apply_defaults(kconfig_t *kc) {
     for (int i = 0; i < kc->options.count; ++i) {
         option_t *opt = kc->options.items[i];
-        if (opt->type == OPT_BOOL)
-            opt->bool_val = opt->def ? (strcmp(opt->def, "y") == 0 || strcmp(opt->def, "1") == 0) : false;
-        else if (opt->type == OPT_STRING)
-            opt->str_val = opt->def ? xstrdup(opt->def) : xstrdup("");
-        else if (opt->type == OPT_CHOICE) {
-            /* set selection based on default_choice */
-            if (kc->default_choice) {
-                for (int j = 0; j < opt->children.count; ++j) {
-                    option_t *child = opt->children.items[j];
-                    child->bool_val = (strcmp(child->name, kc->default_choice) == 0);
-                }
-            } else if (opt->children.count) {
-                opt->children.items[0]->bool_val = true;
-            }
+        opt->user_set = false;
+        for (int j = 0; j < opt->children.count; ++j)
+            opt->children.items[j]->user_set = false;
+    }
+}
+
+static bool set_string(option_t *opt, const char *value) {
+    if (opt->str_val && strcmp(opt->str_val, value) == 0)
+        return false;
+    free(opt->str_val);
+    opt->str_val = xstrdup(value);
+    return true;
+}
+
+/* string, int and hex symbols hold text rather than y/m/n */
+bool option_has_text(const option_t *opt) {
+    return opt->type == OPT_STRING || opt->type == OPT_INT || opt->type == OPT_HEX;
+}
+
+/* A value from .config or the menu; false, and nothing changes, when an
+   int or hex symbol is given something that is not a number. Hex values
+   are stored with their 0x so they can go into C unchanged. */
+bool set_user_text(option_t *opt, const char *value) {
+    if ((opt->type == OPT_INT || opt->type == OPT_HEX) && !valid_number(opt->type, value))
+        return false;
+    if (opt->type == OPT_HEX && !has_hex_prefix(value)) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "0x%s", value);
+        set_string(opt, buf);
+    } else {
+        set_string(opt, value);
+    }
+    opt->user_set = true;
+    return true;
+}
+
+static const default_value *active_default(const kconfig_t *kc, const option_t *opt) {
+    for (const default_value *d = opt->defaults; d; d = d->next) {
+        if (expr_eval(kc, d->cond) != TRI_N)
+            return d;
+    }
+    return NULL;
+}
+
+static bool calc_symbol(const kconfig_t *kc, option_t *opt, tristate parent_visible) {
+    tristate visible = tri_min(expr_eval(kc, opt->depends), parent_visible);
+    if (option_has_text(opt)) {
+        bool changed = opt->visible != visible;
+        if (!opt->user_set) {
+            const default_value *d = active_default(kc, opt);
+            changed |= set_string(opt, d && d->str ? d->str : opt->type == OPT_STRING ? "" : opt->type == OPT_HEX ? "0x0" : "0");
+        }
+        opt->visible = visible;
+        return changed;
+    }
+
+    const bool tristate_ok = opt->type == OPT_TRISTATE && modules_enabled(kc) && opt != kc->modules;
+    if (!tristate_ok && visible == TRI_M)
+        visible = TRI_Y;
+    tristate value;
+    if (opt->user_set) {
+        value = opt->user_tri;
+    } else {
+        const default_value *d = active_default(kc, opt);
+        value = d ? tri_min(expr_eval(kc, d->value), expr_eval(kc, d->cond)) : TRI_N;
+    }
+    value = tri_min(value, visible);
+    for (const struct rev_dep *r = opt->selected_by; r; r = r->next)
+        value = tri_max(value, tri_min(r->from->tri, expr_eval(kc, r->cond)));
+    if (!tristate_ok && value == TRI_M)
+        value = TRI_Y;
+
+    bool changed = opt->visible != visible || opt->tri != value;
+    opt->visible = visible;
+    opt->tri = value;
+    return changed;
+}
+
+/* Exactly one visible member is y: the user's pick, else the default,
+   else the first. */
+static bool calc_choice(const kconfig_t *kc, option_t *choice) {
+    bool changed = false;
+    tristate visible = expr_eval(kc, choice->depends) == TRI_N ? TRI_N : TRI_Y;
+    option_t *pick = NULL;
+    for (int j = 0; j < choice->children.count; ++j) {
+        option_t *child = choice->children.items[j];
+        tristate child_visible = tri_min(visible, expr_eval(kc, child->depends)) == TRI_N ? TRI_N : TRI_Y;
+        changed |= child->visible != child_visible;
+        child->visible = child_visible;
+        if (!pick && child_visible && child->user_set && child->user_tri == TRI_Y)
+            pick = child;
+    }
+    if (!pick && visible) {
+        const default_value *d = active_default(kc, choice);
+        option_t *def = d && d->value && d->value->kind == E_SYMBOL ? expr_symbol(kc, d->value) : NULL;
+        if (def && def->parent == choice && def->visible)
+            pick = def;
+        for (int j = 0; !pick && j < choice->children.count; ++j) {
+            if (choice->children.items[j]->visible)
+                pick = choice->children.items[j];
+        }
+    }
+    for (int j = 0; j < choice->children.count; ++j) {
+        option_t *child = choice->children.items[j];
+        tristate value = child == pick ? TRI_Y : TRI_N;
+        changed |= child->tri != value;
+        child->tri = value;
+    }
+    choice->visible = visible;
+    return changed;
+}
+
+/*
+ * Values follow from the user's settings, defaults, "depends on" (an upper
+ * bound) and "select" (a lower bound). Symbols may refer to ones defined
+ * later, so passes repeat until nothing moves; a dependency loop gives up
+ * after a bounded number of passes.
+ */
+void calc_values(kconfig_t *kc) {
+    const int max_passes = 64;
+    for (int pass = 0; pass < max_passes; ++pass) {
+        bool changed = false;
+        for (int i = 0; i < kc->options.count; ++i) {
+            option_t *opt = kc->options.items[i];
+            if (opt->type == OPT_CHOICE)
+                changed |= calc_choice(kc, opt);
+            else
+                changed |= calc_symbol(kc, opt, TRI_Y);
         }
+        if (!changed)
+            return;
     }
+    fprintf(stderr, "kconfig: values did not settle, check for recursive dependencies\n");
 }
 
 static void ensure_dir(const char *path) {
@@ -263,45 +782,61 @@ static void ensure_dir(const char *path) {
     }
 }
 
+/* Split "CONFIG_X=val" or "# CONFIG_X is not set" (val "n") in place. */
+static bool parse_config_line(char *line, char **name, char **val) {
+    trim(line);
+    if (starts_with(line, "# CONFIG_")) {
+        char *end = strstr(line, " is not set");
+        if (!end) return false;
+        *end = '\0';
+        *name = line + strlen("# CONFIG_");
+        *val = "n";
+        return true;
+    }
+    if (!starts_with(line, "CONFIG_"))
+        return false;
+    char *eq = strchr(line, '=');
+    if (!eq) return false;
+    *eq = '\0';
+    *name = line + strlen("CONFIG_");
+    *val = eq + 1;
+    return true;
+}
+
+static void unquote(char *val) {
+    size_t len = strlen(val);
+    if (len && val[len-1] == '"') val[--len] = '\0';
+    if (*val == '"') memmove(val, val + 1, len);
+}
+
 void load_config_values(kconfig_t *kc, const char *config_path) {
     FILE *f = fopen(config_path, "r");
     if (!f) return;
-    char line[512];
-    while (fgets(line, sizeof(line), f)) {
-        if (starts_with(line, "#") || !strstr(line, "CONFIG_"))
+    char *line = NULL;
+    size_t line_cap = 0;
+    while (getline(&line, &line_cap, f) >= 0) {
+        char *name, *val;
+        if (!parse_config_line(line, &name, &val))
             continue;
-        trim(line);
-        if (!starts_with(line, "CONFIG_"))
-            continue;
-        char *eq = strchr(line, '=');
-        if (!eq) continue;
-        *eq = '\0';
-        char *name = line + strlen("CONFIG_");
-        char *val = eq + 1;
         option_t *opt = find_option(kc, name);
         if (!opt) continue;
-        if (opt->type == OPT_BOOL || opt->type == OPT_CHOICE_OPT) {
-            bool enabled = (strcmp(val, "y") == 0 || strcmp(val, "1") == 0);
-            opt->bool_val = enabled;
-            if (opt->parent && enabled) {
-                for (int i = 0; i < opt->parent->children.count; ++i)
-                    opt->parent->children.items[i]->bool_val = false;
-                opt->bool_val = true;
-            }
-        } else if (opt->type == OPT_STRING) {
-            if (*val == '"') val++;
-            size_t len = strlen(val);
-            if (len && val[len-1] == '"') val[len-1] = '\0';
-            free(opt->str_val);
-            opt->str_val = xstrdup(val);
+        if (option_has_text(opt)) {
+            unquote(val);
+            if (!set_user_text(opt, val))
+                fprintf(stderr, "%s: CONFIG_%s=%s is not a valid %s, using the default\n", config_path, name, val,
+                        opt->type == OPT_INT ? "int" : "hex");
+        } else {
+            tristate t = strcmp(val, "y") == 0 || strcmp(val, "1") == 0 ? TRI_Y : strcmp(val, "m") == 0 ? TRI_M : TRI_N;
+            set_user_value(opt, t);
         }
     }
+    free(line);
     fclose(f);
 }
 
-static void write_bool(FILE *f, const option_t *opt) {
-    if (opt->bool_val)
-        fprintf(f, "CONFIG_%s=y\n", opt->name);
+static void write_tristate(FILE *f, const option_t *opt) {
+    if (opt->tri != TRI_N)
+        fprintf(f, "CONFIG_%s=%s\n", opt->name, tristate_name(opt->tri));
     else
         fprintf(f, "# CONFIG_%s is not set\n", opt->name);
 }
@@ -310,20 +845,182 @@ static void write_string(FILE *f, const option_t *opt) {
     fprintf(f, "CONFIG_%s=\"%s\"\n", opt->name, opt->str_val ? opt->str_val : "");
 }
 
-int save_config(const kconfig_t *kc, const char *config_path, const char *auto_conf_path, const char *auto_header_path, const char *config_mk_path) {
+static void write_symbol(const option_t *opt, FILE *cfg, FILE *auto_conf, FILE *auto_hdr, FILE *cfg_mk) {
+    if (opt->type == OPT_STRING) {
+        /* like Linux, a string whose dependencies are unmet is left out */
+        if (!opt->visible)
+            return;
+        write_string(cfg, opt);
+        write_string(auto_conf, opt);
+        fprintf(cfg_mk, "CONFIG_%s=\"%s\"\n", opt->name, opt->str_val ? opt->str_val : "");
+        fprintf(auto_hdr, "#define CONFIG_%s \"%s\"\n", opt->name, opt->str_val ? opt->str_val : "");
+        return;
+    }
+    if (opt->type == OPT_INT || opt->type == OPT_HEX) {
+        /* numbers go out bare, so C sees an integer constant */
+        if (!opt->visible)
+            return;
+        fprintf(cfg, "CONFIG_%s=%s\n", opt->name, opt->str_val);
+        fprintf(auto_conf, "CONFIG_%s=%s\n", opt->name, opt->str_val);
+        fprintf(cfg_mk, "CONFIG_%s=%s\n", opt->name, opt->str_val);
+        fprintf(auto_hdr, "#define CONFIG_%s %s\n", opt->name, opt->str_val);
+        return;
+    }
+    write_tristate(cfg, opt);
+    write_tristate(auto_conf, opt);
+    if (opt->tri == TRI_M)
+        fprintf(cfg_mk, "CONFIG_%s=m\n", opt->name);
+    else
+        fprintf(cfg_mk, "CONFIG_%s=%d\n", opt->name, opt->tri == TRI_Y ? 1 : 0);
+    if (opt->tri == TRI_Y)
+        fprintf(auto_hdr, "#define CONFIG_%s 1\n", opt->name);
+    else if (opt->tri == TRI_M)
+        fprintf(auto_hdr, "#define CONFIG_%s_MODULE 1\n", opt->name);
+}
+
+static FILE *open_tmp(const char *path, char *tmp, size_t len) {
+    snprintf(tmp, len, "%s.tmp", path);
+    return fopen(tmp, "w");
+}
+
+static bool same_contents(const char *a, const char *b) {
+    FILE *fa = fopen(a, "r");
+    FILE *fb = fopen(b, "r");
+    bool same = fa && fb;
+    while (same) {
+        int ca = fgetc(fa);
+        int cb = fgetc(fb);
+        if (ca != cb)
+            same = false;
+        else if (ca == EOF)
+            break;
+    }
+    if (fa) fclose(fa);
+    if (fb) fclose(fb);
+    return same;
+}
+
+/* Outputs are written beside their target and only moved over it when
+   they differ, so an unchanged file keeps its mtime and make leaves
+   everything that depends on it alone. */
+static int replace_if_changed(const char *tmp, const char *path) {
+    if (same_contents(tmp, path))
+        return remove(tmp);
+    return rename(tmp, path);
+}
+
+/* value as auto.conf spells it (strings without quotes), NULL if absent */
+static const char *symbol_value(const option_t *opt) {
+    if (option_has_text(opt))
+        return opt->visible ? (opt->str_val ? opt->str_val : "") : NULL;
+    return tristate_name(opt->tri);
+}
+
+static void stamp_path(const char *dir, const char *name, char *out, size_t len) {
+    size_t n = (size_t)snprintf(out, len, "%s/", dir);
+    for (const char *p = name; *p && n + 3 < len; ++p)
+        out[n++] = (char)tolower((unsigned char)*p);
+    snprintf(out + n, len - n, ".h");
+}
+
+static void touch_stamp(const char *dir, const char *name) {
+    char path[512];
+    stamp_path(dir, name, path, sizeof(path));
+    FILE *f = fopen(path, "w");
+    if (f) fclose(f);
+}
+
+static bool stamp_exists(const char *dir, const char *name) {
+    char path[512];
+    struct stat st;
+    stamp_path(dir, name, path, sizeof(path));
+    return stat(path, &st) == 0;
+}
+
+static void update_stamp(const char *dir, const option_t *opt, const kconfig_t *old) {
+    const option_t *prev = find_option(old, opt->name);
+    const char *was = prev ? prev->str_val : NULL;
+    const char *now = symbol_value(opt);
+    bool same = was && now ? strcmp(was, now) == 0 : was == now;
+    if (!same || !stamp_exists(dir, opt->name))
+        touch_stamp(dir, opt->name);
+}
+
+/*
+ * Each symbol has an empty include/config/<symbol>.h whose mtime changes
+ * only when the symbol's value does. fixdep makes every object depend on
+ * the stamps of the symbols its sources mention, instead of on
+ * autoconf.h, so flipping one option rebuilds only the files that use it.
+ */
+static void update_stamps(const kconfig_t *kc, const char *auto_conf_path) {
+    char dir[512];
+    strncpy(dir, auto_conf_path, sizeof(dir));
+    dir[sizeof(dir)-1] = '\0';
+    char *slash = strrchr(dir, '/');
+    if (slash)
+        *slash = '\0';
+    else
+        strcpy(dir, ".");
+
+    /* the previous auto.conf, every value held as a string */
+    kconfig_t old = { 0 };
+    FILE *f = fopen(auto_conf_path, "r");
+    if (f) {
+        char *line = NULL;
+        size_t line_cap = 0;
+        while (getline(&line, &line_cap, f) >= 0) {
+            char *name, *val;
+            if (!parse_config_line(line, &name, &val))
+                continue;
+            bool existed;
+            option_t *opt = new_symbol(&old, name, &existed);
+            if (!existed)
+                append_option(&old.options, opt);
+            opt->type = OPT_STRING;
+            unquote(val);
+            set_string(opt, val);
+        }
+        free(line);
+        fclose(f);
+    }
+
+    for (int i = 0; i < kc->options.count; ++i) {
+        const option_t *opt = kc->options.items[i];
+        if (opt->type == OPT_CHOICE) {
+            for (int j = 0; j < opt->children.count; ++j)
+                update_stamp(dir, opt->children.items[j], &old);
+        } else {
+            update_stamp(dir, opt, &old);
+        }
+    }
+    /* a symbol that left the Kconfig changed too, from something to nothing */
+    for (int i = 0; i < old.options.count; ++i) {
+        if (!find_option(kc, old.options.items[i]->name))
+            touch_stamp(dir, old.options.items[i]->name);
+    }
+    free_kconfig(&old);
+}
+
+int save_config(kconfig_t *kc, const char *config_path, const char *auto_conf_path, const char *auto_header_path, const char *config_mk_path) {
+    calc_values(kc);
     ensure_dir(auto_conf_path);
     ensure_dir(auto_header_path);
     ensure_dir(config_mk_path);
 
-    FILE *cfg = fopen(config_path, "w");
-    FILE *auto_conf = fopen(auto_conf_path, "w");
-    FILE *auto_hdr = fopen(auto_header_path, "w");
-    FILE *cfg_mk = fopen(config_mk_path, "w");
+    char cfg_tmp[512], auto_conf_tmp[512], auto_hdr_tmp[512], cfg_mk_tmp[512];
+    FILE *cfg = open_tmp(config_path, cfg_tmp, sizeof(cfg_tmp));
+    FILE *auto_conf = open_tmp(auto_conf_path, auto_conf_tmp, sizeof(auto_conf_tmp));
+    FILE *auto_hdr = open_tmp(auto_header_path, auto_hdr_tmp, sizeof(auto_hdr_tmp));
+    FILE *cfg_mk = open_tmp(config_mk_path, cfg_mk_tmp, sizeof(cfg_mk_tmp));
     if (!cfg || !auto_conf || !auto_hdr || !cfg_mk) {
         if (cfg) fclose(cfg);
         if (auto_conf) fclose(auto_conf);
         if (auto_hdr) fclose(auto_hdr);
         if (cfg_mk) fclose(cfg_mk);
+        remove(cfg_tmp);
+        remove(auto_conf_tmp);
+        remove(auto_hdr_tmp);
+        remove(cfg_mk_tmp);
         return -1;
     }
     fprintf(auto_hdr, "/* Auto-generated configuration header */\n");
@@ -331,26 +1028,11 @@ int save_config(const kconfig_t *kc, const char *config_path, const char *auto_c
 
     for (int i = 0; i < kc->options.count; ++i) {
         const option_t *opt = kc->options.items[i];
-        if (opt->type == OPT_BOOL) {
-            write_bool(cfg, opt);
-            write_bool(auto_conf, opt);
-            fprintf(cfg_mk, "CONFIG_%s=%d\n", opt->name, opt->bool_val ? 1 : 0);
-            if (opt->bool_val)
-                fprintf(auto_hdr, "#define CONFIG_%s 1\n", opt->name);
-        } else if (opt->type == OPT_STRING) {
-            write_string(cfg, opt);
-            write_string(auto_conf, opt);
-            fprintf(cfg_mk, "CONFIG_%s=\"%s\"\n", opt->name, opt->str_val ? opt->str_val : "");
-            fprintf(auto_hdr, "#define CONFIG_%s \"%s\"\n", opt->name, opt->str_val ? opt->str_val : "");
-        } else if (opt->type == OPT_CHOICE) {
-            for (int j = 0; j < opt->children.count; ++j) {
-                const option_t *child = opt->children.items[j];
-                write_bool(cfg, child);
-                write_bool(auto_conf, child);
-                fprintf(cfg_mk, "CONFIG_%s=%d\n", child->name, child->bool_val ? 1 : 0);
-                if (child->bool_val)
-                    fprintf(auto_hdr, "#define CONFIG_%s 1\n", child->name);
-            }
+        if (opt->type == OPT_CHOICE) {
+            for (int j = 0; j < opt->children.count; ++j)
+                write_symbol(opt->children.items[j], cfg, auto_conf, auto_hdr, cfg_mk);
+        } else {
+            write_symbol(opt, cfg, auto_conf, auto_hdr, cfg_mk);
         }
     }
 
@@ -358,5 +1040,12 @@ int save_config(const kconfig_t *kc, const char *config_path, const char *auto_c
     fclose(auto_conf);
     fclose(auto_hdr);
     fclose(cfg_mk);
-    return 0;
+
+    update_stamps(kc, auto_conf_path);
+    int err = 0;
+    err |= replace_if_changed(cfg_tmp, config_path);
+    err |= replace_if_changed(auto_conf_tmp, auto_conf_path);
+    err |= replace_if_changed(auto_hdr_tmp, auto_header_path);
+    err |= replace_if_changed(cfg_mk_tmp, config_mk_path);
+    return err ? -1 : 0;
 }
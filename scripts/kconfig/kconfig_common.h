@@ -6,39 +6,92 @@
 
 typedef enum {
     OPT_BOOL,
+    OPT_TRISTATE,
     OPT_STRING,
+    OPT_INT,
+    OPT_HEX,
     OPT_CHOICE,
     OPT_CHOICE_OPT,
 } option_type;
 
+/* ordered so that min is "and" and max is "or" */
+typedef enum {
+    TRI_N,
+    TRI_M,
+    TRI_Y,
+} tristate;
+
 typedef struct option option_t;
+typedef struct expr expr_t;
 
 typedef struct {
     option_t **items;
     int count;
+    int cap;
 } option_list;
 
+/* "default <value> [if <expr>]"; the first whose condition holds applies */
+typedef struct default_value {
+    expr_t *value;          /* bool/tristate/choice defaults */
+    char *str;              /* string/int/hex defaults */
+    expr_t *cond;
+    struct default_value *next;
+} default_value;
+
+/* "select <symbol> [if <expr>]" */
+typedef struct select_entry {
+    char *name;
+    option_t *target;       /* resolved after parsing */
+    expr_t *cond;
+    struct select_entry *next;
+} select_entry;
+
+/* the other side of a select: which symbol forces this one, and when */
+struct rev_dep {
+    option_t *from;
+    expr_t *cond;
+    struct rev_dep *next;
+};
+
 struct option {
     option_type type;
     char *name;
     char *prompt;
     char *help;
-    char *def;
-    bool bool_val;
-    char *str_val;
-    option_t *parent;      /* for choice options */
-    option_list children;  /* for choice parent */
+    default_value *defaults;
+    expr_t *depends;        /* NULL when always visible */
+    select_entry *selects;
+    struct rev_dep *selected_by;
+    tristate visible;       /* computed value of depends */
+    tristate tri;           /* computed bool/tristate value */
+    tristate user_tri;      /* value from .config or the menu */
+    bool user_set;
+    char *str_val;          /* heap-owned, edited by the frontends */
+    option_t *parent;       /* for choice options */
+    option_list children;   /* for choice parent */
 };
 
+typedef struct arena_block arena_block;
+
 typedef struct {
-    option_list options;
-    char *default_choice; /* name of default option for the current choice during parse */
+    option_list options;    /* top level, in Kconfig order */
+    option_t **slots;       /* symbol table, open addressing */
+    size_t slot_count;
+    size_t symbol_count;
+    arena_block *arena;     /* options, expressions and parsed strings */
+    option_t *modules;      /* MODULES: m is only available while it is y */
 } kconfig_t;
 
 int parse_kconfig(const char *path, kconfig_t *kc, char *err_buf, size_t err_len);
 void free_kconfig(kconfig_t *kc);
+option_t *find_option(const kconfig_t *kc, const char *name);
 void apply_defaults(kconfig_t *kc);
 void load_config_values(kconfig_t *kc, const char *config_path);
-int save_config(const kconfig_t *kc, const char *config_path, const char *auto_conf_path, const char *auto_header_path, const char *config_mk_path);
+void set_user_value(option_t *opt, tristate value);
+bool option_has_text(const option_t *opt);
+bool set_user_text(option_t *opt, const char *value);
+void calc_values(kconfig_t *kc);
+bool modules_enabled(const kconfig_t *kc);
+int save_config(kconfig_t *kc, const char *config_path, const char *auto_conf_path, const char *auto_header_path, const char *config_mk_path);
 
 #endif
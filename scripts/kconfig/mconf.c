@@ -50,18 +50,33 @@ static option_t *option_at(kconfig_t *kc, int idx) {
 }
 
 static void cycle_choice(option_t *choice) {
-    if (!choice || choice->type != OPT_CHOICE || choice->children.count == 0) return;
+    if (!choice || choice->type != OPT_CHOICE || choice->children.count == 0 || !choice->visible) return;
     int current = 0;
     for (int i = 0; i < choice->children.count; ++i) {
-        if (choice->children.items[i]->bool_val) {
+        if (choice->children.items[i]->tri == TRI_Y) {
             current = i;
             break;
         }
     }
-    int next = (current + 1) % choice->children.count;
+    /* next member whose own dependencies allow it */
+    int next = current;
+    for (int step = 1; step <= choice->children.count; ++step) {
+        next = (current + step) % choice->children.count;
+        if (choice->children.items[next]->visible)
+            break;
+    }
     for (int i = 0; i < choice->children.count; ++i)
-        choice->children.items[i]->bool_val = false;
-    choice->children.items[next]->bool_val = true;
+        set_user_value(choice->children.items[i], i == next ? TRI_Y : TRI_N);
+}
+
+/* n -> y for bools; n -> m -> y for tristates while modules are on */
+static void toggle(kconfig_t *kc, option_t *opt) {
+    if (!opt->visible)
+        return;
+    tristate next = opt->tri == TRI_N ? TRI_Y : TRI_N;
+    if (opt->type == OPT_TRISTATE && modules_enabled(kc))
+        next = opt->tri == TRI_N ? TRI_M : opt->tri == TRI_M ? TRI_Y : TRI_N;
+    set_user_value(opt, next);
 }
 
 static void edit_string(option_t *opt, int rows) {
@@ -74,8 +89,13 @@ static void edit_string(option_t *opt, int rows) {
     getnstr(buf, sizeof(buf)-1);
     noecho();
     curs_set(0);
-    free(opt->str_val);
-    opt->str_val = strdup(buf);
+    if (!set_user_text(opt, buf)) {
+        move(rows - FOOTER_ROWS - 1, 0);
+        clrtoeol();
+        mvprintw(rows - FOOTER_ROWS - 1, 0, "\"%s\" is not a valid %s value", buf, opt->type == OPT_INT ? "int" : "hex");
+        refresh();
+        napms(1200);
+    }
 }
 
 static void draw_header(const char *config_path, int cols) {
@@ -149,7 +169,7 @@ static void format_option_label(option_t *opt, char *buf, size_t len) {
     if (opt->type == OPT_CHOICE) {
         option_t *active = NULL;
         for (int j = 0; j < opt->children.count; ++j) {
-            if (opt->children.items[j]->bool_val) {
+            if (opt->children.items[j]->tri == TRI_Y) {
                 active = opt->children.items[j];
                 break;
             }
@@ -159,7 +179,13 @@ static void format_option_label(option_t *opt, char *buf, size_t len) {
     }
 
     if (opt->type == OPT_BOOL || opt->type == OPT_CHOICE_OPT) {
-        snprintf(buf, len, "[%c] %s", opt->bool_val ? 'X' : ' ', opt->prompt ? opt->prompt : opt->name);
+        snprintf(buf, len, "[%c] %s", !opt->visible ? '-' : opt->tri ? 'X' : ' ', opt->prompt ? opt->prompt : opt->name);
+        return;
+    }
+
+    if (opt->type == OPT_TRISTATE) {
+        snprintf(buf, len, "<%c> %s", !opt->visible ? '-' : opt->tri == TRI_Y ? '*' : opt->tri == TRI_M ? 'M' : ' ',
+                 opt->prompt ? opt->prompt : opt->name);
         return;
     }
 
@@ -168,6 +194,12 @@ static void format_option_label(option_t *opt, char *buf, size_t len) {
         return;
     }
 
+    if (opt->type == OPT_INT || opt->type == OPT_HEX) {
+        snprintf(buf, len, "(%s) %s = %s", opt->type == OPT_INT ? "int" : "hex", opt->prompt ? opt->prompt : opt->name,
+                 opt->str_val ? opt->str_val : "");
+        return;
+    }
+
     snprintf(buf, len, "%s", opt->prompt ? opt->prompt : opt->name);
 }
 
@@ -199,8 +231,8 @@ static void render_menu(kconfig_t *kc, int highlight, int scroll, int rows, int
             pop_color(2);
         } else {
             short pair = 0;
-            if (opt->type == OPT_BOOL || opt->type == OPT_CHOICE_OPT)
-                pair = opt->bool_val ? 3 : 4;
+            if (opt->type == OPT_BOOL || opt->type == OPT_TRISTATE || opt->type == OPT_CHOICE_OPT)
+                pair = opt->tri ? 3 : 4;
             if (pair) push_color(pair);
             mvprintw(list_start + i, 2, "%-*.*s", cols - 2, cols - 2, label);
             if (pair) pop_color(pair);
@@ -229,6 +261,7 @@ int main(int argc, char **argv) {
 
     apply_defaults(&kc);
     load_config_values(&kc, config_path);
+    calc_values(&kc);
 
     initscr();
     keypad(stdscr, TRUE);
@@ -284,12 +317,13 @@ int main(int argc, char **argv) {
         case '\n': {
             option_t *opt = option_at(&kc, highlight);
             if (!opt) break;
-            if (opt->type == OPT_BOOL)
-                opt->bool_val = !opt->bool_val;
+            if (opt->type == OPT_BOOL || opt->type == OPT_TRISTATE)
+                toggle(&kc, opt);
             else if (opt->type == OPT_CHOICE)
                 cycle_choice(opt);
-            else if (opt->type == OPT_STRING && c == '\n')
+            else if (option_has_text(opt) && c == '\n')
                 edit_string(opt, rows);
+            calc_values(&kc);
             break;
         }
         default:
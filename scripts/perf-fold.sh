@@ -0,0 +1,67 @@
+#!/bin/sh
+# Turn the "perf-fold:" lines of a serial log into symbolized folded
+# stacks for flamegraph.pl:
+#   scripts/perf-fold.sh build/kernel.elf < build/perf.log > perf.folded
+set -e
+
+if [ $# -ne 1 ]; then
+    echo "usage: $0 kernel.elf < serial.log" >&2
+    exit 1
+fi
+
+awk -v nm="${NM:-nm} -n --defined-only $1" '
+function hex(s,    i, c, v) {
+    sub(/^0[xX]/, "", s)
+    v = 0
+    for (i = 1; i <= length(s); i++) {
+        c = index("0123456789abcdef", tolower(substr(s, i, 1)))
+        if (c == 0) {
+            break
+        }
+        v = v * 16 + c - 1
+    }
+    return v
+}
+function symbolize(a,    lo, hi, mid) {
+    lo = 1
+    hi = nsyms
+    if (hi == 0 || a < addr[1]) {
+        return sprintf("0x%x", a)
+    }
+    while (lo < hi) {
+        mid = int((lo + hi + 1) / 2)
+        if (addr[mid] <= a) {
+            lo = mid
+        } else {
+            hi = mid - 1
+        }
+    }
+    return name[lo]
+}
+BEGIN {
+    while ((nm | getline sym) > 0) {
+        split(sym, f, " ")
+        if (f[2] == "T" || f[2] == "t") {
+            addr[++nsyms] = hex(f[1])
+            name[nsyms] = f[3]
+        }
+    }
+    close(nm)
+}
+/perf-fold: / {
+    sub(/\r$/, "")
+    line = substr($0, index($0, "perf-fold: ") + 11)
+    split(line, parts, " ")
+    n = split(parts[1], frames, ";")
+    out = frames[1]
+    for (i = 2; i <= n; i++) {
+        out = out ";" symbolize(hex(frames[i]))
+    }
+    counts[out] += parts[2]
+}
+END {
+    for (stack in counts) {
+        print stack, counts[stack]
+    }
+}
+'
@@ -0,0 +1,83 @@
+/*
+ * Unpack a PGO_GENERATE profile dump (see include/gcov.h) into the .gcda
+ * files gcc -fprofile-use reads. Each record carries the absolute path
+ * the instrumented build chose, so the files land where a PGO_USE build
+ * of the same tree looks for them.
+ *
+ *   pgo2gcda < build/pgo.bin
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "gcov.h"
+
+#define MAX_NAME 4096
+
+static int read_full(void *buf, size_t len) {
+    return fread(buf, 1, len, stdin) == len;
+}
+
+/* Anything the port saw before the dump is skipped up to the magic. */
+static int find_magic(struct pgo_file_header *h) {
+    const size_t n = sizeof(h->magic);
+    char window[sizeof(h->magic)];
+    size_t have = 0;
+    int c;
+    while ((c = getchar()) != EOF) {
+        if (have == n) {
+            memmove(window, window + 1, n - 1);
+            have--;
+        }
+        window[have++] = (char)c;
+        if (have == n && memcmp(window, PGO_MAGIC, n) == 0) {
+            memcpy(h->magic, window, n);
+            return read_full((char *)h + n, sizeof(*h) - n);
+        }
+    }
+    return 0;
+}
+
+static int make_parents(char *path) {
+    for (char *p = strchr(path + 1, '/'); p; p = strchr(p + 1, '/')) {
+        *p = '\0';
+        const int failed = mkdir(path, 0755) != 0 && errno != EEXIST;
+        *p = '/';
+        if (failed) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int main(void) {
+    struct pgo_file_header h;
+    if (!find_magic(&h)) {
+        fprintf(stderr, "pgo2gcda: no profile dump on stdin\n");
+        return 1;
+    }
+    char name[MAX_NAME + 1];
+    for (uint32_t i = 0; i < h.nr_files; i++) {
+        struct pgo_record_header rh;
+        if (!read_full(&rh, sizeof(rh)) || rh.name_len == 0 || rh.name_len > MAX_NAME) {
+            fprintf(stderr, "pgo2gcda: bad record %u of %u\n", i, h.nr_files);
+            return 1;
+        }
+        char *data = malloc(rh.data_len ? rh.data_len : 1);
+        if (!data || !read_full(name, rh.name_len) || !read_full(data, rh.data_len)) {
+            fprintf(stderr, "pgo2gcda: dump truncated at record %u of %u\n", i, h.nr_files);
+            return 1;
+        }
+        name[rh.name_len] = '\0';
+        FILE *out = make_parents(name) ? fopen(name, "wb") : NULL;
+        if (!out || fwrite(data, 1, rh.data_len, out) != rh.data_len || fclose(out) != 0) {
+            fprintf(stderr, "pgo2gcda: cannot write %s: %s\n", name, strerror(errno));
+            return 1;
+        }
+        free(data);
+    }
+    fprintf(stderr, "pgo2gcda: %u profiles written\n", h.nr_files);
+    return 0;
+}
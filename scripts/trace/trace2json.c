@@ -0,0 +1,157 @@
+/*
+ * Convert a DEBUG_TRACING_SUBSYSTEM dump (see include/trace.h) into the
+ * Chrome trace event JSON understood by chrome://tracing and Perfetto.
+ *
+ *   trace2json < build/trace.bin > build/trace.json
+ */
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+
+static const char phase_char[] = { 'i', 'B', 'E' };
+
+static int read_full(void *buf, size_t len) {
+    return fread(buf, 1, len, stdin) == len;
+}
+
+/* Anything the port saw before the dump (there should be nothing, but a
+   shared serial log may precede it) is skipped up to the magic. */
+static int find_magic(struct trace_file_header *h) {
+    const size_t n = sizeof(h->magic);
+    char window[sizeof(h->magic)];
+    size_t have = 0;
+    int c;
+    while ((c = getchar()) != EOF) {
+        if (have == n) {
+            memmove(window, window + 1, n - 1);
+            have--;
+        }
+        window[have++] = (char)c;
+        if (have == n && memcmp(window, TRACE_MAGIC, n) == 0) {
+            memcpy(h->magic, window, n);
+            return read_full((char *)h + n, sizeof(*h) - n);
+        }
+    }
+    return 0;
+}
+
+static void print_string(const char *s, size_t max) {
+    putchar('"');
+    for (size_t i = 0; i < max && s[i]; i++) {
+        const unsigned char c = (unsigned char)s[i];
+        if (c == '"' || c == '\\') {
+            printf("\\%c", c);
+        } else if (c < 0x20 || c >= 0x7f) {
+            printf("\\u%04x", c);
+        } else {
+            putchar(c);
+        }
+    }
+    putchar('"');
+}
+
+int main(void) {
+    struct trace_file_header h;
+    if (!find_magic(&h)) {
+        fprintf(stderr, "trace2json: no %s header in input\n", TRACE_MAGIC);
+        return 1;
+    }
+    if (!h.nr_events || h.nr_events > 4096) {
+        fprintf(stderr, "trace2json: bad event count %" PRIu32 "\n", h.nr_events);
+        return 1;
+    }
+    struct trace_event_desc *descs = calloc(h.nr_events, sizeof(*descs));
+    if (!descs || !read_full(descs, h.nr_events * sizeof(*descs))) {
+        fprintf(stderr, "trace2json: truncated event table\n");
+        return 1;
+    }
+    struct cpu_block {
+        struct trace_cpu_header h;
+        struct trace_record *records;
+    } *cpus = calloc(h.nr_cpus ? h.nr_cpus : 1, sizeof(*cpus));
+    uint32_t nr_cpus = 0;
+    uint64_t base = UINT64_MAX;
+    int status = 0;
+
+    /* CPUs are dumped one after another, so everything is read before
+       anything is printed to find the earliest timestamp. */
+    while (cpus && nr_cpus < h.nr_cpus) {
+        struct cpu_block *b = &cpus[nr_cpus];
+        if (!read_full(&b->h, sizeof(b->h)) || b->h.count > TRACE_RECORDS_PER_CPU) {
+            fprintf(stderr, "trace2json: truncated at cpu %" PRIu32 "\n", nr_cpus);
+            status = 1;
+            break;
+        }
+        b->records = malloc((b->h.count ? b->h.count : 1) * sizeof(struct trace_record));
+        if (!b->records) {
+            break;
+        }
+        nr_cpus++;
+        for (uint32_t i = 0; i < b->h.count; i++) {
+            if (!read_full(&b->records[i], sizeof(struct trace_record))) {
+                fprintf(stderr, "trace2json: cpu%" PRIu32 " truncated after %" PRIu32 " records\n",
+                        b->h.cpu, i);
+                b->h.count = i;
+                status = 1;
+                break;
+            }
+            if (b->records[i].tsc < base) {
+                base = b->records[i].tsc;
+            }
+        }
+        if (b->h.overwritten) {
+            fprintf(stderr, "trace2json: cpu%" PRIu32 " lost %" PRIu64 " oldest records\n", b->h.cpu,
+                    b->h.overwritten);
+        }
+        if (status) {
+            break;
+        }
+    }
+
+    /* ts is in microseconds; without a calibrated TSC, report raw kilocycles */
+    const double cycles_per_us = h.tsc_khz ? (double)h.tsc_khz / 1000.0 : 1000.0;
+    printf("{\"traceEvents\":[");
+    for (uint32_t c = 0; c < nr_cpus; c++) {
+        const struct cpu_block *b = &cpus[c];
+        printf("%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%" PRIu32
+               ",\"args\":{\"name\":\"cpu%" PRIu32 "\"}}",
+               c ? "," : "", b->h.cpu, b->h.cpu);
+        for (uint32_t i = 0; i < b->h.count; i++) {
+            const struct trace_record *r = &b->records[i];
+            if (r->id >= h.nr_events) {
+                continue;
+            }
+            const struct trace_event_desc *d = &descs[r->id];
+            printf(",\n{\"name\":");
+            print_string(d->name, sizeof(d->name));
+            printf(",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":0,\"tid\":%" PRIu32,
+                   d->phase < sizeof(phase_char) ? phase_char[d->phase] : 'i',
+                   (double)(r->tsc - base) / cycles_per_us, b->h.cpu);
+            if (d->phase == TRACE_INSTANT) {
+                printf(",\"s\":\"t\"");
+            }
+            printf(",\"args\":{");
+            int comma = 0;
+            for (int a = 0; a < 3; a++) {
+                if (!d->args[a][0]) {
+                    continue;
+                }
+                printf("%s", comma ? "," : "");
+                print_string(d->args[a], sizeof(d->args[a]));
+                printf(":\"0x%" PRIx64 "\"", r->args[a]);
+                comma = 1;
+            }
+            printf("}}");
+        }
+    }
+    printf("\n],\"displayTimeUnit\":\"ns\"}\n");
+    for (uint32_t c = 0; c < nr_cpus; c++) {
+        free(cpus[c].records);
+    }
+    free(cpus);
+    free(descs);
+    return status;
+}
@@ -0,0 +1,129 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bench.h"
+#include "console.h"
+#include "spinlock.h"
+#include "string.h"
+#include "tsc.h"
+
+#define BENCH_SAMPLES 256
+#define BENCH_WARMUP 16
+#define BENCH_MAX_LOOPS (1ULL << 24)
+
+extern const struct bench __bench_start[];
+extern const struct bench __bench_end[];
+
+static uint64_t samples[BENCH_SAMPLES];
+
+/* token is "all", a suite, or suite.name */
+static bool bench_selected(const struct bench *b, const char *token, size_t len) {
+    if (len == 3 && strncmp(token, "all", 3) == 0) {
+        return true;
+    }
+    const size_t suite_len = strlen(b->suite);
+    if (len < suite_len || strncmp(token, b->suite, suite_len) != 0) {
+        return false;
+    }
+    if (len == suite_len) {
+        return true;
+    }
+    return token[suite_len] == '.' && len - suite_len - 1 == strlen(b->name) &&
+           strncmp(token + suite_len + 1, b->name, len - suite_len - 1) == 0;
+}
+
+static bool spec_selects(const char *spec, const struct bench *b) {
+    while (*spec) {
+        size_t len = 0;
+        while (spec[len] && spec[len] != ',') {
+            len++;
+        }
+        if (len && bench_selected(b, spec, len)) {
+            return true;
+        }
+        spec += spec[len] ? len + 1 : len;
+    }
+    return false;
+}
+
+static uint64_t time_loops(const struct bench *b, uint64_t loops) {
+    const uint64_t start = tsc_read();
+    b->fn(loops);
+    return tsc_read() - start;
+}
+
+static void sort_samples(void) {
+    for (size_t i = 1; i < BENCH_SAMPLES; i++) {
+        const uint64_t v = samples[i];
+        size_t j = i;
+        while (j && samples[j - 1] > v) {
+            samples[j] = samples[j - 1];
+            j--;
+        }
+        samples[j] = v;
+    }
+}
+
+/* picoseconds keep sub-nanosecond operations apart without fractions */
+static uint64_t ps_per_op(uint64_t cycles, uint64_t loops, uint64_t khz) {
+    return cycles * 1000000000ULL / khz / loops;
+}
+
+static void bench_one(const struct bench *b, uint64_t khz) {
+    const uint64_t target = khz / 100 ? khz / 100 : 1000;
+    uint64_t loops = 1;
+    while (loops < BENCH_MAX_LOOPS && time_loops(b, loops) < target) {
+        loops *= 2;
+    }
+    for (int i = 0; i < BENCH_WARMUP; i++) {
+        time_loops(b, loops);
+    }
+    for (size_t i = 0; i < BENCH_SAMPLES; i++) {
+        samples[i] = time_loops(b, loops);
+    }
+    sort_samples();
+    kprint("bench: %s.%s loops %lu min %lu median %lu p99 %lu ps\n", b->suite, b->name, loops,
+           ps_per_op(samples[0], loops, khz), ps_per_op(samples[BENCH_SAMPLES / 2], loops, khz),
+           ps_per_op(samples[BENCH_SAMPLES * 99 / 100], loops, khz));
+}
+
+uint32_t bench_run(const char *spec) {
+    const uint64_t khz = tsc_khz();
+    if (!khz) {
+        kprint("bench: TSC not calibrated, nothing measured\n");
+        return 0;
+    }
+    kprint("bench: tsc_khz %lu\n", khz);
+    uint32_t ran = 0;
+    for (const struct bench *b = __bench_start; b < __bench_end; b++) {
+        if (spec_selects(spec, b)) {
+            bench_one(b, khz);
+            ran++;
+        }
+    }
+    kprint("bench: done %u\n", ran);
+    return ran;
+}
+
+#ifdef CONFIG_MICROBENCH
+/* Floors for the rest: what a sample costs before any work is done. */
+static void bench_tsc_read(uint64_t loops) {
+    for (uint64_t i = 0; i < loops; i++) {
+        const uint64_t t = tsc_read();
+        bench_clobber(&t);
+    }
+}
+
+BENCH(core, tsc_read, bench_tsc_read);
+
+static void bench_spin_lock(uint64_t loops) {
+    static spinlock_t lock = SPINLOCK_INIT;
+    for (uint64_t i = 0; i < loops; i++) {
+        spin_lock(&lock);
+        spin_unlock(&lock);
+    }
+}
+
+BENCH(core, spin_lock, bench_spin_lock);
+#endif
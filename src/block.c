@@ -0,0 +1,141 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "string.h"
+
+#include "block.h"
+#include "console.h"
+#include "log.h"
+#include "memory.h"
+#include "paging.h"
+#include "spinlock.h"
+#include "trace.h"
+
+static struct block_device *devices[BLOCK_MAX_DEVICES];
+static size_t device_count = 0;
+static spinlock_t devices_lock = SPINLOCK_INIT;
+
+static bool bdev_transfer(struct inode *inode, uint64_t index, void *const *pages, size_t count, bool write) {
+    struct block_device *dev = (struct block_device *)inode->private;
+    struct block_vec vecs[64];
+    const uint64_t sectors_per_page = PAGE_SIZE / dev->sector_size;
+    uint64_t pos = index * PAGE_SIZE;
+    size_t done = 0;
+
+    while (done < count) {
+        size_t n = 0;
+        uint64_t first_sector = (pos / PAGE_SIZE) * sectors_per_page;
+        while (done + n < count && n < sizeof(vecs) / sizeof(vecs[0]) && pos < inode->size) {
+            uint64_t len = inode->size - pos;
+            vecs[n].buf = pages[done + n];
+            vecs[n].len = (uint32_t)(len < PAGE_SIZE ? len : PAGE_SIZE);
+            pos += PAGE_SIZE;
+            n++;
+        }
+        if (n == 0) {
+            break;
+        }
+        if (!block_rw(dev, first_sector, vecs, n, write)) {
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+static bool bdev_readpages(struct inode *inode, uint64_t index, void *const *pages, size_t count) {
+    return bdev_transfer(inode, index, pages, count, false);
+}
+
+static bool bdev_writepages(struct inode *inode, uint64_t index, void *const *pages, size_t count) {
+    return bdev_transfer(inode, index, pages, count, true);
+}
+
+static const struct address_space_ops bdev_aops = {
+    .readpages = bdev_readpages,
+    .writepages = bdev_writepages,
+};
+
+bool block_register(struct block_device *dev) {
+    if (!dev || !dev->sector_size) {
+        return false;
+    }
+    if (!dev->max_vecs) {
+        dev->max_vecs = 1;
+    }
+    memset(&dev->inode, 0, sizeof(dev->inode));
+    dev->inode.size = dev->sectors * dev->sector_size;
+    dev->inode.a_ops = &bdev_aops;
+    dev->inode.private = dev;
+
+    spin_lock(&devices_lock);
+    const bool full = device_count >= BLOCK_MAX_DEVICES;
+    if (!full) {
+        devices[device_count++] = dev;
+    }
+    spin_unlock(&devices_lock);
+    if (full) {
+        return false;
+    }
+    pr_info("block: %s %lu sectors of %u bytes\n", dev->name, dev->sectors, dev->sector_size);
+    return true;
+}
+
+struct block_device *block_find(const char *name) {
+    for (size_t i = 0; i < device_count; i++) {
+        if (strcmp(devices[i]->name, name) == 0) {
+            return devices[i];
+        }
+    }
+    return 0;
+}
+
+struct block_device *block_first(void) {
+    return device_count ? devices[0] : 0;
+}
+
+struct block_device *block_device_at(size_t index) {
+    return index < device_count ? devices[index] : 0;
+}
+
+/* Split into chunks the driver can take in one request; everything else
+   (merging, readahead sizing) happens above this layer. */
+bool block_rw(struct block_device *dev, uint64_t sector, const struct block_vec *vecs, size_t count, bool write) {
+    while (count) {
+        size_t n = count < dev->max_vecs ? count : dev->max_vecs;
+        uint64_t bytes = 0;
+        for (size_t i = 0; i < n; i++) {
+            bytes += vecs[i].len;
+        }
+        if (sector + bytes / dev->sector_size > dev->sectors) {
+            return false;
+        }
+        TRACE(block_rq_issue, sector, bytes, write);
+        const bool ok = dev->ops->submit(dev, sector, vecs, n, write);
+        TRACE(block_rq_complete, sector, bytes, ok);
+        if (!ok) {
+            return false;
+        }
+        if (write) {
+            dev->write_requests++;
+            dev->write_bytes += bytes;
+        } else {
+            dev->read_requests++;
+            dev->read_bytes += bytes;
+        }
+        sector += bytes / dev->sector_size;
+        vecs += n;
+        count -= n;
+    }
+    return true;
+}
+
+bool block_read(struct block_device *dev, uint64_t sector, void *buf, uint32_t len) {
+    struct block_vec vec = { buf, len };
+    return block_rw(dev, sector, &vec, 1, false);
+}
+
+void block_log_stats(const struct block_device *dev) {
+    kprint("block: %s reads %lu (%lu bytes) writes %lu (%lu bytes)\n", dev->name, dev->read_requests,
+           dev->read_bytes, dev->write_requests, dev->write_bytes);
+}
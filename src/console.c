@@ -2,44 +2,24 @@
 #include <stdint.h>
 #include <generated/autoconf.h>
 #include "console.h"
+#include "format.h"
 #include "memory.h"
+#include "module.h"
 #include "serial.h"
+#include "spinlock.h"
+#include "string.h"
 
-static volatile uint16_t *vga = (uint16_t *)0xB8000;
-static uint16_t vga_row = 0;
-static uint16_t vga_col = 0;
-static uint16_t vga_color = 0x0700;
-static bool serial_enabled = false;
-static const struct stivale2_framebuffer_tag *framebuffer = 0;
+#define KPRINT_BUF 256
 
-static uint64_t parse_hex(const char *str, uint64_t fallback) {
-    if (!str || !*str) {
-        return fallback;
-    }
+/* one message at a time, so lines from different CPUs do not interleave */
+static spinlock_t console_lock = SPINLOCK_INIT;
 
-    uint64_t value = 0;
-    const char *p = str;
-    if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
-        p += 2;
-    }
+#ifdef CONFIG_VGA_CONSOLE
+#define VGA_ATTR ((uint16_t)(CONFIG_VGA_COLOR & 0xFFFF))
 
-    while (*p) {
-        char c = *p++;
-        uint8_t digit;
-        if (c >= '0' && c <= '9') {
-            digit = (uint8_t)(c - '0');
-        } else if (c >= 'a' && c <= 'f') {
-            digit = (uint8_t)(10 + c - 'a');
-        } else if (c >= 'A' && c <= 'F') {
-            digit = (uint8_t)(10 + c - 'A');
-        } else {
-            return fallback;
-        }
-        value = (value << 4) | digit;
-    }
-
-    return value;
-}
+static volatile uint16_t *vga = (uint16_t *)0xB8000;
+static uint16_t vga_row = 0;
+static uint16_t vga_col = 0;
 
 static void vga_newline(void) {
     vga_col = 0;
@@ -54,147 +34,165 @@ static void vga_putc(char c) {
         return;
     }
     const size_t idx = vga_row * 80 + vga_col;
-    vga[idx] = (uint16_t)c | vga_color;
+    vga[idx] = (uint16_t)(uint8_t)c | VGA_ATTR;
     if (++vga_col >= 80) {
         vga_newline();
     }
 }
 
-static void framebuffer_clear(void) {
-    if (!framebuffer) {
-        return;
-    }
-    uint32_t width = framebuffer->framebuffer_width;
-    uint32_t height = framebuffer->framebuffer_height;
-    uint32_t pitch = framebuffer->framebuffer_pitch;
-    uint8_t bpp = framebuffer->framebuffer_bpp;
-
-    if (bpp != 32) {
-        return; /* keep code simple */
+static void vga_write(const char *s, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        vga_putc(s[i]);
     }
+}
+#endif
 
-    uint32_t color = (uint32_t)parse_hex(CONFIG_FRAMEBUFFER_BG_COLOR, 0x000000);
-    uint32_t *fb = (uint32_t *)(uintptr_t)framebuffer->framebuffer_addr;
-    for (uint32_t y = 0; y < height; y++) {
-        uint32_t *row = (uint32_t *)((uintptr_t)fb + y * pitch);
-        for (uint32_t x = 0; x < width; x++) {
-            row[x] = color;
-        }
-    }
+#ifdef CONFIG_ENABLE_SERIAL_DEBUG
+/* a missing UART reads back as always ready, so writes just vanish */
+static void serial_sink_init(struct stivale2_struct *boot_info) {
+    (void)boot_info;
+    serial_init();
 }
+#endif
 
-static void framebuffer_test_pattern(void) {
-    if (!framebuffer) {
-        return;
-    }
+#ifdef CONFIG_FRAMEBUFFER_ENABLE
+static uint32_t fb_channel(uint32_t value, uint8_t size, uint8_t shift) {
+    return size ? (value >> (8 - size)) << shift : 0;
+}
 
-    uint32_t width = framebuffer->framebuffer_width;
-    uint32_t height = framebuffer->framebuffer_height;
-    uint32_t pitch = framebuffer->framebuffer_pitch;
-    uint8_t bpp = framebuffer->framebuffer_bpp;
+/* 8-bit r/g/b into the framebuffer's own channel layout */
+static uint32_t fb_pixel(const struct stivale2_framebuffer_tag *fb, uint32_t r, uint32_t g, uint32_t b) {
+    return fb_channel(r & 0xFF, fb->red_mask_size, fb->red_mask_shift) |
+           fb_channel(g & 0xFF, fb->green_mask_size, fb->green_mask_shift) |
+           fb_channel(b & 0xFF, fb->blue_mask_size, fb->blue_mask_shift);
+}
 
-    if (bpp != 32) {
-        return;
+static inline __attribute__((always_inline)) void fb_store(uint8_t *p, uint32_t pixel, const uint32_t bytes) {
+    if (bytes == 4) {
+        *(uint32_t *)p = pixel;
+    } else if (bytes == 2) {
+        *(uint16_t *)p = (uint16_t)pixel;
+    } else {
+        p[0] = (uint8_t)pixel;
+        p[1] = (uint8_t)(pixel >> 8);
+        p[2] = (uint8_t)(pixel >> 16);
     }
+}
 
-    uint32_t *fb = (uint32_t *)(uintptr_t)framebuffer->framebuffer_addr;
-    for (uint32_t y = 0; y < height; y++) {
-        uint32_t *row = (uint32_t *)((uintptr_t)fb + y * pitch);
+/* bytes is a constant at each call, so every pixel format gets its own
+   loop with the store folded in */
+static inline __attribute__((always_inline)) void fb_paint(const struct stivale2_framebuffer_tag *fb, const uint32_t bytes) {
+    const uint32_t width = fb->framebuffer_width;
+    const uint32_t height = fb->framebuffer_height;
+    uint8_t *row = (uint8_t *)(uintptr_t)fb->framebuffer_addr;
+#ifndef CONFIG_FRAMEBUFFER_TEST_PATTERN
+    const uint32_t bg = CONFIG_FRAMEBUFFER_BG_COLOR;
+    const uint32_t pixel = fb_pixel(fb, bg >> 16, bg >> 8, bg);
+#endif
+    for (uint32_t y = 0; y < height; y++, row += fb->framebuffer_pitch) {
         for (uint32_t x = 0; x < width; x++) {
-            uint8_t r = (uint8_t)((x * 255) / (width ? width : 1));
-            uint8_t g = (uint8_t)((y * 255) / (height ? height : 1));
-            uint8_t b = (uint8_t)(((x ^ y) & 0xFF));
-            row[x] = ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
+#ifdef CONFIG_FRAMEBUFFER_TEST_PATTERN
+            const uint32_t pixel = fb_pixel(fb, (x * 255) / width, (y * 255) / height, x ^ y);
+#endif
+            fb_store(row + x * bytes, pixel, bytes);
         }
     }
 }
 
-static const struct stivale2_tag *find_tag(struct stivale2_struct *info, uint64_t id) {
-    uint64_t current = info ? info->tags : 0;
-    while (current) {
-        const struct stivale2_tag *tag = (const struct stivale2_tag *)current;
-        if (tag->identifier == id) {
-            return tag;
-        }
-        current = tag->next;
+/* No text renderer yet: the framebuffer is painted once and left alone. */
+static void framebuffer_init(struct stivale2_struct *boot_info) {
+    const uint64_t fb_id = 0x506461d2950408faULL;
+    const struct stivale2_framebuffer_tag *fb =
+        (const struct stivale2_framebuffer_tag *)memory_find_tag(boot_info, fb_id);
+    if (!fb || !fb->framebuffer_width || !fb->framebuffer_height) {
+        return;
+    }
+    switch (fb->framebuffer_bpp) {
+    case 16:
+        fb_paint(fb, 2);
+        break;
+    case 24:
+        fb_paint(fb, 3);
+        break;
+    case 32:
+        fb_paint(fb, 4);
+        break;
     }
-    return 0;
 }
+#endif
 
-void console_init(struct stivale2_struct *boot_info) {
-    const uint64_t fb_id = 0x506461d2950408faULL;
-    framebuffer = (const struct stivale2_framebuffer_tag *)find_tag(boot_info, fb_id);
-
-    vga_color = (uint16_t)parse_hex(CONFIG_VGA_COLOR, 0x0700) & 0xFFFF;
-
-#ifdef CONFIG_FRAMEBUFFER_ENABLE
-    framebuffer_clear();
-#ifdef CONFIG_FRAMEBUFFER_TEST_PATTERN
-    framebuffer_test_pattern();
+/*
+ * Output backends, fixed at build time. A disabled one is not in the
+ * table, and the loops over it are unrolled so the constant entries
+ * fold into direct calls to the sinks that remain.
+ */
+struct console_sink {
+    void (*init)(struct stivale2_struct *boot_info);
+    void (*write)(const char *s, size_t len);
+};
+
+static const struct console_sink console_sinks[] = {
+#ifdef CONFIG_VGA_CONSOLE
+    { 0, vga_write },
 #endif
+#ifdef CONFIG_FRAMEBUFFER_ENABLE
+    { framebuffer_init, 0 },
 #endif
-
 #ifdef CONFIG_ENABLE_SERIAL_DEBUG
-    serial_enabled = serial_init();
+    { serial_sink_init, serial_write_chars },
 #endif
+};
+
+#define NR_CONSOLE_SINKS (sizeof(console_sinks) / sizeof(console_sinks[0]))
+
+void console_init(struct stivale2_struct *boot_info) {
+#pragma GCC unroll 8
+    for (const struct console_sink *sink = console_sinks; sink < console_sinks + NR_CONSOLE_SINKS; sink++) {
+        if (sink->init) {
+            sink->init(boot_info);
+        }
+    }
 }
 
-void console_putc(char c) {
-    vga_putc(c);
-#ifdef CONFIG_ENABLE_SERIAL_DEBUG
-    if (serial_enabled) {
-        serial_write(c);
+static void put_chars(const char *s, size_t len) {
+#pragma GCC unroll 8
+    for (const struct console_sink *sink = console_sinks; sink < console_sinks + NR_CONSOLE_SINKS; sink++) {
+        if (sink->write) {
+            sink->write(s, len);
+        }
     }
-#endif
+}
+
+void console_putc(char c) {
+    const uint64_t flags = spin_lock_irqsave(&console_lock);
+    put_chars(&c, 1);
+    spin_unlock_irqrestore(&console_lock, flags);
 }
 
 void console_write(const char *s) {
-    while (*s) {
-        console_putc(*s++);
-    }
+    const uint64_t flags = spin_lock_irqsave(&console_lock);
+    put_chars(s, strlen(s));
+    spin_unlock_irqrestore(&console_lock, flags);
 }
 
-static void kprint_hex(uint64_t value) {
-    char buf[17];
-    buf[16] = '\0';
-    for (int i = 15; i >= 0; i--) {
-        uint8_t nibble = (uint8_t)(value & 0xF);
-        buf[i] = (nibble < 10) ? ('0' + nibble) : ('A' + nibble - 10);
-        value >>= 4;
-    }
-    console_write("0x");
-    console_write(buf);
+static void flush_to_console(struct format_buf *b) {
+    const uint64_t flags = spin_lock_irqsave(&console_lock);
+    put_chars(b->data, b->len);
+    spin_unlock_irqrestore(&console_lock, flags);
+    b->len = 0;
 }
 
+/* Format on the stack without the lock, then hand the sinks the whole
+   message at once; only messages over KPRINT_BUF go out in pieces. */
 void kprint(const char *fmt, ...) {
+    char buf[KPRINT_BUF];
+    struct format_buf b = { buf, sizeof(buf), 0, flush_to_console };
     va_list args;
     va_start(args, fmt);
-
-    for (const char *p = fmt; *p; p++) {
-        if (*p != '%') {
-            console_putc(*p);
-            continue;
-        }
-        p++;
-        switch (*p) {
-        case 's': {
-            const char *s = va_arg(args, const char *);
-            console_write(s ? s : "(null)");
-            break;
-        }
-        case 'x': {
-            uint64_t v = va_arg(args, uint64_t);
-            kprint_hex(v);
-            break;
-        }
-        case '%':
-            console_putc('%');
-            break;
-        default:
-            console_putc('?');
-            break;
-        }
-    }
-
+    vformat(&b, fmt, args);
     va_end(args);
+    if (b.len) {
+        flush_to_console(&b);
+    }
 }
+EXPORT_SYMBOL(kprint);
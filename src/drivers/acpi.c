@@ -0,0 +1,263 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "acpi.h"
+#include "console.h"
+#include "lapic.h"
+#include "log.h"
+#include "memory.h"
+#include "paging.h"
+#include "tsc.h"
+
+/* Open-addressed signature -> table map, filled once at boot; a machine
+   has a few dozen tables at most. */
+#define ACPI_INDEX_SLOTS 64
+#define ACPI_INDEX_SHIFT 6
+#define ACPI_TABLE_MAX_LEN (16u << 20)
+
+/* FADT fields locating the DSDT, which no root table lists */
+#define ACPI_FADT_DSDT   40
+#define ACPI_FADT_X_DSDT 140
+
+struct acpi_index_entry {
+    uint32_t signature;         /* 0: empty slot */
+    uint32_t instances;
+    const struct acpi_sdt_header *table;
+};
+
+_Static_assert(ACPI_INDEX_SLOTS == 1 << ACPI_INDEX_SHIFT, "index_slot() shift");
+
+static struct acpi_index_entry table_index[ACPI_INDEX_SLOTS];
+static uint32_t indexed;
+
+static uint8_t checksum(const void *data, size_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+    uint8_t sum = 0;
+    for (size_t i = 0; i < len; i++) {
+        sum = (uint8_t)(sum + p[i]);
+    }
+    return sum;
+}
+
+static const struct acpi_rsdp *scan_for_rsdp(uint64_t start, uint64_t end) {
+    for (uint64_t addr = start; addr + 20 <= end; addr += 16) {
+        const struct acpi_rsdp *candidate = (const struct acpi_rsdp *)(uintptr_t)addr;
+        if (memcmp(candidate->signature, "RSD PTR ", 8) == 0 && checksum(candidate, 20) == 0) {
+            return candidate;
+        }
+    }
+    return 0;
+}
+
+/* Legacy BIOS locations: first KiB of the EBDA, then the E0000-FFFFF ROM area. */
+static const struct acpi_rsdp *find_rsdp_legacy(void) {
+    uintptr_t bda_ebda = 0x40E;
+    __asm__ ("" : "+r"(bda_ebda)); /* hide the low constant address from -Warray-bounds */
+    uint64_t ebda = (uint64_t)(*(volatile uint16_t *)bda_ebda) << 4;
+    const struct acpi_rsdp *found = 0;
+    if (ebda >= 0x80000 && ebda < 0xA0000) {
+        found = scan_for_rsdp(ebda, ebda + 1024);
+    }
+    if (!found) {
+        found = scan_for_rsdp(0xE0000, 0x100000);
+    }
+    return found;
+}
+
+static uint32_t signature_key(const char *signature) {
+    uint32_t key;
+    memcpy(&key, signature, 4);
+    return key;
+}
+
+static uint32_t index_slot(uint32_t key) {
+    return (key * 0x9E3779B1u) >> (32 - ACPI_INDEX_SHIFT);
+}
+
+/* Map a table and checksum it; 0 when it cannot be mapped at all. */
+static const struct acpi_sdt_header *map_table(uint64_t phys, bool *valid) {
+    const struct acpi_sdt_header *hdr = paging_map_phys(phys, sizeof(*hdr));
+    *valid = false;
+    if (!hdr || hdr->length < sizeof(*hdr) || hdr->length > ACPI_TABLE_MAX_LEN) {
+        return 0;
+    }
+    hdr = paging_map_phys(phys, hdr->length);
+    *valid = hdr && checksum(hdr, hdr->length) == 0;
+    return hdr;
+}
+
+static void index_table(uint64_t phys) {
+    bool valid;
+    const struct acpi_sdt_header *hdr = map_table(phys, &valid);
+    if (!hdr) {
+        pr_warn("ACPI: unmappable table at %#lx\n", phys);
+        return;
+    }
+    pr_info("ACPI: %.4s %#010lx %6u v%02u %.6s %.8s checksum %s\n", hdr->signature, phys, hdr->length,
+            hdr->revision, hdr->oem_id, hdr->oem_table_id, valid ? "ok" : "BAD, ignored");
+    if (!valid) {
+        return;
+    }
+    const uint32_t key = signature_key(hdr->signature);
+    uint32_t slot = index_slot(key);
+    for (uint32_t probes = 0; probes < ACPI_INDEX_SLOTS; probes++) {
+        struct acpi_index_entry *e = &table_index[slot];
+        if (e->signature == key) {
+            e->instances++;     /* SSDTs come in numbers; the first one wins */
+            return;
+        }
+        if (!e->signature) {
+            e->signature = key;
+            e->instances = 1;
+            e->table = hdr;
+            indexed++;
+            return;
+        }
+        slot = (slot + 1) & (ACPI_INDEX_SLOTS - 1);
+    }
+    pr_warn("ACPI: table index full, %.4s dropped\n", hdr->signature);
+}
+
+static void index_dsdt(const struct acpi_sdt_header *fadt) {
+    uint64_t dsdt = 0;
+    if (fadt->length >= ACPI_FADT_X_DSDT + 8) {
+        memcpy(&dsdt, (const uint8_t *)fadt + ACPI_FADT_X_DSDT, 8);
+    }
+    if (!dsdt && fadt->length >= ACPI_FADT_DSDT + 4) {
+        memcpy(&dsdt, (const uint8_t *)fadt + ACPI_FADT_DSDT, 4);
+    }
+    if (dsdt) {
+        index_table(dsdt);
+    }
+}
+
+/* The RSDT's checksum is over the first 20 bytes, the XSDT's fields are
+   covered by the extended one. */
+static bool rsdp_valid(const struct acpi_rsdp *r, bool *xsdt_ok) {
+    *xsdt_ok = r->revision >= 2 && r->length >= sizeof(*r) && r->length <= 4096 && r->xsdt_address &&
+               checksum(r, r->length) == 0;
+    return checksum(r, 20) == 0;
+}
+
+static void log_summary(void) {
+    const struct acpi_hpet *hpet = (const struct acpi_hpet *)acpi_find_table("HPET");
+    if (hpet && hpet->header.length >= sizeof(*hpet)) {
+        pr_info("ACPI: HPET %u at %#lx, %u comparators\n", hpet->hpet_number, hpet->base.address,
+                ((hpet->event_timer_block_id >> 8) & 0x1F) + 1);
+    }
+    const struct acpi_srat *srat = (const struct acpi_srat *)acpi_find_table("SRAT");
+    if (srat) {
+        uint32_t cpus = 0, ranges = 0;
+        const uint8_t *p = srat->entries;
+        const uint8_t *end = (const uint8_t *)srat + srat->header.length;
+        while (p + 2 <= end && p[1] >= 2 && p + p[1] <= end) {
+            if (p[0] == ACPI_SRAT_CPU_AFFINITY || p[0] == ACPI_SRAT_X2APIC_AFFINITY) {
+                cpus++;
+            } else if (p[0] == ACPI_SRAT_MEMORY_AFFINITY) {
+                ranges++;
+            }
+            p += p[1];
+        }
+        pr_info("ACPI: SRAT %u CPU and %u memory affinity entries\n", cpus, ranges);
+    }
+}
+
+void acpi_init(struct stivale2_struct *boot_info) {
+    const uint64_t t0 = tsc_read();
+    const struct stivale2_struct_tag_rsdp *tag =
+        (const struct stivale2_struct_tag_rsdp *)memory_find_tag(boot_info, STIVALE2_STRUCT_TAG_RSDP_ID);
+
+    const struct acpi_rsdp *rsdp = tag ? (const struct acpi_rsdp *)(uintptr_t)tag->rsdp : find_rsdp_legacy();
+    bool xsdt_ok = false;
+    if (!rsdp || !rsdp_valid(rsdp, &xsdt_ok)) {
+        pr_warn("ACPI: no valid RSDP found\n");
+        return;
+    }
+    pr_info("ACPI: RSDP rev %u %.6s from %s\n", rsdp->revision, rsdp->oem_id, tag ? "Stivale2" : "BIOS scan");
+
+    bool valid = false;
+    const struct acpi_sdt_header *root = 0;
+    size_t entry_size = 8;
+    if (xsdt_ok) {
+        root = map_table(rsdp->xsdt_address, &valid);
+    }
+    if (!valid && rsdp->rsdt_address) {
+        root = map_table(rsdp->rsdt_address, &valid);
+        entry_size = 4;
+    }
+    if (!root || !valid) {
+        pr_err("ACPI: no root table with a valid checksum\n");
+        return;
+    }
+
+    const size_t count = (root->length - sizeof(*root)) / entry_size;
+    const uint8_t *entries = (const uint8_t *)(root + 1);
+    for (size_t i = 0; i < count; i++) {
+        uint64_t phys = 0;
+        memcpy(&phys, entries + i * entry_size, entry_size);
+        if (phys) {
+            index_table(phys);
+        }
+    }
+    const struct acpi_sdt_header *fadt = acpi_find_table("FACP");
+    if (fadt) {
+        index_dsdt(fadt);
+    }
+    pr_info("ACPI: %u tables from the %s indexed in %lu us\n", indexed, entry_size == 8 ? "XSDT" : "RSDT",
+            tsc_cycles_to_us(tsc_read() - t0));
+    log_summary();
+}
+
+const struct acpi_sdt_header *acpi_find_table(const char *signature) {
+    if (!signature || !indexed) {
+        return 0;
+    }
+    const uint32_t key = signature_key(signature);
+    uint32_t slot = index_slot(key);
+    for (uint32_t probes = 0; probes < ACPI_INDEX_SLOTS; probes++) {
+        const struct acpi_index_entry *e = &table_index[slot];
+        if (e->signature == key) {
+            return e->table;
+        }
+        if (!e->signature) {
+            return 0;
+        }
+        slot = (slot + 1) & (ACPI_INDEX_SLOTS - 1);
+    }
+    return 0;
+}
+
+/* APIC IDs of enabled processors from the MADT; the boot CPU alone when
+   there is no table. Online-capable entries are hotplug slots and are not
+   started at boot. */
+size_t acpi_cpu_apic_ids(uint32_t *ids, size_t max) {
+    const struct acpi_madt *madt = (const struct acpi_madt *)acpi_find_table("APIC");
+    size_t count = 0;
+    if (madt) {
+        const uint8_t *p = madt->entries;
+        const uint8_t *end = (const uint8_t *)madt + madt->header.length;
+        while (p + 2 <= end && p[1] >= 2 && p + p[1] <= end) {
+            uint32_t flags = 0;
+            uint32_t apic_id = 0;
+            if (p[0] == ACPI_MADT_LAPIC && p[1] >= 8) {
+                apic_id = p[3];
+                memcpy(&flags, p + 4, 4);
+            } else if (p[0] == ACPI_MADT_X2APIC && p[1] >= 16) {
+                memcpy(&apic_id, p + 4, 4);
+                memcpy(&flags, p + 8, 4);
+            } else {
+                p += p[1];
+                continue;
+            }
+            if ((flags & ACPI_MADT_LAPIC_ENABLED) && count < max) {
+                ids[count++] = apic_id;
+            }
+            p += p[1];
+        }
+    }
+    if (!count && max) {
+        ids[count++] = lapic_id();
+    }
+    return count;
+}
@@ -6,10 +6,11 @@
 
 #include "console.h"
 #include "cpu.h"
+#include "interrupts.h"
+#include "log.h"
+#include "smp.h"
 
-static inline void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *d) {
-    __asm__ volatile ("cpuid" : "=a" (*a), "=b" (*b), "=c" (*c), "=d" (*d) : "a" (leaf), "c" (subleaf));
-}
+static uint8_t fpu_state[NR_CPUS][512] __attribute__((aligned(16)));
 
 static void detect_vendor(struct cpu_info *info) {
     uint32_t eax = 0, ebx = 0, ecx = 0, edx = 0;
@@ -60,6 +61,9 @@ static void detect_basic_features(struct cpu_info *info) {
     info->sse3 = (ecx >> 0) & 0x1;
     info->avx = (ecx >> 28) & 0x1;
     info->avx2 = false;
+    info->pcid = (ecx >> 17) & 0x1;
+    info->monitor = (ecx >> 3) & 0x1;
+    info->hypervisor = (ecx >> 31) & 0x1;
 }
 
 static void detect_ext_features(struct cpu_info *info) {
@@ -73,25 +77,75 @@ static void detect_ext_features(struct cpu_info *info) {
     info->avx2 = (ebx >> 5) & 0x1;
 }
 
+static void detect_mwait(struct cpu_info *info) {
+    uint32_t eax = 0, ebx = 0, ecx = 0, edx = 0;
+    cpuid(0, 0, &eax, &ebx, &ecx, &edx);
+    if (!info->monitor || eax < 5) {
+        return;
+    }
+
+    cpuid(5, 0, &eax, &ebx, &ecx, &edx);
+    /* the sub-state counts are only meaningful with the extensions bit */
+    if (ecx & 0x1) {
+        info->mwait_substates = edx;
+    }
+}
+
+static void detect_extended_leaves(struct cpu_info *info) {
+    uint32_t eax = 0, ebx = 0, ecx = 0, edx = 0;
+    cpuid(0x80000000, 0, &eax, &ebx, &ecx, &edx);
+    const uint32_t max = eax;
+    if (max >= 0x80000001) {
+        cpuid(0x80000001, 0, &eax, &ebx, &ecx, &edx);
+        info->rdtscp = (edx >> 27) & 0x1;
+    }
+    if (max >= 0x80000007) {
+        cpuid(0x80000007, 0, &eax, &ebx, &ecx, &edx);
+        info->tsc_invariant = (edx >> 8) & 0x1;
+    }
+}
+
+static void detect_pmu(struct cpu_info *info) {
+    uint32_t eax = 0, ebx = 0, ecx = 0, edx = 0;
+    cpuid(0, 0, &eax, &ebx, &ecx, &edx);
+    if (eax < 0xA) {
+        return;
+    }
+
+    cpuid(0xA, 0, &eax, &ebx, &ecx, &edx);
+    info->pmu_version = (uint8_t)(eax & 0xFF);
+    if (!info->pmu_version) {
+        return;
+    }
+    info->pmu_gp_counters = (uint8_t)((eax >> 8) & 0xFF);
+    info->pmu_gp_width = (uint8_t)((eax >> 16) & 0xFF);
+    info->pmu_event_bits = (uint8_t)((eax >> 24) & 0xFF);
+    info->pmu_events_missing = ebx;
+    if (info->pmu_version >= 2) {
+        info->pmu_fixed_counters = (uint8_t)(edx & 0x1F);
+        info->pmu_fixed_width = (uint8_t)((edx >> 5) & 0xFF);
+    }
+}
+
 static void log_driver_notes(const struct cpu_info *info) {
     if (info->is_intel) {
-        kprint("Intel driver hints: APIC + xAPIC ready.\n");
+        pr_info("Intel driver hints: APIC + xAPIC ready.\n");
         if (info->avx2) {
-            kprint(" - AVX2 present, vector paths enabled.\n");
+            pr_info(" - AVX2 present, vector paths enabled.\n");
         } else if (info->avx) {
-            kprint(" - AVX present, falling back to AVX1 paths.\n");
+            pr_info(" - AVX present, falling back to AVX1 paths.\n");
         } else {
-            kprint(" - Legacy SIMD only, using SSE fast paths.\n");
+            pr_info(" - Legacy SIMD only, using SSE fast paths.\n");
         }
     } else if (info->is_amd) {
-        kprint("AMD driver hints: enable CCX-friendly timers.\n");
+        pr_info("AMD driver hints: enable CCX-friendly timers.\n");
         if (info->avx2) {
-            kprint(" - Zen-class core detected, wide vectors available.\n");
+            pr_info(" - Zen-class core detected, wide vectors available.\n");
         } else {
-            kprint(" - Older core, keep 128-bit aligned code paths.\n");
+            pr_info(" - Older core, keep 128-bit aligned code paths.\n");
         }
     } else {
-        kprint("Generic x86_64 CPU detected.\n");
+        pr_info("Generic x86_64 CPU detected.\n");
     }
 }
 
@@ -103,6 +157,9 @@ void cpu_detect(struct cpu_info *info) {
     detect_vendor(info);
     detect_basic_features(info);
     detect_ext_features(info);
+    detect_mwait(info);
+    detect_extended_leaves(info);
+    detect_pmu(info);
 }
 
 void cpu_log(const struct cpu_info *info) {
@@ -110,8 +167,25 @@ void cpu_log(const struct cpu_info *info) {
         return;
     }
 
-    kprint("CPU vendor: %s\n", info->vendor);
-    kprint("Family %x Model %x Stepping %x\n", (uint64_t)info->family, (uint64_t)info->model, (uint64_t)info->stepping);
-    kprint("Features: SSE=%x SSE2=%x SSE3=%x AVX=%x AVX2=%x\n", (uint64_t)info->sse, (uint64_t)info->sse2, (uint64_t)info->sse3, (uint64_t)info->avx, (uint64_t)info->avx2);
+    pr_info("CPU vendor: %s\n", info->vendor);
+    pr_info("Family %#x Model %#x Stepping %u\n", info->family, info->model, info->stepping);
+    pr_info("Features: SSE=%d SSE2=%d SSE3=%d AVX=%d AVX2=%d\n", info->sse, info->sse2, info->sse3, info->avx, info->avx2);
+    if (info->pmu_version) {
+        pr_info("PMU: version %u, %u counters of %u bits, %u fixed, missing events %#x\n", info->pmu_version,
+                info->pmu_gp_counters, info->pmu_gp_width, info->pmu_fixed_counters, info->pmu_events_missing);
+    } else {
+        pr_info("PMU: no architectural performance monitoring\n");
+    }
     log_driver_notes(info);
 }
+
+uint64_t kernel_fpu_begin(void) {
+    const uint64_t flags = irq_save();
+    __asm__ volatile ("fxsave64 %0" : "=m"(fpu_state[smp_processor_id()]));
+    return flags;
+}
+
+void kernel_fpu_end(uint64_t flags) {
+    __asm__ volatile ("fxrstor64 %0" : : "m"(fpu_state[smp_processor_id()]));
+    irq_restore(flags);
+}
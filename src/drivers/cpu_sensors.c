@@ -0,0 +1,98 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cpu.h"
+#include "cpu_sensors.h"
+#include "log.h"
+#include "module.h"
+#include "smp.h"
+
+#if defined(CONFIG_HW_CPU_SENSORS) || defined(MODULE)
+
+#define CPUID_THERMAL_LEAF 0x06
+#define CPUID_THERMAL_DTS (1u << 0)
+#define CPUID_THERMAL_PTM (1u << 6)
+#define MSR_IA32_THERM_STATUS 0x19C
+#define MSR_TEMPERATURE_TARGET 0x1A2
+#define MSR_IA32_PACKAGE_THERM_STATUS 0x1B1
+#define THERM_STATUS_VALID (1u << 31)
+#define TJMAX_DEFAULT 100
+
+/* The sensors count down from TjMax, so a reading is TjMax minus the
+   digital readout in bits 22:16. */
+struct sensor_reading {
+    bool valid;
+    uint32_t readout;
+};
+
+static bool probed;
+static bool have_dts;
+static bool have_ptm;
+static uint32_t tjmax = TJMAX_DEFAULT;
+
+static int cpu_sensors_probe(void) {
+    uint32_t a, b, c, d;
+    probed = true;
+    cpuid(0, 0, &a, &b, &c, &d);
+    /* "GenuineIntel"; AMD keeps its sensor behind SMN, not these MSRs */
+    if (b != 0x756e6547 || d != 0x49656e69 || c != 0x6c65746e || a < CPUID_THERMAL_LEAF) {
+        return 0;
+    }
+    cpuid(CPUID_THERMAL_LEAF, 0, &a, &b, &c, &d);
+    have_dts = a & CPUID_THERMAL_DTS;
+    have_ptm = a & CPUID_THERMAL_PTM;
+    if (have_dts) {
+        const uint32_t target = (uint32_t)(rdmsr(MSR_TEMPERATURE_TARGET) >> 16) & 0xff;
+        tjmax = target ? target : TJMAX_DEFAULT;
+        pr_info("cpu_sensors: digital thermal sensor, TjMax %u C%s\n", tjmax, have_ptm ? ", package sensor" : "");
+    }
+    return 0;
+}
+module_init(cpu_sensors_probe);
+
+static void read_sensor(struct sensor_reading *out, uint32_t msr) {
+    const uint64_t status = rdmsr(msr);
+    out->valid = status & THERM_STATUS_VALID;
+    out->readout = (uint32_t)(status >> 16) & 0x7f;
+}
+
+static void read_core_sensor(void *arg) {
+    read_sensor(arg, MSR_IA32_THERM_STATUS);
+}
+
+void cpu_sensors_report(void) {
+    if (!probed) {
+        cpu_sensors_probe();
+    }
+    if (!have_dts) {
+        pr_info("cpu_sensors: no digital thermal sensor\n");
+        return;
+    }
+    struct sensor_reading readings[NR_CPUS] = { 0 };
+    const uint32_t self = smp_processor_id();
+    for (uint32_t cpu = 0; cpu < NR_CPUS; cpu++) {
+        if (cpu != self) {
+            smp_call(cpu, read_core_sensor, &readings[cpu]);
+        }
+    }
+    read_core_sensor(&readings[self]);
+    for (uint32_t cpu = 0; cpu < NR_CPUS; cpu++) {
+        smp_call_wait(cpu);
+        if (cpu == self || smp_cpu_online(cpu)) {
+            if (readings[cpu].valid) {
+                pr_info("cpu_sensors: cpu%u %u C\n", cpu, tjmax - readings[cpu].readout);
+            } else {
+                pr_info("cpu_sensors: cpu%u no reading\n", cpu);
+            }
+        }
+    }
+    if (have_ptm) {
+        struct sensor_reading pkg;
+        read_sensor(&pkg, MSR_IA32_PACKAGE_THERM_STATUS);
+        if (pkg.valid) {
+            pr_info("cpu_sensors: package %u C\n", tjmax - pkg.readout);
+        }
+    }
+}
+
+#endif /* CONFIG_HW_CPU_SENSORS || MODULE */
@@ -0,0 +1,197 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bench.h"
+#include "cpu.h"
+#include "cpuidle.h"
+#include "interrupts.h"
+#include "log.h"
+#include "smp.h"
+#include "tsc.h"
+
+#ifdef CONFIG_PM_STUB
+
+#define CPUIDLE_MAX_STATES 8
+
+struct cpuidle_state {
+    const char *name;
+    bool mwait;
+    uint8_t hint;               /* MWAIT EAX: C-state - 1 in 7:4, sub-state in 3:0 */
+    uint32_t exit_latency_us;
+    uint32_t target_residency_us;
+};
+
+/* Without ACPI _CST there are no per-platform figures; these are typical
+   of recent Intel cores and only order the states. */
+static const struct cpuidle_state mwait_levels[CPUIDLE_MAX_STATES] = {
+    [1] = { "MWAIT C1", true, 0x00, 2, 2 },
+    [2] = { "MWAIT C2", true, 0x10, 20, 80 },
+    [3] = { "MWAIT C3", true, 0x20, 70, 200 },
+    [4] = { "MWAIT C4", true, 0x30, 100, 300 },
+    [5] = { "MWAIT C5", true, 0x40, 120, 400 },
+    [6] = { "MWAIT C6", true, 0x50, 133, 600 },
+    [7] = { "MWAIT C7", true, 0x60, 166, 800 },
+};
+
+static struct cpuidle_state states[CPUIDLE_MAX_STATES];
+static uint32_t state_count;
+
+/* The line MONITOR watches: remote CPUs store to wake and read state. */
+struct cpuidle_cpu {
+    volatile uint32_t wake;
+    volatile uint32_t state;    /* 1 + the state entered, 0 while running */
+    volatile uint64_t kick_tsc; /* first kick while idle */
+} __attribute__((aligned(64)));
+
+struct cpuidle_stats {
+    uint64_t entries;
+    uint64_t residency;         /* TSC cycles */
+    uint64_t wakes;             /* exits an smp_kick() caused */
+    uint64_t wake_latency;      /* TSC cycles from the kick to running again */
+    uint64_t wake_latency_max;
+};
+
+struct cpuidle_gov {
+    uint64_t predicted_ns;
+    struct cpuidle_stats stats[CPUIDLE_MAX_STATES];
+} __attribute__((aligned(64)));
+
+static struct cpuidle_cpu idle_cpus[NR_CPUS];
+static struct cpuidle_gov govs[NR_CPUS];
+
+void cpuidle_init(const struct cpu_info *cpu, bool force_hlt) {
+    uint32_t n = 0;
+    if (cpu->monitor && !force_hlt) {
+        states[n++] = mwait_levels[1];
+        /* deeper states may stop the TSC, which measures residency here */
+        for (uint32_t level = 2; level < CPUIDLE_MAX_STATES && cpu->tsc_invariant; level++) {
+            if ((cpu->mwait_substates >> (level * 4)) & 0xF) {
+                states[n++] = mwait_levels[level];
+            }
+        }
+    } else {
+        states[n++] = (struct cpuidle_state){ "HLT", false, 0, 1, 1 };
+        pr_info("cpuidle: HLT only%s\n", cpu->monitor ? " (idle=hlt)" : ", no MONITOR/MWAIT");
+    }
+    for (uint32_t i = 0; i < n && states[i].mwait; i++) {
+        pr_info("cpuidle: state %u %s (hint 0x%02x) exit %u us target %u us\n", i, states[i].name,
+                states[i].hint, states[i].exit_latency_us, states[i].target_residency_us);
+    }
+    __atomic_store_n(&state_count, n, __ATOMIC_RELEASE);
+}
+
+/* Deepest state whose break-even time fits the prediction. */
+static uint32_t select_state(uint32_t count, uint64_t predicted_ns) {
+    uint32_t s = 0;
+    for (uint32_t i = 1; i < count; i++) {
+        if ((uint64_t)states[i].target_residency_us * 1000 <= predicted_ns) {
+            s = i;
+        }
+    }
+    return s;
+}
+
+void cpuidle_enter(uint64_t expected_ns) {
+    const uint32_t count = __atomic_load_n(&state_count, __ATOMIC_ACQUIRE);
+    if (!count) {
+        __asm__ volatile ("sti; hlt" ::: "memory");
+        return;
+    }
+    const uint32_t self = smp_processor_id();
+    struct cpuidle_cpu *c = &idle_cpus[self];
+    struct cpuidle_gov *g = &govs[self];
+    const uint32_t s = select_state(count, expected_ns ? expected_ns : g->predicted_ns);
+
+    __atomic_store_n(&c->state, s + 1, __ATOMIC_RELAXED);
+    /* pairs with cpuidle_kick(): either it sees state or we see wake */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    const uint64_t t0 = rdtsc();
+    if (states[s].mwait) {
+        __asm__ volatile ("monitor" : : "a"(&c->wake), "c"(0), "d"(0));
+        if (!c->wake) {
+            /* like "sti; hlt", the interrupt shadow covers mwait */
+            __asm__ volatile ("sti; mwait" : : "a"((uint32_t)states[s].hint), "c"(0) : "memory");
+        } else {
+            interrupts_enable();
+        }
+    } else {
+        __asm__ volatile ("sti; hlt" ::: "memory");
+    }
+    const uint64_t t1 = rdtsc();
+    __atomic_store_n(&c->state, 0, __ATOMIC_RELAXED);
+    c->wake = 0;
+    const uint64_t kick = __atomic_exchange_n(&c->kick_tsc, 0, __ATOMIC_RELAXED);
+
+    struct cpuidle_stats *st = &g->stats[s];
+    st->entries++;
+    st->residency += t1 - t0;
+    if (kick && kick <= t1) {
+        const uint64_t latency = t1 - kick;
+        st->wakes++;
+        st->wake_latency += latency;
+        if (latency > st->wake_latency_max) {
+            st->wake_latency_max = latency;
+        }
+    }
+    /* the next sleep is predicted to look like the recent ones */
+    g->predicted_ns = (g->predicted_ns * 7 + tsc_cycles_to_ns(t1 - t0)) / 8;
+}
+
+bool cpuidle_kick(uint32_t cpu) {
+    if (cpu >= NR_CPUS) {
+        return false;
+    }
+    struct cpuidle_cpu *c = &idle_cpus[cpu];
+    c->wake = 1;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    const uint32_t state = __atomic_load_n(&c->state, __ATOMIC_RELAXED);
+    if (!state) {
+        return false;
+    }
+    uint64_t none = 0;
+    __atomic_compare_exchange_n(&c->kick_tsc, &none, rdtsc(), false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    return states[state - 1].mwait;
+}
+
+void cpuidle_report(void) {
+    const uint32_t count = __atomic_load_n(&state_count, __ATOMIC_ACQUIRE);
+    for (uint32_t s = 0; s < count; s++) {
+        struct cpuidle_stats sum = { 0 };
+        for (uint32_t cpu = 0; cpu < NR_CPUS; cpu++) {
+            const struct cpuidle_stats *st = &govs[cpu].stats[s];
+            sum.entries += st->entries;
+            sum.residency += st->residency;
+            sum.wakes += st->wakes;
+            sum.wake_latency += st->wake_latency;
+            if (st->wake_latency_max > sum.wake_latency_max) {
+                sum.wake_latency_max = st->wake_latency_max;
+            }
+        }
+        pr_info("cpuidle: %s entries %lu residency %lu us wakes %lu latency avg %lu max %lu ns\n",
+                states[s].name, sum.entries,
+                tsc_cycles_to_us(sum.residency), sum.wakes,
+                sum.wakes ? tsc_cycles_to_ns(sum.wake_latency / sum.wakes) : 0,
+                tsc_cycles_to_ns(sum.wake_latency_max));
+    }
+}
+
+#ifdef CONFIG_MICROBENCH
+static void nop_call(void *arg) {
+    (void)arg;
+}
+
+/* Post an empty call to the first AP and wait for it: one wake of an
+   idle CPU, by MWAIT store or IPI, plus the mailbox round trip. */
+static void bench_remote_wake(uint64_t loops) {
+    uint32_t cpu = 1;
+    while (cpu < NR_CPUS && !smp_cpu_online(cpu)) {
+        cpu++;
+    }
+    for (uint64_t i = 0; i < loops && smp_call(cpu, nop_call, 0); i++) {
+        smp_call_wait(cpu);
+    }
+}
+BENCH(idle, remote_wake, bench_remote_wake);
+#endif
+
+#endif /* CONFIG_PM_STUB */
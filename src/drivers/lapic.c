@@ -0,0 +1,78 @@
+#include <stdint.h>
+
+#include "console.h"
+#include "cpu.h"
+#include "interrupts.h"
+#include "io.h"
+#include "lapic.h"
+#include "log.h"
+#include "paging.h"
+
+#define IA32_APIC_BASE_MSR 0x1B
+#define APIC_BASE_ENABLE (1ULL << 11)
+
+#define LAPIC_REG_ID    0x020
+#define LAPIC_REG_EOI   0x0B0
+#define LAPIC_REG_SVR   0x0F0
+#define LAPIC_REG_TPR   0x080
+#define LAPIC_REG_LVT_PMC 0x340
+#define LAPIC_REG_ICR_LO  0x300
+#define LAPIC_REG_ICR_HI  0x310
+#define LAPIC_ICR_PENDING (1u << 12)
+
+static volatile uint8_t *lapic_base = 0;
+
+static uint32_t lapic_read(uint32_t reg) {
+    return mmio_read32(lapic_base + reg);
+}
+
+static void lapic_write(uint32_t reg, uint32_t value) {
+    mmio_write32(lapic_base + reg, value);
+}
+
+void lapic_init(void) {
+    uint64_t msr = rdmsr(IA32_APIC_BASE_MSR);
+    uint64_t phys = msr & 0xFFFFFF000ULL;
+    wrmsr(IA32_APIC_BASE_MSR, msr | APIC_BASE_ENABLE);
+
+    if (!lapic_base) {
+        lapic_base = paging_map_mmio(phys, 0x1000);
+        if (!lapic_base) {
+            pr_err("LAPIC: unable to map registers at %#lx\n", phys);
+            return;
+        }
+    }
+
+    lapic_write(LAPIC_REG_TPR, 0);
+    lapic_write(LAPIC_REG_SVR, 0x100 | IRQ_VECTOR_SPURIOUS); /* software enable */
+}
+
+uint32_t lapic_id(void) {
+    if (!lapic_base) {
+        return 0;
+    }
+    return lapic_read(LAPIC_REG_ID) >> 24;
+}
+
+void lapic_eoi(void) {
+    if (lapic_base) {
+        lapic_write(LAPIC_REG_EOI, 0);
+    }
+}
+
+void lapic_set_lvt_pmc(uint32_t value) {
+    if (lapic_base) {
+        lapic_write(LAPIC_REG_LVT_PMC, value);
+    }
+}
+
+void lapic_send_ipi(uint32_t apic_id, uint32_t icr_low) {
+    if (!lapic_base) {
+        return;
+    }
+    lapic_write(LAPIC_REG_ICR_HI, apic_id << 24);
+    lapic_write(LAPIC_REG_ICR_LO, icr_low);
+    while (lapic_read(LAPIC_REG_ICR_LO) & LAPIC_ICR_PENDING) {
+        cpu_relax();
+    }
+}
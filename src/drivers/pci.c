@@ -0,0 +1,387 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "acpi.h"
+#include "console.h"
+#include "io.h"
+#include "log.h"
+#include "paging.h"
+#include "pci.h"
+#include "spinlock.h"
+#include "tsc.h"
+
+#define PCI_CONFIG_ADDRESS 0xCF8
+#define PCI_CONFIG_DATA    0xCFC
+
+static struct pci_dev devices[PCI_MAX_DEVICES];
+static size_t device_count = 0;
+static const struct pci_driver *drivers[PCI_MAX_DRIVERS];
+static size_t driver_count = 0;
+/* drivers register from whichever CPU runs their initcall */
+static spinlock_t drivers_lock = SPINLOCK_INIT;
+
+/* ECAM window for segment 0, taken from the ACPI MCFG table when present. */
+static volatile uint8_t *ecam_base = 0;
+static uint8_t ecam_start_bus = 0;
+static uint8_t ecam_end_bus = 0;
+
+static volatile uint8_t *ecam_addr(uint8_t bus, uint8_t slot, uint8_t func, uint16_t offset) {
+    if (!ecam_base || bus < ecam_start_bus || bus > ecam_end_bus) {
+        return 0;
+    }
+    uint64_t off = ((uint64_t)(bus - ecam_start_bus) << 20) | ((uint64_t)slot << 15) |
+                   ((uint64_t)func << 12) | offset;
+    return ecam_base + off;
+}
+
+static void legacy_select(uint8_t bus, uint8_t slot, uint8_t func, uint16_t offset) {
+    uint32_t address = 0x80000000u | ((uint32_t)bus << 16) | ((uint32_t)slot << 11) |
+                       ((uint32_t)func << 8) | (offset & 0xFC);
+    outl(PCI_CONFIG_ADDRESS, address);
+}
+
+static uint32_t cfg_read32(uint8_t bus, uint8_t slot, uint8_t func, uint16_t offset) {
+    volatile uint8_t *p = ecam_addr(bus, slot, func, offset & ~3u);
+    if (p) {
+        return mmio_read32(p);
+    }
+    if (offset >= 256) {
+        return 0xFFFFFFFF;
+    }
+    legacy_select(bus, slot, func, offset);
+    return inl(PCI_CONFIG_DATA);
+}
+
+static void cfg_write32(uint8_t bus, uint8_t slot, uint8_t func, uint16_t offset, uint32_t value) {
+    volatile uint8_t *p = ecam_addr(bus, slot, func, offset & ~3u);
+    if (p) {
+        mmio_write32(p, value);
+        return;
+    }
+    if (offset >= 256) {
+        return;
+    }
+    legacy_select(bus, slot, func, offset);
+    outl(PCI_CONFIG_DATA, value);
+}
+
+uint32_t pci_read32(const struct pci_dev *dev, uint16_t offset) {
+    return cfg_read32(dev->bus, dev->slot, dev->func, offset);
+}
+
+uint16_t pci_read16(const struct pci_dev *dev, uint16_t offset) {
+    return (uint16_t)(pci_read32(dev, offset & ~3u) >> ((offset & 2) * 8));
+}
+
+uint8_t pci_read8(const struct pci_dev *dev, uint16_t offset) {
+    return (uint8_t)(pci_read32(dev, offset & ~3u) >> ((offset & 3) * 8));
+}
+
+void pci_write32(const struct pci_dev *dev, uint16_t offset, uint32_t value) {
+    cfg_write32(dev->bus, dev->slot, dev->func, offset, value);
+}
+
+void pci_write16(const struct pci_dev *dev, uint16_t offset, uint16_t value) {
+    const uint32_t shift = (offset & 2) * 8;
+    uint32_t v = pci_read32(dev, offset & ~3u);
+    v = (v & ~(0xFFFFu << shift)) | ((uint32_t)value << shift);
+    pci_write32(dev, offset & ~3u, v);
+}
+
+void pci_write8(const struct pci_dev *dev, uint16_t offset, uint8_t value) {
+    const uint32_t shift = (offset & 3) * 8;
+    uint32_t v = pci_read32(dev, offset & ~3u);
+    v = (v & ~(0xFFu << shift)) | ((uint32_t)value << shift);
+    pci_write32(dev, offset & ~3u, v);
+}
+
+void pci_enable_device(struct pci_dev *dev) {
+    uint16_t cmd = pci_read16(dev, PCI_COMMAND);
+    cmd |= PCI_COMMAND_MEMORY | PCI_COMMAND_IO | PCI_COMMAND_MASTER;
+    pci_write16(dev, PCI_COMMAND, cmd);
+}
+
+uint8_t pci_find_capability(const struct pci_dev *dev, uint8_t cap_id, uint8_t start) {
+    if (!(pci_read16(dev, PCI_STATUS) & PCI_STATUS_CAP_LIST)) {
+        return 0;
+    }
+    uint8_t ptr = start ? pci_read8(dev, start + 1) : pci_read8(dev, PCI_CAP_PTR);
+    for (int guard = 0; ptr && guard < 48; guard++) {
+        ptr &= 0xFC;
+        if (pci_read8(dev, ptr) == cap_id) {
+            return ptr;
+        }
+        ptr = pci_read8(dev, ptr + 1);
+    }
+    return 0;
+}
+
+/* Size each BAR by writing all ones with decoding disabled, then map memory
+   BARs so drivers can dereference bar[i].virt directly. */
+static void size_bars(struct pci_dev *dev) {
+    const int bar_count = (dev->header_type & 0x7F) == 0 ? 6 : 2;
+    const uint16_t cmd = pci_read16(dev, PCI_COMMAND);
+    pci_write16(dev, PCI_COMMAND, cmd & ~(PCI_COMMAND_IO | PCI_COMMAND_MEMORY));
+
+    for (int i = 0; i < bar_count; i++) {
+        const uint16_t reg = PCI_BAR0 + i * 4;
+        uint32_t orig = pci_read32(dev, reg);
+        struct pci_bar *bar = &dev->bar[i];
+
+        pci_write32(dev, reg, 0xFFFFFFFF);
+        uint32_t mask = pci_read32(dev, reg);
+        pci_write32(dev, reg, orig);
+
+        if (orig & 1) {
+            bar->io = true;
+            bar->phys = orig & ~3u;
+            bar->size = (uint64_t)(~(mask & ~3u) + 1) & 0xFFFF;
+            continue;
+        }
+
+        uint64_t base = orig & ~0xFu;
+        uint64_t size_mask = 0xFFFFFFFF00000000ULL | (mask & ~0xFu);
+        bar->prefetch = (orig & 0x8) != 0;
+        if (((orig >> 1) & 3) == 2 && i + 1 < bar_count) {
+            uint32_t orig_hi = pci_read32(dev, reg + 4);
+            pci_write32(dev, reg + 4, 0xFFFFFFFF);
+            uint32_t mask_hi = pci_read32(dev, reg + 4);
+            pci_write32(dev, reg + 4, orig_hi);
+            base |= (uint64_t)orig_hi << 32;
+            size_mask = ((uint64_t)mask_hi << 32) | (mask & ~0xFu);
+            bar->is64 = true;
+        }
+        if ((mask & ~0xFu) == 0 && !bar->is64) {
+            continue; /* unimplemented BAR */
+        }
+
+        bar->phys = base;
+        bar->size = ~size_mask + 1;
+        if (bar->phys && bar->size) {
+            bar->virt = paging_map_mmio(bar->phys, bar->size);
+        }
+        if (bar->is64) {
+            i++;
+        }
+    }
+
+    pci_write16(dev, PCI_COMMAND, cmd);
+}
+
+static const char *class_name(uint8_t class_code, uint8_t subclass) {
+    switch (class_code) {
+    case 0x01:
+        return subclass == 0x06 ? "SATA controller" : subclass == 0x08 ? "NVMe controller" : "storage";
+    case 0x02:
+        return "network";
+    case 0x03:
+        return "display";
+    case 0x04:
+        return "multimedia";
+    case 0x06:
+        return subclass == 0x00 ? "host bridge" : subclass == 0x01 ? "ISA bridge" :
+               subclass == 0x04 ? "PCI bridge" : "bridge";
+    case 0x0C:
+        return subclass == 0x03 ? "USB controller" : subclass == 0x05 ? "SMBus" : "serial bus";
+    case 0xFF:
+        return "vendor specific";
+    default:
+        return "other";
+    }
+}
+
+static const char *virtio_name(uint16_t device_id) {
+    /* transitional IDs 0x1000.., modern IDs 0x1040 + virtio device type */
+    switch (device_id) {
+    case 0x1000: case 0x1041: return "virtio-net";
+    case 0x1001: case 0x1042: return "virtio-blk";
+    case 0x1002: case 0x1045: return "virtio-balloon";
+    case 0x1003: case 0x1043: return "virtio-console";
+    case 0x1005: case 0x1044: return "virtio-rng";
+    case 0x1004: case 0x1048: return "virtio-scsi";
+    case 0x1050: return "virtio-gpu";
+    default: return "virtio";
+    }
+}
+
+static void log_device(const struct pci_dev *dev) {
+    const char *name = dev->vendor_id == 0x1AF4 ? virtio_name(dev->device_id)
+                                                : class_name(dev->class_code, dev->subclass);
+    pr_info("PCI %02x:%02x.%x ", dev->bus, dev->slot, dev->func);
+    pr_info("id %04x:%04x %s", dev->vendor_id, dev->device_id, name);
+    if (dev->msix_cap) {
+        pr_info(" msix(%u)", dev->msix_entries);
+    } else if (dev->msi_cap) {
+        pr_info(" msi");
+    }
+    pr_info("\n");
+    for (int i = 0; i < 6; i++) {
+        const struct pci_bar *bar = &dev->bar[i];
+        if (bar->size) {
+            pr_debug("    BAR%d %s %#lx size %#lx\n", i, bar->io ? "io " : "mem", bar->phys, bar->size);
+        }
+    }
+}
+
+static const struct pci_device_id *match(const struct pci_driver *drv, const struct pci_dev *dev) {
+    for (const struct pci_device_id *id = drv->id_table; id && id->vendor; id++) {
+        if ((id->vendor == PCI_ANY_ID || id->vendor == dev->vendor_id) &&
+            (id->device == PCI_ANY_ID || id->device == dev->device_id)) {
+            return id;
+        }
+    }
+    return 0;
+}
+
+static void try_bind(struct pci_dev *dev, const struct pci_driver *drv) {
+    if (dev->driver) {
+        return;
+    }
+    const struct pci_device_id *id = match(drv, dev);
+    if (!id) {
+        return;
+    }
+    if (drv->probe(dev, id)) {
+        dev->driver = drv;
+        pr_info("PCI %02x:%02x.%x bound to %s\n", dev->bus, dev->slot, dev->func, drv->name);
+    }
+}
+
+static void scan_bus(uint8_t bus, int depth);
+
+static void scan_function(uint8_t bus, uint8_t slot, uint8_t func, int depth) {
+    uint32_t id = cfg_read32(bus, slot, func, PCI_VENDOR_ID);
+    if ((id & 0xFFFF) == 0xFFFF) {
+        return;
+    }
+    if (device_count >= PCI_MAX_DEVICES) {
+        return;
+    }
+
+    struct pci_dev *dev = &devices[device_count++];
+    dev->bus = bus;
+    dev->slot = slot;
+    dev->func = func;
+    dev->vendor_id = (uint16_t)(id & 0xFFFF);
+    dev->device_id = (uint16_t)(id >> 16);
+
+    uint32_t class_reg = pci_read32(dev, PCI_REVISION);
+    dev->revision = (uint8_t)class_reg;
+    dev->prog_if = (uint8_t)(class_reg >> 8);
+    dev->subclass = (uint8_t)(class_reg >> 16);
+    dev->class_code = (uint8_t)(class_reg >> 24);
+    dev->header_type = pci_read8(dev, PCI_HEADER_TYPE);
+    dev->irq_line = pci_read8(dev, PCI_IRQ_LINE);
+    if ((dev->header_type & 0x7F) == 0) {
+        dev->subsys_vendor = pci_read16(dev, PCI_SUBSYS_VENDOR);
+        dev->subsys_id = pci_read16(dev, PCI_SUBSYS_ID);
+    }
+
+    size_bars(dev);
+    dev->msi_cap = pci_find_capability(dev, PCI_CAP_ID_MSI, 0);
+    dev->msix_cap = pci_find_capability(dev, PCI_CAP_ID_MSIX, 0);
+    if (dev->msix_cap) {
+        dev->msix_entries = (uint16_t)((pci_read16(dev, dev->msix_cap + 2) & 0x7FF) + 1);
+    }
+
+    if (dev->class_code == 0x06 && dev->subclass == 0x04 && depth < 8) {
+        uint8_t secondary = pci_read8(dev, PCI_SECONDARY_BUS);
+        if (secondary > bus) {
+            scan_bus(secondary, depth + 1);
+        }
+    }
+}
+
+static void scan_bus(uint8_t bus, int depth) {
+    for (uint8_t slot = 0; slot < 32; slot++) {
+        uint32_t id = cfg_read32(bus, slot, 0, PCI_VENDOR_ID);
+        if ((id & 0xFFFF) == 0xFFFF) {
+            continue;
+        }
+        scan_function(bus, slot, 0, depth);
+        uint8_t header = (uint8_t)(cfg_read32(bus, slot, 0, PCI_HEADER_TYPE & ~3u) >> 16);
+        if (header & 0x80) {
+            for (uint8_t func = 1; func < 8; func++) {
+                scan_function(bus, slot, func, depth);
+            }
+        }
+    }
+}
+
+static void setup_ecam(void) {
+    const struct acpi_mcfg *mcfg = (const struct acpi_mcfg *)acpi_find_table("MCFG");
+    if (!mcfg) {
+        return;
+    }
+    size_t count = (mcfg->header.length - sizeof(*mcfg)) / sizeof(mcfg->entries[0]);
+    for (size_t i = 0; i < count; i++) {
+        const struct acpi_mcfg_allocation *a = &mcfg->entries[i];
+        if (a->segment != 0) {
+            continue;
+        }
+        uint64_t size = ((uint64_t)(a->end_bus - a->start_bus) + 1) << 20;
+        ecam_base = paging_map_mmio(a->base_address, size);
+        ecam_start_bus = a->start_bus;
+        ecam_end_bus = a->end_bus;
+        return;
+    }
+}
+
+void pci_init(void) {
+    const uint64_t start = tsc_read();
+
+    setup_ecam();
+
+    uint8_t host_header = (uint8_t)(cfg_read32(0, 0, 0, PCI_HEADER_TYPE & ~3u) >> 16);
+    if (host_header & 0x80) {
+        /* multiple host controllers: function N decodes bus N */
+        for (uint8_t func = 0; func < 8; func++) {
+            if ((cfg_read32(0, 0, func, PCI_VENDOR_ID) & 0xFFFF) != 0xFFFF) {
+                scan_bus(func, 0);
+            }
+        }
+    } else {
+        scan_bus(0, 0);
+    }
+
+    const uint64_t elapsed = tsc_read() - start;
+
+    for (size_t i = 0; i < device_count; i++) {
+        log_device(&devices[i]);
+    }
+    pr_info("PCI: %zu devices via %s in %lu us\n", device_count,
+            ecam_base ? "ECAM" : "port I/O", tsc_cycles_to_us(elapsed));
+
+    for (size_t d = 0; d < driver_count; d++) {
+        for (size_t i = 0; i < device_count; i++) {
+            try_bind(&devices[i], drivers[d]);
+        }
+    }
+}
+
+bool pci_register_driver(const struct pci_driver *driver) {
+    if (!driver) {
+        return false;
+    }
+    spin_lock(&drivers_lock);
+    const bool full = driver_count >= PCI_MAX_DRIVERS;
+    if (!full) {
+        drivers[driver_count++] = driver;
+    }
+    spin_unlock(&drivers_lock);
+    if (full) {
+        return false;
+    }
+    for (size_t i = 0; i < device_count; i++) {
+        try_bind(&devices[i], driver);
+    }
+    return true;
+}
+
+struct pci_dev *pci_devices(size_t *count) {
+    if (count) {
+        *count = device_count;
+    }
+    return devices;
+}
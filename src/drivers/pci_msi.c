@@ -0,0 +1,110 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "console.h"
+#include "interrupts.h"
+#include "io.h"
+#include "lapic.h"
+#include "log.h"
+#include "pci.h"
+
+#define MSIX_CTRL_ENABLE  0x8000
+#define MSIX_CTRL_MASKALL 0x4000
+#define MSIX_ENTRY_SIZE   16
+#define MSIX_VECTOR_CTRL_MASK 0x1
+
+#define MSI_CTRL_ENABLE   0x0001
+#define MSI_CTRL_64BIT    0x0080
+#define MSI_CTRL_MME_MASK 0x0070
+
+/* Fixed delivery, edge triggered, physical destination mode. */
+static uint32_t msi_address(uint32_t apic_id) {
+    return (uint32_t)LAPIC_MSI_ADDR_BASE | ((apic_id & 0xFF) << 12);
+}
+
+static int install_vector(irq_handler_t handler, void *ctx) {
+    int vector = irq_alloc_vector();
+    if (vector < 0) {
+        pr_warn("PCI: out of interrupt vectors\n");
+        return -1;
+    }
+    irq_register((uint8_t)vector, handler, ctx);
+    return vector;
+}
+
+int pci_msix_enable(struct pci_dev *dev) {
+    if (!dev->msix_cap) {
+        return -1;
+    }
+
+    uint32_t table = pci_read32(dev, dev->msix_cap + 4);
+    const struct pci_bar *bar = &dev->bar[table & 0x7];
+    if (!bar->virt) {
+        return -1;
+    }
+    dev->msix_table = (volatile uint8_t *)bar->virt + (table & ~0x7u);
+
+    /* Mask every entry before the function comes out of mask-all so no
+       message fires at a stale address while drivers fill in the table. */
+    uint16_t ctrl = pci_read16(dev, dev->msix_cap + 2);
+    pci_write16(dev, dev->msix_cap + 2, ctrl | MSIX_CTRL_ENABLE | MSIX_CTRL_MASKALL);
+    for (uint16_t i = 0; i < dev->msix_entries; i++) {
+        mmio_write32(dev->msix_table + i * MSIX_ENTRY_SIZE + 12, MSIX_VECTOR_CTRL_MASK);
+    }
+    pci_write16(dev, dev->msix_cap + 2, (ctrl | MSIX_CTRL_ENABLE) & ~MSIX_CTRL_MASKALL);
+
+    /* INTx is redundant once MSI-X is live */
+    pci_write16(dev, PCI_COMMAND, pci_read16(dev, PCI_COMMAND) | PCI_COMMAND_INTX_DISABLE);
+    return dev->msix_entries;
+}
+
+void pci_msix_mask(struct pci_dev *dev, uint16_t entry, bool masked) {
+    if (!dev->msix_table || entry >= dev->msix_entries) {
+        return;
+    }
+    volatile uint8_t *e = dev->msix_table + entry * MSIX_ENTRY_SIZE;
+    uint32_t ctrl = mmio_read32(e + 12);
+    ctrl = masked ? (ctrl | MSIX_VECTOR_CTRL_MASK) : (ctrl & ~MSIX_VECTOR_CTRL_MASK);
+    mmio_write32(e + 12, ctrl);
+}
+
+int pci_msix_route(struct pci_dev *dev, uint16_t entry, uint32_t apic_id, irq_handler_t handler, void *ctx) {
+    if (!dev->msix_table || entry >= dev->msix_entries) {
+        return -1;
+    }
+    int vector = install_vector(handler, ctx);
+    if (vector < 0) {
+        return -1;
+    }
+
+    volatile uint8_t *e = dev->msix_table + entry * MSIX_ENTRY_SIZE;
+    mmio_write32(e + 0, msi_address(apic_id));
+    mmio_write32(e + 4, 0);
+    mmio_write32(e + 8, (uint32_t)vector);
+    pci_msix_mask(dev, entry, false);
+    return vector;
+}
+
+int pci_msi_route(struct pci_dev *dev, uint32_t apic_id, irq_handler_t handler, void *ctx) {
+    if (!dev->msi_cap) {
+        return -1;
+    }
+    int vector = install_vector(handler, ctx);
+    if (vector < 0) {
+        return -1;
+    }
+
+    const uint8_t cap = dev->msi_cap;
+    uint16_t ctrl = pci_read16(dev, cap + 2);
+    pci_write32(dev, cap + 4, msi_address(apic_id));
+    if (ctrl & MSI_CTRL_64BIT) {
+        pci_write32(dev, cap + 8, 0);
+        pci_write16(dev, cap + 12, (uint16_t)vector);
+    } else {
+        pci_write16(dev, cap + 8, (uint16_t)vector);
+    }
+    ctrl = (uint16_t)((ctrl & ~MSI_CTRL_MME_MASK) | MSI_CTRL_ENABLE); /* one message */
+    pci_write16(dev, cap + 2, ctrl);
+    pci_write16(dev, PCI_COMMAND, pci_read16(dev, PCI_COMMAND) | PCI_COMMAND_INTX_DISABLE);
+    return vector;
+}
@@ -2,6 +2,7 @@
 #include "io.h"
 
 #define COM1_PORT 0x3F8
+#define COM2_PORT 0x2F8
 
 bool serial_init(void) {
     outb(COM1_PORT + 1, 0x00);    // Disable interrupts
@@ -24,3 +25,45 @@ void serial_write(char c) {
     }
     outb(COM1_PORT, (uint8_t)c);
 }
+
+/* An empty transmit register means the whole 16-byte FIFO is free, so one
+   status poll covers a burst instead of every character. */
+void serial_write_chars(const char *s, size_t len) {
+    while (len) {
+        const size_t burst = len < 16 ? len : 16;
+        while (!serial_is_ready()) {
+        }
+        for (size_t i = 0; i < burst; i++) {
+            outb(COM1_PORT, (uint8_t)s[i]);
+        }
+        s += burst;
+        len -= burst;
+    }
+}
+
+/* COM2 carries binary streams such as pcap captures, away from the
+   console. Probed through the scratch register since QEMU only creates
+   it when a second -serial is given. */
+bool serial_aux_init(void) {
+    outb(COM2_PORT + 7, 0xA5);
+    if (inb(COM2_PORT + 7) != 0xA5) {
+        return false;
+    }
+    outb(COM2_PORT + 1, 0x00);    // Disable interrupts
+    outb(COM2_PORT + 3, 0x80);    // Enable DLAB
+    outb(COM2_PORT + 0, 0x01);    // Set divisor to 1 (115200 baud)
+    outb(COM2_PORT + 1, 0x00);    //                  (hi byte)
+    outb(COM2_PORT + 3, 0x03);    // 8 bits, no parity, one stop bit
+    outb(COM2_PORT + 2, 0xC7);    // Enable FIFO, clear, 14-byte threshold
+    outb(COM2_PORT + 4, 0x03);    // RTS/DSR set, no IRQs
+    return true;
+}
+
+void serial_aux_write(const void *data, size_t len) {
+    const uint8_t *p = data;
+    for (size_t i = 0; i < len; i++) {
+        while (!(inb(COM2_PORT + 5) & 0x20)) {
+        }
+        outb(COM2_PORT, p[i]);
+    }
+}
@@ -0,0 +1,120 @@
+#include <stdint.h>
+
+#include "console.h"
+#include "io.h"
+#include "log.h"
+#include "module.h"
+#include "tsc.h"
+
+#define PIT_CH2 0x42
+#define PIT_CMD 0x43
+#define PIT_GATE 0x61
+#define PIT_HZ 1193182ULL
+#define CALIBRATE_MS 10ULL
+#define FALLBACK_KHZ 1000000ULL /* assume 1 GHz if the PIT never fires */
+
+static uint64_t khz = 0;
+static uint64_t boot_tsc;
+
+/*
+ * Measure the TSC against a one-shot countdown on PIT channel 2. The gate
+ * is driven through port 0x61 so the speaker stays silent; bit 5 of the
+ * same port flips once the counter reaches zero.
+ */
+static uint64_t calibrate_with_pit(void) {
+    const uint16_t latch = (uint16_t)((PIT_HZ * CALIBRATE_MS) / 1000);
+
+    outb(PIT_GATE, (uint8_t)((inb(PIT_GATE) & ~0x02) | 0x01));
+    outb(PIT_CMD, 0xB0); /* channel 2, lobyte/hibyte, mode 0 */
+    outb(PIT_CH2, (uint8_t)(latch & 0xFF));
+    outb(PIT_CH2, (uint8_t)(latch >> 8));
+
+    uint64_t start = rdtsc();
+    uint64_t spins = 0;
+    while (!(inb(PIT_GATE) & 0x20)) {
+        if (++spins > 100000000ULL) {
+            return 0;
+        }
+    }
+    uint64_t end = rdtsc();
+
+    return (end - start) / CALIBRATE_MS;
+}
+
+/*
+ * Skip the PIT when the frequency is published: hypervisors that expose
+ * the timing leaf (KVM, VMware) give TSC kHz in 0x40000010, and recent
+ * Intel parts give the crystal clock and TSC ratio in leaf 0x15.
+ */
+static uint64_t khz_from_cpuid(void) {
+    uint32_t a, b, c, d;
+    cpuid(1, 0, &a, &b, &c, &d);
+    if (c & (1u << 31)) {
+        cpuid(0x40000000, 0, &a, &b, &c, &d);
+        if (a >= 0x40000010) {
+            cpuid(0x40000010, 0, &a, &b, &c, &d);
+            if (a) {
+                return a;
+            }
+        }
+    }
+    cpuid(0, 0, &a, &b, &c, &d);
+    if (a >= 0x15) {
+        cpuid(0x15, 0, &a, &b, &c, &d);
+        if (a && b && c) {
+            return (uint64_t)c * b / a / 1000;
+        }
+    }
+    return 0;
+}
+
+void tsc_init(void) {
+    khz = khz_from_cpuid();
+    if (khz) {
+        pr_info("TSC: %lu kHz (CPUID)\n", khz);
+        return;
+    }
+    khz = calibrate_with_pit();
+    if (!khz) {
+        khz = FALLBACK_KHZ;
+        pr_warn("TSC: PIT calibration failed, assuming %lu kHz\n", khz);
+        return;
+    }
+    pr_info("TSC: %lu kHz\n", khz);
+}
+
+uint64_t tsc_mark_boot(void) {
+    boot_tsc = rdtsc();
+    return boot_tsc;
+}
+
+uint64_t tsc_boot(void) {
+    return boot_tsc;
+}
+
+uint64_t tsc_khz(void) {
+    return khz ? khz : FALLBACK_KHZ;
+}
+EXPORT_SYMBOL(tsc_khz);
+
+uint64_t tsc_cycles_to_ns(uint64_t cycles) {
+    /* split to avoid overflowing cycles * 1e6 for long intervals */
+    uint64_t k = tsc_khz();
+    return (cycles / k) * 1000000ULL + ((cycles % k) * 1000000ULL) / k;
+}
+EXPORT_SYMBOL(tsc_cycles_to_ns);
+
+uint64_t tsc_cycles_to_us(uint64_t cycles) {
+    uint64_t k = tsc_khz();
+    return (cycles / k) * 1000ULL + ((cycles % k) * 1000ULL) / k;
+}
+EXPORT_SYMBOL(tsc_cycles_to_us);
+
+void tsc_udelay(uint64_t us) {
+    const uint64_t start = rdtsc();
+    const uint64_t cycles = us * tsc_khz() / 1000;
+    while (rdtsc() - start < cycles) {
+        cpu_relax();
+    }
+}
+EXPORT_SYMBOL(tsc_udelay);
@@ -0,0 +1,321 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "console.h"
+#include "cpu.h"
+#include "io.h"
+#include "log.h"
+#include "memory.h"
+#include "virtio.h"
+
+/* virtio 1.0 PCI capability types */
+#define VIRTIO_PCI_CAP_COMMON_CFG 1
+#define VIRTIO_PCI_CAP_NOTIFY_CFG 2
+#define VIRTIO_PCI_CAP_ISR_CFG    3
+#define VIRTIO_PCI_CAP_DEVICE_CFG 4
+
+/* common configuration layout */
+#define COMMON_DFSELECT      0x00
+#define COMMON_DF            0x04
+#define COMMON_GFSELECT      0x08
+#define COMMON_GF            0x0C
+#define COMMON_MSIX          0x10
+#define COMMON_NUMQ          0x12
+#define COMMON_STATUS        0x14
+#define COMMON_CFG_GEN       0x15
+#define COMMON_Q_SELECT      0x16
+#define COMMON_Q_SIZE        0x18
+#define COMMON_Q_MSIX        0x1A
+#define COMMON_Q_ENABLE      0x1C
+#define COMMON_Q_NOFF        0x1E
+#define COMMON_Q_DESC        0x20
+#define COMMON_Q_AVAIL       0x28
+#define COMMON_Q_USED        0x30
+
+static inline void virtio_wmb(void) {
+    __asm__ volatile ("" ::: "memory"); /* x86 keeps stores ordered */
+}
+
+static inline void virtio_mb(void) {
+    __asm__ volatile ("mfence" ::: "memory");
+}
+
+static volatile uint8_t *cap_window(struct pci_dev *pci, uint8_t cap) {
+    uint8_t bar = pci_read8(pci, cap + 4);
+    uint32_t offset = pci_read32(pci, cap + 8);
+    if (bar > 5 || !pci->bar[bar].virt) {
+        return 0;
+    }
+    return (volatile uint8_t *)pci->bar[bar].virt + offset;
+}
+
+bool virtio_pci_init(struct virtio_device *vdev, struct pci_dev *pci) {
+    memset(vdev, 0, sizeof(*vdev));
+    vdev->pci = pci;
+
+    for (uint8_t cap = pci_find_capability(pci, PCI_CAP_ID_VNDR, 0); cap;
+         cap = pci_find_capability(pci, PCI_CAP_ID_VNDR, cap)) {
+        switch (pci_read8(pci, cap + 3)) {
+        case VIRTIO_PCI_CAP_COMMON_CFG:
+            if (!vdev->common) {
+                vdev->common = cap_window(pci, cap);
+            }
+            break;
+        case VIRTIO_PCI_CAP_NOTIFY_CFG:
+            if (!vdev->notify_base) {
+                vdev->notify_base = cap_window(pci, cap);
+                vdev->notify_multiplier = pci_read32(pci, cap + 16);
+            }
+            break;
+        case VIRTIO_PCI_CAP_ISR_CFG:
+            if (!vdev->isr) {
+                vdev->isr = cap_window(pci, cap);
+            }
+            break;
+        case VIRTIO_PCI_CAP_DEVICE_CFG:
+            if (!vdev->device_cfg) {
+                vdev->device_cfg = cap_window(pci, cap);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (!vdev->common || !vdev->notify_base) {
+        pr_warn("virtio: device has no modern (1.0) interface, legacy-only is unsupported\n");
+        return false;
+    }
+
+    pci_enable_device(pci);
+    mmio_write8(vdev->common + COMMON_STATUS, 0); /* reset */
+    while (mmio_read8(vdev->common + COMMON_STATUS) != 0) {
+        cpu_relax();
+    }
+    mmio_write8(vdev->common + COMMON_STATUS, VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER);
+    return true;
+}
+
+bool virtio_negotiate(struct virtio_device *vdev, uint64_t wanted) {
+    volatile uint8_t *c = vdev->common;
+    mmio_write32(c + COMMON_DFSELECT, 0);
+    uint64_t offered = mmio_read32(c + COMMON_DF);
+    mmio_write32(c + COMMON_DFSELECT, 1);
+    offered |= (uint64_t)mmio_read32(c + COMMON_DF) << 32;
+
+    vdev->features = offered & (wanted | VIRTIO_F_VERSION_1);
+    mmio_write32(c + COMMON_GFSELECT, 0);
+    mmio_write32(c + COMMON_GF, (uint32_t)vdev->features);
+    mmio_write32(c + COMMON_GFSELECT, 1);
+    mmio_write32(c + COMMON_GF, (uint32_t)(vdev->features >> 32));
+
+    uint8_t status = mmio_read8(c + COMMON_STATUS);
+    mmio_write8(c + COMMON_STATUS, status | VIRTIO_STATUS_FEATURES_OK);
+    if (!(mmio_read8(c + COMMON_STATUS) & VIRTIO_STATUS_FEATURES_OK)) {
+        virtio_fail(vdev);
+        return false;
+    }
+    return true;
+}
+
+uint16_t virtio_num_queues(const struct virtio_device *vdev) {
+    return mmio_read16(vdev->common + COMMON_NUMQ);
+}
+
+struct virtqueue *virtio_setup_queue(struct virtio_device *vdev, uint16_t index, uint16_t max_size, uint16_t msix_vector) {
+    volatile uint8_t *c = vdev->common;
+    mmio_write16(c + COMMON_Q_SELECT, index);
+    uint16_t size = mmio_read16(c + COMMON_Q_SIZE);
+    if (!size) {
+        return 0;
+    }
+    if (size > max_size) {
+        size = max_size;
+    }
+    if (size > VIRTIO_MAX_QUEUE_SIZE) {
+        size = VIRTIO_MAX_QUEUE_SIZE;
+    }
+
+    const size_t desc_bytes = sizeof(struct virtq_desc) * size;
+    const size_t avail_bytes = sizeof(struct virtq_avail) + sizeof(uint16_t) * (size + 1);
+    const size_t used_off = (desc_bytes + avail_bytes + 3) & ~(size_t)3;
+    const size_t used_bytes = sizeof(struct virtq_used) + sizeof(struct virtq_used_elem) * size + sizeof(uint16_t);
+
+    struct virtqueue *vq = bump_alloc(sizeof(*vq), 16);
+    uint8_t *ring = bump_alloc(used_off + used_bytes, 4096);
+    void **tokens = bump_alloc(sizeof(void *) * size, 8);
+    if (!vq || !ring || !tokens) {
+        return 0;
+    }
+    memset(vq, 0, sizeof(*vq));
+    memset(ring, 0, used_off + used_bytes);
+    memset(tokens, 0, sizeof(void *) * size);
+
+    vq->index = index;
+    vq->size = size;
+    vq->desc = (struct virtq_desc *)ring;
+    vq->avail = (struct virtq_avail *)(ring + desc_bytes);
+    vq->used = (struct virtq_used *)(ring + used_off);
+    vq->tokens = tokens;
+    for (uint16_t i = 0; i < size; i++) {
+        vq->desc[i].next = (uint16_t)(i + 1);
+    }
+    vq->free_head = 0;
+    vq->num_free = size;
+
+    uint16_t notify_off = mmio_read16(c + COMMON_Q_NOFF);
+    vq->notify = (volatile uint16_t *)(vdev->notify_base + (uint32_t)notify_off * vdev->notify_multiplier);
+
+    mmio_write16(c + COMMON_Q_SIZE, size);
+    mmio_write16(c + COMMON_Q_MSIX, msix_vector);
+    mmio_write32(c + COMMON_Q_DESC, (uint32_t)(uintptr_t)vq->desc);
+    mmio_write32(c + COMMON_Q_DESC + 4, (uint32_t)((uint64_t)(uintptr_t)vq->desc >> 32));
+    mmio_write32(c + COMMON_Q_AVAIL, (uint32_t)(uintptr_t)vq->avail);
+    mmio_write32(c + COMMON_Q_AVAIL + 4, (uint32_t)((uint64_t)(uintptr_t)vq->avail >> 32));
+    mmio_write32(c + COMMON_Q_USED, (uint32_t)(uintptr_t)vq->used);
+    mmio_write32(c + COMMON_Q_USED + 4, (uint32_t)((uint64_t)(uintptr_t)vq->used >> 32));
+    mmio_write16(c + COMMON_Q_ENABLE, 1);
+    return vq;
+}
+
+void virtio_driver_ok(struct virtio_device *vdev) {
+    uint8_t status = mmio_read8(vdev->common + COMMON_STATUS);
+    mmio_write8(vdev->common + COMMON_STATUS, status | VIRTIO_STATUS_DRIVER_OK);
+}
+
+void virtio_fail(struct virtio_device *vdev) {
+    uint8_t status = mmio_read8(vdev->common + COMMON_STATUS);
+    mmio_write8(vdev->common + COMMON_STATUS, status | VIRTIO_STATUS_FAILED);
+}
+
+uint8_t virtio_cfg_read8(const struct virtio_device *vdev, uint32_t offset) {
+    return mmio_read8(vdev->device_cfg + offset);
+}
+
+uint16_t virtio_cfg_read16(const struct virtio_device *vdev, uint32_t offset) {
+    return mmio_read16(vdev->device_cfg + offset);
+}
+
+uint32_t virtio_cfg_read32(const struct virtio_device *vdev, uint32_t offset) {
+    return mmio_read32(vdev->device_cfg + offset);
+}
+
+uint64_t virtio_cfg_read64(const struct virtio_device *vdev, uint32_t offset) {
+    /* retry until the generation counter shows a consistent snapshot */
+    uint8_t gen;
+    uint64_t value;
+    do {
+        gen = mmio_read8(vdev->common + COMMON_CFG_GEN);
+        value = mmio_read32(vdev->device_cfg + offset);
+        value |= (uint64_t)mmio_read32(vdev->device_cfg + offset + 4) << 32;
+    } while (gen != mmio_read8(vdev->common + COMMON_CFG_GEN));
+    return value;
+}
+
+int virtq_add(struct virtqueue *vq, const struct virtq_sg *sg, size_t count, void *token) {
+    if (!count || count > vq->num_free) {
+        return -1;
+    }
+
+    const uint16_t head = vq->free_head;
+    uint16_t idx = head;
+    uint16_t last = head;
+    for (size_t i = 0; i < count; i++) {
+        struct virtq_desc *d = &vq->desc[idx];
+        d->addr = (uint64_t)(uintptr_t)sg[i].addr;
+        d->len = sg[i].len;
+        d->flags = (uint16_t)((sg[i].write ? VIRTQ_DESC_F_WRITE : 0) | (i + 1 < count ? VIRTQ_DESC_F_NEXT : 0));
+        last = idx;
+        idx = d->next;
+    }
+    vq->free_head = vq->desc[last].next;
+    vq->num_free = (uint16_t)(vq->num_free - count);
+    vq->tokens[head] = token;
+
+    vq->avail->ring[vq->avail->idx % vq->size] = head;
+    virtio_wmb();
+    vq->avail->idx++;
+    return head;
+}
+
+int virtq_add_indirect(struct virtqueue *vq, const struct virtq_sg *sg, size_t count, void *token,
+                       struct virtq_desc *table) {
+    if (!count || !vq->num_free) {
+        return -1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        table[i].addr = (uint64_t)(uintptr_t)sg[i].addr;
+        table[i].len = sg[i].len;
+        table[i].flags = (uint16_t)((sg[i].write ? VIRTQ_DESC_F_WRITE : 0) | (i + 1 < count ? VIRTQ_DESC_F_NEXT : 0));
+        table[i].next = (uint16_t)(i + 1);
+    }
+
+    const uint16_t head = vq->free_head;
+    struct virtq_desc *d = &vq->desc[head];
+    vq->free_head = d->next;
+    vq->num_free--;
+    d->addr = (uint64_t)(uintptr_t)table;
+    d->len = (uint32_t)(sizeof(struct virtq_desc) * count);
+    d->flags = VIRTQ_DESC_F_INDIRECT;
+    vq->tokens[head] = token;
+
+    vq->avail->ring[vq->avail->idx % vq->size] = head;
+    virtio_wmb();
+    vq->avail->idx++;
+    return head;
+}
+
+void virtq_kick(struct virtqueue *vq) {
+    virtio_mb();
+    /* the device is already polling this ring; skip the MMIO exit */
+    if (*(volatile uint16_t *)&vq->used->flags & VIRTQ_USED_F_NO_NOTIFY) {
+        return;
+    }
+    mmio_write16(vq->notify, vq->index);
+}
+
+bool virtq_has_used(const struct virtqueue *vq) {
+    return *(volatile uint16_t *)&vq->used->idx != vq->last_used;
+}
+
+/* Only a hint to the device; a completion may still race in. */
+void virtq_disable_cb(struct virtqueue *vq) {
+    vq->avail->flags |= VIRTQ_AVAIL_F_NO_INTERRUPT;
+}
+
+/* Re-arm interrupts; false means work arrived meanwhile and the caller
+   should keep polling instead of waiting for an interrupt. */
+bool virtq_enable_cb(struct virtqueue *vq) {
+    vq->avail->flags &= (uint16_t)~VIRTQ_AVAIL_F_NO_INTERRUPT;
+    virtio_mb();
+    return !virtq_has_used(vq);
+}
+
+void *virtq_get_used(struct virtqueue *vq, uint32_t *len) {
+    if (!virtq_has_used(vq)) {
+        return 0;
+    }
+    virtio_mb();
+    const struct virtq_used_elem *e = &vq->used->ring[vq->last_used % vq->size];
+    uint16_t head = (uint16_t)e->id;
+    if (len) {
+        *len = e->len;
+    }
+    vq->last_used++;
+
+    void *token = vq->tokens[head];
+    vq->tokens[head] = 0;
+
+    /* return the chain to the free list */
+    uint16_t idx = head;
+    uint16_t freed = 1;
+    while (vq->desc[idx].flags & VIRTQ_DESC_F_NEXT) {
+        idx = vq->desc[idx].next;
+        freed++;
+    }
+    vq->desc[idx].next = vq->free_head;
+    vq->free_head = head;
+    vq->num_free = (uint16_t)(vq->num_free + freed);
+    return token;
+}
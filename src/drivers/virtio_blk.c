@@ -0,0 +1,137 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "block.h"
+#include "console.h"
+#include "cpu.h"
+#include "log.h"
+#include "memory.h"
+#include "pci.h"
+#include "virtio.h"
+#include "virtio_blk.h"
+
+#define VIRTIO_BLK_MAX_DEVICES 4
+#define VIRTIO_BLK_QUEUE_SIZE 256
+#define VIRTIO_BLK_MAX_SEGS 64 /* data descriptors per request; bounds stack use */
+#define VIRTIO_BLK_F_SEG_MAX (1ULL << 2)
+
+#define VIRTIO_BLK_T_IN  0
+#define VIRTIO_BLK_T_OUT 1
+
+#define VIRTIO_BLK_CFG_CAPACITY 0
+#define VIRTIO_BLK_CFG_SEG_MAX  12
+
+#define POLL_LIMIT 200000000ULL
+
+struct virtio_blk_req_hdr {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t sector;
+} __attribute__((packed));
+
+struct virtio_blk {
+    struct virtio_device vdev;
+    struct virtqueue *vq;
+    struct block_device bdev;
+};
+
+static struct virtio_blk disks[VIRTIO_BLK_MAX_DEVICES];
+static size_t disk_count = 0;
+
+/* Requests complete synchronously: queue, kick and spin on the used ring.
+   Batching happens above us, so one large request is the common case. */
+static bool virtio_blk_submit(struct block_device *dev, uint64_t sector, const struct block_vec *vecs,
+                              size_t count, bool write) {
+    struct virtio_blk *blk = (struct virtio_blk *)dev->priv;
+    struct virtq_sg sg[VIRTIO_BLK_MAX_SEGS + 2];
+    struct virtio_blk_req_hdr hdr = { write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN, 0, sector };
+    volatile uint8_t status = 0xFF;
+
+    if (count > VIRTIO_BLK_MAX_SEGS || count + 2 > blk->vq->size) {
+        return false;
+    }
+    sg[0] = (struct virtq_sg){ &hdr, sizeof(hdr), false };
+    for (size_t i = 0; i < count; i++) {
+        sg[i + 1] = (struct virtq_sg){ vecs[i].buf, vecs[i].len, !write };
+    }
+    sg[count + 1] = (struct virtq_sg){ (void *)&status, 1, true };
+
+    if (virtq_add(blk->vq, sg, count + 2, &hdr) < 0) {
+        return false;
+    }
+    virtq_kick(blk->vq);
+
+    for (uint64_t spins = 0; !virtq_has_used(blk->vq); spins++) {
+        if (spins > POLL_LIMIT) {
+            pr_err_ratelimited("virtio-blk: %s request timed out\n", dev->name);
+            return false;
+        }
+        cpu_relax();
+    }
+    virtq_get_used(blk->vq, 0);
+    return status == 0;
+}
+
+static const struct block_device_ops virtio_blk_ops = {
+    .submit = virtio_blk_submit,
+};
+
+static bool virtio_blk_probe(struct pci_dev *pci, const struct pci_device_id *id) {
+    (void)id;
+    if (disk_count >= VIRTIO_BLK_MAX_DEVICES) {
+        return false;
+    }
+    struct virtio_blk *blk = &disks[disk_count];
+    if (!virtio_pci_init(&blk->vdev, pci)) {
+        return false;
+    }
+    if (!virtio_negotiate(&blk->vdev, VIRTIO_BLK_F_SEG_MAX)) {
+        pr_err("virtio-blk: feature negotiation failed\n");
+        return false;
+    }
+    blk->vq = virtio_setup_queue(&blk->vdev, 0, VIRTIO_BLK_QUEUE_SIZE, VIRTIO_NO_VECTOR);
+    if (!blk->vq) {
+        virtio_fail(&blk->vdev);
+        return false;
+    }
+
+    uint32_t seg_max = blk->vq->size - 2 < VIRTIO_BLK_MAX_SEGS ? blk->vq->size - 2 : VIRTIO_BLK_MAX_SEGS;
+    if (blk->vdev.features & VIRTIO_BLK_F_SEG_MAX) {
+        uint32_t dev_max = virtio_cfg_read32(&blk->vdev, VIRTIO_BLK_CFG_SEG_MAX);
+        if (dev_max && dev_max < seg_max) {
+            seg_max = dev_max;
+        }
+    }
+
+    struct block_device *bdev = &blk->bdev;
+    bdev->name[0] = 'v';
+    bdev->name[1] = 'd';
+    bdev->name[2] = (char)('a' + disk_count);
+    bdev->name[3] = '\0';
+    bdev->sector_size = 512;
+    bdev->sectors = virtio_cfg_read64(&blk->vdev, VIRTIO_BLK_CFG_CAPACITY);
+    bdev->max_vecs = seg_max;
+    bdev->ops = &virtio_blk_ops;
+    bdev->priv = blk;
+
+    virtio_driver_ok(&blk->vdev);
+    disk_count++;
+    return block_register(bdev);
+}
+
+static const struct pci_device_id virtio_blk_ids[] = {
+    { 0x1AF4, 0x1001 }, /* transitional */
+    { 0x1AF4, 0x1042 }, /* modern */
+    { 0, 0 },
+};
+
+static const struct pci_driver virtio_blk_driver = {
+    .name = "virtio-blk",
+    .id_table = virtio_blk_ids,
+    .probe = virtio_blk_probe,
+};
+
+void virtio_blk_init(void) {
+    pci_register_driver(&virtio_blk_driver);
+}
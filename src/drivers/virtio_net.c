@@ -0,0 +1,411 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "acpi.h"
+#include "console.h"
+#include "cpu.h"
+#include "inet.h"
+#include "interrupts.h"
+#include "lapic.h"
+#include "log.h"
+#include "memory.h"
+#include "netdev.h"
+#include "pci.h"
+#include "skbuff.h"
+#include "tsc.h"
+#include "virtio.h"
+#include "virtio_net.h"
+
+#define VIRTIO_NET_MAX_DEVICES 2
+#define VIRTIO_NET_MAX_PAIRS 8
+#define VIRTIO_NET_QUEUE_SIZE 256
+#define RX_REFILL_BATCH 32
+#define TX_MAX_SG (2 + MAX_SKB_FRAGS)
+#define TX_RECLAIM_THRESHOLD 32
+#define CTRL_POLL_LIMIT 100000000ULL
+
+#define VIRTIO_NET_F_MAC       (1ULL << 5)
+#define VIRTIO_NET_F_MRG_RXBUF (1ULL << 15)
+#define VIRTIO_NET_F_STATUS    (1ULL << 16)
+#define VIRTIO_NET_F_CTRL_VQ   (1ULL << 17)
+#define VIRTIO_NET_F_MQ        (1ULL << 22)
+
+#define VIRTIO_NET_CFG_MAC       0
+#define VIRTIO_NET_CFG_MAX_PAIRS 8
+
+#define VIRTIO_NET_CTRL_MQ 4
+#define VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET 0
+
+struct virtio_net_hdr {
+    uint8_t flags;
+    uint8_t gso_type;
+    uint16_t hdr_len;
+    uint16_t gso_size;
+    uint16_t csum_start;
+    uint16_t csum_offset;
+    uint16_t num_buffers; /* always present with VERSION_1 */
+} __attribute__((packed));
+
+/* The device writes its header right in front of the frame so the frame
+   itself lands at NET_SKB_PAD and can become an skb without a copy. */
+#define RX_HDR_OFFSET (NET_SKB_PAD - sizeof(struct virtio_net_hdr))
+#define RX_BUF_LEN    (SKB_BUF_DATA - RX_HDR_OFFSET)
+
+struct virtio_net;
+
+struct vnet_queue_pair {
+    struct napi_struct napi; /* first, so poll() can recover the pair */
+    struct virtio_net *vn;
+    struct virtqueue *rx;
+    struct virtqueue *tx;
+    struct virtq_desc *tx_tables; /* TX_MAX_SG indirect entries per ring slot */
+    uint64_t irqs;
+};
+
+struct virtio_net {
+    struct virtio_device vdev;
+    struct net_device ndev;
+    struct virtqueue *ctrl;
+    struct vnet_queue_pair pairs[VIRTIO_NET_MAX_PAIRS];
+    uint16_t pair_count;
+    bool mergeable;
+    bool indirect;
+};
+
+static struct virtio_net nics[VIRTIO_NET_MAX_DEVICES];
+static size_t nic_count = 0;
+
+/* We offer no offloads, so every packet carries the same all-zero header
+   and the device only ever reads it. */
+static const struct virtio_net_hdr tx_hdr;
+
+static void rx_refill(struct vnet_queue_pair *qp) {
+    if (qp->rx->num_free < RX_REFILL_BATCH) {
+        return;
+    }
+    bool added = false;
+    while (qp->rx->num_free) {
+        uint8_t *buf = skb_frag_alloc();
+        if (!buf) {
+            break;
+        }
+        struct virtq_sg sg = { buf + RX_HDR_OFFSET, RX_BUF_LEN, true };
+        if (virtq_add(qp->rx, &sg, 1, buf) < 0) {
+            skb_frag_put(buf);
+            break;
+        }
+        added = true;
+    }
+    if (added) {
+        virtq_kick(qp->rx);
+    }
+}
+
+static void tx_reclaim(struct vnet_queue_pair *qp) {
+    struct sk_buff *skb;
+    while ((skb = virtq_get_used(qp->tx, 0)) != 0) {
+        skb_free(skb);
+    }
+}
+
+/* Turn one used RX chain (num_buffers entries with MRG_RXBUF) into an skb. */
+static struct sk_buff *rx_build(struct vnet_queue_pair *qp, uint8_t *buf, uint32_t len) {
+    struct virtio_net *vn = qp->vn;
+    const struct virtio_net_hdr *hdr = (const struct virtio_net_hdr *)(buf + RX_HDR_OFFSET);
+    uint16_t extra = vn->mergeable && hdr->num_buffers > 1 ? (uint16_t)(hdr->num_buffers - 1) : 0;
+
+    struct sk_buff *skb = 0;
+    if (len >= sizeof(*hdr)) {
+        skb = skb_build(buf, NET_SKB_PAD, len - (uint32_t)sizeof(*hdr));
+    }
+    if (!skb) {
+        skb_frag_put(buf);
+    }
+    while (extra--) {
+        uint32_t frag_len = 0;
+        uint8_t *frag = virtq_get_used(qp->rx, &frag_len);
+        if (!frag) {
+            break;
+        }
+        if (!skb || !skb_add_frag(skb, frag, (uint16_t)RX_HDR_OFFSET, (uint16_t)frag_len)) {
+            skb_frag_put(frag);
+            skb_free(skb);
+            skb = 0;
+        }
+    }
+    return skb;
+}
+
+static int vnet_poll(struct napi_struct *napi, int budget) {
+    struct vnet_queue_pair *qp = (struct vnet_queue_pair *)napi;
+    struct net_device *dev = &qp->vn->ndev;
+    int work = 0;
+
+    tx_reclaim(qp);
+    while (work < budget) {
+        uint32_t len = 0;
+        uint8_t *buf = virtq_get_used(qp->rx, &len);
+        if (!buf) {
+            break;
+        }
+        work++;
+        struct sk_buff *skb = rx_build(qp, buf, len);
+        if (!skb) {
+            dev->stats.rx_dropped++;
+            continue;
+        }
+        dev->stats.rx_packets++;
+        dev->stats.rx_bytes += skb->len;
+        skb->dev = dev;
+        netif_receive_skb(skb);
+    }
+    rx_refill(qp);
+
+    if (work < budget) {
+        napi_complete(napi);
+        if (!virtq_enable_cb(qp->rx)) {
+            /* raced with a new completion: keep polling */
+            virtq_disable_cb(qp->rx);
+            napi_schedule(napi);
+        }
+    }
+    return work;
+}
+
+/* Mask further RX interrupts for this pair and defer to polling. */
+static void vnet_irq(struct interrupt_frame *frame, void *ctx) {
+    (void)frame;
+    struct vnet_queue_pair *qp = ctx;
+    qp->irqs++;
+    virtq_disable_cb(qp->rx);
+    napi_schedule(&qp->napi);
+}
+
+static bool vnet_xmit(struct net_device *dev, struct sk_buff *skb) {
+    struct virtio_net *vn = dev->priv;
+    struct vnet_queue_pair *qp = &vn->pairs[lapic_id() % vn->pair_count];
+    struct virtq_sg sg[TX_MAX_SG];
+    const struct skb_shared_info *sh = skb_shinfo(skb);
+
+    if (qp->tx->num_free < TX_RECLAIM_THRESHOLD) {
+        tx_reclaim(qp);
+    }
+
+    size_t n = 0;
+    sg[n++] = (struct virtq_sg){ (void *)&tx_hdr, sizeof(tx_hdr), false };
+    if (skb_headlen(skb)) {
+        sg[n++] = (struct virtq_sg){ skb->data, skb_headlen(skb), false };
+    }
+    for (uint8_t i = 0; i < sh->nr_frags; i++) {
+        sg[n++] = (struct virtq_sg){ sh->frags[i].buf + sh->frags[i].offset, sh->frags[i].size, false };
+    }
+
+    const uint32_t len = skb->len;
+    int head;
+    if (vn->indirect) {
+        head = virtq_add_indirect(qp->tx, sg, n, skb, &qp->tx_tables[qp->tx->free_head * TX_MAX_SG]);
+    } else {
+        head = virtq_add(qp->tx, sg, n, skb);
+    }
+    if (head < 0) {
+        dev->stats.tx_dropped++;
+        skb_free(skb);
+        return false;
+    }
+    virtq_kick(qp->tx);
+    dev->stats.tx_packets++;
+    dev->stats.tx_bytes += len;
+    return true;
+}
+
+static const struct net_device_ops vnet_ops = {
+    .xmit = vnet_xmit,
+};
+
+static bool ctrl_set_pairs(struct virtio_net *vn, uint16_t pairs) {
+    struct {
+        uint8_t class;
+        uint8_t cmd;
+        uint16_t pairs;
+    } __attribute__((packed)) cmd = { VIRTIO_NET_CTRL_MQ, VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET, pairs };
+    volatile uint8_t ack = 0xFF;
+    struct virtq_sg sg[2] = {
+        { &cmd, sizeof(cmd), false },
+        { (void *)&ack, 1, true },
+    };
+    if (virtq_add(vn->ctrl, sg, 2, &cmd) < 0) {
+        return false;
+    }
+    virtq_kick(vn->ctrl);
+    for (uint64_t spins = 0; !virtq_has_used(vn->ctrl); spins++) {
+        if (spins > CTRL_POLL_LIMIT) {
+            return false;
+        }
+        cpu_relax();
+    }
+    virtq_get_used(vn->ctrl, 0);
+    return ack == 0;
+}
+
+static bool virtio_net_probe(struct pci_dev *pci, const struct pci_device_id *id) {
+    (void)id;
+    if (nic_count >= VIRTIO_NET_MAX_DEVICES) {
+        return false;
+    }
+    struct virtio_net *vn = &nics[nic_count];
+    if (!virtio_pci_init(&vn->vdev, pci)) {
+        return false;
+    }
+    int vectors = pci_msix_enable(pci);
+    if (vectors <= 0) {
+        pr_warn("virtio-net: MSI-X required for interrupt-driven polling\n");
+        virtio_fail(&vn->vdev);
+        return false;
+    }
+    if (!virtio_negotiate(&vn->vdev, VIRTIO_NET_F_MAC | VIRTIO_NET_F_MRG_RXBUF | VIRTIO_NET_F_STATUS |
+                                     VIRTIO_NET_F_CTRL_VQ | VIRTIO_NET_F_MQ | VIRTIO_F_RING_INDIRECT_DESC)) {
+        pr_err("virtio-net: feature negotiation failed\n");
+        return false;
+    }
+    const uint64_t features = vn->vdev.features;
+    vn->mergeable = features & VIRTIO_NET_F_MRG_RXBUF;
+    vn->indirect = features & VIRTIO_F_RING_INDIRECT_DESC;
+
+    /* one RX/TX pair per CPU, bounded by what the device and MSI-X offer */
+    uint32_t cpus[VIRTIO_NET_MAX_PAIRS];
+    uint16_t max_pairs = 1;
+    if ((features & VIRTIO_NET_F_MQ) && (features & VIRTIO_NET_F_CTRL_VQ)) {
+        max_pairs = virtio_cfg_read16(&vn->vdev, VIRTIO_NET_CFG_MAX_PAIRS);
+    }
+    uint16_t pairs = (uint16_t)acpi_cpu_apic_ids(cpus, VIRTIO_NET_MAX_PAIRS);
+    if (pairs > max_pairs) {
+        pairs = max_pairs;
+    }
+    if (pairs > vectors) {
+        pairs = (uint16_t)vectors;
+    }
+
+    /* Queue interrupts stay on this CPU until the others are brought up;
+       the per-pair vectors let them be re-steered later. */
+    const uint32_t apic = lapic_id();
+    for (uint16_t i = 0; i < pairs; i++) {
+        struct vnet_queue_pair *qp = &vn->pairs[i];
+        qp->vn = vn;
+        qp->napi.poll = vnet_poll;
+        qp->napi.dev = &vn->ndev;
+        if (pci_msix_route(pci, i, apic, vnet_irq, qp) < 0) {
+            break;
+        }
+        qp->rx = virtio_setup_queue(&vn->vdev, (uint16_t)(2 * i), VIRTIO_NET_QUEUE_SIZE, i);
+        qp->tx = virtio_setup_queue(&vn->vdev, (uint16_t)(2 * i + 1), VIRTIO_NET_QUEUE_SIZE, VIRTIO_NO_VECTOR);
+        if (!qp->rx || !qp->tx) {
+            break;
+        }
+        if (vn->indirect) {
+            qp->tx_tables = bump_alloc(sizeof(struct virtq_desc) * TX_MAX_SG * qp->tx->size, 16);
+            if (!qp->tx_tables) {
+                break;
+            }
+        }
+        /* TX completions are reaped lazily on the next transmit or poll */
+        virtq_disable_cb(qp->tx);
+        vn->pair_count++;
+    }
+    if (!vn->pair_count) {
+        virtio_fail(&vn->vdev);
+        return false;
+    }
+    if (features & VIRTIO_NET_F_CTRL_VQ) {
+        vn->ctrl = virtio_setup_queue(&vn->vdev, (uint16_t)(2 * max_pairs), 16, VIRTIO_NO_VECTOR);
+    }
+
+    struct net_device *ndev = &vn->ndev;
+    ndev->name[0] = 'e';
+    ndev->name[1] = 't';
+    ndev->name[2] = 'h';
+    ndev->name[3] = (char)('0' + nic_count);
+    ndev->name[4] = '\0';
+    ndev->mtu = 1500;
+    ndev->ops = &vnet_ops;
+    ndev->priv = vn;
+    if (features & VIRTIO_NET_F_MAC) {
+        for (uint32_t i = 0; i < ETH_ALEN; i++) {
+            ndev->mac[i] = virtio_cfg_read8(&vn->vdev, VIRTIO_NET_CFG_MAC + i);
+        }
+    }
+
+    virtio_driver_ok(&vn->vdev);
+    if (vn->pair_count > 1 && (!vn->ctrl || !ctrl_set_pairs(vn, vn->pair_count))) {
+        pr_warn("virtio-net: could not enable %u queue pairs, using one\n", vn->pair_count);
+        vn->pair_count = 1;
+    }
+    for (uint16_t i = 0; i < vn->pair_count; i++) {
+        rx_refill(&vn->pairs[i]);
+    }
+
+    pr_info("virtio-net: %u queue pairs, %s RX buffers, %s TX descriptors\n", vn->pair_count,
+            vn->mergeable ? "mergeable" : "single", vn->indirect ? "indirect" : "chained");
+    nic_count++;
+    return netdev_register(ndev);
+}
+
+static const struct pci_device_id virtio_net_ids[] = {
+    { 0x1AF4, 0x1000 }, /* transitional */
+    { 0x1AF4, 0x1041 }, /* modern */
+    { 0, 0 },
+};
+
+static const struct pci_driver virtio_net_driver = {
+    .name = "virtio-net",
+    .id_table = virtio_net_ids,
+    .probe = virtio_net_probe,
+};
+
+void virtio_net_init(void) {
+    pci_register_driver(&virtio_net_driver);
+}
+
+#ifdef CONFIG_VIRTIO_NET_BENCH
+#define NIC_BENCH_TX_PACKETS 200000
+
+static struct sk_buff *nic_bench_frame(struct net_device *dev, uint16_t proto, uint32_t len) {
+    struct sk_buff *skb = skb_alloc(len);
+    if (!skb) {
+        return 0;
+    }
+    struct ethhdr *eth = skb_put(skb, len);
+    memset(eth->dest, 0xFF, ETH_ALEN);
+    memcpy(eth->source, dev->mac, ETH_ALEN);
+    eth->proto = htons(proto);
+    skb->dev = dev;
+    return skb;
+}
+
+void virtio_net_bench(void) {
+    struct net_device *dev = netdev_find("eth0");
+    if (!dev) {
+        kprint("nic bench: no eth0\n");
+        return;
+    }
+
+    const uint64_t sent_before = dev->stats.tx_packets;
+    const uint64_t start = tsc_read();
+    for (uint32_t i = 0; i < NIC_BENCH_TX_PACKETS; i++) {
+        struct sk_buff *skb = nic_bench_frame(dev, ETH_P_BENCH, 64);
+        if (!skb) {
+            break;
+        }
+        dev_queue_xmit(skb);
+    }
+    const uint64_t ns = tsc_cycles_to_ns(tsc_read() - start);
+    const uint64_t sent = dev->stats.tx_packets - sent_before;
+    kprint("nic bench: tx 64 B: %lu sent, %lu dropped, %lu pps\n", sent, dev->stats.tx_dropped,
+           ns ? sent * 1000000000 / ns : 0);
+
+    if (dev->ipv4_gateway) {
+        ping_bench("nic bench", dev->ipv4_gateway);
+    }
+    kprint("nic bench: rx %lu packets, %lu dropped\n", dev->stats.rx_packets, dev->stats.rx_dropped);
+}
+#endif
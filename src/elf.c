@@ -0,0 +1,138 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "elf.h"
+#include "memory.h"
+
+/* the loader places every SHF_ALLOC section in one page-aligned block */
+#define ELF_MAX_ALIGN 4096
+#define BAD_WIDTH 0xff
+
+static bool in_image(uint64_t offset, uint64_t len, size_t size) {
+    return offset <= size && len <= size - offset;
+}
+
+/* Bytes a relocation writes, BAD_WIDTH for types the loader lacks. */
+static uint32_t rela_width(uint32_t type) {
+    switch (type) {
+    case R_X86_64_NONE:
+        return 0;
+    case R_X86_64_64:
+    case R_X86_64_PC64:
+        return 8;
+    case R_X86_64_32:
+    case R_X86_64_32S:
+    case R_X86_64_PC32:
+    case R_X86_64_PLT32:
+        return 4;
+    default:
+        return BAD_WIDTH;
+    }
+}
+
+static const char *check_sections(size_t size, const Elf64_Shdr *sh, uint16_t shnum) {
+    uint64_t total = 0;
+    for (uint16_t i = 0; i < shnum; i++) {
+        if (sh[i].sh_type != SHT_NOBITS && !in_image(sh[i].sh_offset, sh[i].sh_size, size)) {
+            return "section out of bounds";
+        }
+        const uint64_t align = sh[i].sh_addralign ? sh[i].sh_addralign : 1;
+        if ((align & (align - 1)) || align > ELF_MAX_ALIGN) {
+            return "section misaligned";
+        }
+        if ((sh[i].sh_type == SHT_SYMTAB || sh[i].sh_type == SHT_RELA) && (sh[i].sh_offset & 7)) {
+            return "section misaligned";
+        }
+        if (!(sh[i].sh_flags & SHF_ALLOC)) {
+            continue;
+        }
+        /* the same sum layout_sections() makes, without wrapping */
+        total = (total + align - 1) & ~(align - 1);
+        if (sh[i].sh_size > UINT64_MAX - ELF_MAX_ALIGN - total) {
+            return "sections too large";
+        }
+        total += sh[i].sh_size;
+    }
+    return 0;
+}
+
+static const char *check_symbols(const uint8_t *image, const Elf64_Shdr *sh, uint16_t shnum, uint16_t symndx) {
+    const Elf64_Shdr *symtab = &sh[symndx];
+    if (symtab->sh_size % sizeof(Elf64_Sym) || symtab->sh_link >= shnum) {
+        return "bad symbol table";
+    }
+    const Elf64_Shdr *strtab = &sh[symtab->sh_link];
+    const char *strings = (const char *)(image + strtab->sh_offset);
+    if (strtab->sh_type != SHT_STRTAB || !strtab->sh_size || strings[strtab->sh_size - 1] != '\0') {
+        return "bad string table";
+    }
+    const Elf64_Sym *syms = (const Elf64_Sym *)(image + symtab->sh_offset);
+    const size_t nsyms = symtab->sh_size / sizeof(Elf64_Sym);
+    for (size_t i = 0; i < nsyms; i++) {
+        if (syms[i].st_name >= strtab->sh_size) {
+            return "symbol name out of bounds";
+        }
+        const uint16_t shndx = syms[i].st_shndx;
+        if (shndx >= shnum && shndx != SHN_ABS && shndx != SHN_COMMON) {
+            return "symbol in bad section";
+        }
+    }
+    return 0;
+}
+
+/* Only relocations that apply_rela() will process: those aimed at an
+   SHF_ALLOC section. */
+static const char *check_relocations(const uint8_t *image, const Elf64_Shdr *sh, uint16_t shnum, uint16_t symndx) {
+    const size_t nsyms = sh[symndx].sh_size / sizeof(Elf64_Sym);
+    for (uint16_t i = 0; i < shnum; i++) {
+        if (sh[i].sh_type != SHT_RELA || sh[i].sh_info >= shnum || !(sh[sh[i].sh_info].sh_flags & SHF_ALLOC)) {
+            continue;
+        }
+        if (sh[i].sh_link != symndx || sh[i].sh_size % sizeof(Elf64_Rela)) {
+            return "bad relocation section";
+        }
+        const Elf64_Shdr *target = &sh[sh[i].sh_info];
+        const Elf64_Rela *r = (const Elf64_Rela *)(image + sh[i].sh_offset);
+        const size_t count = sh[i].sh_size / sizeof(*r);
+        for (size_t j = 0; j < count; j++) {
+            const uint32_t width = rela_width(ELF64_R_TYPE(r[j].r_info));
+            if (width == BAD_WIDTH) {
+                return "unsupported relocation type";
+            }
+            if (ELF64_R_SYM(r[j].r_info) >= nsyms || r[j].r_offset > target->sh_size ||
+                target->sh_size - r[j].r_offset < width) {
+                return "relocation out of bounds";
+            }
+        }
+    }
+    return 0;
+}
+
+const char *elf_check_rel(const uint8_t *image, size_t size) {
+    const Elf64_Ehdr *eh = (const Elf64_Ehdr *)image;
+    if (size < sizeof(*eh) || memcmp(eh->e_ident, ELF_MAGIC, 4) != 0 || eh->e_ident[4] != ELFCLASS64 ||
+        eh->e_ident[5] != ELFDATA2LSB || eh->e_type != ET_REL || eh->e_machine != EM_X86_64) {
+        return "not an x86_64 relocatable ELF object";
+    }
+    if (eh->e_shentsize != sizeof(Elf64_Shdr) || (eh->e_shoff & 7) ||
+        !in_image(eh->e_shoff, (uint64_t)eh->e_shnum * sizeof(Elf64_Shdr), size)) {
+        return "section headers out of bounds";
+    }
+    const Elf64_Shdr *sh = (const Elf64_Shdr *)(image + eh->e_shoff);
+    const uint16_t shnum = eh->e_shnum;
+    const char *err = check_sections(size, sh, shnum);
+    if (err) {
+        return err;
+    }
+
+    uint16_t symndx = 0;
+    while (symndx < shnum && sh[symndx].sh_type != SHT_SYMTAB) {
+        symndx++;
+    }
+    if (symndx == shnum) {
+        return "no symbol table";
+    }
+    err = check_symbols(image, sh, shnum, symndx);
+    return err ? err : check_relocations(image, sh, shnum, symndx);
+}
@@ -0,0 +1,408 @@
+#include <limits.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bench.h"
+#include "format.h"
+#include "memory.h"
+
+enum {
+    FLAG_LEFT = 1 << 0,
+    FLAG_PLUS = 1 << 1,
+    FLAG_SPACE = 1 << 2,
+    FLAG_ALT = 1 << 3,
+    FLAG_ZERO = 1 << 4,
+    FLAG_UPPER = 1 << 5,
+    FLAG_PREFIX = 1 << 6, /* 0x even for zero, as %p wants */
+};
+
+enum length {
+    LEN_INT,
+    LEN_CHAR,
+    LEN_SHORT,
+    LEN_LONG,
+    LEN_LLONG,
+    LEN_SIZE,
+    LEN_PTRDIFF,
+    LEN_MAX,
+};
+
+struct spec {
+    uint32_t flags;
+    int width;
+    int precision; /* -1 when not given */
+};
+
+static void put_chars(struct format_buf *b, const char *s, size_t n) {
+    while (n) {
+        if (b->len == b->size) {
+            if (!b->flush) {
+                return;
+            }
+            b->flush(b);
+        }
+        const size_t room = b->size - b->len;
+        const size_t chunk = n < room ? n : room;
+        char *dst = b->data + b->len;
+        for (size_t i = 0; i < chunk; i++) {
+            dst[i] = s[i];
+        }
+        b->len += chunk;
+        s += chunk;
+        n -= chunk;
+    }
+}
+
+static void put_repeat(struct format_buf *b, char c, size_t n) {
+    while (n) {
+        if (b->len == b->size) {
+            if (!b->flush) {
+                return;
+            }
+            b->flush(b);
+        }
+        const size_t room = b->size - b->len;
+        const size_t chunk = n < room ? n : room;
+        char *dst = b->data + b->len;
+        for (size_t i = 0; i < chunk; i++) {
+            dst[i] = c;
+        }
+        b->len += chunk;
+        n -= chunk;
+    }
+}
+
+static size_t pad_width(const struct spec *s, size_t body) {
+    return (size_t)s->width > body ? (size_t)s->width - body : 0;
+}
+
+static size_t put_field(struct format_buf *b, const struct spec *s, const char *text, size_t len) {
+    const size_t pad = pad_width(s, len);
+    if (!(s->flags & FLAG_LEFT)) {
+        put_repeat(b, ' ', pad);
+    }
+    put_chars(b, text, len);
+    if (s->flags & FLAG_LEFT) {
+        put_repeat(b, ' ', pad);
+    }
+    return len + pad;
+}
+
+static size_t put_number(struct format_buf *b, const struct spec *s, uint64_t value, bool negative,
+                         unsigned base) {
+    const char *digits = s->flags & FLAG_UPPER ? "0123456789ABCDEF" : "0123456789abcdef";
+    char buf[24];
+    size_t pos = sizeof(buf);
+    const bool zero = value == 0;
+    if (!zero || s->precision != 0) {
+        if (base == 10) {
+            do {
+                buf[--pos] = (char)('0' + value % 10);
+                value /= 10;
+            } while (value);
+        } else {
+            const unsigned shift = base == 16 ? 4 : 3;
+            do {
+                buf[--pos] = digits[value & (base - 1)];
+                value >>= shift;
+            } while (value);
+        }
+    }
+    const size_t len = sizeof(buf) - pos;
+
+    char prefix[2];
+    size_t prefix_len = 0;
+    if (negative) {
+        prefix[prefix_len++] = '-';
+    } else if (s->flags & FLAG_PLUS) {
+        prefix[prefix_len++] = '+';
+    } else if (s->flags & FLAG_SPACE) {
+        prefix[prefix_len++] = ' ';
+    }
+    if (base == 16 && (s->flags & FLAG_PREFIX || (s->flags & FLAG_ALT && !zero))) {
+        prefix[prefix_len++] = '0';
+        prefix[prefix_len++] = s->flags & FLAG_UPPER ? 'X' : 'x';
+    }
+
+    size_t zeros = s->precision > 0 && (size_t)s->precision > len ? (size_t)s->precision - len : 0;
+    if (base == 8 && s->flags & FLAG_ALT && !zeros && (len == 0 || buf[pos] != '0')) {
+        zeros = 1;
+    }
+    if (s->precision < 0 && (s->flags & (FLAG_ZERO | FLAG_LEFT)) == FLAG_ZERO) {
+        const size_t fill = pad_width(s, prefix_len + len);
+        zeros = fill > zeros ? fill : zeros;
+    }
+
+    const size_t body = prefix_len + zeros + len;
+    const size_t pad = pad_width(s, body);
+    if (!(s->flags & FLAG_LEFT)) {
+        put_repeat(b, ' ', pad);
+    }
+    put_chars(b, prefix, prefix_len);
+    put_repeat(b, '0', zeros);
+    put_chars(b, buf + pos, len);
+    if (s->flags & FLAG_LEFT) {
+        put_repeat(b, ' ', pad);
+    }
+    return body + pad;
+}
+
+static int64_t fetch_signed(va_list *args, enum length length) {
+    switch (length) {
+    case LEN_CHAR:
+        return (signed char)va_arg(*args, int);
+    case LEN_SHORT:
+        return (short)va_arg(*args, int);
+    case LEN_LONG:
+        return va_arg(*args, long);
+    case LEN_LLONG:
+        return va_arg(*args, long long);
+    case LEN_SIZE:
+        return (int64_t)va_arg(*args, size_t);
+    case LEN_PTRDIFF:
+        return va_arg(*args, ptrdiff_t);
+    case LEN_MAX:
+        return va_arg(*args, intmax_t);
+    default:
+        return va_arg(*args, int);
+    }
+}
+
+static uint64_t fetch_unsigned(va_list *args, enum length length) {
+    switch (length) {
+    case LEN_CHAR:
+        return (unsigned char)va_arg(*args, unsigned int);
+    case LEN_SHORT:
+        return (unsigned short)va_arg(*args, unsigned int);
+    case LEN_LONG:
+        return va_arg(*args, unsigned long);
+    case LEN_LLONG:
+        return va_arg(*args, unsigned long long);
+    case LEN_SIZE:
+        return va_arg(*args, size_t);
+    case LEN_PTRDIFF:
+        return (uint64_t)va_arg(*args, ptrdiff_t);
+    case LEN_MAX:
+        return va_arg(*args, uintmax_t);
+    default:
+        return va_arg(*args, unsigned int);
+    }
+}
+
+static int clamp_width(int v) {
+    return v > FORMAT_WIDTH_MAX ? FORMAT_WIDTH_MAX : v;
+}
+
+/* digits of a width or precision, saturating instead of overflowing */
+static int parse_digits(const char **p) {
+    int v = 0;
+    while (**p >= '0' && **p <= '9') {
+        if (v <= FORMAT_WIDTH_MAX) {
+            v = v * 10 + (**p - '0');
+        }
+        (*p)++;
+    }
+    return clamp_width(v);
+}
+
+static const char *parse_flags(const char *p, uint32_t *flags) {
+    for (;; p++) {
+        switch (*p) {
+        case '-':
+            *flags |= FLAG_LEFT;
+            break;
+        case '+':
+            *flags |= FLAG_PLUS;
+            break;
+        case ' ':
+            *flags |= FLAG_SPACE;
+            break;
+        case '#':
+            *flags |= FLAG_ALT;
+            break;
+        case '0':
+            *flags |= FLAG_ZERO;
+            break;
+        default:
+            return p;
+        }
+    }
+}
+
+static const char *parse_length(const char *p, enum length *length) {
+    switch (*p) {
+    case 'h':
+        if (p[1] == 'h') {
+            *length = LEN_CHAR;
+            return p + 2;
+        }
+        *length = LEN_SHORT;
+        return p + 1;
+    case 'l':
+        if (p[1] == 'l') {
+            *length = LEN_LLONG;
+            return p + 2;
+        }
+        *length = LEN_LONG;
+        return p + 1;
+    case 'z':
+        *length = LEN_SIZE;
+        return p + 1;
+    case 't':
+        *length = LEN_PTRDIFF;
+        return p + 1;
+    case 'j':
+        *length = LEN_MAX;
+        return p + 1;
+    default:
+        *length = LEN_INT;
+        return p;
+    }
+}
+
+size_t vformat(struct format_buf *b, const char *fmt, va_list args) {
+    va_list ap;
+    va_copy(ap, args);
+    size_t n = 0;
+    const char *p = fmt;
+    while (*p) {
+        if (*p != '%') {
+            const char *run = p;
+            while (*p && *p != '%') {
+                p++;
+            }
+            put_chars(b, run, (size_t)(p - run));
+            n += (size_t)(p - run);
+            continue;
+        }
+
+        struct spec s = { 0, 0, -1 };
+        p = parse_flags(p + 1, &s.flags);
+        if (*p == '*') {
+            const int w = va_arg(ap, int);
+            if (w < 0) {
+                s.flags |= FLAG_LEFT;
+            }
+            s.width = clamp_width(w < 0 ? (w == INT_MIN ? FORMAT_WIDTH_MAX : -w) : w);
+            p++;
+        } else {
+            s.width = parse_digits(&p);
+        }
+        if (*p == '.') {
+            p++;
+            if (*p == '*') {
+                const int prec = va_arg(ap, int);
+                s.precision = prec < 0 ? -1 : clamp_width(prec);
+                p++;
+            } else {
+                s.precision = parse_digits(&p);
+            }
+        }
+        enum length length;
+        p = parse_length(p, &length);
+
+        switch (*p) {
+        case 'd':
+        case 'i': {
+            const int64_t v = fetch_signed(&ap, length);
+            n += put_number(b, &s, v < 0 ? 0 - (uint64_t)v : (uint64_t)v, v < 0, 10);
+            break;
+        }
+        case 'u':
+            n += put_number(b, &s, fetch_unsigned(&ap, length), false, 10);
+            break;
+        case 'o':
+            n += put_number(b, &s, fetch_unsigned(&ap, length), false, 8);
+            break;
+        case 'X':
+            s.flags |= FLAG_UPPER;
+            /* fall through */
+        case 'x':
+            n += put_number(b, &s, fetch_unsigned(&ap, length), false, 16);
+            break;
+        case 'p':
+            s.flags = (s.flags & FLAG_LEFT) | FLAG_PREFIX;
+            s.precision = s.precision > 16 ? s.precision : 16;
+            n += put_number(b, &s, (uintptr_t)va_arg(ap, void *), false, 16);
+            break;
+        case 'c': {
+            const char c = (char)va_arg(ap, int);
+            n += put_field(b, &s, &c, 1);
+            break;
+        }
+        case 's': {
+            const char *str = va_arg(ap, const char *);
+            if (!str) {
+                str = "(null)";
+            }
+            size_t len = 0;
+            while ((s.precision < 0 || len < (size_t)s.precision) && str[len]) {
+                len++;
+            }
+            n += put_field(b, &s, str, len);
+            break;
+        }
+        case '%':
+            put_chars(b, "%", 1);
+            n++;
+            break;
+        case '\0':
+            /* a lone '%' ends the string; do not step past it */
+            put_chars(b, "?", 1);
+            va_end(ap);
+            return n + 1;
+        default:
+            put_chars(b, "?", 1);
+            n++;
+            break;
+        }
+        p++;
+    }
+    va_end(ap);
+    return n;
+}
+
+int vsnprintf(char *buf, size_t size, const char *fmt, va_list args) {
+    struct format_buf b = { buf, size ? size - 1 : 0, 0, 0 };
+    const size_t n = vformat(&b, fmt, args);
+    if (size) {
+        buf[b.len] = '\0';
+    }
+    return n > INT_MAX ? INT_MAX : (int)n;
+}
+
+int snprintf(char *buf, size_t size, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    const int n = vsnprintf(buf, size, fmt, args);
+    va_end(args);
+    return n;
+}
+
+#ifdef CONFIG_MICROBENCH
+/* One typical console line; the inverse of the median is lines per second. */
+static void bench_snprintf_line(uint64_t loops) {
+    char line[128];
+    for (uint64_t i = 0; i < loops; i++) {
+        const int n = snprintf(line, sizeof(line), "pci: %02x:%02x.%x %04x:%04x bound to %s, bar0 %#lx\n",
+                               (unsigned)(i & 0xFF), 3u, 0u, 0x1AF4u, 0x1041u, "virtio-net", 0xFEBC1000UL + i);
+        bench_clobber(line);
+        bench_clobber(&n);
+    }
+}
+
+BENCH(format, snprintf_line, bench_snprintf_line);
+
+static void bench_snprintf_decimal(uint64_t loops) {
+    char line[64];
+    for (uint64_t i = 0; i < loops; i++) {
+        const int n = snprintf(line, sizeof(line), "%lu", UINT64_MAX - i);
+        bench_clobber(line);
+        bench_clobber(&n);
+    }
+}
+
+BENCH(format, snprintf_u64, bench_snprintf_decimal);
+#endif
@@ -0,0 +1,536 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "string.h"
+
+#include "block.h"
+#include "console.h"
+#include "ext2.h"
+#include "log.h"
+#include "memory.h"
+#include "page_cache.h"
+#include "paging.h"
+#include "tsc.h"
+#include "vfs.h"
+
+#define EXT2_SUPER_OFFSET 1024
+#define EXT2_MAGIC 0xEF53
+#define EXT2_ROOT_INO 2
+#define EXT2_NDIR_BLOCKS 12
+#define EXT2_IND_BLOCK 12
+#define EXT2_DIND_BLOCK 13
+#define EXT2_TIND_BLOCK 14
+
+#define EXT2_FEATURE_INCOMPAT_FILETYPE 0x0002
+#define EXT2_FEATURE_INCOMPAT_FLEX_BG  0x0200
+#define EXT2_SUPPORTED_INCOMPAT (EXT2_FEATURE_INCOMPAT_FILETYPE | EXT2_FEATURE_INCOMPAT_FLEX_BG)
+
+#define EXT2_MAX_MOUNTS 4
+#define ICACHE_BUCKETS 64
+#define META_SETS 32
+#define META_WAYS 4
+#define READ_VECS 64
+
+struct ext2_super {
+    uint32_t inodes_count;
+    uint32_t blocks_count;
+    uint32_t r_blocks_count;
+    uint32_t free_blocks_count;
+    uint32_t free_inodes_count;
+    uint32_t first_data_block;
+    uint32_t log_block_size;
+    uint32_t log_frag_size;
+    uint32_t blocks_per_group;
+    uint32_t frags_per_group;
+    uint32_t inodes_per_group;
+    uint32_t mtime;
+    uint32_t wtime;
+    uint16_t mnt_count;
+    uint16_t max_mnt_count;
+    uint16_t magic;
+    uint16_t state;
+    uint16_t errors;
+    uint16_t minor_rev_level;
+    uint32_t lastcheck;
+    uint32_t checkinterval;
+    uint32_t creator_os;
+    uint32_t rev_level;
+    uint16_t def_resuid;
+    uint16_t def_resgid;
+    uint32_t first_ino;
+    uint16_t inode_size;
+    uint16_t block_group_nr;
+    uint32_t feature_compat;
+    uint32_t feature_incompat;
+    uint32_t feature_ro_compat;
+} __attribute__((packed));
+
+struct ext2_group_desc {
+    uint32_t block_bitmap;
+    uint32_t inode_bitmap;
+    uint32_t inode_table;
+    uint16_t free_blocks_count;
+    uint16_t free_inodes_count;
+    uint16_t used_dirs_count;
+    uint16_t pad;
+    uint32_t reserved[3];
+} __attribute__((packed));
+
+struct ext2_disk_inode {
+    uint16_t mode;
+    uint16_t uid;
+    uint32_t size;
+    uint32_t atime;
+    uint32_t ctime;
+    uint32_t mtime;
+    uint32_t dtime;
+    uint16_t gid;
+    uint16_t links_count;
+    uint32_t blocks;
+    uint32_t flags;
+    uint32_t osd1;
+    uint32_t block[15];
+    uint32_t generation;
+    uint32_t file_acl;
+    uint32_t size_high;
+} __attribute__((packed));
+
+struct ext2_dirent {
+    uint32_t inode;
+    uint16_t rec_len;
+    uint8_t name_len;
+    uint8_t file_type;
+    char name[];
+} __attribute__((packed));
+
+/* Metadata blocks (group tables, inode tables, indirect blocks, bitmaps)
+   live in a small set-associative cache so walking a big file's indirect
+   tree does not go back to the device for every mapping. */
+struct meta_buf {
+    uint32_t block;
+    uint32_t stamp;
+    uint8_t *data;
+};
+
+struct ext2_fs {
+    struct block_device *dev;
+    uint32_t block_size;
+    uint32_t sectors_per_block;
+    uint32_t inode_size;
+    uint32_t inodes_per_group;
+    uint32_t groups;
+    uint32_t blocks_count;
+    struct ext2_group_desc *gdt;
+    struct meta_buf meta[META_SETS][META_WAYS];
+    uint32_t meta_clock;
+    uint64_t meta_hits;
+    uint64_t meta_misses;
+    struct ext2_inode_info *icache[ICACHE_BUCKETS];
+};
+
+struct ext2_inode_info {
+    struct inode vfs;
+    struct ext2_fs *fs;
+    uint32_t block[15];
+    /* last physically contiguous run handed out by map_run() */
+    uint32_t ext_lblk;
+    uint32_t ext_pblk;
+    uint32_t ext_len;
+    struct ext2_inode_info *hash_next;
+};
+
+static struct ext2_fs filesystems[EXT2_MAX_MOUNTS];
+static size_t fs_count = 0;
+static struct object_pool inode_pool = OBJECT_POOL("ext2_inode", struct ext2_inode_info);
+
+static const struct inode_operations ext2_dir_iops;
+static const struct address_space_ops ext2_aops;
+
+static const uint8_t *meta_block(struct ext2_fs *fs, uint32_t block) {
+    struct meta_buf *set = fs->meta[block % META_SETS];
+    struct meta_buf *victim = &set[0];
+    for (int i = 0; i < META_WAYS; i++) {
+        if (set[i].data && set[i].block == block) {
+            set[i].stamp = ++fs->meta_clock;
+            fs->meta_hits++;
+            return set[i].data;
+        }
+        if (!set[i].data || set[i].stamp < victim->stamp) {
+            victim = &set[i];
+        }
+    }
+
+    fs->meta_misses++;
+    if (!victim->data) {
+        victim->data = page_alloc();
+        if (!victim->data) {
+            return 0;
+        }
+    }
+    if (!block_read(fs->dev, (uint64_t)block * fs->sectors_per_block, victim->data, fs->block_size)) {
+        victim->block = 0;
+        victim->stamp = 0;
+        return 0;
+    }
+    victim->block = block;
+    victim->stamp = ++fs->meta_clock;
+    return victim->data;
+}
+
+static bool read_disk_inode(struct ext2_fs *fs, uint32_t ino, struct ext2_disk_inode *out) {
+    if (ino == 0 || (ino - 1) / fs->inodes_per_group >= fs->groups) {
+        return false;
+    }
+    const uint32_t group = (ino - 1) / fs->inodes_per_group;
+    const uint64_t offset = (uint64_t)((ino - 1) % fs->inodes_per_group) * fs->inode_size;
+    const uint32_t block = fs->gdt[group].inode_table + (uint32_t)(offset / fs->block_size);
+    const uint8_t *data = meta_block(fs, block);
+    if (!data) {
+        return false;
+    }
+    memcpy(out, data + offset % fs->block_size, sizeof(*out));
+    return true;
+}
+
+static struct inode *get_inode(struct ext2_fs *fs, uint32_t ino) {
+    struct ext2_inode_info **bucket = &fs->icache[ino % ICACHE_BUCKETS];
+    for (struct ext2_inode_info *ei = *bucket; ei; ei = ei->hash_next) {
+        if (ei->vfs.ino == ino) {
+            return &ei->vfs;
+        }
+    }
+
+    struct ext2_disk_inode raw;
+    if (!read_disk_inode(fs, ino, &raw)) {
+        return 0;
+    }
+    struct ext2_inode_info *ei = pool_alloc(&inode_pool);
+    if (!ei) {
+        return 0;
+    }
+    memset(ei, 0, sizeof(*ei));
+    ei->fs = fs;
+    memcpy(ei->block, raw.block, sizeof(ei->block));
+    ei->vfs.ino = ino;
+    ei->vfs.mode = raw.mode;
+    ei->vfs.size = raw.size;
+    if ((raw.mode & VFS_MODE_TYPE) == VFS_MODE_REG) {
+        ei->vfs.size |= (uint64_t)raw.size_high << 32;
+    }
+    ei->vfs.i_op = (raw.mode & VFS_MODE_TYPE) == VFS_MODE_DIR ? &ext2_dir_iops : 0;
+    ei->vfs.a_ops = &ext2_aops;
+    ei->vfs.private = ei;
+
+    ei->hash_next = *bucket;
+    *bucket = ei;
+    return &ei->vfs;
+}
+
+/*
+ * Map logical block lblk and report how many following blocks are
+ * physically contiguous with it (or, for holes, also holes). Runs never
+ * cross an indirect block boundary, so one cached table answers the lot.
+ */
+static uint32_t map_run(struct ext2_inode_info *ei, uint32_t lblk, uint32_t max, uint32_t *pblk) {
+    struct ext2_fs *fs = ei->fs;
+    if (ei->ext_len && lblk >= ei->ext_lblk && lblk < ei->ext_lblk + ei->ext_len) {
+        uint32_t skip = lblk - ei->ext_lblk;
+        uint32_t left = ei->ext_len - skip;
+        *pblk = ei->ext_pblk ? ei->ext_pblk + skip : 0;
+        return left < max ? left : max;
+    }
+
+    const uint32_t apb = fs->block_size / 4;
+    const uint32_t *table = ei->block;
+    uint32_t idx = lblk;
+    uint32_t limit = EXT2_NDIR_BLOCKS;
+
+    if (lblk >= EXT2_NDIR_BLOCKS) {
+        uint32_t rel = lblk - EXT2_NDIR_BLOCKS;
+        uint32_t path[3];
+        uint32_t depth;
+        uint32_t root;
+        if (rel < apb) {
+            depth = 1;
+            root = ei->block[EXT2_IND_BLOCK];
+            path[0] = rel;
+        } else if ((rel -= apb) < apb * apb) {
+            depth = 2;
+            root = ei->block[EXT2_DIND_BLOCK];
+            path[0] = rel / apb;
+            path[1] = rel % apb;
+        } else {
+            rel -= apb * apb;
+            depth = 3;
+            root = ei->block[EXT2_TIND_BLOCK];
+            path[0] = rel / (apb * apb);
+            path[1] = (rel / apb) % apb;
+            path[2] = rel % apb;
+        }
+
+        uint32_t block = root;
+        for (uint32_t level = 0; level + 1 < depth && block; level++) {
+            const uint32_t *t = (const uint32_t *)meta_block(fs, block);
+            block = t ? t[path[level]] : 0;
+        }
+        if (!block) {
+            *pblk = 0;
+            return 1;
+        }
+        table = (const uint32_t *)meta_block(fs, block);
+        if (!table) {
+            *pblk = 0;
+            return 0;
+        }
+        idx = path[depth - 1];
+        limit = apb;
+    }
+
+    const uint32_t first = table[idx];
+    uint32_t n = 1;
+    while (n < max && idx + n < limit) {
+        uint32_t next = table[idx + n];
+        if (first ? next != first + n : next != 0) {
+            break;
+        }
+        n++;
+    }
+    *pblk = first;
+    ei->ext_lblk = lblk;
+    ei->ext_pblk = first;
+    ei->ext_len = n;
+    return n;
+}
+
+struct read_batch {
+    struct ext2_fs *fs;
+    uint32_t next_pblk;
+    uint32_t first_pblk;
+    size_t count;
+    struct block_vec vecs[READ_VECS];
+};
+
+static bool batch_flush(struct read_batch *b) {
+    if (!b->count) {
+        return true;
+    }
+    bool ok = block_rw(b->fs->dev, (uint64_t)b->first_pblk * b->fs->sectors_per_block, b->vecs, b->count, false);
+    b->count = 0;
+    return ok;
+}
+
+/* Append one block; neighbours on disk and in memory share a vec. */
+static bool batch_add(struct read_batch *b, uint32_t pblk, uint8_t *dest) {
+    if (b->count && pblk != b->next_pblk) {
+        if (!batch_flush(b)) {
+            return false;
+        }
+    }
+    if (b->count) {
+        struct block_vec *last = &b->vecs[b->count - 1];
+        if ((uint8_t *)last->buf + last->len == dest) {
+            last->len += b->fs->block_size;
+            b->next_pblk = pblk + 1;
+            return true;
+        }
+        if (b->count == READ_VECS && !batch_flush(b)) {
+            return false;
+        }
+    }
+    if (!b->count) {
+        b->first_pblk = pblk;
+    }
+    b->vecs[b->count].buf = dest;
+    b->vecs[b->count].len = b->fs->block_size;
+    b->count++;
+    b->next_pblk = pblk + 1;
+    return true;
+}
+
+static bool ext2_readpages(struct inode *inode, uint64_t index, void *const *pages, size_t count) {
+    struct ext2_inode_info *ei = (struct ext2_inode_info *)inode->private;
+    struct ext2_fs *fs = ei->fs;
+    const uint32_t per_page = (uint32_t)(PAGE_SIZE / fs->block_size);
+    const uint64_t file_blocks = (inode->size + fs->block_size - 1) / fs->block_size;
+    const uint64_t first = index * per_page;
+    const uint32_t total = (uint32_t)(count * per_page);
+    struct read_batch batch;
+    batch.fs = fs;
+    batch.count = 0;
+
+    for (uint32_t i = 0; i < total;) {
+        uint8_t *dest = (uint8_t *)pages[i / per_page] + (i % per_page) * fs->block_size;
+        if (first + i >= file_blocks) {
+            memset(dest, 0, fs->block_size);
+            i++;
+            continue;
+        }
+        uint32_t pblk = 0;
+        uint32_t run = map_run(ei, (uint32_t)(first + i), total - i, &pblk);
+        if (!run) {
+            return false;
+        }
+        for (uint32_t j = 0; j < run; j++, i++) {
+            dest = (uint8_t *)pages[i / per_page] + (i % per_page) * fs->block_size;
+            if (!pblk) {
+                memset(dest, 0, fs->block_size); /* sparse hole */
+            } else if (!batch_add(&batch, pblk + j, dest)) {
+                return false;
+            }
+        }
+    }
+    return batch_flush(&batch);
+}
+
+static const struct address_space_ops ext2_aops = {
+    .readpages = ext2_readpages,
+    .writepages = 0, /* read-only */
+};
+
+static struct inode *ext2_lookup(struct inode *dir, const char *name, size_t len) {
+    struct ext2_inode_info *ei = (struct ext2_inode_info *)dir->private;
+    struct ext2_fs *fs = ei->fs;
+    uint8_t *buf = page_alloc();
+    if (!buf) {
+        return 0;
+    }
+
+    uint32_t found = 0;
+    for (uint64_t off = 0; off < dir->size && !found; off += fs->block_size) {
+        size_t got = page_cache_read(dir, off, buf, fs->block_size);
+        for (size_t pos = 0; pos + sizeof(struct ext2_dirent) <= got;) {
+            const struct ext2_dirent *de = (const struct ext2_dirent *)(buf + pos);
+            if (de->rec_len < sizeof(struct ext2_dirent) || pos + de->rec_len > got) {
+                break;
+            }
+            if (de->inode && de->name_len == len && memcmp(de->name, name, len) == 0) {
+                found = de->inode;
+                break;
+            }
+            pos += de->rec_len;
+        }
+    }
+    page_free(buf);
+    return found ? get_inode(fs, found) : 0;
+}
+
+static const struct inode_operations ext2_dir_iops = {
+    .lookup = ext2_lookup,
+};
+
+static struct inode *ext2_mount(struct block_device *dev) {
+    if (fs_count >= EXT2_MAX_MOUNTS) {
+        return 0;
+    }
+    uint8_t *buf = page_alloc();
+    if (!buf) {
+        return 0;
+    }
+    if (!block_read(dev, EXT2_SUPER_OFFSET / dev->sector_size, buf, 1024)) {
+        page_free(buf);
+        return 0;
+    }
+    struct ext2_super sb;
+    memcpy(&sb, buf, sizeof(sb));
+    page_free(buf);
+
+    if (sb.magic != EXT2_MAGIC) {
+        return 0;
+    }
+    if (sb.rev_level >= 1 && (sb.feature_incompat & ~EXT2_SUPPORTED_INCOMPAT)) {
+        pr_err("ext2: %s has unsupported incompat features %#x\n", dev->name, sb.feature_incompat);
+        return 0;
+    }
+    const uint32_t block_size = 1024u << sb.log_block_size;
+    if (block_size > PAGE_SIZE || !sb.blocks_per_group || !sb.inodes_per_group) {
+        return 0;
+    }
+
+    struct ext2_fs *fs = &filesystems[fs_count];
+    memset(fs, 0, sizeof(*fs));
+    fs->dev = dev;
+    fs->block_size = block_size;
+    fs->sectors_per_block = block_size / dev->sector_size;
+    fs->inode_size = sb.rev_level >= 1 ? sb.inode_size : 128;
+    fs->inodes_per_group = sb.inodes_per_group;
+    fs->blocks_count = sb.blocks_count;
+    fs->groups = (sb.blocks_count - sb.first_data_block + sb.blocks_per_group - 1) / sb.blocks_per_group;
+
+    /* the whole group descriptor table stays resident for the mount */
+    const uint32_t gdt_bytes = fs->groups * sizeof(struct ext2_group_desc);
+    const uint32_t gdt_blocks = (gdt_bytes + block_size - 1) / block_size;
+    fs->gdt = bump_alloc((size_t)gdt_blocks * block_size, 16);
+    if (!fs->gdt || !block_read(dev, (uint64_t)(sb.first_data_block + 1) * fs->sectors_per_block, fs->gdt,
+                                gdt_blocks * block_size)) {
+        return 0;
+    }
+
+    struct inode *root = get_inode(fs, EXT2_ROOT_INO);
+    if (!root || !vfs_is_dir(root)) {
+        return 0;
+    }
+    fs_count++;
+    pr_info("ext2: %s block size %u, %u groups, %u free blocks\n", dev->name, block_size, fs->groups,
+            sb.free_blocks_count);
+    return root;
+}
+
+static const struct filesystem_type ext2_fs_type = {
+    .name = "ext2",
+    .mount = ext2_mount,
+};
+
+void ext2_init(void) {
+    vfs_register_filesystem(&ext2_fs_type);
+}
+
+void ext2_log_stats(void) {
+    for (size_t i = 0; i < fs_count; i++) {
+        kprint("ext2: %s metadata cache hits %lu misses %lu\n", filesystems[i].dev->name,
+               filesystems[i].meta_hits, filesystems[i].meta_misses);
+    }
+}
+
+#ifdef CONFIG_EXT2_BENCH
+#define EXT2_BENCH_CHUNK (1024 * 1024)
+
+void ext2_bench(void) {
+    const uint64_t lookup_start = tsc_read();
+    struct inode *inode = vfs_lookup(CONFIG_EXT2_BENCH_FILE);
+    const uint64_t lookup_cold = tsc_read() - lookup_start;
+    uint8_t *buf = bump_alloc(EXT2_BENCH_CHUNK, 4096);
+    if (!inode || !buf) {
+        kprint("ext2 bench: %s not found\n", CONFIG_EXT2_BENCH_FILE);
+        return;
+    }
+    const uint64_t relookup_start = tsc_read();
+    vfs_lookup(CONFIG_EXT2_BENCH_FILE);
+    const uint64_t lookup_warm = tsc_read() - relookup_start;
+
+    struct block_device *dev = block_first();
+    const uint64_t requests = dev->read_requests;
+    const uint64_t bytes = dev->read_bytes;
+    const uint64_t start = tsc_read();
+    uint64_t total = 0;
+    for (uint64_t off = 0; off < inode->size; off += EXT2_BENCH_CHUNK) {
+        size_t got = vfs_read(inode, off, buf, EXT2_BENCH_CHUNK);
+        if (!got) {
+            kprint("ext2 bench: read failed at %lu\n", off);
+            break;
+        }
+        total += got;
+    }
+    const uint64_t us = tsc_cycles_to_us(tsc_read() - start);
+    const uint64_t reqs = dev->read_requests - requests;
+    struct vfs_stats vs;
+    vfs_get_stats(&vs);
+
+    kprint("ext2 bench: %lu MiB in %lu us (%lu MiB/s)\n", total >> 20, us, us ? (total >> 20) * 1000000 / us : 0);
+    kprint("ext2 bench: %lu device reads, avg %lu KiB per request\n", reqs,
+           reqs ? ((dev->read_bytes - bytes) / reqs) >> 10 : 0);
+    kprint("ext2 bench: lookup cold %lu ns warm %lu ns, dcache hits %lu misses %lu\n",
+           tsc_cycles_to_ns(lookup_cold), tsc_cycles_to_ns(lookup_warm), vs.dcache_hits, vs.dcache_misses);
+    ext2_log_stats();
+    page_cache_log_stats();
+}
+#endif
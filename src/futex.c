@@ -0,0 +1,183 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bench.h"
+#include "cpuidle.h"
+#include "futex.h"
+#include "interrupts.h"
+#include "smp.h"
+#include "spinlock.h"
+
+#define FUTEX_BUCKETS 64
+
+/* Lives on the waiter's stack while it sleeps. */
+struct futex_waiter {
+    uintptr_t key;
+    uint32_t cpu;
+    uint32_t woken;
+    struct futex_waiter *next;
+};
+
+struct futex_bucket {
+    spinlock_t lock;
+    struct futex_waiter *head;
+} __attribute__((aligned(64)));
+
+static struct futex_bucket buckets[FUTEX_BUCKETS];
+
+/* The kernel's identity map makes a word's address its physical one. */
+static struct futex_bucket *bucket_of(uintptr_t key) {
+    const uint64_t h = (uint64_t)(key >> 2) * 0x9E3779B97F4A7C15ULL;
+    return &buckets[h >> (64 - 6)];
+}
+
+_Static_assert(FUTEX_BUCKETS == 1 << 6, "bucket_of() shift");
+
+bool futex_wait(uint32_t *word, uint32_t expected) {
+    struct futex_waiter w = { (uintptr_t)word, smp_processor_id(), 0, 0 };
+    struct futex_bucket *b = bucket_of(w.key);
+
+    uint64_t flags = spin_lock_irqsave(&b->lock);
+    /* checked under the bucket lock, so a wake after the store that
+       changed it cannot slip between the check and the enqueue */
+    if (__atomic_load_n(word, __ATOMIC_RELAXED) != expected) {
+        spin_unlock_irqrestore(&b->lock, flags);
+        return false;
+    }
+    /* a bucket holds few sleepers: walk to the end to keep them FIFO */
+    struct futex_waiter **link = &b->head;
+    while (*link) {
+        link = &(*link)->next;
+    }
+    *link = &w;
+    spin_unlock_irqrestore(&b->lock, flags);
+
+    /* the waker's smp_kick() cannot slip past the check, see smp_ap_idle() */
+    for (;;) {
+        interrupts_disable();
+        if (__atomic_load_n(&w.woken, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+        cpuidle_enter(0);
+    }
+    irq_restore(flags);
+    return true;
+}
+
+uint32_t futex_wake(uint32_t *word, uint32_t n) {
+    const uintptr_t key = (uintptr_t)word;
+    struct futex_bucket *b = bucket_of(key);
+    uint32_t cpus[NR_CPUS];
+    uint32_t woken = 0;
+
+    const uint64_t flags = spin_lock_irqsave(&b->lock);
+    struct futex_waiter **link = &b->head;
+    while (*link && woken < n) {
+        struct futex_waiter *w = *link;
+        if (w->key != key) {
+            link = &w->next;
+            continue;
+        }
+        *link = w->next;
+        /* a sleeper halts its CPU, so there are at most NR_CPUS */
+        if (woken < NR_CPUS) {
+            cpus[woken] = w->cpu;
+        }
+        woken++;
+        /* w is gone once this is visible */
+        __atomic_store_n(&w->woken, 1, __ATOMIC_RELEASE);
+    }
+    spin_unlock_irqrestore(&b->lock, flags);
+
+    for (uint32_t i = 0; i < woken && i < NR_CPUS; i++) {
+        smp_kick(cpus[i]);
+    }
+    return woken;
+}
+
+void mutex_lock_slow(struct mutex *m) {
+    /* whoever leaves 2 behind makes the next unlock wake someone */
+    uint32_t c = __atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE);
+    while (c != 0) {
+        futex_wait(&m->state, 2);
+        c = __atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE);
+    }
+}
+
+#ifdef CONFIG_MICROBENCH
+/* Kernel-side only: no syscall entry or user-mode return is measured.
+   The contended and handoff cases pair the boot CPU with the first AP;
+   on a single CPU they only measure the boot CPU's half. */
+struct futex_bench {
+    struct mutex lock;
+    uint32_t turn;
+    uint64_t loops;
+    uint64_t counter;
+};
+
+static struct futex_bench fb __attribute__((aligned(64)));
+
+static uint32_t bench_partner(void) {
+    for (uint32_t cpu = 1; cpu < NR_CPUS; cpu++) {
+        if (smp_cpu_online(cpu)) {
+            return cpu;
+        }
+    }
+    return NR_CPUS;
+}
+
+static void bench_mutex_uncontended(uint64_t loops) {
+    for (uint64_t i = 0; i < loops; i++) {
+        mutex_lock(&fb.lock);
+        fb.counter++;
+        mutex_unlock(&fb.lock);
+    }
+}
+BENCH(futex, mutex_uncontended, bench_mutex_uncontended);
+
+static void contend(void *arg) {
+    const uint64_t loops = (uint64_t)(uintptr_t)arg;
+    for (uint64_t i = 0; i < loops; i++) {
+        mutex_lock(&fb.lock);
+        fb.counter++;
+        mutex_unlock(&fb.lock);
+    }
+}
+
+static void bench_mutex_contended(uint64_t loops) {
+    const uint32_t cpu = bench_partner();
+    smp_call(cpu, contend, (void *)(uintptr_t)loops);
+    contend((void *)(uintptr_t)loops);
+    smp_call_wait(cpu);
+}
+BENCH(futex, mutex_contended, bench_mutex_contended);
+
+/* One op is a round trip: the boot CPU hands turn to the partner, sleeps
+   until it comes back, and each side wakes the other through the futex. */
+static void handoff_partner(void *arg) {
+    const uint64_t loops = (uint64_t)(uintptr_t)arg;
+    for (uint64_t i = 0; i < loops; i++) {
+        while (__atomic_load_n(&fb.turn, __ATOMIC_ACQUIRE) != 1) {
+            futex_wait(&fb.turn, 0);
+        }
+        __atomic_store_n(&fb.turn, 0, __ATOMIC_RELEASE);
+        futex_wake(&fb.turn, 1);
+    }
+}
+
+static void bench_handoff(uint64_t loops) {
+    const uint32_t cpu = bench_partner();
+    if (!smp_call(cpu, handoff_partner, (void *)(uintptr_t)loops)) {
+        return;
+    }
+    for (uint64_t i = 0; i < loops; i++) {
+        __atomic_store_n(&fb.turn, 1, __ATOMIC_RELEASE);
+        futex_wake(&fb.turn, 1);
+        while (__atomic_load_n(&fb.turn, __ATOMIC_ACQUIRE) != 0) {
+            futex_wait(&fb.turn, 1);
+        }
+    }
+    smp_call_wait(cpu);
+}
+BENCH(futex, handoff, bench_handoff);
+#endif
@@ -0,0 +1,209 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gcov.h"
+#include "log.h"
+#include "memory.h"
+#include "serial.h"
+#include "string.h"
+
+#ifdef CONFIG_PGO_GENERATE
+
+/* The part of libgcov the kernel needs: gcc's per-object records, mirrored
+   from libgcc/libgcov.h, and the .gcda writer. */
+#if __GNUC__ >= 14
+#define GCOV_COUNTERS 9
+#elif __GNUC__ >= 10
+#define GCOV_COUNTERS 8
+#else
+#error "PGO_GENERATE needs gcc 10 or newer"
+#endif
+
+#define GCOV_DATA_MAGIC 0x67636461u /* "gcda" */
+#define GCOV_TAG_FUNCTION 0x01000000u
+#define GCOV_TAG_COUNTER_BASE 0x01a10000u
+#define GCOV_TAG_OBJECT_SUMMARY 0xa1000000u
+#define GCOV_TAG_FOR_COUNTER(n) (GCOV_TAG_COUNTER_BASE + ((uint32_t)(n) << 17))
+#define GCOV_COUNTER_ARCS 0
+
+/* record lengths count bytes since gcc 12, 32-bit words before */
+#if __GNUC__ >= 12
+#define GCOV_UNIT 4
+#else
+#define GCOV_UNIT 1
+#endif
+
+typedef int64_t gcov_type;
+
+struct gcov_ctr_info {
+    uint32_t num;
+    gcov_type *values;
+};
+
+/* ctrs[] holds one entry per counter kind whose merge function is set */
+struct gcov_fn_info {
+    const struct gcov_info *key;
+    uint32_t ident;
+    uint32_t lineno_checksum;
+    uint32_t cfg_checksum;
+    struct gcov_ctr_info ctrs[];
+};
+
+struct gcov_info {
+    uint32_t version;
+    struct gcov_info *next;
+    uint32_t stamp;
+#if __GNUC__ >= 12
+    uint32_t checksum;
+#endif
+    const char *filename;
+    void (*merge[GCOV_COUNTERS])(gcov_type *, uint32_t);
+    uint32_t n_functions;
+    const struct gcov_fn_info *const *functions;
+};
+
+static struct gcov_info *gcov_list;
+static uint32_t gcov_files;
+
+/* Each instrumented object registers itself from an init_array constructor. */
+void __gcov_init(struct gcov_info *info) {
+    info->next = gcov_list;
+    gcov_list = info;
+    gcov_files++;
+}
+
+/* libgcov writes and merges .gcda files at exit; the kernel dumps once
+   instead and every dump is a single run. */
+void __gcov_exit(void) {
+}
+
+void __gcov_merge_add(gcov_type *counters, uint32_t n) {
+    (void)counters;
+    (void)n;
+}
+
+extern void (*__init_array_start[])(void);
+extern void (*__init_array_end[])(void);
+
+void gcov_init(void) {
+    for (void (**ctor)(void) = __init_array_start; ctor < __init_array_end; ctor++) {
+        (*ctor)();
+    }
+}
+
+/* The first pass only counts, so the record length precedes the data
+   without buffering a whole .gcda. */
+struct gcda_writer {
+    bool emit;
+    uint32_t len;
+};
+
+static void put_u32(struct gcda_writer *w, uint32_t v) {
+    if (w->emit) {
+        serial_aux_write(&v, sizeof(v));
+    }
+    w->len += sizeof(v);
+}
+
+static void put_counter(struct gcda_writer *w, gcov_type v) {
+    put_u32(w, (uint32_t)v);
+    put_u32(w, (uint32_t)((uint64_t)v >> 32));
+}
+
+static uint32_t arcs_max(const struct gcov_info *info) {
+    gcov_type max = 0;
+    if (!info->merge[GCOV_COUNTER_ARCS]) {
+        return 0;
+    }
+    for (uint32_t f = 0; f < info->n_functions; f++) {
+        const struct gcov_fn_info *fn = info->functions[f];
+        if (!fn || fn->key != info) {
+            continue;
+        }
+        for (uint32_t i = 0; i < fn->ctrs[0].num; i++) {
+            if (fn->ctrs[0].values[i] > max) {
+                max = fn->ctrs[0].values[i];
+            }
+        }
+    }
+    return (uint32_t)max;
+}
+
+static void write_gcda(struct gcda_writer *w, const struct gcov_info *info) {
+    put_u32(w, GCOV_DATA_MAGIC);
+    put_u32(w, info->version);
+    put_u32(w, info->stamp);
+#if __GNUC__ >= 12
+    put_u32(w, info->checksum);
+#endif
+    put_u32(w, GCOV_TAG_OBJECT_SUMMARY);
+    put_u32(w, 2 * GCOV_UNIT);
+    put_u32(w, 1); /* runs */
+    put_u32(w, arcs_max(info));
+
+    for (uint32_t f = 0; f < info->n_functions; f++) {
+        const struct gcov_fn_info *fn = info->functions[f];
+        put_u32(w, GCOV_TAG_FUNCTION);
+        /* a function merged away by COMDAT folding is recorded empty */
+        if (!fn || fn->key != info) {
+            put_u32(w, 0);
+            continue;
+        }
+        put_u32(w, 3 * GCOV_UNIT);
+        put_u32(w, fn->ident);
+        put_u32(w, fn->lineno_checksum);
+        put_u32(w, fn->cfg_checksum);
+        const struct gcov_ctr_info *ctr = fn->ctrs;
+        for (uint32_t t = 0; t < GCOV_COUNTERS; t++) {
+            if (!info->merge[t]) {
+                continue;
+            }
+            put_u32(w, GCOV_TAG_FOR_COUNTER(t));
+            put_u32(w, ctr->num * 2 * GCOV_UNIT);
+            for (uint32_t i = 0; i < ctr->num; i++) {
+                put_counter(w, ctr->values[i]);
+            }
+            ctr++;
+        }
+    }
+    put_u32(w, 0);
+}
+
+void gcov_dump(void) {
+    if (!serial_aux_init()) {
+        pr_warn("pgo: no COM2, profile skipped\n");
+        return;
+    }
+    struct pgo_file_header h = {
+        .nr_files = gcov_files,
+    };
+    memcpy(h.magic, PGO_MAGIC, sizeof(h.magic));
+    serial_aux_write(&h, sizeof(h));
+
+    for (const struct gcov_info *info = gcov_list; info; info = info->next) {
+        struct gcda_writer sizer = { .emit = false };
+        write_gcda(&sizer, info);
+        const struct pgo_record_header rh = {
+            .name_len = (uint32_t)strlen(info->filename),
+            .data_len = sizer.len,
+        };
+        serial_aux_write(&rh, sizeof(rh));
+        serial_aux_write(info->filename, rh.name_len);
+        struct gcda_writer out = { .emit = true };
+        write_gcda(&out, info);
+    }
+    pr_info("pgo: %u profiles written to COM2\n", gcov_files);
+}
+
+#elif defined(CONFIG_PGO)
+
+/* PGO_USE keeps the calls so kernel.c compiles to the control flow the
+   profile was taken from. */
+void gcov_init(void) {
+}
+
+void gcov_dump(void) {
+}
+
+#endif /* CONFIG_PGO_GENERATE */
@@ -0,0 +1,82 @@
+#include <stdint.h>
+
+#include "gdt.h"
+#include "smp.h"
+
+#ifdef CONFIG_USERLAND
+
+struct tss {
+    uint32_t reserved0;
+    uint64_t rsp[3];
+    uint64_t reserved1;
+    uint64_t ist[7];
+    uint64_t reserved2;
+    uint16_t reserved3;
+    uint16_t iomap_base;
+} __attribute__((packed));
+
+struct gdt_ptr {
+    uint16_t limit;
+    uint64_t base;
+} __attribute__((packed));
+
+#define GDT_CODE64(dpl) (0x00AF9A000000FFFFULL | ((uint64_t)(dpl) << 45))
+#define GDT_DATA(dpl)   (0x00CF92000000FFFFULL | ((uint64_t)(dpl) << 45))
+#define GDT_CODE32(dpl) (0x00CF9A000000FFFFULL | ((uint64_t)(dpl) << 45))
+
+/* a TSS descriptor takes two slots */
+static uint64_t gdt[GDT_TSS / 8 + 2 * NR_CPUS] __attribute__((aligned(16)));
+static struct tss tss[NR_CPUS] __attribute__((aligned(16)));
+/* gdt_init() runs before the page allocator exists */
+static uint8_t ist_stacks[NR_CPUS][IST_COUNT][IST_STACK_SIZE] __attribute__((aligned(16)));
+
+static void set_tss_descriptor(uint32_t cpu) {
+    const uint64_t base = (uint64_t)(uintptr_t)&tss[cpu];
+    const uint64_t limit = sizeof(struct tss) - 1;
+    uint64_t *d = &gdt[GDT_TSS / 8 + 2 * cpu];
+    /* present, DPL0, available 64-bit TSS */
+    d[0] = (limit & 0xFFFF) | ((base & 0xFFFFFF) << 16) | (0x89ULL << 40) | (((limit >> 16) & 0xF) << 48) |
+           (((base >> 24) & 0xFF) << 56);
+    d[1] = base >> 32;
+}
+
+void gdt_init(void) {
+    gdt[0] = 0;
+    gdt[GDT_KERNEL_CS / 8] = GDT_CODE64(0);
+    gdt[GDT_KERNEL_DS / 8] = GDT_DATA(0);
+    gdt[GDT_USER_CS32 / 8] = GDT_CODE32(3);
+    gdt[GDT_USER_DS / 8] = GDT_DATA(3);
+    gdt[GDT_USER_CS / 8] = GDT_CODE64(3);
+    for (uint32_t cpu = 0; cpu < NR_CPUS; cpu++) {
+        /* no I/O permission bitmap: ring 3 gets #GP on every port */
+        tss[cpu].iomap_base = sizeof(struct tss);
+        for (uint32_t i = 0; i < IST_COUNT; i++) {
+            tss[cpu].ist[i] = (uint64_t)(uintptr_t)(ist_stacks[cpu][i] + IST_STACK_SIZE);
+        }
+        set_tss_descriptor(cpu);
+    }
+
+    const struct gdt_ptr ptr = { sizeof(gdt) - 1, (uint64_t)(uintptr_t)gdt };
+    __asm__ volatile ("lgdt %0" : : "m"(ptr));
+    __asm__ volatile (
+        "pushq %q0\n\t"
+        "leaq 1f(%%rip), %%rax\n\t"
+        "pushq %%rax\n\t"
+        "lretq\n"
+        "1:\n\t"
+        "mov %w1, %%ds\n\t"
+        "mov %w1, %%es\n\t"
+        "mov %w1, %%ss"
+        : : "r"((uint64_t)GDT_KERNEL_CS), "r"(GDT_KERNEL_DS) : "rax", "memory");
+    gdt_load_tss(0);
+}
+
+void gdt_load_tss(uint32_t cpu) {
+    __asm__ volatile ("ltr %w0" : : "r"((uint16_t)(GDT_TSS + 16 * cpu)));
+}
+
+void tss_set_kernel_stack(uint32_t cpu, uint64_t rsp0) {
+    tss[cpu].rsp[0] = rsp0;
+}
+
+#endif /* CONFIG_USERLAND */
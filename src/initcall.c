@@ -0,0 +1,218 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "console.h"
+#include "cpu.h"
+#include "initcall.h"
+#include "log.h"
+#include "smp.h"
+#include "string.h"
+#include "trace.h"
+#include "tsc.h"
+
+enum {
+    CALL_PENDING,
+    CALL_RUNNING,
+    CALL_DONE,
+};
+
+static const char *const level_names[INITCALL_NR_LEVELS] = {
+    "early", "core", "driver", "subsys", "late", "deferred",
+};
+
+static struct initcall *table;
+static size_t table_count;
+static uint64_t done_mask;
+static uint32_t level_pending[INITCALL_NR_LEVELS];
+static uint64_t level_start[INITCALL_NR_LEVELS];
+static uint64_t level_end[INITCALL_NR_LEVELS];
+
+static int find_call(const char *name, size_t len) {
+    for (size_t i = 0; i < table_count; i++) {
+        if (strncmp(table[i].name, name, len) == 0 && table[i].name[len] == '\0') {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+/* Dependencies in an earlier level are met by the level barrier; only
+   those in the same level become mask bits. */
+static bool resolve_deps(struct initcall *c) {
+    for (const char *p = c->deps ? c->deps : ""; *p;) {
+        size_t len = 0;
+        while (p[len] && p[len] != ',') {
+            len++;
+        }
+        const int dep = find_call(p, len);
+        if (dep >= 0 && table[dep].level > c->level) {
+            pr_err("initcall: %s waits on a later level\n", c->name);
+            return false;
+        }
+        if (dep >= 0 && table[dep].level == c->level) {
+            c->dep_mask |= 1ULL << dep;
+        }
+        p += p[len] ? len + 1 : len;
+    }
+    return true;
+}
+
+bool initcall_init(struct initcall *calls, size_t count) {
+    if (count > INITCALL_MAX) {
+        return false;
+    }
+    table = calls;
+    table_count = count;
+    for (size_t i = 0; i < count; i++) {
+        struct initcall *c = &calls[i];
+        c->state = CALL_PENDING;
+        c->dep_mask = 0;
+        if (c->level >= INITCALL_NR_LEVELS || !resolve_deps(c)) {
+            table_count = 0;
+            return false;
+        }
+        level_pending[c->level]++;
+    }
+
+    /* peel off calls whose dependencies are all peeled; leftovers cycle */
+    uint64_t sorted = 0;
+    const uint64_t all = count == 64 ? ~0ULL : (1ULL << count) - 1;
+    for (bool progress = true; progress && sorted != all;) {
+        progress = false;
+        for (size_t i = 0; i < count; i++) {
+            if (!(sorted & (1ULL << i)) && (calls[i].dep_mask & ~sorted) == 0) {
+                sorted |= 1ULL << i;
+                progress = true;
+            }
+        }
+    }
+    if (sorted != all) {
+        for (size_t i = 0; i < count; i++) {
+            if (!(sorted & (1ULL << i))) {
+                pr_err("initcall: dependency cycle through %s\n", calls[i].name);
+            }
+        }
+        table_count = 0;
+        return false;
+    }
+    return true;
+}
+
+static void run_call(struct initcall *c, size_t index) {
+    c->cpu = smp_processor_id();
+    c->start_tsc = tsc_read();
+    TRACE(initcall_start, index, c->level);
+    c->fn();
+    TRACE(initcall_finish, index);
+    c->end_tsc = tsc_read();
+    __atomic_store_n(&c->state, CALL_DONE, __ATOMIC_RELEASE);
+    __atomic_fetch_or(&done_mask, 1ULL << index, __ATOMIC_RELEASE);
+    __atomic_fetch_sub(&level_pending[c->level], 1, __ATOMIC_RELEASE);
+}
+
+/* Take runnable calls of one level, first in table order, until nothing
+   is left that this CPU may run. */
+static void drain(uint8_t level) {
+    const bool boot_cpu = smp_processor_id() == 0;
+    for (;;) {
+        bool claimed = false;
+        bool takeable = false;
+        for (size_t i = 0; i < table_count && !claimed; i++) {
+            struct initcall *c = &table[i];
+            if (c->level != level || (c->flags & INITCALL_BSP && !boot_cpu) ||
+                __atomic_load_n(&c->state, __ATOMIC_ACQUIRE) != CALL_PENDING) {
+                continue;
+            }
+            takeable = true;
+            if ((c->dep_mask & ~__atomic_load_n(&done_mask, __ATOMIC_ACQUIRE)) != 0) {
+                continue;
+            }
+            uint32_t expected = CALL_PENDING;
+            if (__atomic_compare_exchange_n(&c->state, &expected, CALL_RUNNING, false, __ATOMIC_ACQ_REL,
+                                            __ATOMIC_RELAXED)) {
+                run_call(c, i);
+                claimed = true;
+            }
+        }
+        if (!takeable) {
+            return;
+        }
+        if (!claimed) {
+            cpu_relax();
+        }
+    }
+}
+
+static void drain_on_ap(void *arg) {
+    drain((uint8_t)(uintptr_t)arg);
+}
+
+static void start_level(enum initcall_level level) {
+    if (!level_start[level]) {
+        level_start[level] = tsc_read();
+    }
+}
+
+static void finish_level(enum initcall_level level) {
+    drain((uint8_t)level);
+    while (__atomic_load_n(&level_pending[level], __ATOMIC_ACQUIRE)) {
+        cpu_relax();
+    }
+    level_end[level] = tsc_read();
+}
+
+void initcall_start_async(enum initcall_level level) {
+    start_level(level);
+    for (uint32_t cpu = 1; cpu < NR_CPUS && level_pending[level]; cpu++) {
+        smp_call(cpu, drain_on_ap, (void *)(uintptr_t)level);
+    }
+}
+
+void initcall_wait(enum initcall_level level) {
+    start_level(level);
+    finish_level(level);
+}
+
+void initcall_run(enum initcall_level first, enum initcall_level last) {
+    for (uint32_t level = first; level <= last; level++) {
+        initcall_start_async((enum initcall_level)level);
+        finish_level((enum initcall_level)level);
+    }
+}
+
+void initcall_report(uint64_t entry_tsc, uint64_t ready_tsc) {
+    kprint("boot: %lu us firmware and loader + %lu us kernel to ready, %u CPUs\n",
+           tsc_cycles_to_us(entry_tsc), tsc_cycles_to_us(ready_tsc - entry_tsc), smp_num_cpus());
+    for (uint32_t level = 0; level < INITCALL_NR_LEVELS; level++) {
+        if (level_end[level] > level_start[level]) {
+            kprint("boot: level %s %lu us\n", level_names[level],
+                   tsc_cycles_to_us(level_end[level] - level_start[level]));
+        }
+    }
+
+    /* slowest first, like systemd-analyze blame */
+    uint8_t order[INITCALL_MAX];
+    for (size_t i = 0; i < table_count; i++) {
+        order[i] = (uint8_t)i;
+    }
+    for (size_t i = 0; i < table_count; i++) {
+        for (size_t j = i + 1; j < table_count; j++) {
+            const struct initcall *a = &table[order[i]];
+            const struct initcall *b = &table[order[j]];
+            if (b->end_tsc - b->start_tsc > a->end_tsc - a->start_tsc) {
+                const uint8_t t = order[i];
+                order[i] = order[j];
+                order[j] = t;
+            }
+        }
+    }
+    for (size_t i = 0; i < table_count; i++) {
+        const struct initcall *c = &table[order[i]];
+        if (c->state != CALL_DONE) {
+            continue;
+        }
+        kprint("boot: %lu us %s (%s, cpu %u, +%lu us)\n", tsc_cycles_to_us(c->end_tsc - c->start_tsc), c->name,
+               level_names[c->level], c->cpu, tsc_cycles_to_us(c->start_tsc - entry_tsc));
+    }
+}
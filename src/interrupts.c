@@ -0,0 +1,161 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "console.h"
+#include "gdt.h"
+#include "interrupts.h"
+#include "io.h"
+#include "lapic.h"
+#include "log.h"
+#include "process.h"
+#include "trace.h"
+
+#define PIC1_CMD 0x20
+#define PIC1_DATA 0x21
+#define PIC2_CMD 0xA0
+#define PIC2_DATA 0xA1
+
+struct idt_entry {
+    uint16_t offset_lo;
+    uint16_t selector;
+    uint8_t ist;
+    uint8_t type_attr;
+    uint16_t offset_mid;
+    uint32_t offset_hi;
+    uint32_t zero;
+} __attribute__((packed));
+
+struct idt_ptr {
+    uint16_t limit;
+    uint64_t base;
+} __attribute__((packed));
+
+struct irq_slot {
+    irq_handler_t handler;
+    void *ctx;
+};
+
+extern char isr_stubs[];
+
+static struct idt_entry idt[256] __attribute__((aligned(16)));
+static struct irq_slot handlers[256];
+static int next_vector = IRQ_VECTOR_BASE;
+
+static const char *const exception_names[32] = {
+    "#DE divide error", "#DB debug", "NMI", "#BP breakpoint",
+    "#OF overflow", "#BR bound range", "#UD invalid opcode", "#NM device not available",
+    "#DF double fault", "coprocessor overrun", "#TS invalid TSS", "#NP segment not present",
+    "#SS stack fault", "#GP general protection", "#PF page fault", "reserved",
+    "#MF x87 error", "#AC alignment check", "#MC machine check", "#XM SIMD error",
+    "#VE virtualization", "#CP control protection", 0, 0,
+    0, 0, 0, 0, "#HV hypervisor injection", "#VC VMM communication", "#SX security", 0,
+};
+
+/* Remap the legacy 8259 pair away from the exception range and mask it;
+   every device interrupt we use arrives through the LAPIC instead. */
+static void pic_disable(void) {
+    outb(PIC1_CMD, 0x11);
+    outb(PIC2_CMD, 0x11);
+    outb(PIC1_DATA, 0x20);
+    outb(PIC2_DATA, 0x28);
+    outb(PIC1_DATA, 0x04);
+    outb(PIC2_DATA, 0x02);
+    outb(PIC1_DATA, 0x01);
+    outb(PIC2_DATA, 0x01);
+    outb(PIC1_DATA, 0xFF);
+    outb(PIC2_DATA, 0xFF);
+}
+
+static void idt_set_gate(uint8_t vector, uint64_t handler, uint16_t selector, uint8_t ist) {
+    struct idt_entry *e = &idt[vector];
+    e->offset_lo = (uint16_t)(handler & 0xFFFF);
+    e->selector = selector;
+    e->ist = ist;
+    e->type_attr = 0x8E; /* present, DPL0, 64-bit interrupt gate */
+    e->offset_mid = (uint16_t)((handler >> 16) & 0xFFFF);
+    e->offset_hi = (uint32_t)(handler >> 32);
+    e->zero = 0;
+}
+
+static void exception_panic(const struct interrupt_frame *frame) {
+    const char *name = frame->vector < 32 ? exception_names[frame->vector] : 0;
+    pr_err("\nCPU exception %lu (%s)\n", frame->vector, name ? name : "unknown");
+    pr_err("  rip 0x%016lx err %#lx rflags %#lx\n", frame->rip, frame->error_code, frame->rflags);
+    if (frame->vector == 14) {
+        uint64_t cr2;
+        __asm__ volatile ("mov %%cr2, %0" : "=r"(cr2));
+        pr_err("  cr2 0x%016lx\n", cr2);
+    }
+    for (;;) {
+        __asm__ volatile ("cli; hlt");
+    }
+}
+
+void interrupt_dispatch(struct interrupt_frame *frame) {
+    const uint8_t vector = (uint8_t)frame->vector;
+    const struct irq_slot *slot = &handlers[vector];
+
+    TRACE(irq_entry, vector);
+    if (slot->handler) {
+        slot->handler(frame, slot->ctx);
+    } else if (vector < 32) {
+#ifdef CONFIG_USERLAND
+        if (frame->cs & 3) {
+            process_fault(frame);
+        }
+#endif
+        exception_panic(frame);
+    }
+
+    if (vector >= 32 && vector != IRQ_VECTOR_SPURIOUS) {
+        lapic_eoi();
+    }
+    TRACE(irq_exit, vector);
+}
+
+void interrupts_init(void) {
+    uint16_t cs;
+    __asm__ volatile ("mov %%cs, %0" : "=r"(cs));
+
+    pic_disable();
+    for (unsigned v = 0; v < 256; v++) {
+        idt_set_gate((uint8_t)v, (uint64_t)(uintptr_t)(isr_stubs + v * 16), cs, 0);
+    }
+#ifdef CONFIG_USERLAND
+    /* the TSS that holds the stacks only exists with user mode */
+    idt[1].ist = IST_DB;
+    idt[2].ist = IST_NMI;
+    idt[8].ist = IST_DF;
+    idt[18].ist = IST_MC;
+#endif
+
+    interrupts_init_ap();
+}
+
+void interrupts_init_ap(void) {
+    struct idt_ptr ptr = { sizeof(idt) - 1, (uint64_t)(uintptr_t)idt };
+    __asm__ volatile ("lidt %0" : : "m"(ptr));
+
+    lapic_init();
+}
+
+/* Drivers probing on different CPUs may race for vectors. */
+int irq_alloc_vector(void) {
+    int vector = __atomic_load_n(&next_vector, __ATOMIC_RELAXED);
+    do {
+        if (vector >= IRQ_VECTOR_LIMIT) {
+            return -1;
+        }
+    } while (!__atomic_compare_exchange_n(&next_vector, &vector, vector + 1, false, __ATOMIC_RELAXED,
+                                          __ATOMIC_RELAXED));
+    return vector;
+}
+
+bool irq_register(uint8_t vector, irq_handler_t handler, void *ctx) {
+    if (handlers[vector].handler && handler) {
+        return false;
+    }
+    handlers[vector].ctx = ctx;
+    handlers[vector].handler = handler;
+    return true;
+}
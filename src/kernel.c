@@ -2,40 +2,329 @@
 
 #include <stdint.h>
 #include <generated/autoconf.h>
+#include "acpi.h"
+#include "bench.h"
 #include "console.h"
 #include "cpu.h"
+#include "cpu_sensors.h"
+#include "cpuidle.h"
+#include "ext2.h"
+#include "gcov.h"
+#include "gdt.h"
+#include "initcall.h"
+#include "inet.h"
+#include "interrupts.h"
+#include "io.h"
 #include "keyboard.h"
+#include "log.h"
 #include "memory.h"
+#include "module.h"
+#include "netdev.h"
+#include "page_cache.h"
+#include "packet.h"
+#include "paging.h"
+#include "perf.h"
+#include "pci.h"
+#include "process.h"
 #include "rootfs.h"
+#include "smp.h"
 #include "stivale2.h"
+#include "string.h"
+#include "tcp.h"
+#include "trace.h"
+#include "tsc.h"
+#include "udp.h"
+#include "vfs.h"
+#include "virtio_blk.h"
+#include "virtio_net.h"
 
 static void scan_memory(void) {
     const struct stivale2_mmap_tag *tag = memory_get_mmap();
     if (!tag) {
-        kprint("No memory map found.\n");
+        pr_warn("No memory map found.\n");
         return;
     }
 
-    kprint("Memory map entries: %x\n", (uint64_t)tag->entries);
+    pr_info("Memory map entries: %lu\n", tag->entries);
     for (uint64_t i = 0; i < tag->entries; i++) {
         const struct stivale2_mmap_entry *entry = &tag->memmap[i];
         if (entry->type != STIVALE2_MMAP_USABLE) {
             continue;
         }
-        kprint(" - base %x length %x\n", entry->base, entry->length);
+        pr_debug(" - base 0x%016lx length %#lx\n", entry->base, entry->length);
     }
 }
 
 static void heap_demo(void) {
     void *block = bump_alloc(4096, 16);
     if (!block) {
-        kprint("Bump allocator out of memory\n");
+        pr_err("Bump allocator out of memory\n");
         return;
     }
     memset(block, 0xAA, 4096);
-    kprint("Allocated 4KiB at %x\n", (uint64_t)(uintptr_t)block);
+    pr_info("Allocated 4KiB at %p\n", block);
 }
 
+#ifdef CONFIG_NET_SPEEDTEST_CLI_MODULE
+/* As a module the speedtest is only loaded when "speedtest=" is given. */
+static void speedtest(void) {
+    char mode[8];
+    if (!memory_cmdline_arg("speedtest", mode, sizeof(mode))) {
+        return;
+    }
+    void (*run)(void) = (void (*)(void))module_symbol("speedtest", "tcp_speedtest");
+    if (run) {
+        run();
+    }
+}
+#endif
+
+#ifdef CONFIG_DEBUG_PERF_ANALYSIS
+/* "perf=cycles,branch-misses" samples the listed events from here until
+   the boot work is done, with "perf_period=N" events between samples;
+   the remaining counters count whatever else is available. */
+static bool profile_start(const struct cpu_info *cpu) {
+    char spec[64];
+    if (!perf_init(cpu) || !memory_cmdline_arg("perf", spec, sizeof(spec))) {
+        return false;
+    }
+    uint32_t sampled = 0;
+    uint32_t used = 0;
+    for (char *name = spec; *name;) {
+        char *end = name;
+        while (*end && *end != ',') {
+            end++;
+        }
+        const bool last = !*end;
+        *end = '\0';
+        enum perf_event_id id;
+        if (!perf_event_parse(name, &id) || !perf_event_available(id)) {
+            pr_err("perf: unknown or unavailable event %s\n", name);
+        } else if (!(sampled & PERF_EVENT_BIT(id)) && used < cpu->pmu_gp_counters) {
+            sampled |= PERF_EVENT_BIT(id);
+            used++;
+        }
+        name = last ? end : end + 1;
+    }
+    uint32_t counted = sampled;
+    for (uint32_t id = 0; id < PERF_COUNT_MAX && used < cpu->pmu_gp_counters; id++) {
+        if (!(counted & PERF_EVENT_BIT(id)) && perf_event_available((enum perf_event_id)id)) {
+            counted |= PERF_EVENT_BIT(id);
+            used++;
+        }
+    }
+    if (!perf_start(counted, sampled, memory_cmdline_u32("perf_period", PERF_DEFAULT_PERIOD))) {
+        pr_err("perf: cannot program counters\n");
+        return false;
+    }
+    return true;
+}
+
+static void profile_stop(void) {
+    perf_stop();
+    struct perf_cpu_stats st;
+    perf_get_stats(smp_processor_id(), &st);
+    for (uint32_t id = 0; id < PERF_COUNT_MAX; id++) {
+        if (st.counts[id]) {
+            kprint("perf: %s %lu\n", perf_event_name((enum perf_event_id)id), st.counts[id]);
+        }
+    }
+    kprint("perf: %lu samples, %lu lost, %lu NMIs\n", st.samples, st.lost, st.nmis);
+    perf_dump_folded();
+}
+#endif
+
+#ifdef CONFIG_DEBUG_TRACING_SUBSYSTEM
+/* "trace=irq,net" records the listed subsystems or events until the boot
+   work is done. */
+static bool tracing_start(void) {
+    char spec[128];
+    if (!memory_cmdline_arg("trace", spec, sizeof(spec)) || !spec[0]) {
+        return false;
+    }
+    for (uint32_t cpu = 0; cpu < NR_CPUS; cpu++) {
+        if (smp_cpu_online(cpu) && !trace_cpu_init(cpu)) {
+            pr_err("trace: no memory for the ring\n");
+            return false;
+        }
+    }
+    const uint32_t n = trace_enable(spec);
+    pr_info("trace: %u events enabled\n", n);
+    return n != 0;
+}
+
+static void tracing_stop(void) {
+    trace_disable_all();
+    if (trace_dump()) {
+        pr_info("trace: dump written to COM2\n");
+    } else {
+        pr_warn("trace: no COM2, dump skipped\n");
+    }
+}
+#endif
+
+#ifdef CONFIG_MICROBENCH
+#define QEMU_EXIT_PORT 0xF4
+
+/* "bench=all" or "bench=mem,net.csum_1500" runs the registered
+   microbenchmarks once the boot work has settled. */
+static void microbench(void) {
+    char spec[128];
+    if (!memory_cmdline_arg("bench", spec, sizeof(spec)) || !spec[0]) {
+        return;
+    }
+    bench_run(spec);
+#ifdef CONFIG_PM_STUB
+    cpuidle_report();
+#endif
+#ifdef CONFIG_PGO
+    gcov_dump();
+#endif
+    /* "make bench" adds QEMU's isa-debug-exit here; elsewhere nothing listens */
+    outb(QEMU_EXIT_PORT, 0);
+}
+#endif
+
+#if defined(CONFIG_HW_CPU_SENSORS) || defined(CONFIG_HW_CPU_SENSORS_MODULE)
+/* "sensors=1" prints the CPU temperatures once the boot work is done; as
+   a module the driver is only loaded here, on first use. */
+static void sensors(void) {
+    char arg[8];
+    if (!memory_cmdline_arg("sensors", arg, sizeof(arg))) {
+        return;
+    }
+#ifdef CONFIG_HW_CPU_SENSORS_MODULE
+    void (*report)(void) = (void (*)(void))module_symbol("cpu_sensors", "cpu_sensors_report");
+    if (report) {
+        report();
+    }
+#else
+    cpu_sensors_report();
+#endif
+}
+#endif
+
+static struct stivale2_struct *boot_info;
+static struct cpu_info boot_cpu;
+
+static void cpu_initcall(void) {
+    cpu_detect(&boot_cpu);
+    cpu_log(&boot_cpu);
+}
+
+static void acpi_initcall(void) {
+    acpi_init(boot_info);
+}
+
+#ifdef CONFIG_SMP
+static void smp_initcall(void) {
+    smp_boot_aps(&boot_cpu);
+}
+#endif
+
+#ifdef CONFIG_BLOCK
+static void page_cache_initcall(void) {
+    page_cache_init(0);
+}
+#endif
+
+#ifdef CONFIG_EXT2
+static void ext2_initcall(void) {
+    ext2_init();
+    vfs_automount();
+}
+#endif
+
+#if defined(CONFIG_LOG_ROOTFS) || defined(CONFIG_USERLAND_BASE_TOOLS)
+static void rootfs_initcall(void) {
+    rootfs_init();
+#ifdef CONFIG_LOG_ROOTFS
+    rootfs_log();
+#endif
+}
+#endif
+
+#ifdef CONFIG_PM_STUB
+/* "idle=hlt" keeps every CPU to HLT even where MWAIT exists. */
+static void cpuidle_initcall(void) {
+    char mode[8];
+    cpuidle_init(&boot_cpu, memory_cmdline_arg("idle", mode, sizeof(mode)) && strcmp(mode, "hlt") == 0);
+}
+#endif
+
+#ifdef CONFIG_USERLAND
+static void userland_initcall(void) {
+    process_init(&boot_cpu);
+}
+#endif
+
+#ifdef CONFIG_USERLAND_BASE_TOOLS
+/* /init is a demo: it says hello and exits rather than staying pid 1. */
+static void run_init(void) {
+    static const char *const argv[] = { "/init", 0 };
+    struct process *p = process_spawn("/init", argv);
+    if (!p) {
+        return;
+    }
+    while (process_run(p, 0)) {
+    }
+    pr_info("init: exited with status %d\n", p->exit_status);
+    process_destroy(p);
+}
+#endif
+
+/* Everything kernel_main() brings up, in the order it was written; the
+   levels and dependencies decide what may overlap. */
+static struct initcall boot_initcalls[] = {
+    INITCALL(cpu, cpu_initcall, INITCALL_EARLY, INITCALL_BSP, ""),
+    INITCALL(tsc, tsc_init, INITCALL_EARLY, INITCALL_BSP, "cpu"),
+    INITCALL(acpi, acpi_initcall, INITCALL_EARLY, INITCALL_BSP, "tsc"),
+#ifdef CONFIG_PM_STUB
+    INITCALL(cpuidle, cpuidle_initcall, INITCALL_EARLY, INITCALL_BSP, "cpu,tsc"),
+#endif
+#ifdef CONFIG_USERLAND
+    INITCALL(userland, userland_initcall, INITCALL_EARLY, INITCALL_BSP, "cpu,tsc"),
+#endif
+#ifdef CONFIG_SMP
+    /* APs copy the boot CPU's PCID decision and idle on its states */
+    INITCALL(smp, smp_initcall, INITCALL_EARLY, INITCALL_BSP, "cpu,tsc,acpi,userland,cpuidle"),
+#endif
+#ifdef CONFIG_BLOCK
+    INITCALL(page_cache, page_cache_initcall, INITCALL_CORE, 0, ""),
+#endif
+#ifdef CONFIG_NET_LOOPBACK
+    INITCALL(loopback, loopback_init, INITCALL_CORE, 0, ""),
+#endif
+#ifdef CONFIG_PCI
+    INITCALL(pci, pci_init, INITCALL_DRIVER, INITCALL_BSP, ""),
+#endif
+#ifdef CONFIG_VIRTIO_BLK
+    INITCALL(virtio_blk, virtio_blk_init, INITCALL_DRIVER, 0, "pci"),
+#endif
+#ifdef CONFIG_VIRTIO_NET
+    /* queue interrupts are routed to the CPU that probes the device */
+    INITCALL(virtio_net, virtio_net_init, INITCALL_DRIVER, INITCALL_BSP, "pci"),
+#endif
+#ifdef CONFIG_EXT2
+    INITCALL(ext2, ext2_initcall, INITCALL_SUBSYS, 0, ""),
+#endif
+#ifdef CONFIG_NET_IPV4
+    INITCALL(inet, inet_init, INITCALL_SUBSYS, 0, ""),
+#endif
+#ifdef CONFIG_NET_TCP
+    INITCALL(tcp, tcp_init, INITCALL_SUBSYS, 0, "inet"),
+#endif
+#ifdef CONFIG_LOG_MEMORY_MAP
+    INITCALL(memory_map, scan_memory, INITCALL_DEFERRED, 0, ""),
+#endif
+#ifdef CONFIG_HEAP_DEMO
+    INITCALL(heap_demo, heap_demo, INITCALL_DEFERRED, 0, ""),
+#endif
+#if defined(CONFIG_LOG_ROOTFS) || defined(CONFIG_USERLAND_BASE_TOOLS)
+    INITCALL(rootfs, rootfs_initcall, INITCALL_DEFERRED, 0, ""),
+#endif
+};
+
 static void print_boot_banner(void) {
     console_write("\n==============================\n");
     console_write("      Welcome to Z-Kernel\n");
@@ -53,9 +342,22 @@ static void print_boot_banner(void) {
     console_write("\n\n");
 }
 
-void kernel_main(struct stivale2_struct *boot_info) {
+void kernel_main(struct stivale2_struct *info) {
+    const uint64_t entry_tsc = tsc_mark_boot();
+#ifdef CONFIG_PGO
+    gcov_init();
+#endif
+    smp_early_init();
+#ifdef CONFIG_USERLAND
+    gdt_init();
+#endif
+    boot_info = info;
     console_init(boot_info);
+    paging_init();
     memory_init(boot_info);
+    log_setup(memory_get_cmdline());
+    interrupts_init();
+    interrupts_enable();
 
 #ifdef CONFIG_BOOT_BANNER
     print_boot_banner();
@@ -71,24 +373,77 @@ void kernel_main(struct stivale2_struct *boot_info) {
     console_write("\n");
 #endif
 
-    kprint("Z-Kernel ready.\n");
-    struct cpu_info cpu = {0};
-    cpu_detect(&cpu);
-    cpu_log(&cpu);
-#ifdef CONFIG_LOG_MEMORY_MAP
-    scan_memory();
+    if (!initcall_init(boot_initcalls, sizeof(boot_initcalls) / sizeof(boot_initcalls[0]))) {
+        pr_err("initcall: bad table, nothing started\n");
+    }
+    initcall_run(INITCALL_EARLY, INITCALL_EARLY);
+#ifdef CONFIG_DEBUG_TRACING_SUBSYSTEM
+    const bool tracing = tracing_start();
 #endif
-#ifdef CONFIG_HEAP_DEMO
-    heap_demo();
+#ifdef CONFIG_DEBUG_PERF_ANALYSIS
+    const bool profiling = profile_start(&boot_cpu);
 #endif
-#ifdef CONFIG_LOG_ROOTFS
-    rootfs_init();
-    rootfs_log();
+    initcall_run(INITCALL_CORE, INITCALL_LATE);
+    const uint64_t ready_tsc = tsc_read();
+    pr_info("Z-Kernel ready.\n");
+    initcall_start_async(INITCALL_DEFERRED);
+
+#ifdef CONFIG_PAGE_CACHE_BENCH
+    page_cache_bench();
+#endif
+#ifdef CONFIG_EXT2_BENCH
+    ext2_bench();
+#endif
+#ifdef CONFIG_NET_LOOPBACK_BENCH
+    loopback_bench();
+#endif
+#ifdef CONFIG_NET_IPV4_BENCH
+    udp_bench();
+#endif
+#ifdef CONFIG_NET_PACKET_ANALYZER_BENCH
+    packet_bench();
+#endif
+#ifdef CONFIG_VIRTIO_NET_BENCH
+    virtio_net_bench();
+#endif
+#ifdef CONFIG_NET_SPEEDTEST_CLI
+    tcp_speedtest();
+#elif defined(CONFIG_NET_SPEEDTEST_CLI_MODULE)
+    speedtest();
+#endif
+#ifdef CONFIG_DEBUG_PERF_ANALYSIS
+    if (profiling) {
+        profile_stop();
+    }
+#endif
+#ifdef CONFIG_DEBUG_TRACING_SUBSYSTEM
+    if (tracing) {
+        tracing_stop();
+    }
+#endif
+    initcall_wait(INITCALL_DEFERRED);
+#if defined(CONFIG_HW_CPU_SENSORS) || defined(CONFIG_HW_CPU_SENSORS_MODULE)
+    sensors();
+#endif
+#ifdef CONFIG_MODULES
+    module_log();
+#endif
+#ifdef CONFIG_USERLAND_BASE_TOOLS
+    run_init();
+#endif
+#ifdef CONFIG_BOOT_ANALYZE
+    initcall_report(entry_tsc, ready_tsc);
+#else
+    (void)entry_tsc;
+    (void)ready_tsc;
+#endif
+#ifdef CONFIG_MICROBENCH
+    microbench();
 #endif
 
 #ifdef CONFIG_ENABLE_KEYBOARD_ECHO
     keyboard_init();
-    kprint("Keyboard polling active. Type to echo...\n");
+    pr_info("Keyboard polling active. Type to echo...\n");
 #endif
 
     for (;;) {
@@ -98,6 +453,13 @@ void kernel_main(struct stivale2_struct *boot_info) {
             console_putc(c);
         }
 #endif
-        __asm__ volatile ("hlt");
+#ifdef CONFIG_VIRTIO_NET
+        net_rx_action(NAPI_WEIGHT * 4);
+#endif
+#ifdef CONFIG_NET_TCP
+        tcp_poll();
+#endif
+        interrupts_disable();
+        cpuidle_enter(0);
     }
 }
@@ -0,0 +1,76 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "log.h"
+#include "module.h"
+#include "spinlock.h"
+#include "string.h"
+#include "tsc.h"
+
+uint8_t log_level = LOG_COMPILE_LEVEL;
+EXPORT_SYMBOL(log_level);
+
+static const char *const level_names[] = {
+    [LOG_ERR] = "err", [LOG_WARN] = "warn", [LOG_NOTICE] = "notice", [LOG_INFO] = "info", [LOG_DEBUG] = "debug",
+};
+
+static bool parse_level(const char *s, size_t len, uint8_t *level) {
+    if (len == 1 && s[0] >= '0' + LOG_ERR && s[0] <= '0' + LOG_DEBUG) {
+        *level = (uint8_t)(s[0] - '0');
+        return true;
+    }
+    for (uint8_t l = LOG_ERR; l <= LOG_DEBUG; l++) {
+        if (strlen(level_names[l]) == len && strncmp(s, level_names[l], len) == 0) {
+            *level = l;
+            return true;
+        }
+    }
+    return false;
+}
+
+void log_setup(const char *cmdline) {
+    const char *p = cmdline ? cmdline : "";
+    while (*p) {
+        while (*p == ' ') {
+            p++;
+        }
+        size_t len = 0;
+        while (p[len] && p[len] != ' ') {
+            len++;
+        }
+        uint8_t level;
+        if (len == 5 && strncmp(p, "quiet", 5) == 0) {
+            log_level = LOG_WARN;
+        } else if (len > 9 && strncmp(p, "loglevel=", 9) == 0 && parse_level(p + 9, len - 9, &level)) {
+            log_level = level;
+        }
+        p += len;
+    }
+}
+
+bool log_ratelimit(struct ratelimit *rs) {
+    /* a CPU that finds the state busy drops its message instead of spinning */
+    if (!spin_trylock(&rs->lock)) {
+        return false;
+    }
+    const uint64_t now = tsc_read();
+    const uint64_t khz = tsc_khz() ? tsc_khz() : 1000000;
+    if (!rs->begin || now - rs->begin >= khz * LOG_RATELIMIT_INTERVAL_MS) {
+        if (rs->missed) {
+            kprint("log: %u messages suppressed at %s\n", rs->missed, rs->where);
+        }
+        rs->begin = now;
+        rs->printed = 0;
+        rs->missed = 0;
+    }
+    const bool ok = rs->printed < LOG_RATELIMIT_BURST;
+    if (ok) {
+        rs->printed++;
+    } else {
+        rs->missed++;
+    }
+    spin_unlock(&rs->lock);
+    return ok;
+}
+EXPORT_SYMBOL(log_ratelimit);
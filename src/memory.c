@@ -1,8 +1,44 @@
 #include "memory.h"
+#include "bench.h"
 #include "console.h"
+#include "module.h"
+#include "paging.h"
+#include "string.h"
+#include "trace.h"
+
+#define MULTIBOOT_LOADER_MAGIC 0x2BADB002
+#define MULTIBOOT_INFO_CMDLINE (1u << 2)
+#define MULTIBOOT_INFO_MODS (1u << 3)
+#define MULTIBOOT_INFO_MMAP (1u << 6)
+#define MULTIBOOT_MAX_ENTRIES 32
+
+struct multiboot_mmap_entry {
+    uint32_t size;
+    uint64_t base;
+    uint64_t length;
+    uint32_t type;
+} __attribute__((packed));
+
+struct multiboot_mod_entry {
+    uint32_t start;
+    uint32_t end;
+    uint32_t string;
+    uint32_t reserved;
+};
+
+extern uint32_t multiboot_magic;
+extern uint32_t multiboot_info;
+extern char __kernel_end[];
 
 static const struct stivale2_mmap_tag *boot_mmap = 0;
 
+/* Stivale2-shaped copy of a Multiboot memory map so the rest of the kernel
+   only ever deals with one format. */
+static struct {
+    struct stivale2_mmap_tag tag;
+    struct stivale2_mmap_entry entries[MULTIBOOT_MAX_ENTRIES];
+} multiboot_mmap;
+
 struct allocator_state {
     uint64_t base;
     uint64_t size;
@@ -10,6 +46,20 @@ struct allocator_state {
 };
 
 static struct allocator_state bump_state = {0};
+/* copied out at init: the loader leaves it in memory we hand out later */
+static char boot_cmdline[256];
+/* the module images stay where the loader put them; only the list is copied */
+static struct boot_module boot_modules[MAX_BOOT_MODULES];
+static size_t boot_module_count;
+
+struct free_page {
+    struct free_page *next;
+};
+
+static struct free_page *free_pages = 0;
+static uint64_t free_page_count = 0;
+/* guards bump_state and the free page list; APs allocate during boot */
+static spinlock_t page_lock = SPINLOCK_INIT;
 
 void *memset(void *dest, int c, size_t n) {
     unsigned char *d = (unsigned char *)dest;
@@ -18,15 +68,16 @@ void *memset(void *dest, int c, size_t n) {
     }
     return dest;
 }
+EXPORT_SYMBOL(memset);
 
+/* rep movsb is the fast path on ERMS parts and no slower than a byte
+   loop anywhere else; packet copies of a full frame go through here. */
 void *memcpy(void *dest, const void *src, size_t n) {
-    unsigned char *d = (unsigned char *)dest;
-    const unsigned char *s = (const unsigned char *)src;
-    for (size_t i = 0; i < n; i++) {
-        d[i] = s[i];
-    }
+    void *d = dest;
+    __asm__ volatile("rep movsb" : "+D"(d), "+S"(src), "+c"(n) : : "memory");
     return dest;
 }
+EXPORT_SYMBOL(memcpy);
 
 int memcmp(const void *a, const void *b, size_t n) {
     const unsigned char *pa = (const unsigned char *)a;
@@ -38,18 +89,7 @@ int memcmp(const void *a, const void *b, size_t n) {
     }
     return 0;
 }
-
-static const struct stivale2_tag *find_tag(struct stivale2_struct *info, uint64_t id) {
-    uint64_t current = info ? info->tags : 0;
-    while (current) {
-        const struct stivale2_tag *tag = (const struct stivale2_tag *)current;
-        if (tag->identifier == id) {
-            return tag;
-        }
-        current = tag->next;
-    }
-    return 0;
-}
+EXPORT_SYMBOL(memcmp);
 
 static void select_allocator_region(void) {
     if (!boot_mmap || boot_mmap->entries == 0) {
@@ -58,15 +98,30 @@ static void select_allocator_region(void) {
 
     uint64_t best_len = 0;
     uint64_t best_base = 0;
+    uint64_t reserved_end = (uint64_t)(uintptr_t)__kernel_end;
+    for (size_t i = 0; i < boot_module_count; i++) {
+        if (boot_modules[i].base + boot_modules[i].size > reserved_end) {
+            reserved_end = boot_modules[i].base + boot_modules[i].size;
+        }
+    }
+    reserved_end = (reserved_end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
 
     for (uint64_t i = 0; i < boot_mmap->entries; i++) {
         const struct stivale2_mmap_entry *entry = &boot_mmap->memmap[i];
         if (entry->type != STIVALE2_MMAP_USABLE) {
             continue;
         }
-        if (entry->length > best_len && entry->base >= 0x100000) {
-            best_len = entry->length;
-            best_base = entry->base;
+        uint64_t base = entry->base;
+        uint64_t len = entry->length;
+        /* Multiboot reports the kernel image and boot modules as usable
+           RAM; skip past them. */
+        if (base < reserved_end && base + len > reserved_end) {
+            len -= reserved_end - base;
+            base = reserved_end;
+        }
+        if (len > best_len && base >= 0x100000) {
+            best_len = len;
+            best_base = base;
         }
     }
 
@@ -75,13 +130,97 @@ static void select_allocator_region(void) {
     bump_state.offset = 0;
 }
 
+static const struct stivale2_mmap_tag *multiboot_to_mmap(void) {
+    if (multiboot_magic != MULTIBOOT_LOADER_MAGIC || !multiboot_info) {
+        return 0;
+    }
+    const uint8_t *info = (const uint8_t *)(uintptr_t)multiboot_info;
+    uint32_t flags = *(const uint32_t *)info;
+    if (!(flags & MULTIBOOT_INFO_MMAP)) {
+        return 0;
+    }
+
+    uint32_t length = *(const uint32_t *)(info + 44);
+    uint32_t addr = *(const uint32_t *)(info + 48);
+    uint64_t count = 0;
+    for (uint32_t off = 0; off < length && count < MULTIBOOT_MAX_ENTRIES;) {
+        const struct multiboot_mmap_entry *e = (const struct multiboot_mmap_entry *)(uintptr_t)(addr + off);
+        struct stivale2_mmap_entry *out = &multiboot_mmap.entries[count++];
+        out->base = e->base;
+        out->length = e->length;
+        out->type = e->type == 1 ? STIVALE2_MMAP_USABLE : 0x1000 + e->type;
+        off += e->size + sizeof(e->size);
+    }
+    multiboot_mmap.tag.entries = count;
+    return &multiboot_mmap.tag;
+}
+
+static void save_cmdline(struct stivale2_struct *boot_info) {
+    const char *src = 0;
+    const struct stivale2_struct_tag_cmdline *tag =
+        (const struct stivale2_struct_tag_cmdline *)memory_find_tag(boot_info, STIVALE2_STRUCT_TAG_CMDLINE_ID);
+    if (tag) {
+        src = (const char *)(uintptr_t)tag->cmdline;
+    } else if (multiboot_magic == MULTIBOOT_LOADER_MAGIC && multiboot_info) {
+        const uint8_t *info = (const uint8_t *)(uintptr_t)multiboot_info;
+        if (*(const uint32_t *)info & MULTIBOOT_INFO_CMDLINE) {
+            src = (const char *)(uintptr_t)*(const uint32_t *)(info + 16);
+        }
+    }
+    size_t i = 0;
+    for (; src && src[i] && i < sizeof(boot_cmdline) - 1; i++) {
+        boot_cmdline[i] = src[i];
+    }
+    boot_cmdline[i] = '\0';
+}
+
+static void add_boot_module(uint64_t start, uint64_t end, const char *path) {
+    if (boot_module_count == MAX_BOOT_MODULES || end <= start) {
+        return;
+    }
+    struct boot_module *m = &boot_modules[boot_module_count++];
+    m->base = start;
+    m->size = end - start;
+    size_t i = 0;
+    for (; path && path[i] && i < sizeof(m->path) - 1; i++) {
+        m->path[i] = path[i];
+    }
+    m->path[i] = '\0';
+}
+
+static void save_modules(struct stivale2_struct *boot_info) {
+    const struct stivale2_struct_tag_modules *tag =
+        (const struct stivale2_struct_tag_modules *)memory_find_tag(boot_info, STIVALE2_STRUCT_TAG_MODULES_ID);
+    if (tag) {
+        for (uint64_t i = 0; i < tag->module_count; i++) {
+            add_boot_module(tag->modules[i].begin, tag->modules[i].end, tag->modules[i].string);
+        }
+    } else if (multiboot_magic == MULTIBOOT_LOADER_MAGIC && multiboot_info) {
+        const uint8_t *info = (const uint8_t *)(uintptr_t)multiboot_info;
+        if (!(*(const uint32_t *)info & MULTIBOOT_INFO_MODS)) {
+            return;
+        }
+        const uint32_t count = *(const uint32_t *)(info + 20);
+        const struct multiboot_mod_entry *mods =
+            (const struct multiboot_mod_entry *)(uintptr_t)*(const uint32_t *)(info + 24);
+        for (uint32_t i = 0; i < count; i++) {
+            add_boot_module(mods[i].start, mods[i].end, (const char *)(uintptr_t)mods[i].string);
+        }
+    }
+}
+
 void memory_init(struct stivale2_struct *boot_info) {
     const uint64_t mmap_id = 0x2187f79e8612de07ULL;
-    boot_mmap = (const struct stivale2_mmap_tag *)find_tag(boot_info, mmap_id);
+    boot_mmap = (const struct stivale2_mmap_tag *)memory_find_tag(boot_info, mmap_id);
+    if (!boot_mmap) {
+        boot_mmap = multiboot_to_mmap();
+    }
+    save_cmdline(boot_info);
+    save_modules(boot_info);
     select_allocator_region();
 }
 
-void *bump_alloc(size_t size, size_t align) {
+static void *bump_alloc_locked(size_t size, size_t align) {
     if (bump_state.size == 0) {
         return 0;
     }
@@ -101,6 +240,183 @@ void *bump_alloc(size_t size, size_t align) {
     return (void *)(uintptr_t)base;
 }
 
+void *bump_alloc(size_t size, size_t align) {
+    const uint64_t flags = spin_lock_irqsave(&page_lock);
+    void *p = bump_alloc_locked(size, align);
+    spin_unlock_irqrestore(&page_lock, flags);
+    return p;
+}
+
 const struct stivale2_mmap_tag *memory_get_mmap(void) {
     return boot_mmap;
 }
+
+const struct stivale2_tag *memory_find_tag(struct stivale2_struct *info, uint64_t id) {
+    uint64_t current = info ? info->tags : 0;
+    while (current) {
+        const struct stivale2_tag *tag = (const struct stivale2_tag *)current;
+        if (tag->identifier == id) {
+            return tag;
+        }
+        current = tag->next;
+    }
+    return 0;
+}
+
+const char *memory_get_cmdline(void) {
+    return boot_cmdline;
+}
+
+bool memory_cmdline_arg(const char *key, char *buf, size_t len) {
+    const char *p = boot_cmdline;
+    const size_t klen = strlen(key);
+    while (*p) {
+        while (*p == ' ') {
+            p++;
+        }
+        if (strncmp(p, key, klen) == 0 && p[klen] == '=') {
+            p += klen + 1;
+            size_t i = 0;
+            while (*p && *p != ' ' && i + 1 < len) {
+                buf[i++] = *p++;
+            }
+            buf[i] = '\0';
+            return true;
+        }
+        while (*p && *p != ' ') {
+            p++;
+        }
+    }
+    return false;
+}
+EXPORT_SYMBOL(memory_cmdline_arg);
+
+uint32_t memory_cmdline_u32(const char *key, uint32_t fallback) {
+    char buf[16];
+    if (!memory_cmdline_arg(key, buf, sizeof(buf)) || !buf[0]) {
+        return fallback;
+    }
+    uint32_t value = 0;
+    for (const char *p = buf; *p; p++) {
+        if (*p < '0' || *p > '9') {
+            return fallback;
+        }
+        value = value * 10 + (uint32_t)(*p - '0');
+    }
+    return value;
+}
+EXPORT_SYMBOL(memory_cmdline_u32);
+
+const struct boot_module *memory_boot_modules(size_t *count) {
+    *count = boot_module_count;
+    return boot_modules;
+}
+
+void *page_alloc(void) {
+    const uint64_t flags = spin_lock_irqsave(&page_lock);
+    void *page = free_pages;
+    if (page) {
+        free_pages = free_pages->next;
+        free_page_count--;
+    } else {
+        page = bump_alloc_locked(PAGE_SIZE, PAGE_SIZE);
+    }
+    spin_unlock_irqrestore(&page_lock, flags);
+    TRACE(kmem_page_alloc, page);
+    return page;
+}
+EXPORT_SYMBOL(page_alloc);
+
+void page_free(void *page) {
+    if (!page) {
+        return;
+    }
+    TRACE(kmem_page_free, page);
+    struct free_page *fp = (struct free_page *)page;
+    const uint64_t flags = spin_lock_irqsave(&page_lock);
+    fp->next = free_pages;
+    free_pages = fp;
+    free_page_count++;
+    spin_unlock_irqrestore(&page_lock, flags);
+}
+EXPORT_SYMBOL(page_free);
+
+uint64_t memory_free_pages(void) {
+    return free_page_count + (bump_state.size - bump_state.offset) / PAGE_SIZE;
+}
+
+void *pool_alloc(struct object_pool *pool) {
+    const uint64_t flags = spin_lock_irqsave(&pool->lock);
+    if (!pool->free_list) {
+        uint8_t *page = page_alloc();
+        if (!page) {
+            spin_unlock_irqrestore(&pool->lock, flags);
+            return 0;
+        }
+        size_t per_page = PAGE_SIZE / pool->object_size;
+        for (size_t i = 0; i < per_page; i++) {
+            struct free_page *node = (struct free_page *)(page + i * pool->object_size);
+            node->next = (struct free_page *)pool->free_list;
+            pool->free_list = node;
+        }
+    }
+    struct free_page *obj = (struct free_page *)pool->free_list;
+    pool->free_list = obj->next;
+    pool->in_use++;
+    spin_unlock_irqrestore(&pool->lock, flags);
+    TRACE(kmem_pool_alloc, obj, pool->object_size);
+    return obj;
+}
+
+void pool_free(struct object_pool *pool, void *obj) {
+    if (!obj) {
+        return;
+    }
+    TRACE(kmem_pool_free, obj, pool->object_size);
+    struct free_page *node = (struct free_page *)obj;
+    const uint64_t flags = spin_lock_irqsave(&pool->lock);
+    node->next = (struct free_page *)pool->free_list;
+    pool->free_list = node;
+    pool->in_use--;
+    spin_unlock_irqrestore(&pool->lock, flags);
+}
+
+#ifdef CONFIG_MICROBENCH
+static uint8_t bench_src[PAGE_SIZE] __attribute__((aligned(64)));
+static uint8_t bench_dst[PAGE_SIZE] __attribute__((aligned(64)));
+
+static void bench_memcpy_4k(uint64_t loops) {
+    for (uint64_t i = 0; i < loops; i++) {
+        memcpy(bench_dst, bench_src, PAGE_SIZE);
+        bench_clobber(bench_dst);
+    }
+}
+
+BENCH(mem, memcpy_4k, bench_memcpy_4k);
+
+static void bench_memset_4k(uint64_t loops) {
+    for (uint64_t i = 0; i < loops; i++) {
+        memset(bench_dst, (int)i, PAGE_SIZE);
+        bench_clobber(bench_dst);
+    }
+}
+
+BENCH(mem, memset_4k, bench_memset_4k);
+
+static void bench_page_alloc_free(uint64_t loops) {
+    for (uint64_t i = 0; i < loops; i++) {
+        page_free(page_alloc());
+    }
+}
+
+BENCH(mem, page_alloc_free, bench_page_alloc_free);
+
+static void bench_pool_alloc_free(uint64_t loops) {
+    static struct object_pool pool = OBJECT_POOL("bench", uint64_t[8]);
+    for (uint64_t i = 0; i < loops; i++) {
+        pool_free(&pool, pool_alloc(&pool));
+    }
+}
+
+BENCH(mem, pool_alloc_free, bench_pool_alloc_free);
+#endif
@@ -0,0 +1,345 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cpu.h"
+#include "elf.h"
+#include "log.h"
+#include "memory.h"
+#include "module.h"
+#include "paging.h"
+#include "string.h"
+#include "tsc.h"
+#include "vfs.h"
+
+#ifdef CONFIG_MODULES
+
+enum module_state {
+    MODULE_LOADING,
+    MODULE_LIVE,
+    MODULE_FAILED,
+};
+
+struct module {
+    char name[MODULE_NAME_LEN];
+    enum module_state state;
+    uint8_t *base;          /* every SHF_ALLOC section, laid out in one block */
+    size_t size;
+    const Elf64_Sym *symtab; /* st_value resolved to load addresses */
+    const char *strtab;
+    size_t nsyms;
+    uint32_t nrelocs;
+    uint64_t load_cycles;
+    struct module *next;
+};
+
+static struct object_pool module_pool = OBJECT_POOL("module", struct module);
+static struct module *modules;
+/* Guards the list only. A load runs unlocked with the module listed as
+   MODULE_LOADING, and other requests for it spin until it settles, so a
+   module's init may request other modules but not itself. */
+static spinlock_t module_lock = SPINLOCK_INIT;
+
+extern const struct kernel_symbol __ksymtab_start[];
+extern const struct kernel_symbol __ksymtab_end[];
+
+uintptr_t ksym_lookup(const char *name) {
+    const struct kernel_symbol *lo = __ksymtab_start;
+    const struct kernel_symbol *hi = __ksymtab_end;
+    while (lo < hi) {
+        const struct kernel_symbol *mid = lo + (hi - lo) / 2;
+        const int cmp = strcmp(name, mid->name);
+        if (cmp == 0) {
+            return mid->value;
+        }
+        if (cmp < 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return 0;
+}
+
+static struct module *find_module(const char *name) {
+    for (struct module *m = __atomic_load_n(&modules, __ATOMIC_ACQUIRE); m; m = m->next) {
+        if (strcmp(m->name, name) == 0) {
+            return m;
+        }
+    }
+    return 0;
+}
+
+/* "/boot/modules/cpu_sensors.ko args" names module cpu_sensors */
+static bool path_names_module(const char *path, const char *name) {
+    const char *base = path;
+    const char *end = path;
+    for (; *end && *end != ' '; end++) {
+        if (*end == '/') {
+            base = end + 1;
+        }
+    }
+    if (end - base > 3 && strncmp(end - 3, ".ko", 3) == 0) {
+        end -= 3;
+    }
+    const size_t len = strlen(name);
+    return (size_t)(end - base) == len && strncmp(base, name, len) == 0;
+}
+
+static uint8_t *find_image(const char *name, size_t *size) {
+    size_t count;
+    const struct boot_module *boot = memory_boot_modules(&count);
+    for (size_t i = 0; i < count; i++) {
+        if (path_names_module(boot[i].path, name)) {
+            *size = boot[i].size;
+            return (uint8_t *)(uintptr_t)boot[i].base;
+        }
+    }
+#ifdef CONFIG_EXT2
+    char path[sizeof("/lib/modules/.ko") + MODULE_NAME_LEN];
+    const size_t len = strlen(name);
+    memcpy(path, "/lib/modules/", 13);
+    memcpy(path + 13, name, len);
+    memcpy(path + 13 + len, ".ko", 4);
+    struct inode *inode = vfs_lookup(path);
+    if (inode && !vfs_is_dir(inode) && inode->size) {
+        /* the bump region never gives memory back, like the module itself */
+        uint8_t *image = bump_alloc(inode->size, PAGE_SIZE);
+        if (image && vfs_read(inode, 0, image, inode->size) == inode->size) {
+            *size = inode->size;
+            return image;
+        }
+    }
+#endif
+    return 0;
+}
+
+/* Copy the SHF_ALLOC sections into one block and record where each went
+   in its sh_addr, as ld would for a final link. */
+static bool layout_sections(struct module *mod, Elf64_Shdr *sh, uint16_t shnum, const uint8_t *image) {
+    size_t total = 0;
+    for (uint16_t i = 0; i < shnum; i++) {
+        if (!(sh[i].sh_flags & SHF_ALLOC)) {
+            continue;
+        }
+        const size_t align = sh[i].sh_addralign ? sh[i].sh_addralign : 1;
+        total = (total + align - 1) & ~(align - 1);
+        sh[i].sh_addr = total;
+        total += sh[i].sh_size;
+    }
+    mod->size = total;
+    mod->base = bump_alloc(total ? total : 1, PAGE_SIZE);
+    if (!mod->base) {
+        pr_err("module %s: no memory for %lu bytes\n", mod->name, (uint64_t)total);
+        return false;
+    }
+    for (uint16_t i = 0; i < shnum; i++) {
+        if (!(sh[i].sh_flags & SHF_ALLOC)) {
+            continue;
+        }
+        sh[i].sh_addr += (uint64_t)(uintptr_t)mod->base;
+        uint8_t *dst = (uint8_t *)(uintptr_t)sh[i].sh_addr;
+        if (sh[i].sh_type == SHT_NOBITS) {
+            memset(dst, 0, sh[i].sh_size);
+        } else {
+            memcpy(dst, image + sh[i].sh_offset, sh[i].sh_size);
+        }
+    }
+    return true;
+}
+
+static bool resolve_symbols(struct module *mod, Elf64_Sym *syms, const Elf64_Shdr *sh) {
+    for (size_t i = 1; i < mod->nsyms; i++) {
+        Elf64_Sym *sym = &syms[i];
+        const char *name = mod->strtab + sym->st_name;
+        switch (sym->st_shndx) {
+        case SHN_UNDEF:
+            sym->st_value = ksym_lookup(name);
+            if (!sym->st_value && ELF64_ST_BIND(sym->st_info) != STB_WEAK) {
+                pr_err("module %s: unknown symbol %s\n", mod->name, name);
+                return false;
+            }
+            break;
+        case SHN_ABS:
+            break;
+        case SHN_COMMON:
+            pr_err("module %s: common symbol %s, build with -fno-common\n", mod->name, name);
+            return false;
+        default:
+            sym->st_value += sh[sym->st_shndx].sh_addr;
+            break;
+        }
+    }
+    return true;
+}
+
+/* elf_check_rel() has bounds-checked every entry and its type. */
+static bool apply_rela(struct module *mod, const Elf64_Shdr *rel, const Elf64_Shdr *target, const uint8_t *image) {
+    const Elf64_Rela *r = (const Elf64_Rela *)(image + rel->sh_offset);
+    const size_t count = rel->sh_size / sizeof(*r);
+    for (size_t i = 0; i < count; i++) {
+        const uint32_t type = ELF64_R_TYPE(r[i].r_info);
+        const uint32_t symidx = ELF64_R_SYM(r[i].r_info);
+        const uint64_t s = mod->symtab[symidx].st_value;
+        const uint64_t p = target->sh_addr + r[i].r_offset;
+        uint64_t v64;
+        uint32_t v32;
+        switch (type) {
+        case R_X86_64_64:
+        case R_X86_64_PC64:
+            v64 = s + (uint64_t)r[i].r_addend - (type == R_X86_64_PC64 ? p : 0);
+            memcpy((void *)(uintptr_t)p, &v64, sizeof(v64));
+            break;
+        case R_X86_64_32:
+        case R_X86_64_32S:
+        case R_X86_64_PC32:
+        case R_X86_64_PLT32: {
+            const bool pcrel = type == R_X86_64_PC32 || type == R_X86_64_PLT32;
+            v64 = s + (uint64_t)r[i].r_addend - (pcrel ? p : 0);
+            const bool fits = type == R_X86_64_32 ? v64 == (uint32_t)v64 : (int64_t)v64 == (int32_t)v64;
+            if (!fits) {
+                pr_err("module %s: relocation against %s out of range\n", mod->name,
+                       mod->strtab + mod->symtab[symidx].st_name);
+                return false;
+            }
+            v32 = (uint32_t)v64;
+            memcpy((void *)(uintptr_t)p, &v32, sizeof(v32));
+            break;
+        }
+        default: /* R_X86_64_NONE */
+            continue;
+        }
+        mod->nrelocs++;
+    }
+    return true;
+}
+
+static const Elf64_Sym *find_symbol(const struct module *mod, const char *name) {
+    for (size_t i = 1; i < mod->nsyms; i++) {
+        const Elf64_Sym *sym = &mod->symtab[i];
+        if (ELF64_ST_BIND(sym->st_info) != STB_LOCAL && sym->st_shndx != SHN_UNDEF &&
+            strcmp(mod->strtab + sym->st_name, name) == 0) {
+            return sym;
+        }
+    }
+    return 0;
+}
+
+/* The image is relocated in place: sh_addr and st_value end up holding
+   load addresses, and the symbol table stays in use for module_symbol(). */
+static bool load_module(struct module *mod, uint8_t *image, size_t size) {
+    const char *err = elf_check_rel(image, size);
+    if (err) {
+        pr_err("module %s: %s\n", mod->name, err);
+        return false;
+    }
+    const Elf64_Ehdr *eh = (const Elf64_Ehdr *)image;
+    Elf64_Shdr *sh = (Elf64_Shdr *)(image + eh->e_shoff);
+    const uint16_t shnum = eh->e_shnum;
+
+    uint16_t symndx = 0;
+    while (sh[symndx].sh_type != SHT_SYMTAB) {
+        symndx++;
+    }
+    Elf64_Sym *syms = (Elf64_Sym *)(image + sh[symndx].sh_offset);
+    mod->nsyms = sh[symndx].sh_size / sizeof(Elf64_Sym);
+    mod->strtab = (const char *)(image + sh[sh[symndx].sh_link].sh_offset);
+    mod->symtab = syms;
+
+    if (!layout_sections(mod, sh, shnum, image) || !resolve_symbols(mod, syms, sh)) {
+        return false;
+    }
+    for (uint16_t i = 0; i < shnum; i++) {
+        if (sh[i].sh_type != SHT_RELA || sh[i].sh_info >= shnum || !(sh[sh[i].sh_info].sh_flags & SHF_ALLOC)) {
+            continue;
+        }
+        if (!apply_rela(mod, &sh[i], &sh[sh[i].sh_info], image)) {
+            return false;
+        }
+    }
+
+    const Elf64_Sym *this_module = find_symbol(mod, "__this_module");
+    if (this_module) {
+        const struct module_info *info = (const struct module_info *)(uintptr_t)this_module->st_value;
+        if (info->init && info->init() != 0) {
+            pr_err("module %s: init failed\n", mod->name);
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Runs without module_lock: finding the image may read the ext2 root. */
+static bool module_load(struct module *mod) {
+    const uint64_t start = tsc_read();
+    size_t size = 0;
+    uint8_t *image = find_image(mod->name, &size);
+    if (!image) {
+        pr_err("module %s: not found\n", mod->name);
+    }
+    const bool live = image && load_module(mod, image, size);
+    mod->load_cycles = tsc_read() - start;
+    /* a failed module stays listed so it is not tried again */
+    __atomic_store_n(&mod->state, live ? MODULE_LIVE : MODULE_FAILED, __ATOMIC_RELEASE);
+
+    if (live) {
+        pr_info("module %s: %lu bytes at 0x%lx, %u relocations, loaded in %lu us\n", mod->name, (uint64_t)mod->size,
+                (uint64_t)(uintptr_t)mod->base, mod->nrelocs, tsc_cycles_to_us(mod->load_cycles));
+    }
+    return live;
+}
+
+bool request_module(const char *name) {
+    if (strlen(name) >= MODULE_NAME_LEN) {
+        return false;
+    }
+    spin_lock(&module_lock);
+    struct module *mod = find_module(name);
+    if (!mod) {
+        mod = pool_alloc(&module_pool);
+        if (mod) {
+            memset(mod, 0, sizeof(*mod));
+            memcpy(mod->name, name, strlen(name) + 1);
+            mod->state = MODULE_LOADING;
+            mod->next = modules;
+            __atomic_store_n(&modules, mod, __ATOMIC_RELEASE);
+        }
+        spin_unlock(&module_lock);
+        return mod && module_load(mod);
+    }
+    spin_unlock(&module_lock);
+
+    enum module_state state;
+    while ((state = __atomic_load_n(&mod->state, __ATOMIC_ACQUIRE)) == MODULE_LOADING) {
+        cpu_relax();
+    }
+    return state == MODULE_LIVE;
+}
+
+void *module_symbol(const char *module, const char *symbol) {
+    if (!request_module(module)) {
+        return 0;
+    }
+    const struct module *mod = find_module(module);
+    const Elf64_Sym *sym = find_symbol(mod, symbol);
+    if (!sym) {
+        pr_err("module %s: no symbol %s\n", module, symbol);
+        return 0;
+    }
+    return (void *)(uintptr_t)sym->st_value;
+}
+
+void module_log(void) {
+    size_t count;
+    memory_boot_modules(&count);
+    pr_info("modules: %lu exported symbols, %lu boot modules\n", (uint64_t)(__ksymtab_end - __ksymtab_start),
+            (uint64_t)count);
+    static const char *const states[] = { "loading", "live", "failed" };
+    for (const struct module *m = __atomic_load_n(&modules, __ATOMIC_ACQUIRE); m; m = m->next) {
+        const enum module_state state = __atomic_load_n(&m->state, __ATOMIC_ACQUIRE);
+        pr_info("  %-16s %-7s %lu bytes, %lu us\n", m->name, states[state], (uint64_t)m->size,
+                tsc_cycles_to_us(m->load_cycles));
+    }
+}
+
+#endif /* CONFIG_MODULES */
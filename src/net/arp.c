@@ -0,0 +1,196 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "inet.h"
+#include "memory.h"
+#include "netdev.h"
+#include "spinlock.h"
+
+#define ARP_TABLE_SIZE 128 /* power of two, open addressing */
+#define ARP_MAX_PENDING 4  /* packets parked per unresolved neighbour */
+
+#define ARPOP_REQUEST 1
+#define ARPOP_REPLY   2
+
+struct arphdr {
+    uint16_t htype;
+    uint16_t ptype;
+    uint8_t hlen;
+    uint8_t plen;
+    uint16_t oper;
+    uint8_t sha[ETH_ALEN];
+    uint32_t spa;
+    uint8_t tha[ETH_ALEN];
+    uint32_t tpa;
+} __attribute__((packed));
+
+enum arp_state {
+    ARP_FREE,
+    ARP_INCOMPLETE,
+    ARP_REACHABLE,
+};
+
+struct arp_entry {
+    uint32_t ip;
+    struct net_device *dev;
+    uint8_t mac[ETH_ALEN];
+    uint8_t state;
+    struct sk_buff_head pending;
+};
+
+static struct arp_entry table[ARP_TABLE_SIZE];
+static spinlock_t table_lock = SPINLOCK_INIT;
+static const uint8_t broadcast_mac[ETH_ALEN] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+
+static struct arp_entry *arp_slot(uint32_t ip, bool create) {
+    uint32_t h = (ip * 2654435761u) >> 25;
+    for (uint32_t i = 0; i < ARP_TABLE_SIZE; i++) {
+        struct arp_entry *e = &table[(h + i) & (ARP_TABLE_SIZE - 1)];
+        if (e->state != ARP_FREE && e->ip == ip) {
+            return e;
+        }
+        if (e->state == ARP_FREE) {
+            if (!create) {
+                return 0;
+            }
+            e->ip = ip;
+            e->state = ARP_INCOMPLETE;
+            skb_queue_init(&e->pending);
+            return e;
+        }
+    }
+    return 0; /* full: entries are never expired, the table is sized for a LAN */
+}
+
+static bool eth_xmit(struct sk_buff *skb, struct net_device *dev, const uint8_t *dest, uint16_t proto) {
+    struct ethhdr *eth = skb_push(skb, ETH_HLEN);
+    if (!eth) {
+        skb_free(skb);
+        return false;
+    }
+    memcpy(eth->dest, dest, ETH_ALEN);
+    memcpy(eth->source, dev->mac, ETH_ALEN);
+    eth->proto = htons(proto);
+    skb->dev = dev;
+    return dev_queue_xmit(skb);
+}
+
+static void arp_fill(struct arphdr *arp, uint16_t oper, const struct net_device *dev, const uint8_t *tha,
+                     uint32_t tpa) {
+    arp->htype = htons(1);
+    arp->ptype = htons(ETH_P_IP);
+    arp->hlen = ETH_ALEN;
+    arp->plen = 4;
+    arp->oper = htons(oper);
+    memcpy(arp->sha, dev->mac, ETH_ALEN);
+    arp->spa = dev->ipv4_addr;
+    memcpy(arp->tha, tha, ETH_ALEN);
+    arp->tpa = tpa;
+}
+
+static void arp_send_request(struct net_device *dev, uint32_t ip) {
+    struct sk_buff *skb = skb_alloc(sizeof(struct arphdr));
+    if (!skb) {
+        return;
+    }
+    static const uint8_t zero_mac[ETH_ALEN];
+    arp_fill(skb_put(skb, sizeof(struct arphdr)), ARPOP_REQUEST, dev, zero_mac, ip);
+    eth_xmit(skb, dev, broadcast_mac, ETH_P_ARP);
+}
+
+/* skb->data points at the network header. Consumes skb. */
+bool arp_output(struct sk_buff *skb, struct net_device *dev, uint32_t nexthop) {
+    if (nexthop == INADDR_BROADCAST) {
+        return eth_xmit(skb, dev, broadcast_mac, ETH_P_IP);
+    }
+
+    uint8_t mac[ETH_ALEN];
+    bool resolved = false;
+    bool new_entry = false;
+    uint64_t flags = spin_lock_irqsave(&table_lock);
+    struct arp_entry *e = arp_slot(nexthop, false);
+    if (!e) {
+        e = arp_slot(nexthop, true);
+        new_entry = e != 0;
+        if (e) {
+            e->dev = dev;
+        }
+    }
+    if (e && e->state == ARP_REACHABLE) {
+        memcpy(mac, e->mac, ETH_ALEN);
+        resolved = true;
+    } else if (e && e->pending.qlen < ARP_MAX_PENDING) {
+        skb_queue_tail(&e->pending, skb);
+        skb = 0;
+        inet_stats.arp_queued++;
+    }
+    spin_unlock_irqrestore(&table_lock, flags);
+
+    if (resolved) {
+        return eth_xmit(skb, dev, mac, ETH_P_IP);
+    }
+    if (skb) {
+        inet_stats.arp_dropped++;
+        skb_free(skb);
+        return false;
+    }
+    if (new_entry) {
+        arp_send_request(dev, nexthop);
+    }
+    return true;
+}
+
+static void arp_rcv(struct sk_buff *skb, struct net_device *dev) {
+    if (skb_headlen(skb) < sizeof(struct arphdr) || !dev->ipv4_addr) {
+        skb_free(skb);
+        return;
+    }
+    struct arphdr *arp = (struct arphdr *)skb->data;
+    if (ntohs(arp->htype) != 1 || ntohs(arp->ptype) != ETH_P_IP || arp->hlen != ETH_ALEN || arp->plen != 4) {
+        skb_free(skb);
+        return;
+    }
+    const bool for_us = arp->tpa == dev->ipv4_addr;
+
+    /* Learn the sender if we asked for it or it is talking to us, and
+       release whatever was waiting on the resolution. */
+    struct sk_buff_head ready;
+    skb_queue_init(&ready);
+    uint64_t flags = spin_lock_irqsave(&table_lock);
+    struct arp_entry *e = arp_slot(arp->spa, for_us);
+    if (e) {
+        memcpy(e->mac, arp->sha, ETH_ALEN);
+        e->dev = dev;
+        e->state = ARP_REACHABLE;
+        ready = e->pending;
+        skb_queue_init(&e->pending);
+    }
+    spin_unlock_irqrestore(&table_lock, flags);
+
+    struct sk_buff *p;
+    while ((p = skb_dequeue(&ready)) != 0) {
+        eth_xmit(p, dev, arp->sha, ETH_P_IP);
+    }
+
+    if (for_us && ntohs(arp->oper) == ARPOP_REQUEST) {
+        /* answer in place: the request buffer becomes the reply */
+        uint8_t sha[ETH_ALEN];
+        const uint32_t spa = arp->spa;
+        memcpy(sha, arp->sha, ETH_ALEN);
+        arp_fill(arp, ARPOP_REPLY, dev, sha, spa);
+        skb_trim(skb, sizeof(struct arphdr));
+        eth_xmit(skb, dev, sha, ETH_P_ARP);
+        return;
+    }
+    skb_free(skb);
+}
+
+static const struct packet_type arp_packet_type = {
+    .type = ETH_P_ARP,
+    .func = arp_rcv,
+};
+
+void arp_init(void) {
+    net_register_protocol(&arp_packet_type);
+}
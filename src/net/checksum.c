@@ -0,0 +1,83 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bench.h"
+#include "checksum.h"
+#include "cpu.h"
+
+/* Below this the FPU save and restore cost more than the vector loop gains. */
+#define CSUM_SSE_MIN 4096
+
+/* checksum_sse.c, the one file built with SSE: the 32-byte blocks of
+   buf summed into 64 bits. Only between kernel_fpu_begin() and _end(). */
+uint64_t csum_partial_sse(const void *buf, size_t len);
+
+static inline uint64_t fold64(uint64_t s) {
+    s = (s & 0xFFFFFFFF) + (s >> 32);
+    s = (s & 0xFFFFFFFF) + (s >> 32);
+    return s;
+}
+
+uint32_t csum_partial(const void *buf, size_t len, uint32_t sum) {
+    const uint8_t *p = buf;
+    uint64_t s = sum;
+
+    if (len >= CSUM_SSE_MIN) {
+        const size_t blocks = len & ~(size_t)31;
+        const uint64_t flags = kernel_fpu_begin();
+        s += csum_partial_sse(p, blocks);
+        kernel_fpu_end(flags);
+        p += blocks;
+        len -= blocks;
+    }
+
+    for (; len >= 8; len -= 8, p += 8) {
+        uint64_t w;
+        __builtin_memcpy(&w, p, 8);
+        s += (w & 0xFFFFFFFF) + (w >> 32);
+    }
+    if (len >= 4) {
+        uint32_t w;
+        __builtin_memcpy(&w, p, 4);
+        s += w;
+        p += 4;
+        len -= 4;
+    }
+    if (len >= 2) {
+        uint16_t w;
+        __builtin_memcpy(&w, p, 2);
+        s += w;
+        p += 2;
+        len -= 2;
+    }
+    if (len) {
+        s += *p; /* odd trailing byte is the high-order byte in network order */
+    }
+    return (uint32_t)fold64(s);
+}
+
+#ifdef CONFIG_MICROBENCH
+static void bench_csum_1500(uint64_t loops) {
+    static uint8_t frame[1500];
+    uint32_t sum = 0;
+    for (uint64_t i = 0; i < loops; i++) {
+        bench_clobber(frame);
+        sum = csum_partial(frame, sizeof(frame), sum);
+    }
+    bench_clobber(&sum);
+}
+
+BENCH(net, csum_1500, bench_csum_1500);
+
+static void bench_csum_8192(uint64_t loops) {
+    static uint8_t buf[8192];
+    uint32_t sum = 0;
+    for (uint64_t i = 0; i < loops; i++) {
+        bench_clobber(buf);
+        sum = csum_partial(buf, sizeof(buf), sum);
+    }
+    bench_clobber(&sum);
+}
+
+BENCH(net, csum_8192, bench_csum_8192);
+#endif
@@ -0,0 +1,34 @@
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint64_t v2u64 __attribute__((vector_size(16), aligned(1)));
+
+uint64_t csum_partial_sse(const void *buf, size_t len);
+
+static inline uint64_t fold64(uint64_t s) {
+    s = (s & 0xFFFFFFFF) + (s >> 32);
+    s = (s & 0xFFFFFFFF) + (s >> 32);
+    return s;
+}
+
+/*
+ * SSE2 main loop: each 16-byte load is split into 32-bit halves that are
+ * added into 64-bit lanes, so carries collect in the upper bits instead
+ * of needing an add-with-carry chain. Two accumulators keep the adds
+ * independent; the lanes are folded once at the end.
+ */
+uint64_t csum_partial_sse(const void *buf, size_t len) {
+    const uint8_t *p = buf;
+    const v2u64 low = { 0xFFFFFFFF, 0xFFFFFFFF };
+    v2u64 acc0 = { 0, 0 };
+    v2u64 acc1 = { 0, 0 };
+
+    for (; len >= 32; len -= 32, p += 32) {
+        v2u64 a = *(const v2u64 *)p;
+        v2u64 b = *(const v2u64 *)(p + 16);
+        acc0 += (a & low) + (a >> 32);
+        acc1 += (b & low) + (b >> 32);
+    }
+    acc0 += acc1;
+    return fold64(acc0[0]) + fold64(acc0[1]);
+}
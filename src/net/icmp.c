@@ -0,0 +1,133 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "checksum.h"
+#include "console.h"
+#include "cpu.h"
+#include "inet.h"
+#include "memory.h"
+#include "netdev.h"
+#include "tsc.h"
+
+#define PING_ID 0x5A4B
+
+/* The single outstanding net_ping() request. */
+static struct {
+    uint16_t seq;
+    volatile bool answered;
+} ping;
+
+static void icmp_rcv(struct sk_buff *skb) {
+    if (skb->len < sizeof(struct icmphdr) || skb_headlen(skb) < sizeof(struct icmphdr) ||
+        csum_fold(skb_checksum(skb, 0, skb->len, 0)) != 0) {
+        skb_free(skb);
+        return;
+    }
+    struct icmphdr *icmp = (struct icmphdr *)skb->data;
+
+    if (icmp->type == ICMP_ECHO && icmp->code == 0) {
+        const struct iphdr *iph = skb_network_header(skb);
+        const uint32_t peer = iph->saddr;
+        struct inet_route rt;
+        if (!ip_route_output(peer, &rt)) {
+            skb_free(skb);
+            return;
+        }
+        /* turn the request around in its own buffer */
+        icmp->type = ICMP_ECHOREPLY;
+        icmp->checksum = 0;
+        icmp->checksum = csum_fold(skb_checksum(skb, 0, skb->len, 0));
+        inet_stats.icmp_echo_replies_sent++;
+        ip_send(skb, &rt, peer, IPPROTO_ICMP);
+        return;
+    }
+    if (icmp->type == ICMP_ECHOREPLY && ntohs(icmp->id) == PING_ID && ntohs(icmp->sequence) == ping.seq) {
+        ping.answered = true;
+    }
+    skb_free(skb);
+}
+
+/* Send one echo request and poll the stack until the matching reply. */
+bool net_ping(uint32_t daddr, uint16_t seq, uint32_t payload, uint64_t timeout_us, uint64_t *rtt_ns) {
+    struct inet_route rt;
+    if (!ip_route_output(daddr, &rt)) {
+        return false;
+    }
+    struct sk_buff *skb = skb_alloc(sizeof(struct icmphdr) + payload);
+    if (!skb) {
+        return false;
+    }
+    struct icmphdr *icmp = skb_put(skb, sizeof(struct icmphdr) + payload);
+    icmp->type = ICMP_ECHO;
+    icmp->code = 0;
+    icmp->checksum = 0;
+    icmp->id = htons(PING_ID);
+    icmp->sequence = htons(seq);
+    uint8_t *data = (uint8_t *)(icmp + 1);
+    for (uint32_t i = 0; i < payload; i++) {
+        data[i] = (uint8_t)i;
+    }
+    icmp->checksum = csum_fold(csum_partial(icmp, sizeof(*icmp) + payload, 0));
+
+    ping.seq = seq;
+    ping.answered = false;
+    const uint64_t start = tsc_read();
+    if (!ip_send(skb, &rt, daddr, IPPROTO_ICMP)) {
+        return false;
+    }
+    while (!ping.answered) {
+        if (!net_rx_action(NAPI_WEIGHT)) {
+            cpu_relax();
+        }
+        if (tsc_cycles_to_us(tsc_read() - start) >= timeout_us) {
+            return false;
+        }
+    }
+    if (rtt_ns) {
+        *rtt_ns = tsc_cycles_to_ns(tsc_read() - start);
+    }
+    return true;
+}
+
+#if defined(CONFIG_NET_IPV4_BENCH) || defined(CONFIG_VIRTIO_NET_BENCH)
+#define PING_BENCH_SAMPLES 1000
+#define PING_BENCH_TIMEOUT_US 10000
+
+static uint64_t ping_samples[PING_BENCH_SAMPLES];
+
+static void sort_u64(uint64_t *v, size_t n) {
+    for (size_t gap = n / 2; gap; gap /= 2) {
+        for (size_t i = gap; i < n; i++) {
+            uint64_t x = v[i];
+            size_t j = i;
+            for (; j >= gap && v[j - gap] > x; j -= gap) {
+                v[j] = v[j - gap];
+            }
+            v[j] = x;
+        }
+    }
+}
+
+void ping_bench(const char *tag, uint32_t daddr) {
+    size_t count = 0;
+    for (uint32_t i = 0; i < PING_BENCH_SAMPLES; i++) {
+        uint64_t rtt;
+        if (net_ping(daddr, (uint16_t)i, 56, PING_BENCH_TIMEOUT_US, &rtt)) {
+            ping_samples[count++] = rtt;
+        }
+    }
+    if (!count) {
+        kprint("%s: no echo replies\n", tag);
+        return;
+    }
+    sort_u64(ping_samples, count);
+    kprint("%s: rtt over %zu samples: p50 %lu ns, p90 %lu ns, p99 %lu ns, max %lu ns\n", tag, count,
+           ping_samples[count / 2], ping_samples[count * 9 / 10], ping_samples[count * 99 / 100],
+           ping_samples[count - 1]);
+}
+#endif
+
+void icmp_init(void) {
+    inet_add_protocol(IPPROTO_ICMP, icmp_rcv);
+}
@@ -0,0 +1,288 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "string.h"
+
+#include "checksum.h"
+#include "console.h"
+#include "inet.h"
+#include "log.h"
+#include "memory.h"
+#include "module.h"
+#include "netdev.h"
+#include "udp.h"
+
+/* Only set when NET_IPV4 is enabled; inet_init() is not called otherwise. */
+#ifndef CONFIG_NET_IPV4_ADDR
+#define CONFIG_NET_IPV4_ADDR "10.0.2.15"
+#endif
+#ifndef CONFIG_NET_IPV4_PREFIX
+#define CONFIG_NET_IPV4_PREFIX "24"
+#endif
+#ifndef CONFIG_NET_IPV4_GATEWAY
+#define CONFIG_NET_IPV4_GATEWAY "10.0.2.2"
+#endif
+
+static inet_protocol_handler_t inet_protos[256];
+struct inet_stats inet_stats;
+static uint16_t ip_ident;
+
+bool inet_parse_addr(const char *text, uint32_t *addr) {
+    uint32_t host = 0;
+    for (int part = 0; part < 4; part++) {
+        uint32_t value = 0;
+        int digits = 0;
+        while (*text >= '0' && *text <= '9' && digits < 3) {
+            value = value * 10 + (uint32_t)(*text++ - '0');
+            digits++;
+        }
+        if (!digits || value > 255 || *text != (part == 3 ? '\0' : '.')) {
+            return false;
+        }
+        text++;
+        host = (host << 8) | value;
+    }
+    *addr = htonl(host);
+    return true;
+}
+EXPORT_SYMBOL(inet_parse_addr);
+
+void inet_set_addr(struct net_device *dev, uint32_t addr, uint32_t prefix_len, uint32_t gateway) {
+    dev->ipv4_addr = addr;
+    dev->ipv4_mask = prefix_len ? htonl(~0u << (32 - prefix_len)) : 0;
+    dev->ipv4_gateway = gateway;
+    const uint32_t a = ntohl(addr);
+    pr_info("inet: %s %u.%u.%u.%u/%u\n", dev->name, a >> 24, (a >> 16) & 0xFF, (a >> 8) & 0xFF, a & 0xFF,
+            prefix_len);
+}
+EXPORT_SYMBOL(inet_set_addr);
+
+bool inet_add_protocol(uint8_t protocol, inet_protocol_handler_t handler) {
+    if (inet_protos[protocol]) {
+        return false;
+    }
+    inet_protos[protocol] = handler;
+    return true;
+}
+
+static bool addr_is_local(uint32_t daddr, const struct net_device *dev) {
+    if (daddr == INADDR_BROADCAST || (dev->flags & NETDEV_F_LOOPBACK)) {
+        return true;
+    }
+    if (!dev->ipv4_addr) {
+        return false;
+    }
+    return daddr == dev->ipv4_addr || daddr == (dev->ipv4_addr | ~dev->ipv4_mask);
+}
+
+static void ip_rcv(struct sk_buff *skb, struct net_device *dev) {
+    inet_stats.ip_in++;
+    if (skb_headlen(skb) < sizeof(struct iphdr)) {
+        goto drop;
+    }
+    const struct iphdr *iph = (const struct iphdr *)skb->data;
+    const uint32_t ihl = iph->ihl_version & 0xF;
+    const uint32_t tot_len = ntohs(iph->tot_len);
+    if ((iph->ihl_version >> 4) != 4 || ihl < 5 || skb_headlen(skb) < ihl * 4 ||
+        tot_len < ihl * 4 || tot_len > skb->len || ip_fast_csum(iph, ihl) != 0) {
+        goto drop;
+    }
+    /* no reassembly: fragments are dropped */
+    if (ntohs(iph->frag_off) & (IP_MF | IP_OFFSET)) {
+        goto drop;
+    }
+    if (!addr_is_local(iph->daddr, dev)) {
+        goto drop;
+    }
+    inet_protocol_handler_t handler = inet_protos[iph->protocol];
+    if (!handler) {
+        goto drop;
+    }
+
+    if (skb->len > tot_len) {
+        skb_trim(skb, tot_len); /* Ethernet minimum-size padding */
+    }
+    skb_pull(skb, ihl * 4);
+    skb_reset_transport_header(skb);
+    handler(skb);
+    return;
+
+drop:
+    inet_stats.ip_in_dropped++;
+    skb_free(skb);
+}
+
+static const struct packet_type ip_packet_type = {
+    .type = ETH_P_IP,
+    .func = ip_rcv,
+};
+
+/* Loopback for 127/8 and our own addresses, then an on-link device, then
+   the first device with a gateway. */
+bool ip_route_output(uint32_t daddr, struct inet_route *rt) {
+    struct net_device *lo = 0;
+    struct net_device *gw_dev = 0;
+    struct net_device *dev;
+    const bool loopback_net = (ntohl(daddr) >> 24) == 127;
+
+    for (size_t i = 0; (dev = netdev_at(i)) != 0; i++) {
+        if (dev->flags & NETDEV_F_LOOPBACK) {
+            lo = dev;
+            continue;
+        }
+        if (!dev->ipv4_addr) {
+            continue;
+        }
+        if (daddr == dev->ipv4_addr) {
+            if (!lo) {
+                continue;
+            }
+            rt->dev = lo;
+            rt->saddr = daddr;
+            rt->nexthop = daddr;
+            return true;
+        }
+        if (daddr == INADDR_BROADCAST || ((daddr ^ dev->ipv4_addr) & dev->ipv4_mask) == 0) {
+            rt->dev = dev;
+            rt->saddr = dev->ipv4_addr;
+            rt->nexthop = daddr;
+            return true;
+        }
+        if (dev->ipv4_gateway && !gw_dev) {
+            gw_dev = dev;
+        }
+    }
+    if (loopback_net && lo) {
+        rt->dev = lo;
+        rt->saddr = daddr == htonl(INADDR_LOOPBACK) ? daddr : htonl(INADDR_LOOPBACK);
+        rt->nexthop = daddr;
+        return true;
+    }
+    if (gw_dev) {
+        rt->dev = gw_dev;
+        rt->saddr = gw_dev->ipv4_addr;
+        rt->nexthop = gw_dev->ipv4_gateway;
+        return true;
+    }
+    return false;
+}
+
+/* skb->data points at the transport header; the IP and link headers are
+   pushed into its headroom. Consumes skb. */
+bool ip_send(struct sk_buff *skb, const struct inet_route *rt, uint32_t daddr, uint8_t protocol) {
+    struct iphdr *iph = skb_push(skb, sizeof(*iph));
+    if (!iph || skb->len > rt->dev->mtu) {
+        skb_free(skb);
+        return false;
+    }
+    iph->ihl_version = 0x45;
+    iph->tos = 0;
+    iph->tot_len = htons((uint16_t)skb->len);
+    iph->id = htons(ip_ident++);
+    iph->frag_off = htons(0x4000); /* DF */
+    iph->ttl = IP_DEFAULT_TTL;
+    iph->protocol = protocol;
+    iph->check = 0;
+    iph->saddr = rt->saddr;
+    iph->daddr = daddr;
+    iph->check = ip_fast_csum(iph, 5);
+    skb_reset_network_header(skb);
+    skb->dev = rt->dev;
+    skb->protocol = ETH_P_IP;
+    inet_stats.ip_out++;
+
+    if (rt->dev->flags & NETDEV_F_LOOPBACK) {
+        struct ethhdr *eth = skb_push(skb, ETH_HLEN);
+        if (!eth) {
+            skb_free(skb);
+            return false;
+        }
+        memset(eth->dest, 0, 2 * ETH_ALEN);
+        eth->proto = htons(ETH_P_IP);
+        return dev_queue_xmit(skb);
+    }
+    return arp_output(skb, rt->dev, rt->nexthop);
+}
+
+static inline uint32_t csum_block_add(uint32_t sum, uint32_t block, uint32_t offset) {
+    if (offset & 1) {
+        block = (block >> 8) | (block << 24); /* odd start: bytes swap lanes */
+    }
+    return csum_add(sum, block);
+}
+
+/* Checksum len bytes from offset across the linear part and fragments. */
+uint32_t skb_checksum(const struct sk_buff *skb, uint32_t offset, uint32_t len, uint32_t sum) {
+    uint32_t pos = 0;
+    const uint32_t head = skb_headlen(skb);
+    if (offset < head) {
+        uint32_t n = head - offset < len ? head - offset : len;
+        sum = csum_partial(skb->data + offset, n, sum);
+        pos = n;
+        offset += n;
+        len -= n;
+    }
+    offset -= head;
+    const struct skb_shared_info *sh = skb_shinfo(skb);
+    for (uint8_t i = 0; i < sh->nr_frags && len; i++) {
+        const struct skb_frag *f = &sh->frags[i];
+        if (offset >= f->size) {
+            offset -= f->size;
+            continue;
+        }
+        uint32_t n = f->size - offset < len ? f->size - offset : len;
+        sum = csum_block_add(sum, csum_partial(f->buf + f->offset + offset, n, 0), pos);
+        pos += n;
+        len -= n;
+        offset = 0;
+    }
+    return sum;
+}
+
+void inet_get_stats(struct inet_stats *out) {
+    *out = inet_stats;
+}
+
+static uint32_t parse_decimal(const char *text, uint32_t fallback) {
+    uint32_t value = 0;
+    if (!*text) {
+        return fallback;
+    }
+    for (; *text; text++) {
+        if (*text < '0' || *text > '9') {
+            return fallback;
+        }
+        value = value * 10 + (uint32_t)(*text - '0');
+    }
+    return value;
+}
+
+void inet_init(void) {
+    net_register_protocol(&ip_packet_type);
+    arp_init();
+    icmp_init();
+    udp_init();
+
+    struct net_device *dev;
+    bool nic_configured = false;
+    for (size_t i = 0; (dev = netdev_at(i)) != 0; i++) {
+        if (dev->flags & NETDEV_F_LOOPBACK) {
+            inet_set_addr(dev, htonl(INADDR_LOOPBACK), 8, 0);
+            continue;
+        }
+        /* the first NIC takes the configured static address */
+        if (nic_configured) {
+            continue;
+        }
+        uint32_t addr = 0;
+        uint32_t gateway = 0;
+        if (!inet_parse_addr(CONFIG_NET_IPV4_ADDR, &addr)) {
+            pr_err("inet: bad address %s\n", CONFIG_NET_IPV4_ADDR);
+            continue;
+        }
+        inet_parse_addr(CONFIG_NET_IPV4_GATEWAY, &gateway);
+        uint32_t prefix = parse_decimal(CONFIG_NET_IPV4_PREFIX, 24);
+        inet_set_addr(dev, addr, prefix > 32 ? 24 : prefix, gateway);
+        nic_configured = true;
+    }
+}
@@ -0,0 +1,122 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bench.h"
+#include "console.h"
+#include "memory.h"
+#include "netdev.h"
+#include "tsc.h"
+
+/* TX hands the very same skb to RX: no copy, no new allocation. */
+static bool loopback_xmit(struct net_device *dev, struct sk_buff *skb) {
+    const uint32_t len = skb->len;
+    dev->stats.tx_packets++;
+    dev->stats.tx_bytes += len;
+    dev->stats.rx_packets++;
+    dev->stats.rx_bytes += len;
+    netif_rx(skb);
+    return true;
+}
+
+static const struct net_device_ops loopback_ops = {
+    .xmit = loopback_xmit,
+};
+
+static struct net_device loopback_dev = {
+    .name = "lo",
+    .mtu = 1500,
+    .flags = NETDEV_F_LOOPBACK,
+    .ops = &loopback_ops,
+};
+
+void loopback_init(void) {
+    netdev_register(&loopback_dev);
+}
+
+#if defined(CONFIG_NET_LOOPBACK_BENCH) || (defined(CONFIG_NET_LOOPBACK) && defined(CONFIG_MICROBENCH))
+#define LOOPBACK_BENCH_BATCH 64
+
+static uint64_t loopback_bench_received;
+
+static void loopback_bench_rx(struct sk_buff *skb, struct net_device *dev) {
+    (void)dev;
+    loopback_bench_received++;
+    skb_free(skb);
+}
+
+static const struct packet_type loopback_bench_proto = {
+    .type = ETH_P_BENCH,
+    .func = loopback_bench_rx,
+};
+
+/* count frames of frame_len bytes through lo and back up to a protocol
+   handler; the payload is never touched, so this is pure per-packet
+   overhead. Returns false once the skb pool runs dry. */
+static bool loopback_bench_send(uint64_t count, uint32_t frame_len) {
+    static bool registered;
+    if (!registered) {
+        registered = net_register_protocol(&loopback_bench_proto);
+    }
+    bool ok = true;
+    for (uint64_t i = 0; i < count; i++) {
+        struct sk_buff *skb = skb_alloc(frame_len);
+        if (!skb) {
+            ok = false;
+            break;
+        }
+        struct ethhdr *eth = skb_put(skb, frame_len);
+        memset(eth->dest, 0, ETH_ALEN);
+        memset(eth->source, 0, ETH_ALEN);
+        eth->proto = htons(ETH_P_BENCH);
+        skb->dev = &loopback_dev;
+        dev_queue_xmit(skb);
+        if ((i % LOOPBACK_BENCH_BATCH) == LOOPBACK_BENCH_BATCH - 1) {
+            net_rx_action(LOOPBACK_BENCH_BATCH);
+        }
+    }
+    net_rx_action(NET_BACKLOG_MAX);
+    return ok;
+}
+#endif
+
+#ifdef CONFIG_NET_LOOPBACK_BENCH
+#define LOOPBACK_BENCH_PACKETS 1000000
+
+static void loopback_bench_run(uint32_t frame_len) {
+    loopback_bench_received = 0;
+    const uint64_t start = tsc_read();
+    if (!loopback_bench_send(LOOPBACK_BENCH_PACKETS, frame_len)) {
+        kprint("net bench: skb pool exhausted\n");
+    }
+    const uint64_t ns = tsc_cycles_to_ns(tsc_read() - start);
+
+    struct skb_pool_stats ps;
+    skb_get_pool_stats(&ps);
+    kprint("net bench: %u B frames: %lu received, %lu pps, %lu ns/pkt, %lu Mbit/s\n", frame_len,
+           loopback_bench_received, ns ? loopback_bench_received * 1000000000 / ns : 0,
+           loopback_bench_received ? ns / loopback_bench_received : 0,
+           ns ? loopback_bench_received * frame_len * 8 * 1000 / ns : 0);
+    kprint("net bench: skbs in use %lu, buffers in use %lu, alloc failures %lu\n",
+           ps.skbs_in_use, ps.bufs_in_use, ps.alloc_failures);
+}
+
+void loopback_bench(void) {
+    loopback_bench_run(64);
+    loopback_bench_run(1500);
+}
+#endif
+
+#if defined(CONFIG_NET_LOOPBACK) && defined(CONFIG_MICROBENCH)
+static void bench_loopback_64(uint64_t loops) {
+    loopback_bench_send(loops, 64);
+}
+
+BENCH(net, loopback_64, bench_loopback_64);
+
+static void bench_loopback_1500(uint64_t loops) {
+    loopback_bench_send(loops, 1500);
+}
+
+BENCH(net, loopback_1500, bench_loopback_1500);
+#endif
@@ -0,0 +1,186 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "string.h"
+
+#include "console.h"
+#include "interrupts.h"
+#include "log.h"
+#include "module.h"
+#include "netdev.h"
+#include "packet.h"
+#include "spinlock.h"
+#include "trace.h"
+
+static struct net_device *devices[NETDEV_MAX_DEVICES];
+static size_t device_count = 0;
+static spinlock_t devices_lock = SPINLOCK_INIT;
+static const struct packet_type *protocols[NET_MAX_PROTOCOLS];
+static size_t protocol_count = 0;
+static struct sk_buff_head backlog;
+static struct napi_struct *poll_head;
+static struct napi_struct *poll_tail;
+
+static void poll_list_add(struct napi_struct *napi) {
+    napi->next = 0;
+    if (poll_tail) {
+        poll_tail->next = napi;
+    } else {
+        poll_head = napi;
+    }
+    poll_tail = napi;
+}
+
+bool netdev_register(struct net_device *dev) {
+    if (!dev || !dev->ops || !dev->ops->xmit) {
+        return false;
+    }
+    spin_lock(&devices_lock);
+    const bool full = device_count >= NETDEV_MAX_DEVICES;
+    if (!full) {
+        devices[device_count++] = dev;
+        dev->ifindex = (uint32_t)device_count;
+    }
+    spin_unlock(&devices_lock);
+    if (full) {
+        return false;
+    }
+    pr_info("net: %s mtu %u mac %02x:%02x:%02x:%02x:%02x:%02x\n", dev->name, dev->mtu, dev->mac[0], dev->mac[1],
+            dev->mac[2], dev->mac[3], dev->mac[4], dev->mac[5]);
+    return true;
+}
+
+struct net_device *netdev_find(const char *name) {
+    for (size_t i = 0; i < device_count; i++) {
+        if (strcmp(devices[i]->name, name) == 0) {
+            return devices[i];
+        }
+    }
+    return 0;
+}
+
+struct net_device *netdev_at(size_t index) {
+    return index < device_count ? devices[index] : 0;
+}
+EXPORT_SYMBOL(netdev_at);
+
+bool net_register_protocol(const struct packet_type *pt) {
+    if (!pt || !pt->func || protocol_count >= NET_MAX_PROTOCOLS) {
+        return false;
+    }
+    protocols[protocol_count++] = pt;
+    return true;
+}
+
+bool dev_queue_xmit(struct sk_buff *skb) {
+    struct net_device *dev = skb->dev;
+    if (!dev) {
+        skb_free(skb);
+        return false;
+    }
+#ifdef CONFIG_NET_PACKET_ANALYZER
+    packet_capture(skb, PACKET_OUTGOING);
+#endif
+    TRACE(net_dev_xmit, dev->ifindex, skb->len);
+    return dev->ops->xmit(dev, skb);
+}
+
+/* Queue a received frame for net_rx_action(); safe from interrupt
+   context since nothing here touches the protocol handlers. */
+void netif_rx(struct sk_buff *skb) {
+    uint64_t flags = irq_save();
+    if (backlog.qlen >= NET_BACKLOG_MAX) {
+        irq_restore(flags);
+        skb->dev->stats.rx_dropped++;
+        skb_free(skb);
+        return;
+    }
+    skb_queue_tail(&backlog, skb);
+    irq_restore(flags);
+}
+
+/* Strip the Ethernet header and hand the frame to its protocol. */
+void netif_receive_skb(struct sk_buff *skb) {
+    struct net_device *dev = skb->dev;
+    if (skb_headlen(skb) < ETH_HLEN) {
+        dev->stats.rx_dropped++;
+        skb_free(skb);
+        return;
+    }
+#ifdef CONFIG_NET_PACKET_ANALYZER
+    packet_capture(skb, PACKET_HOST);
+#endif
+    TRACE(net_receive_skb, dev->ifindex, skb->len);
+    const struct ethhdr *eth = (const struct ethhdr *)skb->data;
+    skb->mac_header = (uint16_t)(skb->data - skb->head);
+    skb->protocol = ntohs(eth->proto);
+    skb_pull(skb, ETH_HLEN);
+    skb_reset_network_header(skb);
+
+    for (size_t i = 0; i < protocol_count; i++) {
+        if (protocols[i]->type == skb->protocol) {
+            protocols[i]->func(skb, dev);
+            return;
+        }
+    }
+    dev->stats.rx_dropped++;
+    skb_free(skb);
+}
+
+void napi_schedule(struct napi_struct *napi) {
+    uint64_t flags = irq_save();
+    if (!napi->scheduled) {
+        napi->scheduled = true;
+        poll_list_add(napi);
+    }
+    irq_restore(flags);
+}
+
+void napi_complete(struct napi_struct *napi) {
+    napi->scheduled = false;
+}
+
+/* Run scheduled NAPI contexts round robin, NAPI_WEIGHT packets at a time,
+   then the software backlog, until budget is spent or all are idle. */
+size_t net_rx_action(size_t budget) {
+    size_t done = 0;
+    TRACE(net_rx_action, budget);
+    while (done < budget) {
+        uint64_t flags = irq_save();
+        struct napi_struct *napi = poll_head;
+        if (napi) {
+            poll_head = napi->next;
+            if (!poll_head) {
+                poll_tail = 0;
+            }
+        }
+        irq_restore(flags);
+        if (!napi) {
+            break;
+        }
+
+        int work = napi->poll(napi, NAPI_WEIGHT);
+        napi->polls++;
+        done += (size_t)work;
+        if (work >= NAPI_WEIGHT) {
+            /* still busy: stay scheduled, go to the back of the line */
+            flags = irq_save();
+            poll_list_add(napi);
+            irq_restore(flags);
+        }
+    }
+
+    while (done < budget) {
+        uint64_t flags = irq_save();
+        struct sk_buff *skb = skb_dequeue(&backlog);
+        irq_restore(flags);
+        if (!skb) {
+            break;
+        }
+        netif_receive_skb(skb);
+        done++;
+    }
+    TRACE(net_rx_action_done, done);
+    return done;
+}
+EXPORT_SYMBOL(net_rx_action);
@@ -0,0 +1,604 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "console.h"
+#include "inet.h"
+#include "memory.h"
+#include "netdev.h"
+#include "packet.h"
+#include "rcu.h"
+#include "serial.h"
+#include "spinlock.h"
+#include "tsc.h"
+#include "udp.h"
+
+#define PCAP_MAGIC_NSEC 0xa1b23c4du
+#define PCAP_LINKTYPE_ETHERNET 1
+
+struct packet_filter {
+    uint32_t len;
+    struct sock_filter insns[BPF_MAXINSNS];
+};
+
+_Static_assert(sizeof(struct packet_filter) <= 4096, "filter must fit a page");
+_Static_assert(sizeof(struct packet_sock) <= 4096, "socket must fit a page");
+
+struct pcap_file_header {
+    uint32_t magic;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int32_t thiszone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t linktype;
+};
+
+struct pcap_record_header {
+    uint32_t ts_sec;
+    uint32_t ts_nsec;
+    uint32_t incl_len;
+    uint32_t orig_len;
+};
+
+struct packet_sock *packet_socks;
+static spinlock_t socks_lock = SPINLOCK_INIT;
+
+/* ---- classic BPF ---- */
+
+static bool bpf_valid_code(uint16_t code) {
+    switch (code) {
+    case BPF_LD | BPF_W | BPF_ABS: case BPF_LD | BPF_H | BPF_ABS: case BPF_LD | BPF_B | BPF_ABS:
+    case BPF_LD | BPF_W | BPF_IND: case BPF_LD | BPF_H | BPF_IND: case BPF_LD | BPF_B | BPF_IND:
+    case BPF_LD | BPF_W | BPF_LEN: case BPF_LD | BPF_IMM: case BPF_LD | BPF_MEM:
+    case BPF_LDX | BPF_W | BPF_LEN: case BPF_LDX | BPF_IMM: case BPF_LDX | BPF_MEM:
+    case BPF_LDX | BPF_B | BPF_MSH:
+    case BPF_ST: case BPF_STX:
+    case BPF_ALU | BPF_NEG:
+    case BPF_JMP | BPF_JA:
+    case BPF_RET | BPF_K: case BPF_RET | BPF_A:
+    case BPF_MISC | BPF_TAX: case BPF_MISC | BPF_TXA:
+        return true;
+    }
+    if (BPF_CLASS(code) == BPF_ALU) {
+        switch (BPF_OP(code)) {
+        case BPF_ADD: case BPF_SUB: case BPF_MUL: case BPF_DIV: case BPF_MOD:
+        case BPF_OR: case BPF_AND: case BPF_XOR: case BPF_LSH: case BPF_RSH:
+            return (code & ~(BPF_OP(code) | BPF_SRC(code))) == BPF_ALU;
+        }
+        return false;
+    }
+    if (BPF_CLASS(code) == BPF_JMP) {
+        switch (BPF_OP(code)) {
+        case BPF_JEQ: case BPF_JGT: case BPF_JGE: case BPF_JSET:
+            return (code & ~(BPF_OP(code) | BPF_SRC(code))) == BPF_JMP;
+        }
+    }
+    return false;
+}
+
+/* Jumps only go forward and stay inside the program, which must end in a
+   return, so every run terminates within len instructions. */
+bool bpf_check(const struct sock_filter *prog, uint32_t len) {
+    if (!prog || !len || len > BPF_MAXINSNS) {
+        return false;
+    }
+    for (uint32_t pc = 0; pc < len; pc++) {
+        const struct sock_filter *ins = &prog[pc];
+        if (!bpf_valid_code(ins->code)) {
+            return false;
+        }
+        switch (BPF_CLASS(ins->code)) {
+        case BPF_LD:
+        case BPF_LDX:
+            if (BPF_MODE(ins->code) == BPF_MEM && ins->k >= BPF_MEMWORDS) {
+                return false;
+            }
+            break;
+        case BPF_ST:
+        case BPF_STX:
+            if (ins->k >= BPF_MEMWORDS) {
+                return false;
+            }
+            break;
+        case BPF_ALU:
+            if ((BPF_OP(ins->code) == BPF_DIV || BPF_OP(ins->code) == BPF_MOD) &&
+                BPF_SRC(ins->code) == BPF_K && ins->k == 0) {
+                return false;
+            }
+            break;
+        case BPF_JMP:
+            if (BPF_OP(ins->code) == BPF_JA) {
+                if (ins->k >= len - pc - 1) {
+                    return false;
+                }
+            } else if (ins->jt >= len - pc - 1 || ins->jf >= len - pc - 1) {
+                return false;
+            }
+            break;
+        }
+    }
+    return BPF_CLASS(prog[len - 1].code) == BPF_RET;
+}
+
+/* Big-endian load of size bytes at offset; false past the frame end. */
+static bool bpf_load(const struct sk_buff *skb, uint32_t offset, uint32_t size, uint32_t *out) {
+    uint8_t tmp[4];
+    const uint8_t *p;
+    if (offset > skb->len || size > skb->len - offset) {
+        return false;
+    }
+    if (offset + size <= skb_headlen(skb)) {
+        p = skb->data + offset;
+    } else {
+        skb_copy_bits(skb, offset, tmp, size);
+        p = tmp;
+    }
+    switch (size) {
+    case 4:
+        *out = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+        break;
+    case 2:
+        *out = (uint32_t)p[0] << 8 | p[1];
+        break;
+    default:
+        *out = p[0];
+        break;
+    }
+    return true;
+}
+
+static uint32_t bpf_size_bytes(uint16_t code) {
+    return BPF_SIZE(code) == BPF_W ? 4 : BPF_SIZE(code) == BPF_H ? 2 : 1;
+}
+
+/* Run a program accepted by bpf_check() over the frame at skb->data.
+   Loads past the end reject the frame, as on Linux. */
+uint32_t bpf_run(const struct sock_filter *prog, const struct sk_buff *skb) {
+    uint32_t a = 0;
+    uint32_t x = 0;
+    uint32_t mem[BPF_MEMWORDS] = {0};
+    for (const struct sock_filter *ins = prog;; ins++) {
+        const uint32_t k = ins->k;
+        switch (ins->code) {
+        case BPF_LD | BPF_W | BPF_ABS:
+        case BPF_LD | BPF_H | BPF_ABS:
+        case BPF_LD | BPF_B | BPF_ABS:
+            if (!bpf_load(skb, k, bpf_size_bytes(ins->code), &a)) {
+                return 0;
+            }
+            break;
+        case BPF_LD | BPF_W | BPF_IND:
+        case BPF_LD | BPF_H | BPF_IND:
+        case BPF_LD | BPF_B | BPF_IND:
+            if (x + k < x || !bpf_load(skb, x + k, bpf_size_bytes(ins->code), &a)) {
+                return 0;
+            }
+            break;
+        case BPF_LDX | BPF_B | BPF_MSH:
+            if (!bpf_load(skb, k, 1, &x)) {
+                return 0;
+            }
+            x = (x & 0xf) << 2;
+            break;
+        case BPF_LD | BPF_W | BPF_LEN:
+            a = skb->len;
+            break;
+        case BPF_LDX | BPF_W | BPF_LEN:
+            x = skb->len;
+            break;
+        case BPF_LD | BPF_IMM:
+            a = k;
+            break;
+        case BPF_LDX | BPF_IMM:
+            x = k;
+            break;
+        case BPF_LD | BPF_MEM:
+            a = mem[k];
+            break;
+        case BPF_LDX | BPF_MEM:
+            x = mem[k];
+            break;
+        case BPF_ST:
+            mem[k] = a;
+            break;
+        case BPF_STX:
+            mem[k] = x;
+            break;
+        case BPF_MISC | BPF_TAX:
+            x = a;
+            break;
+        case BPF_MISC | BPF_TXA:
+            a = x;
+            break;
+        case BPF_RET | BPF_K:
+            return k;
+        case BPF_RET | BPF_A:
+            return a;
+        case BPF_ALU | BPF_NEG:
+            a = -a;
+            break;
+        case BPF_JMP | BPF_JA:
+            ins += k;
+            break;
+        default:
+            if (BPF_CLASS(ins->code) == BPF_ALU) {
+                const uint32_t v = BPF_SRC(ins->code) == BPF_X ? x : k;
+                switch (BPF_OP(ins->code)) {
+                case BPF_ADD: a += v; break;
+                case BPF_SUB: a -= v; break;
+                case BPF_MUL: a *= v; break;
+                case BPF_DIV: if (!v) return 0; a /= v; break;
+                case BPF_MOD: if (!v) return 0; a %= v; break;
+                case BPF_OR:  a |= v; break;
+                case BPF_AND: a &= v; break;
+                case BPF_XOR: a ^= v; break;
+                case BPF_LSH: a = v < 32 ? a << v : 0; break;
+                case BPF_RSH: a = v < 32 ? a >> v : 0; break;
+                }
+            } else {
+                const uint32_t v = BPF_SRC(ins->code) == BPF_X ? x : k;
+                bool taken;
+                switch (BPF_OP(ins->code)) {
+                case BPF_JEQ: taken = a == v; break;
+                case BPF_JGT: taken = a > v; break;
+                case BPF_JGE: taken = a >= v; break;
+                default:      taken = (a & v) != 0; break;
+                }
+                ins += taken ? ins->jt : ins->jf;
+            }
+            break;
+        }
+    }
+}
+
+/* ---- ring ---- */
+
+static inline struct packet_frame *ring_slot(const struct packet_sock *sk, uint64_t pos) {
+    const uint64_t off = (pos & (sk->slot_count - 1)) * sk->slot_size;
+    return (struct packet_frame *)(sk->pages[off >> 12] + (off & 4095));
+}
+
+/* Claim the slot at head, or 0 when the reader has not freed it yet.
+   Producers race on head only; the winner owns the slot until it
+   publishes seq = pos + 1. */
+static struct packet_frame *ring_reserve(struct packet_sock *sk, uint64_t *pos_out) {
+    uint64_t pos = __atomic_load_n(&sk->head, __ATOMIC_RELAXED);
+    for (;;) {
+        struct packet_frame *f = ring_slot(sk, pos);
+        const int64_t diff = (int64_t)(__atomic_load_n(&f->seq, __ATOMIC_ACQUIRE) - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&sk->head, &pos, pos + 1, true, __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED)) {
+                *pos_out = pos;
+                return f;
+            }
+        } else if (diff < 0) {
+            return 0;
+        } else {
+            pos = __atomic_load_n(&sk->head, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static void packet_rcv(struct packet_sock *sk, struct sk_buff *skb, uint8_t pkttype, uint64_t now_ns) {
+    uint32_t snap = skb->len;
+    const struct packet_filter *filter = rcu_dereference(sk->filter);
+    if (filter) {
+        const uint32_t verdict = bpf_run(filter->insns, skb);
+        if (!verdict) {
+            __atomic_fetch_add(&sk->stats.filtered, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        if (verdict < snap) {
+            snap = verdict;
+        }
+    }
+    if (snap > sk->snaplen) {
+        snap = sk->snaplen;
+    }
+
+    uint64_t pos;
+    struct packet_frame *f = ring_reserve(sk, &pos);
+    if (!f) {
+        __atomic_fetch_add(&sk->stats.drops, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    f->tstamp_ns = now_ns;
+    f->len = skb->len;
+    f->snaplen = snap;
+    f->ifindex = skb->dev->ifindex;
+    f->pkttype = pkttype;
+    if (snap <= skb_headlen(skb)) {
+        memcpy(f + 1, skb->data, snap);
+    } else {
+        skb_copy_bits(skb, 0, f + 1, snap);
+    }
+    __atomic_store_n(&f->seq, pos + 1, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&sk->stats.packets, 1, __ATOMIC_RELAXED);
+}
+
+/* Loopback frames are seen once, on receive, like tcpdump -i lo. */
+void __packet_capture(struct sk_buff *skb, uint8_t pkttype) {
+    struct net_device *dev = skb->dev;
+    if (pkttype == PACKET_OUTGOING && (dev->flags & NETDEV_F_LOOPBACK)) {
+        return;
+    }
+    const uint64_t now_ns = tsc_cycles_to_ns(tsc_read());
+    rcu_read_lock();
+    for (struct packet_sock *sk = rcu_dereference(packet_socks); sk; sk = rcu_dereference(sk->next)) {
+        if (!sk->dev || sk->dev == dev) {
+            packet_rcv(sk, skb, pkttype, now_ns);
+        }
+    }
+    rcu_read_unlock();
+}
+
+/* ---- socket ---- */
+
+struct packet_sock *packet_socket(uint32_t slot_size, uint32_t slot_count, uint32_t snaplen) {
+    if (slot_size < PACKET_SLOT_MIN || slot_size > PACKET_SLOT_MAX || (slot_size & (slot_size - 1)) ||
+        !slot_count || (slot_count & (slot_count - 1)) ||
+        (uint64_t)slot_size * slot_count > (uint64_t)PACKET_RING_MAX_PAGES * 4096 ||
+        (uint64_t)slot_size * slot_count < 4096) {
+        return 0;
+    }
+    struct packet_sock *sk = page_alloc();
+    uint8_t **pages = page_alloc();
+    if (!sk || !pages) {
+        page_free(sk);
+        page_free(pages);
+        return 0;
+    }
+    memset(sk, 0, sizeof(*sk));
+    memset(pages, 0, 4096);
+    sk->pages = pages;
+    sk->slot_size = slot_size;
+    sk->slot_count = slot_count;
+    const uint32_t room = slot_size - (uint32_t)sizeof(struct packet_frame);
+    sk->snaplen = snaplen && snaplen < room ? snaplen : room;
+
+    const uint32_t page_count = (uint32_t)((uint64_t)slot_size * slot_count / 4096);
+    for (uint32_t i = 0; i < page_count; i++) {
+        if (!(pages[i] = page_alloc())) {
+            packet_close(sk);
+            return 0;
+        }
+    }
+    for (uint32_t i = 0; i < slot_count; i++) {
+        ring_slot(sk, i)->seq = i;
+    }
+    return sk;
+}
+
+bool packet_attach_filter(struct packet_sock *sk, const struct sock_filter *prog, uint32_t len) {
+    struct packet_filter *filter = 0;
+    if (prog) {
+        if (!bpf_check(prog, len) || !(filter = page_alloc())) {
+            return false;
+        }
+        filter->len = len;
+        memcpy(filter->insns, prog, len * sizeof(*prog));
+    }
+    struct packet_filter *old = sk->filter;
+    rcu_assign_pointer(sk->filter, filter);
+    if (old) {
+        if (sk->bound) {
+            synchronize_rcu();
+        }
+        page_free(old);
+    }
+    return true;
+}
+
+bool packet_bind(struct packet_sock *sk, struct net_device *dev) {
+    if (sk->bound) {
+        return false;
+    }
+    sk->dev = dev;
+    sk->bound = true;
+    spin_lock(&socks_lock);
+    sk->next = packet_socks;
+    rcu_assign_pointer(packet_socks, sk);
+    spin_unlock(&socks_lock);
+    return true;
+}
+
+void packet_close(struct packet_sock *sk) {
+    if (sk->bound) {
+        spin_lock(&socks_lock);
+        struct packet_sock **link = &packet_socks;
+        while (*link && *link != sk) {
+            link = &(*link)->next;
+        }
+        if (*link) {
+            rcu_assign_pointer(*link, sk->next);
+        }
+        spin_unlock(&socks_lock);
+        synchronize_rcu();
+    }
+    page_free(sk->filter);
+    for (uint32_t i = 0; i < PACKET_RING_MAX_PAGES && sk->pages[i]; i++) {
+        page_free(sk->pages[i]);
+    }
+    page_free(sk->pages);
+    page_free(sk);
+}
+
+void packet_get_stats(const struct packet_sock *sk, struct packet_stats *out) {
+    out->packets = __atomic_load_n(&sk->stats.packets, __ATOMIC_RELAXED);
+    out->drops = __atomic_load_n(&sk->stats.drops, __ATOMIC_RELAXED);
+    out->filtered = __atomic_load_n(&sk->stats.filtered, __ATOMIC_RELAXED);
+}
+
+const struct packet_frame *packet_ring_peek(struct packet_sock *sk) {
+    const struct packet_frame *f = ring_slot(sk, sk->tail);
+    if (__atomic_load_n(&f->seq, __ATOMIC_ACQUIRE) != sk->tail + 1) {
+        return 0;
+    }
+    return f;
+}
+
+void packet_ring_release(struct packet_sock *sk) {
+    struct packet_frame *f = ring_slot(sk, sk->tail);
+    __atomic_store_n(&f->seq, sk->tail + sk->slot_count, __ATOMIC_RELEASE);
+    sk->tail++;
+}
+
+/* ---- pcap export ---- */
+
+void pcap_write_header(pcap_write_t write, void *ctx, uint32_t snaplen) {
+    const struct pcap_file_header h = {
+        .magic = PCAP_MAGIC_NSEC,
+        .version_major = 2,
+        .version_minor = 4,
+        .snaplen = snaplen,
+        .linktype = PCAP_LINKTYPE_ETHERNET,
+    };
+    write(&h, sizeof(h), ctx);
+}
+
+uint64_t packet_export_pcap(struct packet_sock *sk, pcap_write_t write, void *ctx) {
+    uint64_t records = 0;
+    const struct packet_frame *f;
+    while ((f = packet_ring_peek(sk)) != 0) {
+        const struct pcap_record_header rh = {
+            .ts_sec = (uint32_t)(f->tstamp_ns / 1000000000),
+            .ts_nsec = (uint32_t)(f->tstamp_ns % 1000000000),
+            .incl_len = f->snaplen,
+            .orig_len = f->len,
+        };
+        write(&rh, sizeof(rh), ctx);
+        write(packet_frame_data(f), f->snaplen, ctx);
+        packet_ring_release(sk);
+        records++;
+    }
+    return records;
+}
+
+/* ---- capture benchmark ---- */
+
+#ifdef CONFIG_NET_PACKET_ANALYZER_BENCH
+#define CAPTURE_BENCH_DATAGRAMS 200000
+#define CAPTURE_BENCH_BURST 64
+#define CAPTURE_BENCH_PORT 9
+
+/* tcpdump -dd "ip and udp dst port 9" */
+static const struct sock_filter capture_udp_discard[] = {
+    BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 12),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_IP, 0, 8),
+    BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 23),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, 0, 6),
+    BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 20),
+    BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x1fff, 4, 0),
+    BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 14),
+    BPF_STMT(BPF_LD | BPF_H | BPF_IND, 16),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, CAPTURE_BENCH_PORT, 0, 1),
+    BPF_STMT(BPF_RET | BPF_K, 0x40000),
+    BPF_STMT(BPF_RET | BPF_K, 0),
+};
+
+/* tcpdump -dd "arp" */
+static const struct sock_filter capture_arp_only[] = {
+    BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 12),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_ARP, 0, 1),
+    BPF_STMT(BPF_RET | BPF_K, 0x40000),
+    BPF_STMT(BPF_RET | BPF_K, 0),
+};
+
+/* One-way 1472 B datagrams over lo to a discard sink while the reader
+   drains the ring between bursts; returns Mbit/s of payload. */
+static uint64_t capture_bench_run(struct udp_sock *client, struct udp_sock *sink, struct packet_sock *cap) {
+    static uint8_t data[1472];
+    const uint32_t daddr = htonl(INADDR_LOOPBACK);
+    uint64_t received = 0;
+    const uint64_t start = tsc_read();
+    for (uint32_t sent = 0; sent < CAPTURE_BENCH_DATAGRAMS;) {
+        for (uint32_t i = 0; i < CAPTURE_BENCH_BURST && sent < CAPTURE_BENCH_DATAGRAMS; i++, sent++) {
+            udp_sendto(client, daddr, CAPTURE_BENCH_PORT, data, sizeof(data));
+        }
+        net_rx_action(CAPTURE_BENCH_BURST);
+        struct sk_buff *skb;
+        while ((skb = udp_recv_skb(sink)) != 0) {
+            skb_free(skb);
+            received++;
+        }
+        while (cap && packet_ring_peek(cap)) {
+            packet_ring_release(cap);
+        }
+    }
+    const uint64_t ns = tsc_cycles_to_ns(tsc_read() - start);
+    return ns ? received * sizeof(data) * 8 * 1000 / ns : 0;
+}
+
+static void capture_bench_report(const char *tag, uint64_t mbps, uint64_t baseline, struct packet_sock *cap) {
+    struct packet_stats st = {0};
+    if (cap) {
+        packet_get_stats(cap, &st);
+    }
+    kprint("capture bench: %s: %lu Mbit/s, %lu/1000 of baseline, %lu captured, %lu filtered, %lu ring drops\n", tag,
+           mbps, baseline ? mbps * 1000 / baseline : 0, st.packets, st.filtered, st.drops);
+}
+
+static void capture_bench_ring(struct udp_sock *client, struct udp_sock *sink, const char *tag, uint32_t slot_size,
+                               uint32_t slots, uint32_t snaplen, const struct sock_filter *prog, uint32_t prog_len,
+                               uint64_t baseline) {
+    struct packet_sock *cap = packet_socket(slot_size, slots, snaplen);
+    if (!cap) {
+        kprint("capture bench: %s: cannot allocate ring\n", tag);
+        return;
+    }
+    if ((!prog || packet_attach_filter(cap, prog, prog_len)) && packet_bind(cap, 0)) {
+        capture_bench_report(tag, capture_bench_run(client, sink, cap), baseline, cap);
+    }
+    packet_close(cap);
+}
+
+static void capture_bench_write(const void *data, size_t len, void *ctx) {
+    (void)ctx;
+    serial_aux_write(data, len);
+}
+
+void packet_bench(void) {
+    struct udp_sock *sink = udp_socket();
+    struct udp_sock *client = udp_socket();
+    if (!sink || !client || !udp_bind(sink, CAPTURE_BENCH_PORT) || !udp_bind(client, 0)) {
+        kprint("capture bench: cannot set up sockets\n");
+        return;
+    }
+    const uint64_t baseline = capture_bench_run(client, sink, 0);
+    capture_bench_report("no capture", baseline, baseline, 0);
+
+    capture_bench_ring(client, sink, "full frames", 2048, 1024, 0, 0, 0, baseline);
+    capture_bench_ring(client, sink, "udp port 9, 128 B snap", 256, 4096, 128, capture_udp_discard,
+                       sizeof(capture_udp_discard) / sizeof(capture_udp_discard[0]), baseline);
+    capture_bench_ring(client, sink, "arp only", 256, 4096, 0, capture_arp_only,
+                       sizeof(capture_arp_only) / sizeof(capture_arp_only[0]), baseline);
+
+    struct packet_sock *cap = packet_socket(2048, 64, 0);
+    if (!cap || !packet_bind(cap, 0)) {
+        kprint("capture bench: cannot open capture socket\n");
+        return;
+    }
+    for (uint16_t seq = 0; seq < 4; seq++) {
+        uint64_t rtt;
+        net_ping(htonl(INADDR_LOOPBACK), seq, 56, 10000, &rtt);
+        udp_sendto(client, htonl(INADDR_LOOPBACK), CAPTURE_BENCH_PORT, "capture", 7);
+        net_rx_action(NAPI_WEIGHT);
+    }
+    struct sk_buff *skb;
+    while ((skb = udp_recv_skb(sink)) != 0) {
+        skb_free(skb);
+    }
+    if (serial_aux_init()) {
+        pcap_write_header(capture_bench_write, 0, cap->snaplen);
+        const uint64_t records = packet_export_pcap(cap, capture_bench_write, 0);
+        kprint("capture bench: %lu packets written to COM2 as pcap\n", records);
+    } else {
+        kprint("capture bench: no COM2 for pcap export (make run-capture)\n");
+    }
+    packet_close(cap);
+    udp_close(client);
+    udp_close(sink);
+}
+#endif
@@ -0,0 +1,254 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "memory.h"
+#include "skbuff.h"
+
+/* Data buffers are SKB_BUF_SIZE aligned inside their page, so any pointer
+   into one (including a fragment offset) finds its shared info. */
+struct skb_data {
+    uint8_t bytes[SKB_BUF_SIZE];
+};
+
+static struct object_pool skb_pool = OBJECT_POOL("skbuff", struct sk_buff);
+static struct object_pool data_pool = OBJECT_POOL("skb_data", struct skb_data);
+static uint64_t alloc_failures;
+
+static inline struct skb_shared_info *buf_shinfo(uint8_t *buf) {
+    uintptr_t base = (uintptr_t)buf & ~(uintptr_t)(SKB_BUF_SIZE - 1);
+    return (struct skb_shared_info *)(base + SKB_BUF_DATA);
+}
+
+static inline uint8_t *buf_base(uint8_t *buf) {
+    return (uint8_t *)((uintptr_t)buf & ~(uintptr_t)(SKB_BUF_SIZE - 1));
+}
+
+static uint8_t *data_alloc(void) {
+    uint8_t *buf = pool_alloc(&data_pool);
+    if (!buf) {
+        alloc_failures++;
+        return 0;
+    }
+    struct skb_shared_info *sh = buf_shinfo(buf);
+    sh->dataref = 1;
+    sh->nr_frags = 0;
+    return buf;
+}
+
+static void data_put(uint8_t *buf) {
+    struct skb_shared_info *sh = buf_shinfo(buf);
+    if (__atomic_sub_fetch(&sh->dataref, 1, __ATOMIC_ACQ_REL) != 0) {
+        return;
+    }
+    for (uint8_t i = 0; i < sh->nr_frags; i++) {
+        data_put(sh->frags[i].buf);
+    }
+    pool_free(&data_pool, buf_base(buf));
+}
+
+struct sk_buff *skb_alloc(uint32_t size) {
+    if (size > SKB_BUF_DATA - NET_SKB_PAD) {
+        return 0;
+    }
+    struct sk_buff *skb = pool_alloc(&skb_pool);
+    if (!skb) {
+        alloc_failures++;
+        return 0;
+    }
+    uint8_t *buf = data_alloc();
+    if (!buf) {
+        pool_free(&skb_pool, skb);
+        return 0;
+    }
+    memset(skb, 0, sizeof(*skb));
+    skb->head = buf;
+    skb->data = buf + NET_SKB_PAD;
+    skb->tail = skb->data;
+    skb->end = buf + SKB_BUF_DATA;
+    skb->users = 1;
+    return skb;
+}
+
+/* Wrap a buffer from skb_frag_alloc() that a device already filled; the
+   caller's reference on buf moves to the new skb. */
+struct sk_buff *skb_build(uint8_t *buf, uint32_t headroom, uint32_t len) {
+    if (headroom + len > SKB_BUF_DATA) {
+        return 0;
+    }
+    struct sk_buff *skb = pool_alloc(&skb_pool);
+    if (!skb) {
+        alloc_failures++;
+        return 0;
+    }
+    memset(skb, 0, sizeof(*skb));
+    skb->head = buf;
+    skb->data = buf + headroom;
+    skb->tail = skb->data + len;
+    skb->end = buf + SKB_BUF_DATA;
+    skb->len = len;
+    skb->users = 1;
+    return skb;
+}
+
+/* A second header over the same data; neither copy may write to it. */
+struct sk_buff *skb_clone(struct sk_buff *skb) {
+    struct sk_buff *n = pool_alloc(&skb_pool);
+    if (!n) {
+        alloc_failures++;
+        return 0;
+    }
+    *n = *skb;
+    n->next = 0;
+    n->users = 1;
+    __atomic_add_fetch(&skb_shinfo(skb)->dataref, 1, __ATOMIC_RELAXED);
+    return n;
+}
+
+struct sk_buff *skb_get(struct sk_buff *skb) {
+    __atomic_add_fetch(&skb->users, 1, __ATOMIC_RELAXED);
+    return skb;
+}
+
+void skb_free(struct sk_buff *skb) {
+    if (!skb || __atomic_sub_fetch(&skb->users, 1, __ATOMIC_ACQ_REL) != 0) {
+        return;
+    }
+    data_put(skb->head);
+    pool_free(&skb_pool, skb);
+}
+
+void *skb_put(struct sk_buff *skb, uint32_t len) {
+    if (len > skb_tailroom(skb) || skb->data_len) {
+        return 0;
+    }
+    uint8_t *old = skb->tail;
+    skb->tail += len;
+    skb->len += len;
+    return old;
+}
+
+void *skb_push(struct sk_buff *skb, uint32_t len) {
+    if (len > skb_headroom(skb)) {
+        return 0;
+    }
+    skb->data -= len;
+    skb->len += len;
+    return skb->data;
+}
+
+void *skb_pull(struct sk_buff *skb, uint32_t len) {
+    if (len > skb_headlen(skb)) {
+        return 0;
+    }
+    skb->data += len;
+    skb->len -= len;
+    return skb->data;
+}
+
+void skb_reserve(struct sk_buff *skb, uint32_t len) {
+    skb->data += len;
+    skb->tail += len;
+}
+
+void skb_trim(struct sk_buff *skb, uint32_t len) {
+    if (len < skb_headlen(skb) && !skb->data_len) {
+        skb->tail = skb->data + len;
+        skb->len = len;
+    }
+}
+
+uint8_t *skb_frag_alloc(void) {
+    return data_alloc();
+}
+
+void skb_frag_get(uint8_t *buf) {
+    __atomic_add_fetch(&buf_shinfo(buf)->dataref, 1, __ATOMIC_RELAXED);
+}
+
+void skb_frag_put(uint8_t *buf) {
+    data_put(buf);
+}
+
+/* Attach size bytes at buf+offset; the caller's reference on buf moves to
+   the skb. */
+bool skb_add_frag(struct sk_buff *skb, uint8_t *buf, uint16_t offset, uint16_t size) {
+    struct skb_shared_info *sh = skb_shinfo(skb);
+    if (sh->nr_frags >= MAX_SKB_FRAGS || sh->dataref != 1) {
+        return false;
+    }
+    struct skb_frag *f = &sh->frags[sh->nr_frags++];
+    f->buf = buf;
+    f->offset = offset;
+    f->size = size;
+    skb->len += size;
+    skb->data_len += size;
+    return true;
+}
+
+bool skb_copy_bits(const struct sk_buff *skb, uint32_t offset, void *to, uint32_t len) {
+    if (offset + len > skb->len) {
+        return false;
+    }
+    uint8_t *out = to;
+    uint32_t head = skb_headlen(skb);
+    if (offset < head) {
+        uint32_t n = head - offset < len ? head - offset : len;
+        memcpy(out, skb->data + offset, n);
+        out += n;
+        offset += n;
+        len -= n;
+    }
+    offset -= head;
+    const struct skb_shared_info *sh = skb_shinfo(skb);
+    for (uint8_t i = 0; i < sh->nr_frags && len; i++) {
+        const struct skb_frag *f = &sh->frags[i];
+        if (offset >= f->size) {
+            offset -= f->size;
+            continue;
+        }
+        uint32_t n = f->size - offset < len ? f->size - offset : len;
+        memcpy(out, f->buf + f->offset + offset, n);
+        out += n;
+        len -= n;
+        offset = 0;
+    }
+    return len == 0;
+}
+
+void skb_queue_init(struct sk_buff_head *q) {
+    q->head = 0;
+    q->tail = 0;
+    q->qlen = 0;
+}
+
+void skb_queue_tail(struct sk_buff_head *q, struct sk_buff *skb) {
+    skb->next = 0;
+    if (q->tail) {
+        q->tail->next = skb;
+    } else {
+        q->head = skb;
+    }
+    q->tail = skb;
+    q->qlen++;
+}
+
+struct sk_buff *skb_dequeue(struct sk_buff_head *q) {
+    struct sk_buff *skb = q->head;
+    if (!skb) {
+        return 0;
+    }
+    q->head = skb->next;
+    if (!q->head) {
+        q->tail = 0;
+    }
+    skb->next = 0;
+    q->qlen--;
+    return skb;
+}
+
+void skb_get_pool_stats(struct skb_pool_stats *out) {
+    out->skbs_in_use = skb_pool.in_use;
+    out->bufs_in_use = data_pool.in_use;
+    out->alloc_failures = alloc_failures;
+}
@@ -0,0 +1,165 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "console.h"
+#include "inet.h"
+#include "memory.h"
+#include "module.h"
+#include "netdev.h"
+#include "string.h"
+#include "tcp.h"
+
+#if defined(CONFIG_NET_SPEEDTEST_CLI) || defined(MODULE)
+#define SPEEDTEST_PORT 5201
+#define SPEEDTEST_TRACE_US 100000
+#define SPEEDTEST_TRACE_MAX 600
+#define SPEEDTEST_CONNECT_US 5000000
+
+struct cwnd_sample {
+    uint32_t ms;
+    uint32_t cwnd;
+    uint32_t ssthresh;
+    uint32_t srtt_us;
+    uint64_t retrans;
+};
+
+static struct cwnd_sample speedtest_trace[SPEEDTEST_TRACE_MAX];
+static uint8_t speedtest_tx_buf[16384];
+static uint8_t speedtest_rx_buf[16384];
+
+static void speedtest_report(struct tcp_sock *sk, uint64_t us) {
+    const struct tcp_info *info = &sk->info;
+    kprint("speedtest: sent %lu bytes acked in %lu ms, goodput %lu Mbit/s\n", info->bytes_acked, us / 1000,
+           us ? info->bytes_acked * 8 / us : 0);
+    kprint("speedtest: segs out %lu, retrans %lu, fast recoveries %lu, rto expiries %lu, sack blocks in %lu\n",
+           info->segs_out, info->retrans_segs, info->fast_recoveries, info->rto_expiries, info->sack_blocks_in);
+    kprint("speedtest: srtt %u us, min rtt %u us, rto %u us, cwnd %u, %s\n", sk->srtt_us, sk->min_rtt_us,
+           sk->rto_us, sk->cwnd, sk->ca->name);
+}
+
+/* Drive a sender (tx), a receiver behind a listener, or both over lo. */
+static void speedtest_loop(struct tcp_sock *tx, struct tcp_sock *listener, uint64_t duration_us) {
+    struct tcp_sock *rx = 0;
+    uint64_t received = 0;
+    uint64_t rx_start = 0;
+    size_t samples = 0;
+    bool tx_done = !tx;
+    bool rx_done = !listener;
+    uint64_t start = tcp_now_us();
+
+    while (tx && !tcp_established(tx)) {
+        net_rx_action(NAPI_WEIGHT * 4);
+        tcp_poll();
+        if (tx->reset || tcp_now_us() - start > SPEEDTEST_CONNECT_US) {
+            kprint("speedtest: connect failed\n");
+            return;
+        }
+    }
+    start = tcp_now_us();
+    uint64_t next_sample = start;
+    while (!tx_done || !rx_done) {
+        net_rx_action(NAPI_WEIGHT * 4);
+        tcp_poll();
+        const uint64_t now = tcp_now_us();
+        if (!tx_done) {
+            if (now >= next_sample && samples < SPEEDTEST_TRACE_MAX) {
+                speedtest_trace[samples++] = (struct cwnd_sample){
+                    (uint32_t)((now - start) / 1000), tx->cwnd, tx->ssthresh, tx->srtt_us, tx->info.retrans_segs,
+                };
+                next_sample += SPEEDTEST_TRACE_US;
+            }
+            if (tx->reset) {
+                kprint("speedtest: connection reset\n");
+                tx_done = true;
+            } else if (now - start < duration_us) {
+                tcp_send(tx, speedtest_tx_buf, sizeof(speedtest_tx_buf));
+            } else {
+                /* report before close: the socket is freed once closed */
+                speedtest_report(tx, now - start);
+                tcp_close(tx);
+                tx_done = true;
+            }
+        }
+        if (!rx && listener) {
+            rx = tcp_accept(listener);
+            rx_start = now;
+        }
+        if (rx && !rx_done) {
+            int n;
+            while ((n = tcp_recv(rx, speedtest_rx_buf, sizeof(speedtest_rx_buf))) > 0) {
+                received += (uint64_t)n;
+            }
+            if (n == 0) {
+                const uint64_t us = now - rx_start;
+                kprint("speedtest: received %lu bytes in %lu ms, %lu Mbit/s, %lu out-of-order segments\n", received,
+                       us / 1000, us ? received * 8 / us : 0, rx->info.ooo_segs_in);
+                tcp_close(rx);
+                rx_done = true;
+            }
+        }
+    }
+    for (size_t i = 0; i < samples; i++) {
+        const struct cwnd_sample *t = &speedtest_trace[i];
+        kprint("speedtest: t %u ms cwnd %u ssthresh %u srtt %u us retrans %lu\n", t->ms, t->cwnd, t->ssthresh,
+               t->srtt_us, t->retrans);
+    }
+    /* let the FIN handshakes finish */
+    start = tcp_now_us();
+    while (tcp_now_us() - start < 200000) {
+        net_rx_action(NAPI_WEIGHT * 4);
+        tcp_poll();
+    }
+}
+
+void tcp_speedtest(void) {
+    char mode[8] = "lo";
+    char text[16];
+    memory_cmdline_arg("speedtest", mode, sizeof(mode));
+    const uint64_t duration_us = (uint64_t)memory_cmdline_u32("time", 10) * 1000000;
+    tcp_set_rx_loss(memory_cmdline_u32("loss", 0));
+
+    /* a guest pair on a socket netdev has no DHCP: addresses come from the command line */
+    uint32_t addr;
+    if (memory_cmdline_arg("ip", text, sizeof(text)) && inet_parse_addr(text, &addr)) {
+        struct net_device *dev;
+        for (size_t i = 0; (dev = netdev_at(i)) != 0; i++) {
+            if (!(dev->flags & NETDEV_F_LOOPBACK)) {
+                inet_set_addr(dev, addr, 24, 0);
+                break;
+            }
+        }
+    }
+
+    struct tcp_sock *tx = 0;
+    struct tcp_sock *listener = 0;
+    uint32_t peer = htonl(INADDR_LOOPBACK);
+    if (strcmp(mode, "lo") == 0 || strcmp(mode, "server") == 0) {
+        listener = tcp_socket();
+        if (!listener || !tcp_listen(listener, SPEEDTEST_PORT)) {
+            kprint("speedtest: cannot listen\n");
+            return;
+        }
+    }
+    if (strcmp(mode, "client") == 0 &&
+        (!memory_cmdline_arg("peer", text, sizeof(text)) || !inet_parse_addr(text, &peer))) {
+        kprint("speedtest: client needs peer=ADDRESS\n");
+        return;
+    }
+    if (strcmp(mode, "lo") == 0 || strcmp(mode, "client") == 0) {
+        tx = tcp_socket();
+        if (tx && memory_cmdline_arg("cc", text, sizeof(text)) && !tcp_set_congestion_control(tx, text)) {
+            kprint("speedtest: unknown congestion control %s\n", text);
+        }
+        if (!tx || !tcp_connect(tx, peer, SPEEDTEST_PORT)) {
+            kprint("speedtest: cannot connect\n");
+            return;
+        }
+    }
+    kprint("speedtest: %s, port %u\n", mode, SPEEDTEST_PORT);
+    speedtest_loop(tx, listener, duration_us);
+    if (listener) {
+        tcp_close(listener);
+    }
+}
+#endif /* CONFIG_NET_SPEEDTEST_CLI || MODULE */
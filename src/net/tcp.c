@@ -0,0 +1,1474 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "checksum.h"
+#include "inet.h"
+#include "memory.h"
+#include "module.h"
+#include "rcu.h"
+#include "spinlock.h"
+#include "string.h"
+#include "tcp.h"
+#include "tsc.h"
+
+#define TCP_INIT_CWND 10
+#define TCP_MAX_CWND (TCP_RING_SIZE / 536)
+#define TCP_INFINITE_SSTHRESH 0x7FFFFFFF
+#define TCP_DEFAULT_MSS 536
+#define TCP_RTO_INIT_US 1000000
+#define TCP_RTO_MIN_US 200000
+#define TCP_RTO_MAX_US 60000000
+#define TCP_DELACK_US 40000
+#define TCP_TIMEWAIT_US 1000000 /* 2*MSL, shortened: nothing here outlives a boot */
+#define TCP_SYN_RETRIES 6
+#define TCP_MAX_RETRIES 15
+#define TCP_DUPTHRESH 3
+#define TCP_MAX_CONG_OPS 8
+
+#define TCPOPT_EOL 0
+#define TCPOPT_NOP 1
+#define TCPOPT_MSS 2
+#define TCPOPT_WINDOW 3
+#define TCPOPT_SACK_PERM 4
+#define TCPOPT_SACK 5
+
+struct tcp_opts {
+    uint16_t mss;      /* 0 when absent */
+    int8_t wscale;     /* -1 when absent */
+    bool sack_ok;
+    uint8_t nsack;
+    struct tcp_range sack[TCP_MAX_SACK];
+};
+
+/* One received segment, header already validated. */
+struct tcp_seg {
+    const struct sk_buff *skb;
+    uint32_t seq;
+    uint32_t ack;
+    uint32_t win;  /* unscaled */
+    uint8_t flags;
+    uint32_t off;  /* payload offset in skb */
+    uint32_t len;  /* payload bytes */
+    struct tcp_opts opts;
+};
+
+/* Established and half-open sockets hash on the 3-tuple (our address is
+   implied); listeners on the port alone. Both are walked under RCU. */
+static struct tcp_sock *ehash[TCP_HASH_SIZE];
+static struct tcp_sock *lhash[TCP_HASH_SIZE];
+static struct tcp_sock *all_socks;
+static spinlock_t table_lock = SPINLOCK_INIT;
+static struct object_pool sock_pool = OBJECT_POOL("tcp_sock", struct tcp_sock);
+static uint16_t next_ephemeral = 49152;
+static struct tcp_stats stats;
+
+static const struct tcp_congestion_ops *cong_ops[TCP_MAX_CONG_OPS];
+static size_t cong_count;
+
+static uint32_t rx_loss_one_in;
+static uint32_t rx_loss_state = 0x2545F491;
+
+static void tcp_push(struct tcp_sock *sk);
+
+uint64_t tcp_now_us(void) {
+    return tsc_cycles_to_us(tsc_read());
+}
+EXPORT_SYMBOL(tcp_now_us);
+
+static inline uint32_t min_u32(uint32_t a, uint32_t b) {
+    return a < b ? a : b;
+}
+
+static inline uint32_t max_u32(uint32_t a, uint32_t b) {
+    return a > b ? a : b;
+}
+
+/* ---- socket buffers ---- */
+
+static bool ring_alloc(struct tcp_ring *ring) {
+    for (size_t i = 0; i < TCP_RING_PAGES; i++) {
+        ring->pages[i] = page_alloc();
+        if (!ring->pages[i]) {
+            while (i--) {
+                page_free(ring->pages[i]);
+                ring->pages[i] = 0;
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+static void ring_free(struct tcp_ring *ring) {
+    for (size_t i = 0; i < TCP_RING_PAGES; i++) {
+        if (ring->pages[i]) {
+            page_free(ring->pages[i]);
+            ring->pages[i] = 0;
+        }
+    }
+}
+
+static void ring_write(struct tcp_ring *ring, uint32_t seq, const uint8_t *src, uint32_t len) {
+    while (len) {
+        const uint32_t pos = seq & (TCP_RING_SIZE - 1);
+        const uint32_t chunk = min_u32(len, 4096 - (pos & 4095));
+        memcpy(ring->pages[pos >> 12] + (pos & 4095), src, chunk);
+        seq += chunk;
+        src += chunk;
+        len -= chunk;
+    }
+}
+
+static void ring_read(const struct tcp_ring *ring, uint32_t seq, uint8_t *dst, uint32_t len) {
+    while (len) {
+        const uint32_t pos = seq & (TCP_RING_SIZE - 1);
+        const uint32_t chunk = min_u32(len, 4096 - (pos & 4095));
+        memcpy(dst, ring->pages[pos >> 12] + (pos & 4095), chunk);
+        seq += chunk;
+        dst += chunk;
+        len -= chunk;
+    }
+}
+
+static void ring_write_skb(struct tcp_ring *ring, uint32_t seq, const struct sk_buff *skb, uint32_t off,
+                           uint32_t len) {
+    while (len) {
+        const uint32_t pos = seq & (TCP_RING_SIZE - 1);
+        const uint32_t chunk = min_u32(len, 4096 - (pos & 4095));
+        skb_copy_bits(skb, off, ring->pages[pos >> 12] + (pos & 4095), chunk);
+        seq += chunk;
+        off += chunk;
+        len -= chunk;
+    }
+}
+
+/* ---- tables ---- */
+
+static inline uint32_t ehash_fn(uint32_t raddr, uint16_t rport, uint16_t lport) {
+    return ((raddr ^ ((uint32_t)rport << 16 | lport)) * 2654435761u) >> 24;
+}
+
+/* Caller holds rcu_read_lock() or table_lock. */
+static struct tcp_sock *tcp_lookup(uint32_t raddr, uint16_t rport, uint16_t lport) {
+    for (struct tcp_sock *sk = rcu_dereference(ehash[ehash_fn(raddr, rport, lport)]); sk;
+         sk = rcu_dereference(sk->hash_next)) {
+        if (sk->daddr == raddr && sk->dport == rport && sk->sport == lport && !sk->dead) {
+            return sk;
+        }
+    }
+    for (struct tcp_sock *sk = rcu_dereference(lhash[lport & (TCP_HASH_SIZE - 1)]); sk;
+         sk = rcu_dereference(sk->hash_next)) {
+        if (sk->sport == lport && sk->state == TCP_LISTEN) {
+            return sk;
+        }
+    }
+    return 0;
+}
+
+static void tcp_hash(struct tcp_sock *sk) {
+    struct tcp_sock **bucket = sk->state == TCP_LISTEN ? &lhash[sk->sport & (TCP_HASH_SIZE - 1)]
+                                                       : &ehash[ehash_fn(sk->daddr, sk->dport, sk->sport)];
+    uint64_t flags = spin_lock_irqsave(&table_lock);
+    sk->hash_next = *bucket;
+    rcu_assign_pointer(*bucket, sk);
+    spin_unlock_irqrestore(&table_lock, flags);
+}
+
+/* Caller holds table_lock. */
+static void tcp_unhash_locked(struct tcp_sock *sk) {
+    struct tcp_sock **buckets[2] = {
+        &lhash[sk->sport & (TCP_HASH_SIZE - 1)],
+        &ehash[ehash_fn(sk->daddr, sk->dport, sk->sport)],
+    };
+    for (size_t i = 0; i < 2; i++) {
+        for (struct tcp_sock **link = buckets[i]; *link; link = &(*link)->hash_next) {
+            if (*link == sk) {
+                rcu_assign_pointer(*link, sk->hash_next);
+                return;
+            }
+        }
+    }
+}
+
+/* ---- congestion control plumbing ---- */
+
+bool tcp_register_congestion_control(const struct tcp_congestion_ops *ops) {
+    if (cong_count == TCP_MAX_CONG_OPS) {
+        return false;
+    }
+    cong_ops[cong_count] = ops;
+    /* a module registers while sockets may be looking */
+    __atomic_store_n(&cong_count, cong_count + 1, __ATOMIC_RELEASE);
+    return true;
+}
+EXPORT_SYMBOL(tcp_register_congestion_control);
+
+static const struct tcp_congestion_ops *tcp_find_congestion_control(const char *name) {
+    const size_t count = __atomic_load_n(&cong_count, __ATOMIC_ACQUIRE);
+    for (size_t i = 0; i < count; i++) {
+        if (strcmp(cong_ops[i]->name, name) == 0) {
+            return cong_ops[i];
+        }
+    }
+    return 0;
+}
+
+bool tcp_set_congestion_control(struct tcp_sock *sk, const char *name) {
+    const struct tcp_congestion_ops *ops = tcp_find_congestion_control(name);
+#ifdef CONFIG_NET_CONGESTION_SUITE_MODULE
+    if (!ops && strcmp(name, "cubic") == 0 && request_module("tcp_cubic")) {
+        ops = tcp_find_congestion_control(name);
+    }
+#endif
+    if (!ops) {
+        return false;
+    }
+    uint64_t flags = spin_lock_irqsave(&sk->lock);
+    sk->ca = ops;
+    memset(sk->ca_priv, 0, sizeof(sk->ca_priv));
+    if (ops->init) {
+        ops->init(sk);
+    }
+    spin_unlock_irqrestore(&sk->lock, flags);
+    return true;
+}
+EXPORT_SYMBOL(tcp_set_congestion_control);
+
+/* Grow cwnd by one per ACKed segment up to ssthresh; returns what is left
+   over for congestion avoidance. */
+uint32_t tcp_slow_start(struct tcp_sock *sk, uint32_t acked) {
+    const uint32_t cwnd = min_u32(sk->cwnd + acked, sk->ssthresh);
+    acked -= cwnd - sk->cwnd;
+    sk->cwnd = min_u32(cwnd, TCP_MAX_CWND);
+    return acked;
+}
+EXPORT_SYMBOL(tcp_slow_start);
+
+/* Additive increase: one segment per w segments ACKed. */
+void tcp_cong_avoid_ai(struct tcp_sock *sk, uint32_t w, uint32_t acked) {
+    if (sk->cwnd_cnt >= w) {
+        sk->cwnd_cnt = 0;
+        sk->cwnd++;
+    }
+    sk->cwnd_cnt += acked;
+    if (sk->cwnd_cnt >= w) {
+        const uint32_t delta = sk->cwnd_cnt / w;
+        sk->cwnd_cnt -= delta * w;
+        sk->cwnd += delta;
+    }
+    sk->cwnd = min_u32(sk->cwnd, TCP_MAX_CWND);
+}
+EXPORT_SYMBOL(tcp_cong_avoid_ai);
+
+/* ---- output ---- */
+
+static uint32_t tcp_rcv_window(const struct tcp_sock *sk) {
+    return sk->rcv_read + TCP_RING_SIZE - sk->rcv_nxt;
+}
+
+static uint32_t tcp_syn_options(const struct tcp_sock *sk, uint8_t flags, uint8_t *p) {
+    uint32_t n = 0;
+    p[n++] = TCPOPT_MSS;
+    p[n++] = 4;
+    p[n++] = (uint8_t)(sk->mss >> 8);
+    p[n++] = (uint8_t)sk->mss;
+    if (sk->rcv_wscale) {
+        p[n++] = TCPOPT_NOP;
+        p[n++] = TCPOPT_WINDOW;
+        p[n++] = 3;
+        p[n++] = sk->rcv_wscale;
+    }
+    /* a SYN-ACK only echoes what the peer offered */
+    if (!(flags & TCP_ACK) || sk->sack_ok) {
+        p[n++] = TCPOPT_NOP;
+        p[n++] = TCPOPT_NOP;
+        p[n++] = TCPOPT_SACK_PERM;
+        p[n++] = 2;
+    }
+    return n;
+}
+
+static uint32_t tcp_sack_options(const struct tcp_sock *sk, uint8_t *p) {
+    const uint32_t blocks = min_u32(sk->ooo_count, TCP_MAX_SACK);
+    uint32_t n = 0;
+    p[n++] = TCPOPT_NOP;
+    p[n++] = TCPOPT_NOP;
+    p[n++] = TCPOPT_SACK;
+    p[n++] = (uint8_t)(2 + blocks * 8);
+    for (uint32_t i = 0; i < blocks; i++) {
+        const uint32_t edges[2] = { htonl(sk->ooo[i].start), htonl(sk->ooo[i].end) };
+        memcpy(p + n, edges, sizeof(edges));
+        n += sizeof(edges);
+    }
+    return n;
+}
+
+/* Send one segment carrying len bytes of the send buffer from seq. */
+static bool tcp_transmit(struct tcp_sock *sk, uint32_t seq, uint32_t len, uint8_t flags) {
+    struct sk_buff *skb = skb_alloc(len);
+    if (!skb) {
+        return false;
+    }
+    if (len) {
+        ring_read(&sk->sndbuf, seq, skb_put(skb, len), len);
+    }
+
+    uint8_t opts[40];
+    uint32_t opt_len = 0;
+    if (flags & TCP_SYN) {
+        opt_len = tcp_syn_options(sk, flags, opts);
+    } else if (sk->sack_ok && sk->ooo_count) {
+        opt_len = tcp_sack_options(sk, opts);
+    }
+    struct tcphdr *th = skb_push(skb, sizeof(*th) + opt_len);
+    th->source = htons(sk->sport);
+    th->dest = htons(sk->dport);
+    th->seq = htonl(seq);
+    th->ack_seq = (flags & TCP_ACK) ? htonl(sk->rcv_nxt) : 0;
+    th->doff = (uint8_t)(((sizeof(*th) + opt_len) / 4) << 4);
+    th->flags = flags;
+    const uint8_t scale = (flags & TCP_SYN) ? 0 : sk->rcv_wscale;
+    const uint32_t window = min_u32(tcp_rcv_window(sk) >> scale, 0xFFFF);
+    th->window = htons((uint16_t)window);
+    th->check = 0;
+    th->urg_ptr = 0;
+    memcpy(th + 1, opts, opt_len);
+    uint32_t sum = csum_tcpudp_nofold(sk->saddr, sk->daddr, (uint16_t)skb->len, IPPROTO_TCP, 0);
+    th->check = csum_fold(skb_checksum(skb, 0, skb->len, sum));
+
+    if (flags & TCP_ACK) {
+        sk->rcv_wup = sk->rcv_nxt + (window << scale);
+        sk->acks_pending = 0;
+        sk->delack_deadline = 0;
+    }
+    sk->info.segs_out++;
+    return ip_send(skb, &sk->rt, sk->daddr, IPPROTO_TCP);
+}
+
+static void tcp_send_ack(struct tcp_sock *sk) {
+    tcp_transmit(sk, sk->snd_nxt, 0, TCP_ACK);
+}
+
+/* RST in answer to a segment that has no socket. */
+static void tcp_send_reset(const struct iphdr *iph, const struct tcphdr *th, const struct tcp_seg *seg) {
+    if (seg->flags & TCP_RST) {
+        return;
+    }
+    struct inet_route rt;
+    struct sk_buff *skb = skb_alloc(0);
+    if (!skb) {
+        return;
+    }
+    if (!ip_route_output(iph->saddr, &rt)) {
+        skb_free(skb);
+        return;
+    }
+    struct tcphdr *rst = skb_push(skb, sizeof(*rst));
+    memset(rst, 0, sizeof(*rst));
+    rst->source = th->dest;
+    rst->dest = th->source;
+    rst->doff = (sizeof(*rst) / 4) << 4;
+    if (seg->flags & TCP_ACK) {
+        rst->seq = htonl(seg->ack);
+        rst->flags = TCP_RST;
+    } else {
+        const uint32_t consumed = seg->len + !!(seg->flags & TCP_SYN) + !!(seg->flags & TCP_FIN);
+        rst->ack_seq = htonl(seg->seq + consumed);
+        rst->flags = TCP_RST | TCP_ACK;
+    }
+    uint32_t sum = csum_tcpudp_nofold(rt.saddr, iph->saddr, sizeof(*rst), IPPROTO_TCP, 0);
+    rst->check = csum_fold(csum_partial(rst, sizeof(*rst), sum));
+    stats.resets_sent++;
+    ip_send(skb, &rt, iph->saddr, IPPROTO_TCP);
+}
+
+static void tcp_arm_rto(struct tcp_sock *sk) {
+    sk->rto_deadline = tcp_now_us() + ((uint64_t)sk->rto_us << sk->backoff);
+}
+
+/* ---- sender loss accounting (RFC 6675) ---- */
+
+static uint32_t tcp_sacked_bytes(const struct tcp_sock *sk) {
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < sk->sacked_count; i++) {
+        total += sk->sacked[i].end - sk->sacked[i].start;
+    }
+    return total;
+}
+
+static uint32_t tcp_high_sack(const struct tcp_sock *sk) {
+    return sk->sacked_count ? sk->sacked[sk->sacked_count - 1].end : sk->snd_una;
+}
+
+/* Bytes in [from, to) that the receiver has SACKed. */
+static uint32_t tcp_sacked_between(const struct tcp_sock *sk, uint32_t from, uint32_t to) {
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < sk->sacked_count; i++) {
+        uint32_t start = sk->sacked[i].start;
+        uint32_t end = sk->sacked[i].end;
+        if (tcp_before(start, from)) {
+            start = from;
+        }
+        if (tcp_after(end, to)) {
+            end = to;
+        }
+        if (tcp_after(end, start)) {
+            total += end - start;
+        }
+    }
+    return total;
+}
+
+/* Estimate of bytes still in the network. In recovery, unSACKed holes
+   below the highest SACK count as lost unless already retransmitted. */
+static uint32_t tcp_pipe(const struct tcp_sock *sk) {
+    const uint32_t flight = sk->snd_nxt - sk->snd_una;
+    if (!sk->in_recovery) {
+        const uint32_t sacked = sk->sack_ok ? tcp_sacked_bytes(sk) : sk->dupacks * sk->mss;
+        return flight > sacked ? flight - sacked : 0;
+    }
+    if (!sk->sack_ok) {
+        const uint32_t gone = sk->dupacks * sk->mss;
+        return flight > gone ? flight - gone : 0;
+    }
+    const uint32_t high_sack = tcp_high_sack(sk);
+    uint32_t pipe = tcp_after(sk->snd_nxt, high_sack) ? sk->snd_nxt - high_sack : 0;
+    if (tcp_after(sk->high_rxt, sk->snd_una)) {
+        pipe += (sk->high_rxt - sk->snd_una) - tcp_sacked_between(sk, sk->snd_una, sk->high_rxt);
+    }
+    return pipe;
+}
+
+/* Next unSACKed hole to retransmit during recovery. */
+static bool tcp_next_hole(const struct tcp_sock *sk, uint32_t *start, uint32_t *len) {
+    uint32_t seq = tcp_after(sk->high_rxt, sk->snd_una) ? sk->high_rxt : sk->snd_una;
+    if (!sk->sack_ok) {
+        if (seq != sk->snd_una || sk->snd_una == sk->snd_max) {
+            return false;
+        }
+        *start = seq;
+        *len = min_u32(sk->mss, sk->snd_max - seq);
+        return true;
+    }
+    const uint32_t high_sack = tcp_high_sack(sk);
+    for (uint32_t i = 0; i < sk->sacked_count && tcp_before(seq, high_sack); i++) {
+        const struct tcp_range *r = &sk->sacked[i];
+        if (!tcp_after(r->end, seq)) {
+            continue;
+        }
+        if (tcp_before(seq, r->start)) {
+            *start = seq;
+            *len = min_u32(sk->mss, r->start - seq);
+            return true;
+        }
+        seq = r->end;
+    }
+    return false;
+}
+
+static bool tcp_retransmit_hole(struct tcp_sock *sk) {
+    uint32_t start;
+    uint32_t len;
+    if (!tcp_next_hole(sk, &start, &len)) {
+        return false;
+    }
+    /* a hole may end in the FIN */
+    uint8_t flags = TCP_ACK;
+    if (sk->fin_queued && start + len == sk->snd_end + 1) {
+        len--;
+        flags |= TCP_FIN;
+    }
+    tcp_transmit(sk, start, len, flags);
+    sk->high_rxt = start + len + !!(flags & TCP_FIN);
+    sk->info.retrans_segs++;
+    sk->rtt_timing = false;
+    return true;
+}
+
+static bool tcp_can_send(const struct tcp_sock *sk) {
+    return sk->state == TCP_ESTABLISHED || sk->state == TCP_CLOSE_WAIT || sk->state == TCP_FIN_WAIT1 ||
+           sk->state == TCP_CLOSING || sk->state == TCP_LAST_ACK;
+}
+
+/* Send as much as cwnd, the peer's window and the send buffer allow. */
+static void tcp_push(struct tcp_sock *sk) {
+    if (!tcp_can_send(sk)) {
+        return;
+    }
+    const uint32_t cwnd_bytes = sk->cwnd * sk->mss;
+    for (;;) {
+        const uint32_t pipe = tcp_pipe(sk);
+        if (pipe && pipe + sk->mss > cwnd_bytes) {
+            sk->cwnd_limited = true;
+            break;
+        }
+        if (sk->in_recovery && tcp_retransmit_hole(sk)) {
+            continue;
+        }
+
+        const uint32_t avail = sk->snd_end - sk->snd_nxt;
+        if (tcp_after(sk->snd_nxt, sk->snd_end)) {
+            break; /* FIN already out */
+        }
+        if (!avail) {
+            if (sk->fin_queued) {
+                tcp_transmit(sk, sk->snd_nxt, 0, TCP_FIN | TCP_ACK);
+                sk->snd_nxt++;
+                if (tcp_after(sk->snd_nxt, sk->snd_max)) {
+                    sk->snd_max = sk->snd_nxt;
+                }
+                if (!sk->rto_deadline) {
+                    tcp_arm_rto(sk);
+                }
+            }
+            sk->cwnd_limited = false;
+            break;
+        }
+        const uint32_t win_end = sk->snd_una + sk->snd_wnd;
+        if (!tcp_before(sk->snd_nxt, win_end)) {
+            /* zero window: the retransmit timer doubles as the persist timer */
+            if (!sk->rto_deadline) {
+                tcp_arm_rto(sk);
+            }
+            sk->cwnd_limited = false;
+            break;
+        }
+        const uint32_t len = min_u32(min_u32(avail, sk->mss), win_end - sk->snd_nxt);
+        const bool retransmit = tcp_before(sk->snd_nxt, sk->snd_max);
+        tcp_transmit(sk, sk->snd_nxt, len, len == avail ? TCP_ACK | TCP_PSH : TCP_ACK);
+        sk->snd_nxt += len;
+        if (retransmit) {
+            sk->info.retrans_segs++;
+        } else if (!sk->rtt_timing) {
+            sk->rtt_timing = true;
+            sk->rtt_seq = sk->snd_nxt;
+            sk->rtt_start_us = tcp_now_us();
+        }
+        if (tcp_after(sk->snd_nxt, sk->snd_max)) {
+            sk->snd_max = sk->snd_nxt;
+        }
+        if (!sk->rto_deadline) {
+            tcp_arm_rto(sk);
+        }
+    }
+}
+
+/* ---- input: ACK processing ---- */
+
+static void tcp_rtt_sample(struct tcp_sock *sk, uint32_t rtt) {
+    if (!rtt) {
+        rtt = 1;
+    }
+    if (!sk->srtt_us) {
+        sk->srtt_us = rtt;
+        sk->rttvar_us = rtt / 2;
+    } else {
+        const uint32_t err = rtt > sk->srtt_us ? rtt - sk->srtt_us : sk->srtt_us - rtt;
+        sk->rttvar_us = sk->rttvar_us - sk->rttvar_us / 4 + err / 4;
+        sk->srtt_us = sk->srtt_us - sk->srtt_us / 8 + rtt / 8;
+    }
+    if (!sk->min_rtt_us || rtt < sk->min_rtt_us) {
+        sk->min_rtt_us = rtt;
+    }
+    uint32_t rto = sk->srtt_us + max_u32(4 * sk->rttvar_us, 1000);
+    sk->rto_us = rto < TCP_RTO_MIN_US ? TCP_RTO_MIN_US : rto > TCP_RTO_MAX_US ? TCP_RTO_MAX_US : rto;
+}
+
+/* Fold the peer's SACK blocks into the sorted, disjoint scoreboard. */
+static bool tcp_update_scoreboard(struct tcp_sock *sk, const struct tcp_opts *opts) {
+    bool changed = false;
+    for (uint32_t b = 0; b < opts->nsack; b++) {
+        struct tcp_range add = opts->sack[b];
+        /* ignore D-SACKs and anything outside what we sent */
+        if (!tcp_after(add.end, add.start) || !tcp_after(add.end, sk->snd_una) ||
+            tcp_after(add.end, sk->snd_max)) {
+            continue;
+        }
+        if (tcp_before(add.start, sk->snd_una)) {
+            add.start = sk->snd_una;
+        }
+        sk->info.sack_blocks_in++;
+
+        struct tcp_range merged[TCP_SCOREBOARD + 1];
+        uint32_t n = 0;
+        bool placed = false;
+        for (uint32_t i = 0; i < sk->sacked_count; i++) {
+            const struct tcp_range r = sk->sacked[i];
+            if (tcp_before(r.end, add.start)) {
+                merged[n++] = r;
+            } else if (tcp_after(r.start, add.end)) {
+                if (!placed) {
+                    merged[n++] = add;
+                    placed = true;
+                }
+                merged[n++] = r;
+            } else {
+                if (tcp_before(r.start, add.start)) {
+                    add.start = r.start;
+                }
+                if (tcp_after(r.end, add.end)) {
+                    add.end = r.end;
+                }
+            }
+        }
+        if (!placed) {
+            merged[n++] = add;
+        }
+        if (n > TCP_SCOREBOARD) {
+            continue; /* no room: the block will be reported again */
+        }
+        changed |= n != sk->sacked_count || memcmp(merged, sk->sacked, n * sizeof(merged[0])) != 0;
+        memcpy(sk->sacked, merged, n * sizeof(merged[0]));
+        sk->sacked_count = n;
+    }
+    return changed;
+}
+
+static void tcp_trim_scoreboard(struct tcp_sock *sk) {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < sk->sacked_count; i++) {
+        struct tcp_range r = sk->sacked[i];
+        if (!tcp_after(r.end, sk->snd_una)) {
+            continue;
+        }
+        if (tcp_before(r.start, sk->snd_una)) {
+            r.start = sk->snd_una;
+        }
+        sk->sacked[n++] = r;
+    }
+    sk->sacked_count = n;
+}
+
+static void tcp_enter_recovery(struct tcp_sock *sk) {
+    sk->ssthresh = sk->ca->ssthresh(sk);
+    sk->cwnd = sk->ssthresh;
+    sk->cwnd_cnt = 0;
+    sk->in_recovery = true;
+    sk->recover = sk->snd_max;
+    sk->high_rxt = sk->snd_una;
+    sk->rtt_timing = false;
+    sk->info.fast_recoveries++;
+    /* the first hole goes out regardless of the pipe */
+    tcp_retransmit_hole(sk);
+}
+
+static void tcp_ack(struct tcp_sock *sk, const struct tcp_seg *seg) {
+    if (tcp_after(seg->ack, sk->snd_max)) {
+        tcp_send_ack(sk);
+        return;
+    }
+    if (tcp_before(seg->ack, sk->snd_una)) {
+        return;
+    }
+    const uint32_t old_wnd = sk->snd_wnd;
+    if (tcp_before(sk->snd_wl1, seg->seq) || (sk->snd_wl1 == seg->seq && !tcp_before(seg->ack, sk->snd_wl2))) {
+        sk->snd_wnd = seg->win << sk->snd_wscale;
+        sk->snd_wl1 = seg->seq;
+        sk->snd_wl2 = seg->ack;
+    }
+    const bool sack_news = sk->sack_ok && seg->opts.nsack && tcp_update_scoreboard(sk, &seg->opts);
+
+    if (tcp_after(seg->ack, sk->snd_una)) {
+        const uint32_t acked = seg->ack - sk->snd_una;
+        sk->info.bytes_acked += acked;
+        sk->snd_una = seg->ack;
+        if (tcp_before(sk->snd_nxt, sk->snd_una)) {
+            sk->snd_nxt = sk->snd_una;
+        }
+        tcp_trim_scoreboard(sk);
+        if (sk->rtt_timing && !tcp_before(seg->ack, sk->rtt_seq)) {
+            sk->rtt_timing = false;
+            tcp_rtt_sample(sk, (uint32_t)(tcp_now_us() - sk->rtt_start_us));
+        }
+        sk->backoff = 0;
+
+        if (sk->in_recovery) {
+            if (!tcp_before(sk->snd_una, sk->recover)) {
+                sk->in_recovery = false;
+                sk->cwnd = max_u32(sk->ssthresh, 2);
+                sk->dupacks = 0;
+            } else if (!sk->sack_ok) {
+                /* NewReno partial ACK: the next segment is lost too */
+                sk->high_rxt = sk->snd_una;
+                sk->dupacks = 0;
+                tcp_retransmit_hole(sk);
+            }
+        } else {
+            sk->dupacks = 0;
+            if (sk->cwnd_limited) {
+                sk->ca->cong_avoid(sk, (acked + sk->mss - 1) / sk->mss);
+            }
+        }
+        if (sk->snd_una == sk->snd_max) {
+            sk->rto_deadline = 0;
+        } else {
+            tcp_arm_rto(sk);
+        }
+        return;
+    }
+
+    /* duplicate ACK (RFC 5681), or new SACK information */
+    if (sk->snd_una != sk->snd_max && !seg->len && !(seg->flags & (TCP_SYN | TCP_FIN)) &&
+        (sk->snd_wnd == old_wnd || sack_news)) {
+        sk->dupacks++;
+        const bool lost = sk->dupacks >= TCP_DUPTHRESH ||
+                          (sk->sack_ok && tcp_sacked_bytes(sk) >= TCP_DUPTHRESH * sk->mss);
+        if (!sk->in_recovery && lost && !tcp_before(sk->snd_una, sk->recover)) {
+            tcp_enter_recovery(sk);
+        }
+    }
+}
+
+/* ---- input: data ---- */
+
+static bool tcp_ooo_insert(struct tcp_sock *sk, uint32_t start, uint32_t end) {
+    struct tcp_range add = { start, end };
+    struct tcp_range keep[TCP_OOO_RANGES];
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < sk->ooo_count; i++) {
+        const struct tcp_range r = sk->ooo[i];
+        if (tcp_before(r.end, add.start) || tcp_after(r.start, add.end)) {
+            keep[n++] = r;
+            continue;
+        }
+        if (tcp_before(r.start, add.start)) {
+            add.start = r.start;
+        }
+        if (tcp_after(r.end, add.end)) {
+            add.end = r.end;
+        }
+    }
+    if (n == TCP_OOO_RANGES) {
+        return false;
+    }
+    /* most recently changed block first, as RFC 2018 asks */
+    sk->ooo[0] = add;
+    memcpy(&sk->ooo[1], keep, n * sizeof(keep[0]));
+    sk->ooo_count = n + 1;
+    return true;
+}
+
+static void tcp_ooo_advance(struct tcp_sock *sk) {
+    bool again = true;
+    while (again) {
+        again = false;
+        for (uint32_t i = 0; i < sk->ooo_count; i++) {
+            if (tcp_after(sk->ooo[i].start, sk->rcv_nxt)) {
+                continue;
+            }
+            if (tcp_after(sk->ooo[i].end, sk->rcv_nxt)) {
+                sk->rcv_nxt = sk->ooo[i].end;
+            }
+            sk->ooo[i] = sk->ooo[--sk->ooo_count];
+            again = true;
+            break;
+        }
+    }
+}
+
+static void tcp_data(struct tcp_sock *sk, const struct tcp_seg *seg) {
+    uint32_t seq = seg->seq;
+    uint32_t off = seg->off;
+    uint32_t len = seg->len;
+    if (tcp_before(seq, sk->rcv_nxt)) {
+        const uint32_t dup = sk->rcv_nxt - seq;
+        if (dup >= len) {
+            tcp_send_ack(sk);
+            return;
+        }
+        seq += dup;
+        off += dup;
+        len -= dup;
+    }
+    const uint32_t limit = sk->rcv_read + TCP_RING_SIZE;
+    if (!tcp_before(seq, limit)) {
+        tcp_send_ack(sk);
+        return;
+    }
+    if (tcp_after(seq + len, limit)) {
+        len = limit - seq;
+    }
+
+    if (seq == sk->rcv_nxt) {
+        ring_write_skb(&sk->rcvbuf, seq, seg->skb, off, len);
+        sk->rcv_nxt += len;
+        sk->info.bytes_received += len;
+        if (sk->ooo_count) {
+            tcp_ooo_advance(sk);
+            tcp_send_ack(sk);
+        } else if (++sk->acks_pending >= 2) {
+            tcp_send_ack(sk);
+        } else if (!sk->delack_deadline) {
+            sk->delack_deadline = tcp_now_us() + TCP_DELACK_US;
+        }
+        return;
+    }
+    sk->info.ooo_segs_in++;
+    if (tcp_ooo_insert(sk, seq, seq + len)) {
+        ring_write_skb(&sk->rcvbuf, seq, seg->skb, off, len);
+    }
+    tcp_send_ack(sk); /* duplicate ACK carrying SACK blocks */
+}
+
+/* ---- input: state machine ---- */
+
+static void tcp_set_state_closed(struct tcp_sock *sk) {
+    sk->state = TCP_CLOSED;
+    sk->rto_deadline = 0;
+    sk->delack_deadline = 0;
+    if (sk->closed_by_app) {
+        sk->dead = true;
+    }
+}
+
+static void tcp_apply_syn_options(struct tcp_sock *sk, const struct tcp_seg *seg) {
+    sk->mss = min_u32(sk->mss, seg->opts.mss ? seg->opts.mss : TCP_DEFAULT_MSS);
+    if (seg->opts.wscale >= 0) {
+        sk->snd_wscale = (uint8_t)min_u32((uint32_t)seg->opts.wscale, 14);
+    } else {
+        sk->snd_wscale = 0;
+        sk->rcv_wscale = 0;
+    }
+    sk->sack_ok = seg->opts.sack_ok;
+    sk->irs = seg->seq;
+    sk->rcv_nxt = seg->seq + 1;
+    sk->rcv_read = sk->rcv_nxt;
+    sk->rcv_wup = sk->rcv_nxt;
+    sk->snd_wnd = seg->win; /* never scaled on a SYN */
+    sk->snd_wl1 = seg->seq;
+}
+
+static uint32_t tcp_new_iss(void) {
+    const uint64_t t = tsc_read();
+    return (uint32_t)(t ^ (t >> 29)) * 2654435761u;
+}
+
+static bool tcp_route(struct tcp_sock *sk) {
+    if (!ip_route_output(sk->daddr, &sk->rt)) {
+        return false;
+    }
+    sk->saddr = sk->rt.saddr;
+    sk->mss = sk->rt.dev->mtu - sizeof(struct iphdr) - sizeof(struct tcphdr);
+    return true;
+}
+
+static void tcp_sock_defaults(struct tcp_sock *sk, const struct tcp_congestion_ops *ca) {
+    sk->ca = ca;
+    sk->cwnd = TCP_INIT_CWND;
+    sk->ssthresh = TCP_INFINITE_SSTHRESH;
+    sk->rto_us = TCP_RTO_INIT_US;
+    sk->rcv_wscale = TCP_RCV_WSCALE;
+}
+
+static void tcp_link(struct tcp_sock *sk) {
+    uint64_t flags = spin_lock_irqsave(&table_lock);
+    sk->all_next = all_socks;
+    rcu_assign_pointer(all_socks, sk);
+    spin_unlock_irqrestore(&table_lock, flags);
+}
+
+/* A SYN reached a listener: answer from a fresh child in SYN_RECV. */
+static void tcp_listen_rcv(struct tcp_sock *lsk, const struct iphdr *iph, const struct tcphdr *th,
+                           const struct tcp_seg *seg) {
+    if (seg->flags & TCP_RST) {
+        return;
+    }
+    if ((seg->flags & TCP_ACK) || !(seg->flags & TCP_SYN)) {
+        tcp_send_reset(iph, th, seg);
+        return;
+    }
+    struct tcp_sock *sk = pool_alloc(&sock_pool);
+    if (!sk) {
+        return;
+    }
+    memset(sk, 0, sizeof(*sk));
+    tcp_sock_defaults(sk, lsk->ca);
+    sk->saddr = iph->daddr;
+    sk->daddr = iph->saddr;
+    sk->sport = lsk->sport;
+    sk->dport = ntohs(th->source);
+    if (!tcp_route(sk) || !ring_alloc(&sk->sndbuf) || !ring_alloc(&sk->rcvbuf)) {
+        ring_free(&sk->sndbuf);
+        pool_free(&sock_pool, sk);
+        return;
+    }
+    sk->saddr = iph->daddr;
+    tcp_apply_syn_options(sk, seg);
+    sk->iss = tcp_new_iss();
+    sk->snd_una = sk->iss;
+    sk->snd_nxt = sk->iss + 1;
+    sk->snd_max = sk->snd_nxt;
+    sk->snd_end = sk->snd_nxt;
+    sk->recover = sk->iss;
+    sk->parent = lsk;
+    sk->closed_by_app = true; /* orphan until accepted */
+    sk->state = TCP_SYN_RECV;
+    if (sk->ca->init) {
+        sk->ca->init(sk);
+    }
+    tcp_link(sk);
+    tcp_hash(sk);
+    stats.passive_opens++;
+    tcp_transmit(sk, sk->iss, 0, TCP_SYN | TCP_ACK);
+    tcp_arm_rto(sk);
+}
+
+static void tcp_syn_sent_rcv(struct tcp_sock *sk, const struct iphdr *iph, const struct tcphdr *th,
+                             const struct tcp_seg *seg) {
+    const bool ack_ok = (seg->flags & TCP_ACK) && seg->ack == sk->snd_nxt;
+    if ((seg->flags & TCP_ACK) && !ack_ok) {
+        tcp_send_reset(iph, th, seg);
+        return;
+    }
+    if (seg->flags & TCP_RST) {
+        if (ack_ok) {
+            sk->reset = true;
+            tcp_set_state_closed(sk);
+        }
+        return;
+    }
+    if (!(seg->flags & TCP_SYN) || !ack_ok) {
+        return; /* simultaneous open is not supported */
+    }
+    tcp_apply_syn_options(sk, seg);
+    sk->snd_una = seg->ack;
+    sk->snd_wl2 = seg->ack;
+    if (sk->rtt_timing) {
+        sk->rtt_timing = false;
+        tcp_rtt_sample(sk, (uint32_t)(tcp_now_us() - sk->rtt_start_us));
+    }
+    sk->backoff = 0;
+    sk->rto_deadline = 0;
+    sk->state = TCP_ESTABLISHED;
+    tcp_send_ack(sk);
+    tcp_push(sk);
+}
+
+static void tcp_accept_queue(struct tcp_sock *lsk, struct tcp_sock *sk) {
+    sk->accept_next = 0;
+    if (lsk->accept_tail) {
+        lsk->accept_tail->accept_next = sk;
+    } else {
+        lsk->accept_head = sk;
+    }
+    lsk->accept_tail = sk;
+}
+
+/* The FIN we sent has been acknowledged. */
+static void tcp_fin_acked(struct tcp_sock *sk) {
+    switch (sk->state) {
+    case TCP_FIN_WAIT1:
+        sk->state = TCP_FIN_WAIT2;
+        break;
+    case TCP_CLOSING:
+        sk->state = TCP_TIME_WAIT;
+        sk->rto_deadline = tcp_now_us() + TCP_TIMEWAIT_US;
+        break;
+    case TCP_LAST_ACK:
+        tcp_set_state_closed(sk);
+        break;
+    default:
+        break;
+    }
+}
+
+static void tcp_fin_rcv(struct tcp_sock *sk) {
+    sk->rcv_nxt++;
+    sk->fin_received = true;
+    switch (sk->state) {
+    case TCP_SYN_RECV:
+    case TCP_ESTABLISHED:
+        sk->state = TCP_CLOSE_WAIT;
+        break;
+    case TCP_FIN_WAIT1:
+        sk->state = TCP_CLOSING;
+        break;
+    case TCP_FIN_WAIT2:
+        sk->state = TCP_TIME_WAIT;
+        sk->rto_deadline = tcp_now_us() + TCP_TIMEWAIT_US;
+        break;
+    default:
+        break;
+    }
+    tcp_send_ack(sk);
+}
+
+static void tcp_segment(struct tcp_sock *sk, const struct iphdr *iph, const struct tcphdr *th,
+                        const struct tcp_seg *seg) {
+    if (sk->state == TCP_SYN_SENT) {
+        tcp_syn_sent_rcv(sk, iph, th, seg);
+        return;
+    }
+    if (sk->state == TCP_CLOSED) {
+        return;
+    }
+    const uint32_t wnd = tcp_rcv_window(sk);
+    const bool in_window = !tcp_before(seg->seq, sk->rcv_nxt) ? tcp_before(seg->seq, sk->rcv_nxt + wnd + 1)
+                                                              : tcp_after(seg->seq + seg->len, sk->rcv_nxt);
+    if (seg->flags & TCP_RST) {
+        if (in_window || seg->seq == sk->rcv_nxt) {
+            sk->reset = true;
+            tcp_set_state_closed(sk);
+        }
+        return;
+    }
+    if (seg->flags & TCP_SYN) {
+        if (sk->state == TCP_SYN_RECV && seg->seq == sk->irs) {
+            tcp_transmit(sk, sk->iss, 0, TCP_SYN | TCP_ACK); /* our SYN-ACK was lost */
+        } else {
+            tcp_send_ack(sk); /* challenge ACK (RFC 5961) */
+        }
+        return;
+    }
+    if (!(seg->flags & TCP_ACK)) {
+        return;
+    }
+
+    if (sk->state == TCP_SYN_RECV) {
+        if (seg->ack != sk->snd_nxt) {
+            tcp_send_reset(iph, th, seg);
+            return;
+        }
+        sk->snd_una = seg->ack;
+        sk->snd_wnd = seg->win << sk->snd_wscale;
+        sk->snd_wl1 = seg->seq;
+        sk->snd_wl2 = seg->ack;
+        sk->rto_deadline = 0;
+        sk->backoff = 0;
+        sk->state = TCP_ESTABLISHED;
+        struct tcp_sock *lsk = sk->parent;
+        if (!lsk || lsk->state != TCP_LISTEN) {
+            tcp_send_reset(iph, th, seg);
+            tcp_set_state_closed(sk);
+            return;
+        }
+        uint64_t flags = spin_lock_irqsave(&lsk->lock);
+        tcp_accept_queue(lsk, sk);
+        spin_unlock_irqrestore(&lsk->lock, flags);
+    }
+
+    const bool fin_was_out = sk->fin_queued && !tcp_before(sk->snd_una, sk->snd_end + 1);
+    tcp_ack(sk, seg);
+    if (sk->fin_queued && !fin_was_out && !tcp_before(sk->snd_una, sk->snd_end + 1)) {
+        tcp_fin_acked(sk);
+    }
+    if (sk->state == TCP_CLOSED) {
+        return;
+    }
+
+    const bool can_receive = sk->state == TCP_ESTABLISHED || sk->state == TCP_FIN_WAIT1 ||
+                             sk->state == TCP_FIN_WAIT2;
+    if (seg->len && can_receive) {
+        tcp_data(sk, seg);
+    }
+    if ((seg->flags & TCP_FIN) && !sk->fin_received && seg->seq + seg->len == sk->rcv_nxt) {
+        tcp_fin_rcv(sk);
+    }
+    tcp_push(sk);
+}
+
+static void tcp_parse_options(const uint8_t *p, uint32_t len, struct tcp_opts *o) {
+    o->mss = 0;
+    o->wscale = -1;
+    o->sack_ok = false;
+    o->nsack = 0;
+    while (len) {
+        const uint8_t kind = p[0];
+        if (kind == TCPOPT_EOL) {
+            break;
+        }
+        if (kind == TCPOPT_NOP) {
+            p++;
+            len--;
+            continue;
+        }
+        if (len < 2 || p[1] < 2 || p[1] > len) {
+            break;
+        }
+        const uint8_t olen = p[1];
+        if (kind == TCPOPT_MSS && olen == 4) {
+            o->mss = (uint16_t)(p[2] << 8 | p[3]);
+        } else if (kind == TCPOPT_WINDOW && olen == 3) {
+            o->wscale = (int8_t)p[2];
+        } else if (kind == TCPOPT_SACK_PERM && olen == 2) {
+            o->sack_ok = true;
+        } else if (kind == TCPOPT_SACK && olen >= 10) {
+            for (uint32_t i = 0; i < (uint32_t)(olen - 2) / 8 && o->nsack < TCP_MAX_SACK; i++) {
+                uint32_t edges[2];
+                memcpy(edges, p + 2 + i * 8, sizeof(edges));
+                o->sack[o->nsack].start = ntohl(edges[0]);
+                o->sack[o->nsack].end = ntohl(edges[1]);
+                o->nsack++;
+            }
+        }
+        p += olen;
+        len -= olen;
+    }
+}
+
+static bool tcp_rx_loss(void) {
+    if (!rx_loss_one_in) {
+        return false;
+    }
+    rx_loss_state = rx_loss_state * 1664525u + 1013904223u;
+    return (rx_loss_state >> 8) % rx_loss_one_in == 0;
+}
+
+static void tcp_rcv(struct sk_buff *skb) {
+    const struct iphdr *iph = skb_network_header(skb);
+    const struct tcphdr *th = (const struct tcphdr *)skb->data;
+    const uint32_t doff = (uint32_t)(th->doff >> 4) * 4;
+    if (skb_headlen(skb) < sizeof(*th) || doff < sizeof(*th) || doff > skb_headlen(skb) ||
+        csum_fold(skb_checksum(skb, 0, skb->len,
+                               csum_tcpudp_nofold(iph->saddr, iph->daddr, (uint16_t)skb->len, IPPROTO_TCP, 0))) != 0) {
+        stats.bad_segs++;
+        skb_free(skb);
+        return;
+    }
+    struct tcp_seg seg = {
+        .skb = skb,
+        .seq = ntohl(th->seq),
+        .ack = ntohl(th->ack_seq),
+        .win = ntohs(th->window),
+        .flags = th->flags,
+        .off = doff,
+        .len = skb->len - doff,
+    };
+    tcp_parse_options((const uint8_t *)(th + 1), doff - sizeof(*th), &seg.opts);
+
+    rcu_read_lock();
+    struct tcp_sock *sk = tcp_lookup(iph->saddr, ntohs(th->source), ntohs(th->dest));
+    if (!sk) {
+        rcu_read_unlock();
+        stats.no_socket++;
+        tcp_send_reset(iph, th, &seg);
+        skb_free(skb);
+        return;
+    }
+    if (seg.len && tcp_rx_loss()) {
+        rcu_read_unlock();
+        skb_free(skb);
+        return;
+    }
+    uint64_t flags = spin_lock_irqsave(&sk->lock);
+    sk->info.segs_in++;
+    if (sk->state == TCP_LISTEN) {
+        tcp_listen_rcv(sk, iph, th, &seg);
+    } else {
+        tcp_segment(sk, iph, th, &seg);
+    }
+    spin_unlock_irqrestore(&sk->lock, flags);
+    rcu_read_unlock();
+    skb_free(skb);
+}
+
+/* ---- timers ---- */
+
+static void tcp_rto(struct tcp_sock *sk) {
+    sk->rto_deadline = 0;
+    switch (sk->state) {
+    case TCP_TIME_WAIT:
+        tcp_set_state_closed(sk);
+        return;
+    case TCP_SYN_SENT:
+    case TCP_SYN_RECV:
+        if (++sk->backoff > TCP_SYN_RETRIES) {
+            sk->reset = true;
+            tcp_set_state_closed(sk);
+            return;
+        }
+        sk->rtt_timing = false;
+        tcp_transmit(sk, sk->iss, 0, sk->state == TCP_SYN_SENT ? TCP_SYN : TCP_SYN | TCP_ACK);
+        tcp_arm_rto(sk);
+        return;
+    default:
+        break;
+    }
+    if (!tcp_can_send(sk)) {
+        return;
+    }
+    if (!sk->snd_wnd && sk->snd_end != sk->snd_una) {
+        /* persist: probe the zero window with one byte, no loss implied */
+        tcp_transmit(sk, sk->snd_una, 1, TCP_ACK);
+        if (sk->snd_nxt == sk->snd_una) {
+            sk->snd_nxt++;
+            if (tcp_after(sk->snd_nxt, sk->snd_max)) {
+                sk->snd_max = sk->snd_nxt;
+            }
+        }
+        sk->backoff = min_u32(sk->backoff + 1, 6);
+        tcp_arm_rto(sk);
+        return;
+    }
+    if (sk->snd_una == sk->snd_max) {
+        return;
+    }
+    if (++sk->backoff > TCP_MAX_RETRIES) {
+        sk->reset = true;
+        tcp_set_state_closed(sk);
+        return;
+    }
+    /* everything outstanding is presumed lost: go back to snd_una */
+    sk->info.rto_expiries++;
+    sk->ssthresh = sk->ca->ssthresh(sk);
+    sk->cwnd = 1;
+    sk->cwnd_cnt = 0;
+    sk->in_recovery = false;
+    sk->recover = sk->snd_max;
+    sk->sacked_count = 0;
+    sk->dupacks = 0;
+    sk->rtt_timing = false;
+    sk->snd_nxt = sk->snd_una;
+    tcp_push(sk);
+    tcp_arm_rto(sk);
+}
+
+void tcp_poll(void) {
+    struct tcp_sock *reap = 0;
+    uint64_t flags = spin_lock_irqsave(&table_lock);
+    for (struct tcp_sock **link = &all_socks; *link;) {
+        struct tcp_sock *sk = *link;
+        if (sk->dead) {
+            rcu_assign_pointer(*link, sk->all_next);
+            tcp_unhash_locked(sk);
+            sk->accept_next = reap;
+            reap = sk;
+            continue;
+        }
+        link = &sk->all_next;
+    }
+    spin_unlock_irqrestore(&table_lock, flags);
+
+    const uint64_t now = tcp_now_us();
+    rcu_read_lock();
+    for (struct tcp_sock *sk = rcu_dereference(all_socks); sk; sk = rcu_dereference(sk->all_next)) {
+        if ((!sk->rto_deadline || now < sk->rto_deadline) && (!sk->delack_deadline || now < sk->delack_deadline)) {
+            continue;
+        }
+        uint64_t sk_flags = spin_lock_irqsave(&sk->lock);
+        if (sk->delack_deadline && now >= sk->delack_deadline) {
+            tcp_send_ack(sk);
+        }
+        if (sk->rto_deadline && now >= sk->rto_deadline) {
+            tcp_rto(sk);
+        }
+        spin_unlock_irqrestore(&sk->lock, sk_flags);
+    }
+    rcu_read_unlock();
+
+    if (!reap) {
+        return;
+    }
+    synchronize_rcu();
+    while (reap) {
+        struct tcp_sock *sk = reap;
+        reap = sk->accept_next;
+        ring_free(&sk->sndbuf);
+        ring_free(&sk->rcvbuf);
+        pool_free(&sock_pool, sk);
+    }
+}
+EXPORT_SYMBOL(tcp_poll);
+
+/* ---- socket calls ---- */
+
+struct tcp_sock *tcp_socket(void) {
+    struct tcp_sock *sk = pool_alloc(&sock_pool);
+    if (!sk) {
+        return 0;
+    }
+    memset(sk, 0, sizeof(*sk));
+    tcp_sock_defaults(sk, cong_ops[0]);
+    if (sk->ca->init) {
+        sk->ca->init(sk);
+    }
+    tcp_link(sk);
+    return sk;
+}
+EXPORT_SYMBOL(tcp_socket);
+
+bool tcp_listen(struct tcp_sock *sk, uint16_t port) {
+    if (sk->state != TCP_CLOSED || !port) {
+        return false;
+    }
+    rcu_read_lock();
+    struct tcp_sock *other = tcp_lookup(0, 0, port);
+    rcu_read_unlock();
+    if (other) {
+        return false;
+    }
+    sk->sport = port;
+    sk->state = TCP_LISTEN;
+    tcp_hash(sk);
+    return true;
+}
+EXPORT_SYMBOL(tcp_listen);
+
+struct tcp_sock *tcp_accept(struct tcp_sock *lsk) {
+    uint64_t flags = spin_lock_irqsave(&lsk->lock);
+    struct tcp_sock *sk = lsk->accept_head;
+    if (sk) {
+        lsk->accept_head = sk->accept_next;
+        if (!lsk->accept_head) {
+            lsk->accept_tail = 0;
+        }
+        sk->accept_next = 0;
+        sk->parent = 0;
+        sk->closed_by_app = false;
+    }
+    spin_unlock_irqrestore(&lsk->lock, flags);
+    return sk;
+}
+EXPORT_SYMBOL(tcp_accept);
+
+bool tcp_connect(struct tcp_sock *sk, uint32_t daddr, uint16_t dport) {
+    if (sk->state != TCP_CLOSED || sk->dead) {
+        return false;
+    }
+    sk->daddr = daddr;
+    sk->dport = dport;
+    if (!tcp_route(sk) || !ring_alloc(&sk->sndbuf)) {
+        return false;
+    }
+    if (!ring_alloc(&sk->rcvbuf)) {
+        ring_free(&sk->sndbuf);
+        return false;
+    }
+    uint64_t flags = spin_lock_irqsave(&table_lock);
+    for (uint32_t tries = 0; tries < 16384; tries++) {
+        const uint16_t port = next_ephemeral++;
+        if (next_ephemeral == 0) {
+            next_ephemeral = 49152;
+        }
+        if (!tcp_lookup(daddr, dport, port)) {
+            sk->sport = port;
+            break;
+        }
+    }
+    spin_unlock_irqrestore(&table_lock, flags);
+    if (!sk->sport) {
+        return false;
+    }
+
+    flags = spin_lock_irqsave(&sk->lock);
+    sk->iss = tcp_new_iss();
+    sk->snd_una = sk->iss;
+    sk->snd_nxt = sk->iss + 1;
+    sk->snd_max = sk->snd_nxt;
+    sk->snd_end = sk->snd_nxt;
+    sk->recover = sk->iss;
+    sk->state = TCP_SYN_SENT;
+    tcp_hash(sk);
+    stats.active_opens++;
+    sk->rtt_timing = true;
+    sk->rtt_start_us = tcp_now_us();
+    tcp_transmit(sk, sk->iss, 0, TCP_SYN);
+    tcp_arm_rto(sk);
+    spin_unlock_irqrestore(&sk->lock, flags);
+    return true;
+}
+EXPORT_SYMBOL(tcp_connect);
+
+bool tcp_established(const struct tcp_sock *sk) {
+    return sk->state == TCP_ESTABLISHED || sk->state == TCP_CLOSE_WAIT;
+}
+EXPORT_SYMBOL(tcp_established);
+
+size_t tcp_send(struct tcp_sock *sk, const void *data, size_t len) {
+    uint64_t flags = spin_lock_irqsave(&sk->lock);
+    if (sk->fin_queued || (sk->state != TCP_ESTABLISHED && sk->state != TCP_CLOSE_WAIT)) {
+        spin_unlock_irqrestore(&sk->lock, flags);
+        return 0;
+    }
+    const uint32_t room = TCP_RING_SIZE - (sk->snd_end - sk->snd_una);
+    const uint32_t n = len < room ? (uint32_t)len : room;
+    ring_write(&sk->sndbuf, sk->snd_end, data, n);
+    sk->snd_end += n;
+    tcp_push(sk);
+    spin_unlock_irqrestore(&sk->lock, flags);
+    return n;
+}
+EXPORT_SYMBOL(tcp_send);
+
+/* Bytes read, 0 at end of stream or after a reset, -1 if nothing yet. */
+int tcp_recv(struct tcp_sock *sk, void *buf, size_t len) {
+    uint64_t flags = spin_lock_irqsave(&sk->lock);
+    const uint32_t avail = sk->rcv_nxt - sk->rcv_read - (sk->fin_received ? 1 : 0);
+    if (!avail) {
+        const bool eof = sk->fin_received || sk->reset || sk->state == TCP_CLOSED;
+        spin_unlock_irqrestore(&sk->lock, flags);
+        return eof ? 0 : -1;
+    }
+    const uint32_t n = len < avail ? (uint32_t)len : avail;
+    ring_read(&sk->rcvbuf, sk->rcv_read, buf, n);
+    sk->rcv_read += n;
+    /* reopen a window the sender may be stalled on */
+    if (tcp_can_send(sk) && (sk->rcv_read + TCP_RING_SIZE) - sk->rcv_wup >= TCP_RING_SIZE / 4) {
+        tcp_send_ack(sk);
+    }
+    spin_unlock_irqrestore(&sk->lock, flags);
+    return (int)n;
+}
+EXPORT_SYMBOL(tcp_recv);
+
+void tcp_close(struct tcp_sock *sk) {
+    uint64_t flags = spin_lock_irqsave(&sk->lock);
+    sk->closed_by_app = true;
+    switch (sk->state) {
+    case TCP_LISTEN: {
+        /* unaccepted children go down with the listener */
+        struct tcp_sock *child;
+        while ((child = sk->accept_head) != 0) {
+            sk->accept_head = child->accept_next;
+            uint64_t child_flags = spin_lock_irqsave(&child->lock);
+            tcp_transmit(child, child->snd_nxt, 0, TCP_RST | TCP_ACK);
+            tcp_set_state_closed(child);
+            spin_unlock_irqrestore(&child->lock, child_flags);
+        }
+        sk->accept_tail = 0;
+        uint64_t table_flags = spin_lock_irqsave(&table_lock);
+        for (struct tcp_sock *s = all_socks; s; s = s->all_next) {
+            if (s->parent == sk) {
+                s->parent = 0;
+            }
+        }
+        spin_unlock_irqrestore(&table_lock, table_flags);
+        tcp_set_state_closed(sk);
+        break;
+    }
+    case TCP_ESTABLISHED:
+    case TCP_SYN_RECV:
+        sk->fin_queued = true;
+        sk->state = TCP_FIN_WAIT1;
+        tcp_push(sk);
+        break;
+    case TCP_CLOSE_WAIT:
+        sk->fin_queued = true;
+        sk->state = TCP_LAST_ACK;
+        tcp_push(sk);
+        break;
+    case TCP_SYN_SENT:
+    case TCP_CLOSED:
+        tcp_set_state_closed(sk);
+        break;
+    default:
+        break; /* already closing */
+    }
+    spin_unlock_irqrestore(&sk->lock, flags);
+}
+EXPORT_SYMBOL(tcp_close);
+
+void tcp_get_stats(struct tcp_stats *out) {
+    *out = stats;
+}
+
+void tcp_set_rx_loss(uint32_t one_in) {
+    rx_loss_one_in = one_in;
+}
+EXPORT_SYMBOL(tcp_set_rx_loss);
+
+void tcp_init(void) {
+    tcp_cong_init();
+    inet_add_protocol(IPPROTO_TCP, tcp_rcv);
+}
@@ -0,0 +1,40 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tcp.h"
+
+/* ---- Reno (RFC 5681) ---- */
+
+static uint32_t reno_ssthresh(struct tcp_sock *sk) {
+    return sk->cwnd / 2 > 2 ? sk->cwnd / 2 : 2;
+}
+
+static void reno_cong_avoid(struct tcp_sock *sk, uint32_t acked) {
+    if (sk->cwnd < sk->ssthresh) {
+        acked = tcp_slow_start(sk, acked);
+        if (!acked) {
+            return;
+        }
+    }
+    tcp_cong_avoid_ai(sk, sk->cwnd, acked);
+}
+
+static const struct tcp_congestion_ops reno_ops = {
+    .name = "reno",
+    .ssthresh = reno_ssthresh,
+    .cong_avoid = reno_cong_avoid,
+};
+
+/* The first algorithm registered is the default for new sockets. */
+void tcp_cong_init(void) {
+#if defined(CONFIG_NET_CONGESTION_SUITE) && defined(CONFIG_TCP_CONG_DEFAULT_CUBIC)
+    tcp_register_congestion_control(&tcp_cubic_ops);
+    tcp_register_congestion_control(&reno_ops);
+#elif defined(CONFIG_NET_CONGESTION_SUITE)
+    tcp_register_congestion_control(&reno_ops);
+    tcp_register_congestion_control(&tcp_cubic_ops);
+#else
+    tcp_register_congestion_control(&reno_ops);
+#endif
+}
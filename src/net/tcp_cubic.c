@@ -0,0 +1,143 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "module.h"
+#include "tcp.h"
+
+#if defined(CONFIG_NET_CONGESTION_SUITE) || defined(MODULE)
+
+/* ---- CUBIC (RFC 8312) ---- */
+
+#define CUBIC_BETA 717       /* multiplicative decrease, /1024 = 0.7 */
+#define CUBIC_BETA_SCALE 15  /* 8 * (1024 + beta) / 3 / (1024 - beta) */
+#define CUBIC_MAX_DELTA_MS 100000
+
+/* Window growth is W(t) = C (t - K)^3 + W_max with C = 0.4 and t in
+   seconds; times here are milliseconds, so C becomes 4 / 10^10. */
+struct cubic {
+    uint32_t last_max_cwnd;  /* W_max */
+    uint32_t epoch_start_ms; /* 0: no epoch running */
+    uint32_t origin_point;
+    uint32_t k_ms;
+    uint32_t tcp_cwnd;       /* Reno-equivalent window for TCP friendliness */
+    uint32_t ack_cnt;
+    uint32_t cnt;            /* ACKed segments per cwnd increment */
+};
+
+_Static_assert(sizeof(struct cubic) <= sizeof(((struct tcp_sock *)0)->ca_priv), "cubic state too large");
+
+static inline struct cubic *cubic_of(struct tcp_sock *sk) {
+    return (struct cubic *)sk->ca_priv;
+}
+
+static uint32_t cubic_root(uint64_t x) {
+    uint32_t r = 0;
+    for (int bit = 21; bit >= 0; bit--) {
+        const uint64_t c = r | (1u << bit);
+        if (c * c * c <= x) {
+            r = (uint32_t)c;
+        }
+    }
+    return r;
+}
+
+static void cubic_init(struct tcp_sock *sk) {
+    struct cubic *ca = cubic_of(sk);
+    *ca = (struct cubic){0};
+}
+
+static uint32_t cubic_ssthresh(struct tcp_sock *sk) {
+    struct cubic *ca = cubic_of(sk);
+    ca->epoch_start_ms = 0;
+    /* fast convergence: yield bandwidth to newer flows */
+    if (sk->cwnd < ca->last_max_cwnd) {
+        ca->last_max_cwnd = (uint32_t)((uint64_t)sk->cwnd * (1024 + CUBIC_BETA) / 2048);
+    } else {
+        ca->last_max_cwnd = sk->cwnd;
+    }
+    const uint32_t ssthresh = (uint32_t)((uint64_t)sk->cwnd * CUBIC_BETA / 1024);
+    return ssthresh > 2 ? ssthresh : 2;
+}
+
+static void cubic_update(struct tcp_sock *sk, uint32_t acked) {
+    struct cubic *ca = cubic_of(sk);
+    const uint32_t now = (uint32_t)(tcp_now_us() / 1000) | 1;
+    ca->ack_cnt += acked;
+    if (!ca->epoch_start_ms) {
+        ca->epoch_start_ms = now;
+        ca->ack_cnt = acked;
+        ca->tcp_cwnd = sk->cwnd;
+        if (ca->last_max_cwnd <= sk->cwnd) {
+            ca->k_ms = 0;
+            ca->origin_point = sk->cwnd;
+        } else {
+            ca->k_ms = cubic_root((uint64_t)(ca->last_max_cwnd - sk->cwnd) * 2500000000ULL);
+            ca->origin_point = ca->last_max_cwnd;
+        }
+    }
+
+    const uint32_t t = now - ca->epoch_start_ms + sk->min_rtt_us / 1000;
+    uint64_t d = t > ca->k_ms ? t - ca->k_ms : ca->k_ms - t;
+    if (d > CUBIC_MAX_DELTA_MS) {
+        d = CUBIC_MAX_DELTA_MS;
+    }
+    const uint64_t delta = 4 * d * d * d / 10000000000ULL;
+    uint64_t target;
+    if (t > ca->k_ms) {
+        target = ca->origin_point + delta;
+    } else {
+        target = ca->origin_point > delta + 1 ? ca->origin_point - delta : 1;
+    }
+    if (target > sk->cwnd) {
+        ca->cnt = (uint32_t)(sk->cwnd / (target - sk->cwnd));
+    } else {
+        ca->cnt = 100 * sk->cwnd; /* plateau around W_max */
+    }
+    if (!ca->last_max_cwnd && ca->cnt > 20) {
+        ca->cnt = 20; /* no loss seen yet: do not lag Reno by much */
+    }
+
+    /* never grow slower than Reno would in the same time */
+    const uint32_t per_seg = (sk->cwnd * CUBIC_BETA_SCALE) >> 3;
+    while (per_seg && ca->ack_cnt > per_seg) {
+        ca->ack_cnt -= per_seg;
+        ca->tcp_cwnd++;
+    }
+    if (ca->tcp_cwnd > sk->cwnd) {
+        const uint32_t max_cnt = sk->cwnd / (ca->tcp_cwnd - sk->cwnd);
+        if (ca->cnt > max_cnt) {
+            ca->cnt = max_cnt;
+        }
+    }
+    if (ca->cnt < 2) {
+        ca->cnt = 2;
+    }
+}
+
+static void cubic_cong_avoid(struct tcp_sock *sk, uint32_t acked) {
+    if (sk->cwnd < sk->ssthresh) {
+        acked = tcp_slow_start(sk, acked);
+        if (!acked) {
+            return;
+        }
+    }
+    cubic_update(sk, acked);
+    tcp_cong_avoid_ai(sk, cubic_of(sk)->cnt, acked);
+}
+
+const struct tcp_congestion_ops tcp_cubic_ops = {
+    .name = "cubic",
+    .init = cubic_init,
+    .ssthresh = cubic_ssthresh,
+    .cong_avoid = cubic_cong_avoid,
+};
+
+#ifdef MODULE
+static int tcp_cubic_register(void) {
+    return tcp_register_congestion_control(&tcp_cubic_ops) ? 0 : -1;
+}
+module_init(tcp_cubic_register);
+#endif
+
+#endif /* CONFIG_NET_CONGESTION_SUITE || MODULE */
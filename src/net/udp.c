@@ -0,0 +1,274 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "checksum.h"
+#include "console.h"
+#include "inet.h"
+#include "memory.h"
+#include "rcu.h"
+#include "spinlock.h"
+#include "tsc.h"
+#include "udp.h"
+
+/* Port demux table: receivers walk chains under rcu_read_lock() without
+   taking any lock; bind and close serialize on table_lock. */
+static struct udp_sock *udp_table[UDP_HASH_SIZE];
+static spinlock_t table_lock = SPINLOCK_INIT;
+static struct object_pool sock_pool = OBJECT_POOL("udp_sock", struct udp_sock);
+static uint16_t next_ephemeral = UDP_EPHEMERAL_FIRST;
+
+static inline uint32_t udp_hash(uint16_t port) {
+    return port & (UDP_HASH_SIZE - 1);
+}
+
+/* Caller holds table_lock or rcu_read_lock(). */
+static struct udp_sock *udp_lookup(uint16_t port) {
+    for (struct udp_sock *sk = rcu_dereference(udp_table[udp_hash(port)]); sk; sk = rcu_dereference(sk->next)) {
+        if (sk->port == port) {
+            return sk;
+        }
+    }
+    return 0;
+}
+
+struct udp_sock *udp_socket(void) {
+    struct udp_sock *sk = pool_alloc(&sock_pool);
+    if (!sk) {
+        return 0;
+    }
+    memset(sk, 0, sizeof(*sk));
+    skb_queue_init(&sk->rxq);
+    return sk;
+}
+
+bool udp_bind(struct udp_sock *sk, uint16_t port) {
+    if (sk->port) {
+        return false;
+    }
+    spin_lock(&table_lock);
+    if (!port) {
+        for (uint32_t tries = 0; tries < 65536 - UDP_EPHEMERAL_FIRST; tries++) {
+            uint16_t candidate = next_ephemeral++;
+            if (next_ephemeral == 0) {
+                next_ephemeral = UDP_EPHEMERAL_FIRST;
+            }
+            if (!udp_lookup(candidate)) {
+                port = candidate;
+                break;
+            }
+        }
+    }
+    if (!port || udp_lookup(port)) {
+        spin_unlock(&table_lock);
+        return false;
+    }
+    sk->port = port;
+    sk->next = udp_table[udp_hash(port)];
+    rcu_assign_pointer(udp_table[udp_hash(port)], sk);
+    spin_unlock(&table_lock);
+    return true;
+}
+
+void udp_close(struct udp_sock *sk) {
+    if (sk->port) {
+        spin_lock(&table_lock);
+        struct udp_sock **link = &udp_table[udp_hash(sk->port)];
+        while (*link && *link != sk) {
+            link = &(*link)->next;
+        }
+        if (*link) {
+            rcu_assign_pointer(*link, sk->next);
+        }
+        spin_unlock(&table_lock);
+        /* readers may still hold sk: wait them out before freeing */
+        synchronize_rcu();
+    }
+    struct sk_buff *skb;
+    while ((skb = skb_dequeue(&sk->rxq)) != 0) {
+        skb_free(skb);
+    }
+    pool_free(&sock_pool, sk);
+}
+
+static void udp_rcv(struct sk_buff *skb) {
+    if (skb_headlen(skb) < sizeof(struct udphdr)) {
+        skb_free(skb);
+        return;
+    }
+    const struct udphdr *uh = (const struct udphdr *)skb->data;
+    const struct iphdr *iph = skb_network_header(skb);
+    const uint32_t ulen = ntohs(uh->len);
+    if (ulen < sizeof(*uh) || ulen > skb->len) {
+        skb_free(skb);
+        return;
+    }
+    if (uh->check) {
+        uint32_t sum = csum_tcpudp_nofold(iph->saddr, iph->daddr, (uint16_t)ulen, IPPROTO_UDP, 0);
+        if (csum_fold(skb_checksum(skb, 0, ulen, sum)) != 0) {
+            skb_free(skb);
+            return;
+        }
+    }
+    const uint16_t dport = ntohs(uh->dest);
+    struct udp_skb_cb *cb = udp_cb(skb);
+    cb->saddr = iph->saddr;
+    cb->sport = ntohs(uh->source);
+    skb_trim(skb, ulen);
+    skb_pull(skb, sizeof(*uh));
+
+    rcu_read_lock();
+    struct udp_sock *sk = udp_lookup(dport);
+    if (!sk) {
+        rcu_read_unlock();
+        inet_stats.udp_no_port++;
+        skb_free(skb);
+        return;
+    }
+    uint64_t flags = spin_lock_irqsave(&sk->lock);
+    bool queued = sk->rxq.qlen < UDP_RXQ_MAX;
+    if (queued) {
+        skb_queue_tail(&sk->rxq, skb);
+        sk->rx_packets++;
+    } else {
+        sk->rx_dropped++;
+    }
+    spin_unlock_irqrestore(&sk->lock, flags);
+    if (!queued) {
+        skb_free(skb);
+    } else if (sk->data_ready) {
+        sk->data_ready(sk);
+    }
+    rcu_read_unlock();
+}
+
+bool udp_send_skb(struct udp_sock *sk, struct sk_buff *skb, uint32_t daddr, uint16_t dport) {
+    struct inet_route rt;
+    if ((!sk->port && !udp_bind(sk, 0)) || !ip_route_output(daddr, &rt)) {
+        skb_free(skb);
+        return false;
+    }
+    struct udphdr *uh = skb_push(skb, sizeof(*uh));
+    if (!uh || skb->len > 0xFFFF) {
+        skb_free(skb);
+        return false;
+    }
+    uh->source = htons(sk->port);
+    uh->dest = htons(dport);
+    uh->len = htons((uint16_t)skb->len);
+    uh->check = 0;
+    uint32_t sum = csum_tcpudp_nofold(rt.saddr, daddr, (uint16_t)skb->len, IPPROTO_UDP, 0);
+    uint16_t check = csum_fold(skb_checksum(skb, 0, skb->len, sum));
+    uh->check = check ? check : 0xFFFF;
+    return ip_send(skb, &rt, daddr, IPPROTO_UDP);
+}
+
+bool udp_sendto(struct udp_sock *sk, uint32_t daddr, uint16_t dport, const void *data, size_t len) {
+    struct sk_buff *skb = skb_alloc((uint32_t)len);
+    if (!skb) {
+        return false;
+    }
+    memcpy(skb_put(skb, (uint32_t)len), data, len);
+    return udp_send_skb(sk, skb, daddr, dport);
+}
+
+struct sk_buff *udp_recv_skb(struct udp_sock *sk) {
+    uint64_t flags = spin_lock_irqsave(&sk->lock);
+    struct sk_buff *skb = skb_dequeue(&sk->rxq);
+    spin_unlock_irqrestore(&sk->lock, flags);
+    return skb;
+}
+
+/* Returns the datagram length (truncated to len) or -1 if none is queued. */
+int udp_recvfrom(struct udp_sock *sk, void *buf, size_t len, uint32_t *saddr, uint16_t *sport) {
+    struct sk_buff *skb = udp_recv_skb(sk);
+    if (!skb) {
+        return -1;
+    }
+    uint32_t n = skb->len < len ? skb->len : (uint32_t)len;
+    skb_copy_bits(skb, 0, buf, n);
+    if (saddr) {
+        *saddr = udp_cb(skb)->saddr;
+    }
+    if (sport) {
+        *sport = udp_cb(skb)->sport;
+    }
+    skb_free(skb);
+    return (int)n;
+}
+
+void udp_init(void) {
+    inet_add_protocol(IPPROTO_UDP, udp_rcv);
+}
+
+#ifdef CONFIG_NET_IPV4_BENCH
+#define UDP_BENCH_DATAGRAMS 200000
+#define UDP_BENCH_WINDOW 64
+#define UDP_BENCH_PORT 7
+
+/* Echo server: bounce each datagram back in its own buffer. */
+static void udp_bench_echo(struct udp_sock *sk) {
+    struct sk_buff *skb;
+    while ((skb = udp_recv_skb(sk)) != 0) {
+        const struct udp_skb_cb cb = *udp_cb(skb);
+        udp_send_skb(sk, skb, cb.saddr, cb.sport);
+    }
+}
+
+static void udp_bench_run(struct udp_sock *client, uint32_t payload) {
+    static uint8_t data[1472];
+    const uint32_t daddr = htonl(INADDR_LOOPBACK);
+    uint64_t sent = 0;
+    uint64_t received = 0;
+    const uint64_t start = tsc_read();
+    uint64_t last_progress = start;
+    while (received < UDP_BENCH_DATAGRAMS) {
+        while (sent < UDP_BENCH_DATAGRAMS && sent - received < UDP_BENCH_WINDOW &&
+               udp_sendto(client, daddr, UDP_BENCH_PORT, data, payload)) {
+            sent++;
+        }
+        net_rx_action(NAPI_WEIGHT);
+        struct sk_buff *skb;
+        while ((skb = udp_recv_skb(client)) != 0) {
+            skb_free(skb);
+            received++;
+            last_progress = tsc_read();
+        }
+        if (tsc_cycles_to_us(tsc_read() - last_progress) > 100000) {
+            /* lost datagrams: stop rather than spin forever */
+            break;
+        }
+    }
+    const uint64_t ns = tsc_cycles_to_ns(tsc_read() - start);
+    kprint("inet bench: udp echo %u B: %lu of %lu echoed, %lu datagrams/s, %lu MB/s\n", payload, received,
+           sent, ns ? received * 1000000000 / ns : 0, ns ? received * payload * 1000 / ns : 0);
+}
+
+void udp_bench(void) {
+    struct udp_sock *server = udp_socket();
+    struct udp_sock *client = udp_socket();
+    if (!server || !client || !udp_bind(server, UDP_BENCH_PORT) || !udp_bind(client, 0)) {
+        kprint("inet bench: cannot set up sockets\n");
+        return;
+    }
+    server->data_ready = udp_bench_echo;
+    udp_bench_run(client, 64);
+    udp_bench_run(client, 1472);
+    udp_close(client);
+    udp_close(server);
+
+    struct inet_stats st;
+    inet_get_stats(&st);
+    kprint("inet bench: ip in %lu, ip dropped %lu, ip out %lu, udp no port %lu\n", st.ip_in, st.ip_in_dropped, st.ip_out,
+           st.udp_no_port);
+
+    ping_bench("inet bench: ping 127.0.0.1", htonl(INADDR_LOOPBACK));
+    struct net_device *dev;
+    for (size_t i = 0; (dev = netdev_at(i)) != 0; i++) {
+        if (!(dev->flags & NETDEV_F_LOOPBACK) && dev->ipv4_gateway) {
+            ping_bench("inet bench: ping gateway", dev->ipv4_gateway);
+            break;
+        }
+    }
+}
+#endif
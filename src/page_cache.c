@@ -0,0 +1,496 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "block.h"
+#include "console.h"
+#include "memory.h"
+#include "page_cache.h"
+#include "paging.h"
+#include "tsc.h"
+
+#define PG_UPTODATE   0x01
+#define PG_DIRTY      0x02
+#define PG_REFERENCED 0x04
+#define PG_READAHEAD  0x08 /* reaching this page starts the next async window */
+#define PG_RA_UNUSED  0x10 /* read speculatively and not yet touched */
+#define PG_PINNED     0x20 /* handed out by find_page(), evict_one() skips it */
+
+#define NO_INDEX (~0ULL)
+
+struct cache_page {
+    struct inode *inode;
+    uint64_t index;
+    uint8_t *data;
+    uint32_t flags;
+    struct cache_page *prev; /* CLOCK ring */
+    struct cache_page *next;
+};
+
+static struct object_pool desc_pool = OBJECT_POOL("cache_page", struct cache_page);
+static struct cache_page *clock_hand = 0;
+static uint64_t nr_cached = 0;
+static uint64_t max_cached = 0;
+static struct page_cache_stats stats;
+
+static void ring_insert(struct cache_page *p) {
+    if (!clock_hand) {
+        p->prev = p->next = p;
+        clock_hand = p;
+        return;
+    }
+    /* behind the hand, so a new page gets a full sweep before eviction */
+    p->next = clock_hand;
+    p->prev = clock_hand->prev;
+    clock_hand->prev->next = p;
+    clock_hand->prev = p;
+}
+
+static void ring_remove(struct cache_page *p) {
+    if (p->next == p) {
+        clock_hand = 0;
+    } else {
+        p->prev->next = p->next;
+        p->next->prev = p->prev;
+        if (clock_hand == p) {
+            clock_hand = p->next;
+        }
+    }
+    p->prev = p->next = 0;
+}
+
+static void release(struct cache_page *p) {
+    radix_tree_delete(&p->inode->pages, p->index);
+    ring_remove(p);
+    page_free(p->data);
+    pool_free(&desc_pool, p);
+    nr_cached--;
+}
+
+/* Second-chance sweep: referenced pages lose their bit and survive one more
+   pass, dirty pages are skipped and written back if nothing else is free,
+   pinned pages are in use and skipped outright. */
+static bool evict_one(void) {
+    for (int attempt = 0; attempt < 2; attempt++) {
+        struct cache_page *dirty = 0;
+        for (uint64_t scanned = 0; clock_hand && scanned < 2 * nr_cached + 1; scanned++) {
+            struct cache_page *p = clock_hand;
+            clock_hand = p->next;
+            if (p->flags & PG_PINNED) {
+                continue;
+            }
+            if (p->flags & PG_REFERENCED) {
+                p->flags &= ~PG_REFERENCED;
+                continue;
+            }
+            if (p->flags & PG_DIRTY) {
+                dirty = p;
+                continue;
+            }
+            release(p);
+            stats.evictions++;
+            return true;
+        }
+        if (!dirty || !page_cache_writeback(dirty->inode)) {
+            break;
+        }
+    }
+    return false;
+}
+
+static struct cache_page *alloc_page(struct inode *inode, uint64_t index) {
+    while (nr_cached >= max_cached) {
+        if (!evict_one()) {
+            break;
+        }
+    }
+    void *data = page_alloc();
+    if (!data && evict_one()) {
+        data = page_alloc();
+    }
+    if (!data) {
+        return 0;
+    }
+    struct cache_page *p = pool_alloc(&desc_pool);
+    if (!p) {
+        page_free(data);
+        return 0;
+    }
+    p->inode = inode;
+    p->index = index;
+    p->data = data;
+    p->flags = 0;
+    p->prev = p->next = 0;
+    return p;
+}
+
+static void add_page(struct cache_page *p) {
+    radix_tree_insert(&p->inode->pages, p->index, p);
+    ring_insert(p);
+    nr_cached++;
+}
+
+static uint64_t last_page(const struct inode *inode) {
+    return inode->size ? (inode->size - 1) / PAGE_SIZE : 0;
+}
+
+/* Read one run of missing pages with a single readpages() call. */
+static bool read_run(struct inode *inode, uint64_t first, size_t count, uint64_t demand, uint64_t marker) {
+    struct cache_page *pages[PAGE_CACHE_RA_MAX];
+    void *data[PAGE_CACHE_RA_MAX];
+    size_t n = 0;
+
+    for (; n < count; n++) {
+        pages[n] = alloc_page(inode, first + n);
+        if (!pages[n]) {
+            break;
+        }
+        data[n] = pages[n]->data;
+    }
+    if (n == 0) {
+        return false;
+    }
+
+    bool ok = inode->a_ops && inode->a_ops->readpages(inode, first, data, n);
+    stats.read_requests++;
+    for (size_t i = 0; i < n; i++) {
+        struct cache_page *p = pages[i];
+        if (!ok) {
+            page_free(p->data);
+            pool_free(&desc_pool, p);
+            continue;
+        }
+        p->flags = PG_UPTODATE;
+        if (p->index == demand) {
+            /* later runs of the window must not evict it before find_page() */
+            p->flags |= PG_PINNED;
+        } else {
+            p->flags |= PG_RA_UNUSED;
+            stats.ra_pages++;
+        }
+        if (p->index == marker) {
+            p->flags |= PG_READAHEAD;
+        }
+        add_page(p);
+    }
+    return ok;
+}
+
+/* Populate [start, start + count) skipping pages that are already cached. */
+static void read_window(struct inode *inode, uint64_t start, uint64_t count, uint64_t demand, uint64_t marker) {
+    const uint64_t last = last_page(inode);
+    if (start > last) {
+        return;
+    }
+    if (count > last - start + 1) {
+        count = last - start + 1;
+    }
+
+    uint64_t run_start = NO_INDEX;
+    for (uint64_t idx = start; idx <= start + count; idx++) {
+        bool missing = idx < start + count && !radix_tree_lookup(&inode->pages, idx);
+        if (missing && run_start == NO_INDEX) {
+            run_start = idx;
+        }
+        if (!missing && run_start != NO_INDEX) {
+            read_run(inode, run_start, (size_t)(idx - run_start), demand, marker);
+            run_start = NO_INDEX;
+        }
+    }
+}
+
+static uint32_t next_window(uint32_t size) {
+    uint32_t grown = size ? size * 2 : PAGE_CACHE_RA_INIT;
+    return grown > PAGE_CACHE_RA_MAX ? PAGE_CACHE_RA_MAX : grown;
+}
+
+static void sync_readahead(struct inode *inode, uint64_t index) {
+    struct readahead_state *ra = &inode->ra;
+    const bool sequential = (index == 0 && ra->size == 0) || index == ra->prev_index + 1 ||
+                            (ra->size && index == ra->start + ra->size);
+
+    if (!sequential) {
+        /* random access: fetch just the page and restart the ramp-up */
+        ra->start = index;
+        ra->size = 0;
+        ra->async_size = 0;
+        read_window(inode, index, 1, index, NO_INDEX);
+        return;
+    }
+
+    ra->start = index;
+    ra->size = next_window(ra->size);
+    ra->async_size = ra->size / 2;
+    read_window(inode, ra->start, ra->size, index, ra->start + ra->size - ra->async_size);
+}
+
+static void async_readahead(struct inode *inode) {
+    struct readahead_state *ra = &inode->ra;
+    ra->start += ra->size;
+    ra->size = next_window(ra->size);
+    ra->async_size = ra->size;
+    read_window(inode, ra->start, ra->size, NO_INDEX, ra->start);
+}
+
+/* The page comes back pinned: the async window it may start, or anything
+   else that allocates, cannot evict it until put_page(). */
+static struct cache_page *find_page(struct inode *inode, uint64_t index) {
+    struct cache_page *p = radix_tree_lookup(&inode->pages, index);
+    if (p) {
+        stats.hits++;
+        if (p->flags & PG_RA_UNUSED) {
+            p->flags &= ~PG_RA_UNUSED;
+            stats.ra_hits++;
+        }
+        p->flags |= PG_PINNED;
+        if (p->flags & PG_READAHEAD) {
+            p->flags &= ~PG_READAHEAD;
+            async_readahead(inode);
+        }
+    } else {
+        stats.misses++;
+        sync_readahead(inode, index);
+        p = radix_tree_lookup(&inode->pages, index);
+        if (!p) {
+            return 0;
+        }
+        p->flags &= ~PG_RA_UNUSED;
+    }
+    p->flags |= PG_REFERENCED;
+    inode->ra.prev_index = index;
+    return p;
+}
+
+static void put_page(struct cache_page *p) {
+    p->flags &= ~PG_PINNED;
+}
+
+void page_cache_init(uint64_t max_pages) {
+    if (!max_pages) {
+        /* leave half of what is free for everything else */
+        max_pages = memory_free_pages() / 2;
+    }
+    max_cached = max_pages ? max_pages : 1;
+    memset(&stats, 0, sizeof(stats));
+}
+
+size_t page_cache_read(struct inode *inode, uint64_t offset, void *buf, size_t len) {
+    if (!inode || offset >= inode->size) {
+        return 0;
+    }
+    if (len > inode->size - offset) {
+        len = (size_t)(inode->size - offset);
+    }
+
+    uint8_t *out = (uint8_t *)buf;
+    size_t done = 0;
+    while (done < len) {
+        const uint64_t pos = offset + done;
+        const size_t in_page = (size_t)(pos & (PAGE_SIZE - 1));
+        size_t chunk = PAGE_SIZE - in_page;
+        if (chunk > len - done) {
+            chunk = len - done;
+        }
+        struct cache_page *p = find_page(inode, pos / PAGE_SIZE);
+        if (!p) {
+            break;
+        }
+        memcpy(out + done, p->data + in_page, chunk);
+        put_page(p);
+        done += chunk;
+    }
+    return done;
+}
+
+size_t page_cache_write(struct inode *inode, uint64_t offset, const void *buf, size_t len) {
+    if (!inode || !inode->a_ops || !inode->a_ops->writepages) {
+        return 0;
+    }
+
+    const uint8_t *in = (const uint8_t *)buf;
+    size_t done = 0;
+    while (done < len) {
+        const uint64_t pos = offset + done;
+        const uint64_t index = pos / PAGE_SIZE;
+        const size_t in_page = (size_t)(pos & (PAGE_SIZE - 1));
+        size_t chunk = PAGE_SIZE - in_page;
+        if (chunk > len - done) {
+            chunk = len - done;
+        }
+
+        struct cache_page *p = radix_tree_lookup(&inode->pages, index);
+        if (!p && (chunk == PAGE_SIZE || pos >= inode->size)) {
+            /* nothing on disk worth reading: start from a zeroed page */
+            p = alloc_page(inode, index);
+            if (!p) {
+                break;
+            }
+            memset(p->data, 0, PAGE_SIZE);
+            p->flags = PG_UPTODATE;
+            add_page(p);
+        } else if (!p) {
+            p = find_page(inode, index);
+            if (!p) {
+                break;
+            }
+        }
+
+        memcpy(p->data + in_page, in + done, chunk);
+        if (!(p->flags & PG_DIRTY)) {
+            p->flags |= PG_DIRTY;
+            inode->nr_dirty++;
+        }
+        p->flags |= PG_REFERENCED;
+        put_page(p);
+        done += chunk;
+        if (pos + chunk > inode->size) {
+            inode->size = pos + chunk;
+        }
+    }
+
+    if (inode->nr_dirty >= PAGE_CACHE_WB_MAX) {
+        page_cache_writeback(inode);
+    }
+    return done;
+}
+
+static bool flush_run(struct inode *inode, struct cache_page **run, size_t count) {
+    void *data[PAGE_CACHE_WB_MAX];
+    if (!count || count > PAGE_CACHE_WB_MAX) {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        data[i] = run[i]->data;
+    }
+    if (!inode->a_ops->writepages(inode, run[0]->index, data, count)) {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        run[i]->flags &= ~PG_DIRTY;
+    }
+    inode->nr_dirty -= count;
+    stats.wb_pages += count;
+    stats.wb_requests++;
+    return true;
+}
+
+/* Walk dirty pages in index order and merge contiguous ones into writes of
+   up to PAGE_CACHE_WB_MAX pages. */
+bool page_cache_writeback(struct inode *inode) {
+    if (!inode || !inode->nr_dirty || !inode->a_ops || !inode->a_ops->writepages) {
+        return true;
+    }
+
+    struct cache_page *batch[PAGE_CACHE_WB_MAX];
+    struct cache_page *run[PAGE_CACHE_WB_MAX];
+    size_t run_len = 0;
+    uint64_t next = 0;
+    bool ok = true;
+
+    for (;;) {
+        size_t found = radix_tree_gang_lookup(&inode->pages, next, (void **)batch, 0, PAGE_CACHE_WB_MAX);
+        if (!found) {
+            break;
+        }
+        for (size_t i = 0; i < found; i++) {
+            struct cache_page *p = batch[i];
+            const bool extends = run_len && run[run_len - 1]->index + 1 == p->index;
+            if (run_len && (!(p->flags & PG_DIRTY) || !extends || run_len == PAGE_CACHE_WB_MAX)) {
+                ok = flush_run(inode, run, run_len) && ok;
+                run_len = 0;
+            }
+            if (p->flags & PG_DIRTY) {
+                run[run_len++] = p;
+            }
+        }
+        next = batch[found - 1]->index + 1;
+        if (next == 0) {
+            break;
+        }
+    }
+    if (run_len) {
+        ok = flush_run(inode, run, run_len) && ok;
+    }
+    return ok;
+}
+
+void page_cache_invalidate(struct inode *inode) {
+    if (!inode) {
+        return;
+    }
+    page_cache_writeback(inode);
+
+    struct cache_page *batch[PAGE_CACHE_WB_MAX];
+    size_t found;
+    while ((found = radix_tree_gang_lookup(&inode->pages, 0, (void **)batch, 0, PAGE_CACHE_WB_MAX)) > 0) {
+        for (size_t i = 0; i < found; i++) {
+            if (batch[i]->flags & PG_DIRTY) {
+                inode->nr_dirty--;
+            }
+            release(batch[i]);
+        }
+    }
+    memset(&inode->ra, 0, sizeof(inode->ra));
+}
+
+void page_cache_get_stats(struct page_cache_stats *out) {
+    if (!out) {
+        return;
+    }
+    *out = stats;
+    out->cached = nr_cached;
+    out->limit = max_cached;
+}
+
+static uint64_t percent(uint64_t part, uint64_t whole) {
+    return whole ? (part * 100) / whole : 0;
+}
+
+void page_cache_log_stats(void) {
+    kprint("page cache: %lu/%lu pages, hits %lu misses %lu (hit rate %lu%%)\n", nr_cached, max_cached,
+           stats.hits, stats.misses, percent(stats.hits, stats.hits + stats.misses));
+    kprint("  readahead %lu pages, %lu used (%lu%%), %lu read requests\n", stats.ra_pages, stats.ra_hits,
+           percent(stats.ra_hits, stats.ra_pages), stats.read_requests);
+    kprint("  evictions %lu, writeback %lu pages in %lu requests\n", stats.evictions, stats.wb_pages,
+           stats.wb_requests);
+}
+
+#ifdef CONFIG_PAGE_CACHE_BENCH
+#define BENCH_CHUNK (64 * 1024)
+
+static uint64_t read_through_cache(struct inode *inode, uint64_t size, uint8_t *buf) {
+    const uint64_t start = tsc_read();
+    for (uint64_t off = 0; off < size; off += BENCH_CHUNK) {
+        if (!page_cache_read(inode, off, buf, BENCH_CHUNK)) {
+            kprint("page cache bench: read failed at %lu\n", off);
+            break;
+        }
+    }
+    return tsc_cycles_to_us(tsc_read() - start);
+}
+
+void page_cache_bench(void) {
+    struct block_device *dev = block_first();
+    uint8_t *buf = bump_alloc(BENCH_CHUNK, 4096);
+    if (!dev || !buf) {
+        kprint("page cache bench: no block device\n");
+        return;
+    }
+
+    /* keep the file within the cache budget so the second pass is all hits */
+    struct page_cache_stats st;
+    page_cache_get_stats(&st);
+    uint64_t size = dev->inode.size;
+    if (size > st.limit * 4096 * 3 / 4) {
+        size = st.limit * 4096 * 3 / 4;
+    }
+
+    uint64_t cold = read_through_cache(&dev->inode, size, buf);
+    uint64_t warm = read_through_cache(&dev->inode, size, buf);
+    uint64_t mib = size >> 20;
+    kprint("page cache bench: %lu MiB cold %lu us (%lu MiB/s)\n", mib, cold, cold ? mib * 1000000 / cold : 0);
+    kprint("page cache bench: %lu MiB warm %lu us (%lu MiB/s)\n", mib, warm, warm ? mib * 1000000 / warm : 0);
+    page_cache_log_stats();
+    block_log_stats(dev);
+}
+#endif
@@ -0,0 +1,225 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "console.h"
+#include "interrupts.h"
+#include "log.h"
+#include "memory.h"
+#include "paging.h"
+#include "smp.h"
+#include "spinlock.h"
+
+/*
+ * The kernel runs on an identity map: physical addresses are used directly
+ * as pointers. Boot code only guarantees the first 2 MiB on the Multiboot
+ * path, so paging_init() fills in the rest of the low 4 GiB with 2 MiB pages
+ * and device windows above that are added on demand. Its entries are global
+ * so that they stay valid, and get flushed, under every process' PCID.
+ */
+
+#define IDENTITY_LIMIT 0x100000000ULL
+#define CR4_PGE (1ULL << 7)
+
+static spinlock_t map_lock = SPINLOCK_INIT;
+#define TABLE_POOL_PAGES 16
+
+static uint64_t table_pool[TABLE_POOL_PAGES][512] __attribute__((aligned(4096)));
+static unsigned table_pool_used = 0;
+static uint64_t *kernel_pml4;
+
+static uint64_t *alloc_table(void) {
+    uint64_t *table;
+    if (table_pool_used < TABLE_POOL_PAGES) {
+        table = table_pool[table_pool_used++];
+    } else {
+        table = bump_alloc(PAGE_SIZE, PAGE_SIZE);
+        if (!table) {
+            return 0;
+        }
+    }
+    memset(table, 0, PAGE_SIZE);
+    return table;
+}
+
+static uint64_t *next_level(uint64_t *table, unsigned idx) {
+    if (!(table[idx] & PTE_PRESENT)) {
+        uint64_t *child = alloc_table();
+        if (!child) {
+            return 0;
+        }
+        table[idx] = (uint64_t)(uintptr_t)child | PTE_PRESENT | PTE_WRITABLE;
+    }
+    if (table[idx] & PTE_HUGE) {
+        return 0; /* already covered by a 1 GiB page */
+    }
+    return (uint64_t *)(uintptr_t)(table[idx] & PTE_ADDR_MASK);
+}
+
+/* Page directory entry for addr, creating the tables above it; 0 with
+   *covered set when a 1 GiB page already maps addr, 0 alone when out of
+   tables. Always the kernel's tables, whichever process is loaded. */
+static uint64_t *pd_entry(uint64_t addr, bool *covered) {
+    uint64_t *pml4 = kernel_pml4;
+    uint64_t *pdpt = next_level(pml4, (addr >> 39) & 0x1FF);
+    if (!pdpt) {
+        *covered = (pml4[(addr >> 39) & 0x1FF] & PTE_PRESENT) != 0;
+        return 0;
+    }
+    uint64_t *pd = next_level(pdpt, (addr >> 30) & 0x1FF);
+    if (!pd) {
+        *covered = (pdpt[(addr >> 30) & 0x1FF] & PTE_PRESENT) != 0;
+        return 0;
+    }
+    return &pd[(addr >> 21) & 0x1FF];
+}
+
+/* Identity-map one 2 MiB region unless something already covers it. */
+static bool map_huge(uint64_t addr, uint64_t flags) {
+    bool covered = false;
+    uint64_t *pde = pd_entry(addr, &covered);
+    if (!pde) {
+        return covered;
+    }
+    if (!(*pde & PTE_PRESENT)) {
+        *pde = (addr & ~(HUGE_PAGE_SIZE - 1)) | PTE_PRESENT | PTE_WRITABLE | PTE_HUGE | PTE_GLOBAL | flags;
+    }
+    return true;
+}
+
+/* Make [from, to), inside the 2 MiB region of an existing entry, uncached.
+   A 2 MiB page the range only partly covers is split into 4 KiB pages
+   first, so RAM sharing it keeps its caching. *changed is set when a
+   present entry was rewritten; the caller owes every CPU a TLB flush. */
+static bool uncache_range(uint64_t *pde, uint64_t from, uint64_t to, bool *changed) {
+    const uint64_t uc = PTE_PCD | PTE_PWT;
+    const uint64_t base = from & ~(HUGE_PAGE_SIZE - 1);
+    if (*pde & PTE_HUGE) {
+        if ((*pde & uc) == uc) {
+            return true;
+        }
+        *changed = true;
+        if (from == base && to == base + HUGE_PAGE_SIZE) {
+            *pde |= uc;
+            return true;
+        }
+        uint64_t *pt = alloc_table();
+        if (!pt) {
+            return false;
+        }
+        /* bit 12 of a 2 MiB entry is PAT, left clear here */
+        const uint64_t flags = *pde & (0xFFFULL | PTE_NX) & ~PTE_HUGE;
+        for (unsigned i = 0; i < 512; i++) {
+            pt[i] = (base + i * PAGE_SIZE) | flags;
+        }
+        *pde = (uint64_t)(uintptr_t)pt | PTE_PRESENT | PTE_WRITABLE;
+    }
+    uint64_t *pt = (uint64_t *)(uintptr_t)(*pde & PTE_ADDR_MASK);
+    for (uint64_t addr = from & ~(PAGE_SIZE - 1); addr < to; addr += PAGE_SIZE) {
+        uint64_t *pte = &pt[(addr >> 12) & 0x1FF];
+        if ((*pte & uc) != uc) {
+            *pte |= uc;
+            *changed = true;
+        }
+    }
+    return true;
+}
+
+void paging_flush_tlb(void) {
+    const uint64_t flags = irq_save();
+    uint64_t cr4;
+    __asm__ volatile ("mov %%cr4, %0" : "=r"(cr4));
+    /* any write that changes CR4.PGE drops every PCID's entries, global or not */
+    __asm__ volatile ("mov %0, %%cr4" : : "r"(cr4 ^ CR4_PGE) : "memory");
+    __asm__ volatile ("mov %0, %%cr4" : : "r"(cr4) : "memory");
+    irq_restore(flags);
+}
+
+/* The loader's entries for addr's 2 MiB region, which map_huge() left
+   alone, become global too. */
+static void set_global(uint64_t addr) {
+    uint64_t *pdpt = (uint64_t *)(uintptr_t)(kernel_pml4[(addr >> 39) & 0x1FF] & PTE_ADDR_MASK);
+    uint64_t *pdpte = &pdpt[(addr >> 30) & 0x1FF];
+    if (*pdpte & PTE_HUGE) {
+        *pdpte |= PTE_GLOBAL;
+        return;
+    }
+    uint64_t *pd = (uint64_t *)(uintptr_t)(*pdpte & PTE_ADDR_MASK);
+    uint64_t *pde = &pd[(addr >> 21) & 0x1FF];
+    if (*pde & PTE_HUGE) {
+        *pde |= PTE_GLOBAL;
+        return;
+    }
+    uint64_t *pt = (uint64_t *)(uintptr_t)(*pde & PTE_ADDR_MASK);
+    for (unsigned i = 0; i < 512; i++) {
+        if (pt[i] & PTE_PRESENT) {
+            pt[i] |= PTE_GLOBAL;
+        }
+    }
+}
+
+uint64_t paging_kernel_cr3(void) {
+    return (uint64_t)(uintptr_t)kernel_pml4;
+}
+
+void paging_init(void) {
+    uint64_t cr3;
+    __asm__ volatile ("mov %%cr3, %0" : "=r"(cr3));
+    kernel_pml4 = (uint64_t *)(uintptr_t)(cr3 & PTE_ADDR_MASK);
+    for (uint64_t addr = 0; addr < IDENTITY_LIMIT; addr += HUGE_PAGE_SIZE) {
+        if (!map_huge(addr, 0)) {
+            pr_err("paging: out of page tables at %#lx\n", addr);
+            break;
+        }
+        set_global(addr);
+    }
+    /* APs set PGE in the trampoline; turning it on flushes this TLB */
+    uint64_t cr4;
+    __asm__ volatile ("mov %%cr4, %0" : "=r"(cr4));
+    __asm__ volatile ("mov %0, %%cr4" : : "r"(cr4 | CR4_PGE) : "memory");
+}
+
+void *paging_map_phys(uint64_t phys, uint64_t size) {
+    if (!size) {
+        return 0;
+    }
+    uint64_t start = phys & ~(HUGE_PAGE_SIZE - 1);
+    uint64_t end = (phys + size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    bool mapped = true;
+    spin_lock(&map_lock);
+    for (uint64_t addr = start; addr < end && mapped; addr += HUGE_PAGE_SIZE) {
+        mapped = map_huge(addr, 0);
+    }
+    spin_unlock(&map_lock);
+    return mapped ? (void *)(uintptr_t)phys : 0;
+}
+
+void *paging_map_mmio(uint64_t phys, uint64_t size) {
+    if (!size) {
+        return 0;
+    }
+    uint64_t start = phys & ~(HUGE_PAGE_SIZE - 1);
+    uint64_t end = (phys + size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    bool mapped = true;
+    bool changed = false;
+    spin_lock(&map_lock);
+    for (uint64_t addr = start; addr < end && mapped; addr += HUGE_PAGE_SIZE) {
+        bool covered = false;
+        uint64_t *pde = pd_entry(addr, &covered);
+        if (!pde) {
+            mapped = covered;
+        } else if (!(*pde & PTE_PRESENT)) {
+            *pde = addr | PTE_PRESENT | PTE_WRITABLE | PTE_HUGE | PTE_GLOBAL | PTE_PCD | PTE_PWT;
+        } else {
+            const uint64_t from = phys > addr ? phys : addr;
+            const uint64_t to = phys + size < addr + HUGE_PAGE_SIZE ? phys + size : addr + HUGE_PAGE_SIZE;
+            mapped = uncache_range(pde, from, to, &changed);
+        }
+    }
+    spin_unlock(&map_lock);
+    /* PCI probing runs on several CPUs, any of which may have cached the
+       old cacheable entry */
+    if (changed) {
+        smp_flush_tlb_all();
+    }
+    return mapped ? (void *)(uintptr_t)phys : 0;
+}
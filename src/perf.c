@@ -0,0 +1,314 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "console.h"
+#include "cpu.h"
+#include "interrupts.h"
+#include "lapic.h"
+#include "log.h"
+#include "memory.h"
+#include "perf.h"
+#include "smp.h"
+#include "string.h"
+
+#define MSR_PMC0                 0xC1
+#define MSR_PERFEVTSEL0          0x186
+#define MSR_PERF_GLOBAL_STATUS   0x38E
+#define MSR_PERF_GLOBAL_CTRL     0x38F
+#define MSR_PERF_GLOBAL_OVF_CTRL 0x390
+
+#define EVTSEL_USR (1u << 16)
+#define EVTSEL_OS  (1u << 17)
+#define EVTSEL_INT (1u << 20)
+#define EVTSEL_EN  (1u << 22)
+
+#define NMI_VECTOR 2
+
+/* Architectural events; cpuid_bit indexes the leaf 0xA EBX mask. */
+struct perf_event_desc {
+    const char *name;
+    uint8_t event;
+    uint8_t umask;
+    uint8_t cpuid_bit;
+};
+
+static const struct perf_event_desc event_descs[PERF_COUNT_MAX] = {
+    [PERF_COUNT_CYCLES] = { "cycles", 0x3C, 0x00, 0 },
+    [PERF_COUNT_INSTRUCTIONS] = { "instructions", 0xC0, 0x00, 1 },
+    [PERF_COUNT_CACHE_MISSES] = { "cache-misses", 0x2E, 0x41, 4 },
+    [PERF_COUNT_BRANCH_MISSES] = { "branch-misses", 0xC5, 0x00, 6 },
+};
+
+struct perf_cpu {
+    struct perf_sample *samples;
+    uint32_t *order;                 /* scratch for perf_dump_folded() */
+    uint32_t count;
+    volatile bool running;
+    uint32_t events;
+    uint32_t sample_events;
+    uint64_t reload;                 /* counter value after each overflow */
+    uint8_t counter[PERF_COUNT_MAX]; /* general-purpose counter per event */
+    struct perf_cpu_stats stats;
+} __attribute__((aligned(64)));
+
+extern char __text_start[];
+extern char __text_end[];
+
+static struct perf_cpu perf_cpus[NR_CPUS];
+static struct cpu_info pmu;
+static uint64_t counter_mask;
+
+bool perf_event_available(enum perf_event_id id) {
+    if (!pmu.pmu_version || id >= PERF_COUNT_MAX) {
+        return false;
+    }
+    const uint8_t bit = event_descs[id].cpuid_bit;
+    return bit < pmu.pmu_event_bits && !(pmu.pmu_events_missing & (1u << bit));
+}
+
+const char *perf_event_name(enum perf_event_id id) {
+    return id < PERF_COUNT_MAX ? event_descs[id].name : "?";
+}
+
+bool perf_event_parse(const char *name, enum perf_event_id *id) {
+    for (uint32_t i = 0; i < PERF_COUNT_MAX; i++) {
+        if (strcmp(name, event_descs[i].name) == 0) {
+            *id = (enum perf_event_id)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static inline bool in_text(uint64_t addr) {
+    return addr >= (uint64_t)(uintptr_t)__text_start && addr < (uint64_t)(uintptr_t)__text_end;
+}
+
+/* Follow saved rbp links; each must sit higher on the same stack, within
+   PERF_STACK_WINDOW of the interrupted rsp, so a clobbered rbp ends the
+   walk instead of faulting inside the NMI. */
+static uint8_t walk_stack(const struct interrupt_frame *frame, uint64_t *chain) {
+    const uint64_t lo = frame->rsp;
+    const uint64_t hi = frame->rsp + PERF_STACK_WINDOW;
+    uint64_t fp = frame->rbp;
+    uint8_t depth = 0;
+    while (depth < PERF_MAX_STACK && fp >= lo && fp + 16 <= hi && !(fp & 7)) {
+        const uint64_t *link = (const uint64_t *)(uintptr_t)fp;
+        const uint64_t ret = link[1];
+        if (!in_text(ret)) {
+            break;
+        }
+        chain[depth++] = ret;
+        if (link[0] <= fp) {
+            break;
+        }
+        fp = link[0];
+    }
+    return depth;
+}
+
+static void record_sample(struct perf_cpu *pc, const struct interrupt_frame *frame, uint32_t cpu, uint8_t event) {
+    if (pc->count >= PERF_SAMPLES_PER_CPU) {
+        pc->stats.lost++;
+        return;
+    }
+    struct perf_sample *s = &pc->samples[pc->count++];
+    s->rip = frame->rip;
+    s->event = event;
+    s->cpu = (uint16_t)cpu;
+    s->depth = walk_stack(frame, s->callchain);
+    pc->stats.samples++;
+}
+
+static bool counter_overflowed(const struct perf_cpu *pc, uint32_t id, uint64_t status) {
+    const uint8_t c = pc->counter[id];
+    if (pmu.pmu_version >= 2) {
+        return status & (1ULL << c);
+    }
+    /* version 1 has no status register: a sampling counter starts with its
+       top bit set and has wrapped once that bit is clear */
+    return !((rdmsr(MSR_PMC0 + c) >> (pmu.pmu_gp_width - 1)) & 1);
+}
+
+static void perf_nmi(struct interrupt_frame *frame, void *ctx) {
+    (void)ctx;
+    const uint32_t cpu = smp_processor_id();
+    struct perf_cpu *pc = &perf_cpus[cpu];
+    pc->stats.nmis++;
+    const uint64_t status = pmu.pmu_version >= 2 ? rdmsr(MSR_PERF_GLOBAL_STATUS) : 0;
+    if (pc->running) {
+        for (uint32_t id = 0; id < PERF_COUNT_MAX; id++) {
+            if (!(pc->sample_events & PERF_EVENT_BIT(id)) || !counter_overflowed(pc, id, status)) {
+                continue;
+            }
+            pc->stats.counts[id] += (0 - pc->reload) & counter_mask;
+            record_sample(pc, frame, cpu, (uint8_t)id);
+            wrmsr(MSR_PMC0 + pc->counter[id], pc->reload);
+        }
+    }
+    if (pmu.pmu_version >= 2) {
+        wrmsr(MSR_PERF_GLOBAL_OVF_CTRL, status);
+    }
+    lapic_set_lvt_pmc(LAPIC_LVT_NMI);
+}
+
+bool perf_init(const struct cpu_info *cpu) {
+    if (!cpu->pmu_version || !cpu->pmu_gp_counters || cpu->pmu_gp_width < 32) {
+        pr_warn("perf: no usable architectural PMU\n");
+        return false;
+    }
+    pmu = *cpu;
+    counter_mask = pmu.pmu_gp_width >= 64 ? ~0ULL : (1ULL << pmu.pmu_gp_width) - 1;
+    if (!irq_register(NMI_VECTOR, perf_nmi, 0)) {
+        pr_err("perf: NMI vector already claimed\n");
+        pmu.pmu_version = 0;
+        return false;
+    }
+    pr_info("perf: %u counters, events:", pmu.pmu_gp_counters);
+    for (uint32_t id = 0; id < PERF_COUNT_MAX; id++) {
+        if (perf_event_available((enum perf_event_id)id)) {
+            pr_info(" %s", event_descs[id].name);
+        }
+    }
+    pr_info("\n");
+    return true;
+}
+
+bool perf_start(uint32_t events, uint32_t sample_events, uint64_t period) {
+    struct perf_cpu *pc = &perf_cpus[smp_processor_id()];
+    events |= sample_events;
+    if (!pmu.pmu_version || pc->running || !events) {
+        return false;
+    }
+    /* counters only take 32-bit writes, sign-extended from bit 31 */
+    if (!period || period > 0x7FFFFFFF) {
+        period = PERF_DEFAULT_PERIOD;
+    }
+    if (sample_events && !pc->samples) {
+        pc->samples = bump_alloc(PERF_SAMPLES_PER_CPU * sizeof(struct perf_sample), 64);
+        pc->order = bump_alloc(PERF_SAMPLES_PER_CPU * sizeof(uint32_t), 64);
+        if (!pc->samples || !pc->order) {
+            return false;
+        }
+    }
+
+    uint32_t next = 0;
+    for (uint32_t id = 0; id < PERF_COUNT_MAX; id++) {
+        if (!(events & PERF_EVENT_BIT(id))) {
+            continue;
+        }
+        if (!perf_event_available((enum perf_event_id)id) || next >= pmu.pmu_gp_counters) {
+            return false;
+        }
+        pc->counter[id] = (uint8_t)next++;
+    }
+
+    memset(&pc->stats, 0, sizeof(pc->stats));
+    pc->count = 0;
+    pc->events = events;
+    pc->sample_events = sample_events;
+    pc->reload = (0 - period) & counter_mask;
+    pc->running = true;
+    lapic_set_lvt_pmc(LAPIC_LVT_NMI);
+
+    uint64_t enable = 0;
+    for (uint32_t id = 0; id < PERF_COUNT_MAX; id++) {
+        if (!(events & PERF_EVENT_BIT(id))) {
+            continue;
+        }
+        const struct perf_event_desc *d = &event_descs[id];
+        const uint8_t c = pc->counter[id];
+        const bool sampled = sample_events & PERF_EVENT_BIT(id);
+        wrmsr(MSR_PERFEVTSEL0 + c, 0);
+        wrmsr(MSR_PMC0 + c, sampled ? pc->reload : 0);
+        wrmsr(MSR_PERFEVTSEL0 + c, d->event | (uint32_t)d->umask << 8 | EVTSEL_USR | EVTSEL_OS |
+                                       (sampled ? EVTSEL_INT : 0) | EVTSEL_EN);
+        enable |= 1ULL << c;
+    }
+    if (pmu.pmu_version >= 2) {
+        wrmsr(MSR_PERF_GLOBAL_OVF_CTRL, enable);
+        wrmsr(MSR_PERF_GLOBAL_CTRL, enable);
+    }
+    return true;
+}
+
+void perf_stop(void) {
+    struct perf_cpu *pc = &perf_cpus[smp_processor_id()];
+    if (!pc->running) {
+        return;
+    }
+    if (pmu.pmu_version >= 2) {
+        wrmsr(MSR_PERF_GLOBAL_CTRL, 0);
+    }
+    for (uint32_t id = 0; id < PERF_COUNT_MAX; id++) {
+        if (pc->events & PERF_EVENT_BIT(id)) {
+            wrmsr(MSR_PERFEVTSEL0 + pc->counter[id], 0);
+        }
+    }
+    pc->running = false;
+    lapic_set_lvt_pmc(LAPIC_LVT_MASKED);
+    for (uint32_t id = 0; id < PERF_COUNT_MAX; id++) {
+        if (pc->events & PERF_EVENT_BIT(id)) {
+            const uint64_t start = (pc->sample_events & PERF_EVENT_BIT(id)) ? pc->reload : 0;
+            pc->stats.counts[id] += (rdmsr(MSR_PMC0 + pc->counter[id]) - start) & counter_mask;
+        }
+    }
+}
+
+void perf_get_stats(uint32_t cpu, struct perf_cpu_stats *out) {
+    *out = cpu < NR_CPUS ? perf_cpus[cpu].stats : (struct perf_cpu_stats){0};
+}
+
+static int sample_cmp(const struct perf_sample *a, const struct perf_sample *b) {
+    if (a->event != b->event) {
+        return a->event < b->event ? -1 : 1;
+    }
+    if (a->depth != b->depth) {
+        return a->depth < b->depth ? -1 : 1;
+    }
+    if (a->rip != b->rip) {
+        return a->rip < b->rip ? -1 : 1;
+    }
+    return memcmp(a->callchain, b->callchain, a->depth * sizeof(a->callchain[0]));
+}
+
+static void emit_folded(const struct perf_sample *s, uint64_t count) {
+    kprint("perf-fold: %s", event_descs[s->event].name);
+    for (uint8_t i = s->depth; i > 0; i--) {
+        kprint(";%#lx", s->callchain[i - 1]);
+    }
+    kprint(";%#lx %lu\n", s->rip, count);
+}
+
+/* Sort each CPU's samples so identical stacks are adjacent, then print
+   one line per distinct stack with its sample count. */
+void perf_dump_folded(void) {
+    for (uint32_t cpu = 0; cpu < NR_CPUS; cpu++) {
+        struct perf_cpu *pc = &perf_cpus[cpu];
+        if (pc->running || !pc->count) {
+            continue;
+        }
+        const uint32_t n = pc->count;
+        for (uint32_t i = 0; i < n; i++) {
+            pc->order[i] = i;
+        }
+        for (uint32_t gap = n / 2; gap; gap /= 2) {
+            for (uint32_t i = gap; i < n; i++) {
+                const uint32_t x = pc->order[i];
+                uint32_t j = i;
+                for (; j >= gap && sample_cmp(&pc->samples[pc->order[j - gap]], &pc->samples[x]) > 0; j -= gap) {
+                    pc->order[j] = pc->order[j - gap];
+                }
+                pc->order[j] = x;
+            }
+        }
+        uint32_t run_start = 0;
+        for (uint32_t i = 1; i <= n; i++) {
+            if (i == n || sample_cmp(&pc->samples[pc->order[run_start]], &pc->samples[pc->order[i]]) != 0) {
+                emit_folded(&pc->samples[pc->order[run_start]], i - run_start);
+                run_start = i;
+            }
+        }
+    }
+}
@@ -0,0 +1,552 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bench.h"
+#include "cpu.h"
+#include "elf.h"
+#include "gdt.h"
+#include "interrupts.h"
+#include "log.h"
+#include "memory.h"
+#include "paging.h"
+#include "process.h"
+#include "rootfs.h"
+#include "smp.h"
+#include "spinlock.h"
+#include "string.h"
+#include "vdso.h"
+
+#ifdef CONFIG_USERLAND
+
+#define MSR_TSC_AUX 0xC0000103
+#define CR4_PCIDE (1ULL << 17)
+#define CR3_NOFLUSH (1ULL << 63)
+#define PCID_MAX 4095
+#define USER_RFLAGS 0x202 /* IF */
+#define USER_TABLE_FLAGS (PTE_PRESENT | PTE_WRITABLE | PTE_USER)
+#define PTE_SHARED (1ULL << 9) /* available bit: the page is not the process' to free */
+#define ARGV_MAX 16
+
+/* entry.S */
+extern const char syscall_return[];
+void context_switch(uint64_t *save_sp, uint64_t next_sp);
+/* syscall.c */
+void syscall_init_cpu(void);
+
+/* What context_switch() pops, lowest address first. */
+struct switch_frame {
+    uint64_t r15, r14, r13, r12, rbx, rbp;
+    uint64_t rflags;
+    uint64_t ret;
+};
+
+struct free_kstack {
+    struct free_kstack *next;
+};
+
+static struct object_pool process_pool = OBJECT_POOL("process", struct process);
+static spinlock_t process_lock = SPINLOCK_INIT;
+static struct free_kstack *free_kstacks;
+static uint32_t next_pid = 1;
+static uint64_t pcid_used[(PCID_MAX + 64) / 64] = { 1 }; /* 0 is the kernel's */
+static uint64_t kernel_cr3;
+static bool use_pcid;
+static bool use_rdtscp;
+static struct process *current[NR_CPUS];
+
+static void write_cr3(uint64_t cr3) {
+    __asm__ volatile ("mov %0, %%cr3" : : "r"(cr3) : "memory");
+}
+
+static void init_cpu(uint32_t cpu) {
+    syscall_init_cpu();
+    /* what RDTSCP hands user code as the CPU number */
+    if (use_rdtscp) {
+        wrmsr(MSR_TSC_AUX, cpu);
+    }
+    if (use_pcid) {
+        uint64_t cr4;
+        __asm__ volatile ("mov %%cr4, %0" : "=r"(cr4));
+        __asm__ volatile ("mov %0, %%cr4" : : "r"(cr4 | CR4_PCIDE) : "memory");
+    }
+}
+
+void process_init(const struct cpu_info *cpu) {
+    kernel_cr3 = paging_kernel_cr3();
+    use_pcid = cpu->pcid;
+    use_rdtscp = cpu->rdtscp;
+    vdso_init(cpu);
+    init_cpu(0);
+    pr_info("userland: syscall entry ready, PCID %s\n", use_pcid ? "on" : "off");
+}
+
+void process_init_ap(uint32_t cpu) {
+    gdt_load_tss(cpu);
+    init_cpu(cpu);
+}
+
+struct process *process_current(void) {
+    return current[smp_processor_id()];
+}
+
+static uint8_t *kstack_alloc(void) {
+    spin_lock(&process_lock);
+    struct free_kstack *s = free_kstacks;
+    if (s) {
+        free_kstacks = s->next;
+    }
+    spin_unlock(&process_lock);
+    return s ? (uint8_t *)s : bump_alloc(PROCESS_KSTACK_SIZE, 16);
+}
+
+static void kstack_free(uint8_t *stack) {
+    struct free_kstack *s = (struct free_kstack *)stack;
+    spin_lock(&process_lock);
+    s->next = free_kstacks;
+    free_kstacks = s;
+    spin_unlock(&process_lock);
+}
+
+/* Page table entry for a user address; intermediate tables are created
+   when alloc is set. Slots the kernel itself maps are never handed out. */
+static uint64_t *user_pte(uint64_t *pml4, uint64_t va, bool alloc) {
+    uint64_t *table = pml4;
+    for (int shift = 39; shift > 12; shift -= 9) {
+        uint64_t *e = &table[(va >> shift) & 0x1FF];
+        if (!(*e & PTE_PRESENT)) {
+            if (!alloc) {
+                return 0;
+            }
+            uint64_t *child = page_alloc();
+            if (!child) {
+                return 0;
+            }
+            memset(child, 0, PAGE_SIZE);
+            *e = (uint64_t)(uintptr_t)child | USER_TABLE_FLAGS;
+        } else if (!(*e & PTE_USER) || (*e & PTE_HUGE)) {
+            return 0;
+        }
+        table = (uint64_t *)(uintptr_t)(*e & PTE_ADDR_MASK);
+    }
+    return &table[(va >> 12) & 0x1FF];
+}
+
+/* Back va with a zeroed page unless it is mapped already; segments that
+   share a page get the union of their permissions. */
+static bool map_user_page(struct process *p, uint64_t va, uint64_t flags) {
+    uint64_t *pte = user_pte(p->pml4, va, true);
+    if (!pte) {
+        return false;
+    }
+    if (*pte & PTE_SHARED) {
+        return false;
+    }
+    if (!(*pte & PTE_PRESENT)) {
+        void *page = page_alloc();
+        if (!page) {
+            return false;
+        }
+        memset(page, 0, PAGE_SIZE);
+        *pte = (uint64_t)(uintptr_t)page | PTE_PRESENT | PTE_USER;
+    }
+    *pte |= flags;
+    return true;
+}
+
+static void free_user_level(uint64_t *table, int level) {
+    for (unsigned i = 0; i < 512; i++) {
+        if (!(table[i] & PTE_PRESENT)) {
+            continue;
+        }
+        void *next = (void *)(uintptr_t)(table[i] & PTE_ADDR_MASK);
+        if (level > 1) {
+            free_user_level(next, level - 1);
+        } else if (table[i] & PTE_SHARED) {
+            continue;
+        }
+        page_free(next);
+    }
+}
+
+static void free_address_space(uint64_t *pml4) {
+    for (unsigned i = USER_BASE >> 39; i < USER_END >> 39; i++) {
+        if ((pml4[i] & (PTE_PRESENT | PTE_USER)) == (PTE_PRESENT | PTE_USER)) {
+            uint64_t *pdpt = (uint64_t *)(uintptr_t)(pml4[i] & PTE_ADDR_MASK);
+            free_user_level(pdpt, 3);
+            page_free(pdpt);
+        }
+    }
+    page_free(pml4);
+}
+
+/* Kernel pointer to the bytes at va, which must be mapped for the process
+   (and writable when write is set); 0 otherwise. */
+static uint8_t *user_page(uint64_t *pml4, uint64_t va, bool write) {
+    if (va < USER_BASE || va >= USER_END) {
+        return 0;
+    }
+    const uint64_t *pte = user_pte(pml4, va, false);
+    if (!pte || !(*pte & PTE_PRESENT) || (write && !(*pte & PTE_WRITABLE))) {
+        return 0;
+    }
+    return (uint8_t *)(uintptr_t)(*pte & PTE_ADDR_MASK) + (va & (PAGE_SIZE - 1));
+}
+
+/* The kernel never touches user memory through user addresses: it walks
+   the tables, so neither SMAP nor the user's CR3 being live matters. */
+static bool copy_user(uint64_t *pml4, uint64_t uaddr, void *kbuf, size_t len, bool to_user) {
+    uint8_t *k = kbuf;
+    while (len) {
+        uint8_t *u = user_page(pml4, uaddr, to_user);
+        if (!u) {
+            return false;
+        }
+        size_t n = PAGE_SIZE - (uaddr & (PAGE_SIZE - 1));
+        n = n < len ? n : len;
+        if (to_user) {
+            memcpy(u, k, n);
+        } else {
+            memcpy(k, u, n);
+        }
+        uaddr += n;
+        k += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool user_copy_from(void *dst, uint64_t uaddr, size_t len) {
+    return copy_user(process_current()->pml4, uaddr, dst, len, false);
+}
+
+bool user_copy_to(uint64_t uaddr, const void *src, size_t len) {
+    return copy_user(process_current()->pml4, uaddr, (void *)src, len, true);
+}
+
+static bool load_segment(struct process *p, const uint8_t *image, const Elf64_Phdr *ph) {
+    if (ph->p_vaddr < USER_BASE || ph->p_memsz > USER_END - ph->p_vaddr || ph->p_filesz > ph->p_memsz) {
+        return false;
+    }
+    const uint64_t flags = (ph->p_flags & PF_W) ? PTE_WRITABLE : 0;
+    const uint64_t end = ph->p_vaddr + ph->p_memsz;
+    for (uint64_t va = ph->p_vaddr & ~(PAGE_SIZE - 1); va < end; va += PAGE_SIZE) {
+        if (!map_user_page(p, va, flags)) {
+            return false;
+        }
+    }
+    /* the pages are fresh, so the part past p_filesz is already zero */
+    uint64_t va = ph->p_vaddr;
+    const uint8_t *src = image + ph->p_offset;
+    for (uint64_t left = ph->p_filesz; left;) {
+        uint8_t *dst = user_page(p->pml4, va, false);
+        uint64_t n = PAGE_SIZE - (va & (PAGE_SIZE - 1));
+        n = n < left ? n : left;
+        memcpy(dst, src, n);
+        va += n;
+        src += n;
+        left -= n;
+    }
+    return true;
+}
+
+static bool load_elf(struct process *p, const uint8_t *image, size_t size, uint64_t *entry) {
+    const Elf64_Ehdr *eh = (const Elf64_Ehdr *)image;
+    if (size < sizeof(*eh) || memcmp(eh->e_ident, ELF_MAGIC, 4) != 0 || eh->e_ident[4] != ELFCLASS64 ||
+        eh->e_ident[5] != ELFDATA2LSB || eh->e_type != ET_EXEC || eh->e_machine != EM_X86_64 ||
+        eh->e_phentsize != sizeof(Elf64_Phdr) || eh->e_phoff > size ||
+        eh->e_phnum > (size - eh->e_phoff) / sizeof(Elf64_Phdr)) {
+        return false;
+    }
+    /* SYSRET to a non-canonical rip faults in ring 0 */
+    if (eh->e_entry < USER_BASE || eh->e_entry >= USER_END) {
+        return false;
+    }
+    const Elf64_Phdr *ph = (const Elf64_Phdr *)(image + eh->e_phoff);
+    for (uint16_t i = 0; i < eh->e_phnum; i++) {
+        if (ph[i].p_type != PT_LOAD || !ph[i].p_memsz) {
+            continue;
+        }
+        if (ph[i].p_offset > size || ph[i].p_filesz > size - ph[i].p_offset || !load_segment(p, image, &ph[i])) {
+            return false;
+        }
+    }
+    *entry = eh->e_entry;
+    return true;
+}
+
+/* SysV process stack: argc, the argv pointers and a null, an empty envp
+   and an empty auxiliary vector, with the strings above them. */
+static bool setup_stack(struct process *p, const char *const *argv, uint64_t *sp_out) {
+    for (uint64_t va = USER_STACK_TOP - USER_STACK_PAGES * PAGE_SIZE; va < USER_STACK_TOP; va += PAGE_SIZE) {
+        if (!map_user_page(p, va, PTE_WRITABLE)) {
+            return false;
+        }
+    }
+    uint64_t argc = 0;
+    uint64_t uargv[ARGV_MAX];
+    uint64_t sp = USER_STACK_TOP;
+    while (argv[argc]) {
+        const size_t len = strlen(argv[argc]) + 1;
+        if (argc == ARGV_MAX || len > PAGE_SIZE) {
+            return false;
+        }
+        sp -= len;
+        if (!copy_user(p->pml4, sp, (void *)argv[argc], len, true)) {
+            return false;
+        }
+        uargv[argc++] = sp;
+    }
+    uint64_t words[ARGV_MAX + 5];
+    size_t n = 0;
+    words[n++] = argc;
+    for (uint64_t i = 0; i < argc; i++) {
+        words[n++] = uargv[i];
+    }
+    words[n++] = 0; /* argv */
+    words[n++] = 0; /* envp */
+    words[n++] = 0; /* AT_NULL */
+    words[n++] = 0;
+    sp = (sp - n * sizeof(uint64_t)) & ~15ULL;
+    if (!copy_user(p->pml4, sp, words, n * sizeof(uint64_t), true)) {
+        return false;
+    }
+    *sp_out = sp;
+    return true;
+}
+
+/* The kernel stack of a process that has not run yet: context_switch()
+   "returns" into syscall_return, which sysrets to the entry point. */
+static void setup_kstack(struct process *p, uint64_t entry, uint64_t sp) {
+    uint8_t *top = p->kstack + PROCESS_KSTACK_SIZE;
+    struct interrupt_frame *frame = (struct interrupt_frame *)top - 1;
+    memset(frame, 0, sizeof(*frame));
+    frame->rip = entry;
+    frame->cs = GDT_USER_CS;
+    frame->rflags = USER_RFLAGS;
+    frame->rsp = sp;
+    frame->ss = GDT_USER_DS;
+    struct switch_frame *sw = (struct switch_frame *)frame - 1;
+    memset(sw, 0, sizeof(*sw));
+    sw->rflags = 0x2;
+    sw->ret = (uint64_t)(uintptr_t)syscall_return;
+    p->ksp = (uint64_t)(uintptr_t)sw;
+}
+
+struct process *process_spawn(const char *path, const char *const *argv) {
+    const char *image;
+    size_t size;
+    if (!rootfs_read(path, &image, &size)) {
+        pr_err("exec %s: not found\n", path);
+        return 0;
+    }
+    struct process *p = pool_alloc(&process_pool);
+    if (!p) {
+        pr_err("exec %s: out of memory\n", path);
+        return 0;
+    }
+    memset(p, 0, sizeof(*p));
+    p->pml4 = page_alloc();
+    p->kstack = kstack_alloc();
+    if (!p->pml4 || !p->kstack) {
+        pr_err("exec %s: out of memory\n", path);
+        page_free(p->pml4);
+        if (p->kstack) {
+            kstack_free(p->kstack);
+        }
+        pool_free(&process_pool, p);
+        return 0;
+    }
+    /* the kernel half is shared: same tables, never PTE_USER */
+    memcpy(p->pml4, (const void *)(uintptr_t)kernel_cr3, PAGE_SIZE);
+    /* mapped first, so no segment can claim the page */
+    const struct vdso_data *vd = vdso_data();
+    uint64_t *pte = vd ? user_pte(p->pml4, VDSO_DATA_ADDR, true) : 0;
+    if (pte) {
+        *pte = (uint64_t)(uintptr_t)vd | PTE_PRESENT | PTE_USER | PTE_SHARED;
+    }
+
+    uint64_t entry, sp;
+    if (!load_elf(p, (const uint8_t *)image, size, &entry)) {
+        pr_err("exec %s: not a static x86_64 executable for this address space\n", path);
+        process_destroy(p);
+        return 0;
+    }
+    if (!setup_stack(p, argv, &sp)) {
+        pr_err("exec %s: cannot set up the stack\n", path);
+        process_destroy(p);
+        return 0;
+    }
+    setup_kstack(p, entry, sp);
+
+    spin_lock(&process_lock);
+    p->pid = next_pid++;
+    for (uint32_t id = 1; use_pcid && id <= PCID_MAX && !p->pcid; id++) {
+        if (!(pcid_used[id / 64] & (1ULL << (id % 64)))) {
+            pcid_used[id / 64] |= 1ULL << (id % 64);
+            p->pcid = (uint16_t)id;
+        }
+    }
+    spin_unlock(&process_lock);
+    if (use_pcid && !p->pcid) {
+        pr_err("exec %s: out of PCIDs\n", path);
+        process_destroy(p);
+        return 0;
+    }
+    const char *base = path;
+    for (const char *s = path; *s; s++) {
+        if (*s == '/') {
+            base = s + 1;
+        }
+    }
+    for (size_t i = 0; base[i] && i < PROCESS_NAME_LEN - 1; i++) {
+        p->name[i] = base[i];
+    }
+    return p;
+}
+
+/* A CPU's first load of a PCID flushes whatever an earlier owner of the
+   number left in its TLB (a number is only reused once its owner is
+   gone); after that the process keeps its entries across switches, as
+   does the kernel under PCID 0. The kernel's own mappings are global,
+   so they are shared by every PCID and flushed for all of them. */
+static void switch_address_space(struct process *p, uint32_t cpu) {
+    if (!p) {
+        write_cr3(kernel_cr3 | (use_pcid ? CR3_NOFLUSH : 0));
+        return;
+    }
+    uint64_t cr3 = (uint64_t)(uintptr_t)p->pml4 | p->pcid;
+    if (use_pcid && (p->tlb_cpus & (1u << cpu))) {
+        cr3 |= CR3_NOFLUSH;
+    }
+    p->tlb_cpus |= (uint16_t)(1u << cpu);
+    write_cr3(cr3);
+}
+
+bool process_run(struct process *p, uint64_t value) {
+    if (p->exited) {
+        return false;
+    }
+    const uint64_t flags = irq_save();
+    const uint32_t cpu = smp_processor_id();
+    const uint64_t top = (uint64_t)(uintptr_t)(p->kstack + PROCESS_KSTACK_SIZE);
+    p->resume_value = value;
+    current[cpu] = p;
+    tss_set_kernel_stack(cpu, top);
+    smp_set_kernel_rsp(top);
+    switch_address_space(p, cpu);
+    context_switch(&p->caller_sp, p->ksp);
+    switch_address_space(0, cpu);
+    current[cpu] = 0;
+    irq_restore(flags);
+    return !p->exited;
+}
+
+uint64_t process_yield(void) {
+    struct process *p = process_current();
+    context_switch(&p->ksp, p->caller_sp);
+    return p->resume_value;
+}
+
+void process_exit(int status) {
+    struct process *p = process_current();
+    p->exit_status = status;
+    p->exited = true;
+    context_switch(&p->ksp, p->caller_sp);
+    __builtin_unreachable();
+}
+
+void process_fault(const struct interrupt_frame *frame) {
+    const struct process *p = process_current();
+    uint64_t cr2;
+    __asm__ volatile ("mov %%cr2, %0" : "=r"(cr2));
+    pr_err("%s[%u]: exception %lu at rip 0x%016lx err %#lx cr2 0x%016lx, killed\n", p->name, p->pid,
+           frame->vector, frame->rip, frame->error_code, cr2);
+    process_exit(-1);
+}
+
+void process_destroy(struct process *p) {
+    if (!p) {
+        return;
+    }
+    if (p->pcid) {
+        spin_lock(&process_lock);
+        pcid_used[p->pcid / 64] &= ~(1ULL << (p->pcid % 64));
+        spin_unlock(&process_lock);
+    }
+    free_address_space(p->pml4);
+    kstack_free(p->kstack);
+    pool_free(&process_pool, p);
+}
+
+#if defined(CONFIG_MICROBENCH) && defined(CONFIG_USERLAND_BASE_TOOLS)
+/* "/init bench <op>" answers every resume with that many operations and
+   yields again, so one sample is a round trip into ring 3 and back plus
+   loops operations. */
+enum bench_op {
+    BENCH_OP_GETPID,
+    BENCH_OP_CLOCK_SYSCALL,
+    BENCH_OP_CLOCK_VDSO,
+    BENCH_OP_GETCPU,
+    BENCH_OP_MUTEX,
+    BENCH_OP_COUNT,
+};
+
+static const char *const bench_op_names[BENCH_OP_COUNT] = {
+    "getpid", "clock_syscall", "clock_vdso", "getcpu", "mutex",
+};
+static struct process *bench_peers[BENCH_OP_COUNT];
+
+static struct process *bench_peer(enum bench_op op) {
+    if (!bench_peers[op]) {
+        const char *const argv[] = { "/init", "bench", bench_op_names[op], 0 };
+        bench_peers[op] = process_spawn("/init", argv);
+        if (bench_peers[op]) {
+            process_run(bench_peers[op], 0);
+        }
+    }
+    return bench_peers[op] && !bench_peers[op]->exited ? bench_peers[op] : 0;
+}
+
+static void bench_user(enum bench_op op, uint64_t loops) {
+    struct process *p = bench_peer(op);
+    if (p) {
+        process_run(p, loops);
+    }
+}
+
+static void bench_syscall_getpid(uint64_t loops) {
+    bench_user(BENCH_OP_GETPID, loops);
+}
+BENCH(user, syscall_getpid, bench_syscall_getpid);
+
+static void bench_clock_syscall(uint64_t loops) {
+    bench_user(BENCH_OP_CLOCK_SYSCALL, loops);
+}
+BENCH(user, clock_syscall, bench_clock_syscall);
+
+static void bench_clock_vdso(uint64_t loops) {
+    bench_user(BENCH_OP_CLOCK_VDSO, loops);
+}
+BENCH(user, clock_vdso, bench_clock_vdso);
+
+static void bench_getcpu_vdso(uint64_t loops) {
+    bench_user(BENCH_OP_GETCPU, loops);
+}
+BENCH(user, getcpu_vdso, bench_getcpu_vdso);
+
+static void bench_mutex_uncontended(uint64_t loops) {
+    bench_user(BENCH_OP_MUTEX, loops);
+}
+BENCH(user, mutex_uncontended, bench_mutex_uncontended);
+
+static void bench_switch_roundtrip(uint64_t loops) {
+    struct process *p = bench_peer(BENCH_OP_GETPID);
+    for (uint64_t i = 0; p && i < loops; i++) {
+        process_run(p, 0);
+    }
+}
+BENCH(user, switch_roundtrip, bench_switch_roundtrip);
+#endif
+
+#endif /* CONFIG_USERLAND */
@@ -0,0 +1,164 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "memory.h"
+#include "radix_tree.h"
+
+#define RADIX_TREE_MAX_HEIGHT 11 /* ceil(64 / 6) */
+
+static struct object_pool node_pool = OBJECT_POOL("radix_node", struct radix_node);
+
+static struct radix_node *node_alloc(void) {
+    struct radix_node *node = pool_alloc(&node_pool);
+    if (node) {
+        memset(node, 0, sizeof(*node));
+    }
+    return node;
+}
+
+static uint64_t max_index(unsigned height) {
+    if (height >= RADIX_TREE_MAX_HEIGHT) {
+        return ~0ULL;
+    }
+    return (1ULL << (height * RADIX_TREE_SHIFT)) - 1;
+}
+
+static unsigned slot_of(uint64_t index, unsigned level) {
+    return (unsigned)((index >> (level * RADIX_TREE_SHIFT)) & (RADIX_TREE_SLOTS - 1));
+}
+
+void *radix_tree_lookup(const struct radix_tree *tree, uint64_t index) {
+    if (!tree->root || index > max_index(tree->height)) {
+        return 0;
+    }
+    struct radix_node *node = tree->root;
+    for (unsigned level = tree->height - 1; level > 0; level--) {
+        node = node->slots[slot_of(index, level)];
+        if (!node) {
+            return 0;
+        }
+    }
+    return node->slots[slot_of(index, 0)];
+}
+
+static bool grow(struct radix_tree *tree, uint64_t index) {
+    if (!tree->root) {
+        tree->root = node_alloc();
+        if (!tree->root) {
+            return false;
+        }
+        tree->height = 1;
+    }
+    while (index > max_index(tree->height)) {
+        struct radix_node *parent = node_alloc();
+        if (!parent) {
+            return false;
+        }
+        if (tree->root->count) {
+            parent->slots[0] = tree->root;
+            parent->count = 1;
+        } else {
+            pool_free(&node_pool, tree->root);
+        }
+        tree->root = parent;
+        tree->height++;
+    }
+    return true;
+}
+
+bool radix_tree_insert(struct radix_tree *tree, uint64_t index, void *item) {
+    if (!item || !grow(tree, index)) {
+        return false;
+    }
+    struct radix_node *node = tree->root;
+    for (unsigned level = tree->height - 1; level > 0; level--) {
+        unsigned slot = slot_of(index, level);
+        if (!node->slots[slot]) {
+            struct radix_node *child = node_alloc();
+            if (!child) {
+                return false;
+            }
+            node->slots[slot] = child;
+            node->count++;
+        }
+        node = node->slots[slot];
+    }
+    unsigned slot = slot_of(index, 0);
+    if (node->slots[slot]) {
+        return false;
+    }
+    node->slots[slot] = item;
+    node->count++;
+    tree->items++;
+    return true;
+}
+
+void *radix_tree_delete(struct radix_tree *tree, uint64_t index) {
+    if (!tree->root || index > max_index(tree->height)) {
+        return 0;
+    }
+
+    struct radix_node *path[RADIX_TREE_MAX_HEIGHT];
+    struct radix_node *node = tree->root;
+    for (unsigned level = tree->height - 1; level > 0; level--) {
+        path[level] = node;
+        node = node->slots[slot_of(index, level)];
+        if (!node) {
+            return 0;
+        }
+    }
+
+    unsigned slot = slot_of(index, 0);
+    void *item = node->slots[slot];
+    if (!item) {
+        return 0;
+    }
+    node->slots[slot] = 0;
+    node->count--;
+    tree->items--;
+
+    /* release interior nodes that became empty on the way back up */
+    for (unsigned level = 1; level < tree->height && node->count == 0; level++) {
+        pool_free(&node_pool, node);
+        node = path[level];
+        node->slots[slot_of(index, level)] = 0;
+        node->count--;
+    }
+    if (tree->root->count == 0) {
+        pool_free(&node_pool, tree->root);
+        tree->root = 0;
+        tree->height = 0;
+    }
+    return item;
+}
+
+static size_t gang_walk(const struct radix_node *node, unsigned level, uint64_t base, uint64_t first,
+                        void **results, uint64_t *indices, size_t found, size_t max) {
+    const uint64_t span = 1ULL << (level * RADIX_TREE_SHIFT);
+    for (unsigned i = 0; i < RADIX_TREE_SLOTS && found < max; i++) {
+        const uint64_t start = base + i * span;
+        if (!node->slots[i] || start + span - 1 < first) {
+            continue;
+        }
+        if (level == 0) {
+            results[found] = node->slots[i];
+            if (indices) {
+                indices[found] = start;
+            }
+            found++;
+        } else {
+            found = gang_walk(node->slots[i], level - 1, start, first, results, indices, found, max);
+        }
+    }
+    return found;
+}
+
+/* Collect up to max items with index >= first, in ascending index order. */
+size_t radix_tree_gang_lookup(const struct radix_tree *tree, uint64_t first, void **results,
+                              uint64_t *indices, size_t max) {
+    if (!tree->root || first > max_index(tree->height)) {
+        return 0;
+    }
+    return gang_walk(tree->root, tree->height - 1, 0, first, results, indices, 0, max);
+}
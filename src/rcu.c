@@ -0,0 +1,24 @@
+#include <stdint.h>
+
+#include "cpu.h"
+#include "rcu.h"
+#include "smp.h"
+
+struct rcu_cpu rcu_cpus[NR_CPUS];
+
+/* Wait until every other CPU has been outside a read section at least
+   once since the call; the caller itself cannot be inside one. */
+void synchronize_rcu(void) {
+    const uint32_t self = smp_processor_id();
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    for (uint32_t cpu = 0; cpu < NR_CPUS; cpu++) {
+        struct rcu_cpu *rc = &rcu_cpus[cpu];
+        if (cpu == self || !rc->nesting) {
+            continue;
+        }
+        const uint64_t snapshot = rc->passes;
+        while (rc->nesting && rc->passes == snapshot) {
+            cpu_relax();
+        }
+    }
+}
@@ -4,13 +4,25 @@
 #include "string.h"
 
 #include "console.h"
+#include "log.h"
 #include "rootfs.h"
 
+#ifdef CONFIG_USERLAND_BASE_TOOLS
+/* src/initramfs.S */
+extern const char user_init_elf[];
+extern const char user_init_elf_end[];
+#endif
+
+/* /init stays last, rootfs_init() sizes the binary one separately. */
 static struct rootfs_entry entries[] = {
     { "/etc/motd", "Welcome to Z-Kernel!\n", 0 },
     { "/drivers/intel.txt", "Intel microcode placeholder: load APIC + xAPIC paths.\n", 0 },
     { "/drivers/amd.txt", "AMD microcode placeholder: prefer CCX-stable timers.\n", 0 },
+#ifdef CONFIG_USERLAND_BASE_TOOLS
+    { "/init", user_init_elf, 0 },
+#else
     { "/init", "#!/bin/sh\necho Bootstrapping tiny rootfs...\n", 0 },
+#endif
 };
 
 void rootfs_init(void) {
@@ -18,6 +30,9 @@ void rootfs_init(void) {
     for (size_t i = 0; i < count; i++) {
         entries[i].size = strlen(entries[i].data);
     }
+#ifdef CONFIG_USERLAND_BASE_TOOLS
+    entries[count - 1].size = (size_t)(user_init_elf_end - user_init_elf);
+#endif
 }
 
 const struct rootfs_entry *rootfs_entries(size_t *count) {
@@ -59,8 +74,8 @@ bool rootfs_read(const char *path, const char **data, size_t *size) {
 void rootfs_log(void) {
     size_t count = 0;
     const struct rootfs_entry *list = rootfs_entries(&count);
-    kprint("rootfs entries (%x):\n", (uint64_t)count);
+    pr_info("rootfs entries (%zu):\n", count);
     for (size_t i = 0; i < count; i++) {
-        kprint(" - %s (%x bytes)\n", list[i].path, (uint64_t)list[i].size);
+        pr_debug(" - %s (%zu bytes)\n", list[i].path, list[i].size);
     }
 }
@@ -0,0 +1,302 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "acpi.h"
+#include "console.h"
+#include "cpuidle.h"
+#include "cpu.h"
+#include "interrupts.h"
+#include "lapic.h"
+#include "log.h"
+#include "memory.h"
+#include "module.h"
+#include "paging.h"
+#include "process.h"
+#include "smp.h"
+#include "tsc.h"
+
+#define STARTUP_TIMEOUT_US 100000
+#define LEGACY_INIT_DELAY_US 10000 /* MP spec; integrated APICs need none */
+#define SIPI_DELAY_US 200
+
+extern const char smp_trampoline_start[];
+extern const char smp_trampoline_end[];
+extern const char smp_trampoline_cr3[];
+extern const char smp_trampoline_stack[];
+extern const char smp_trampoline_cpu[];
+extern const char smp_trampoline_entry[];
+
+struct gdt_ptr {
+    uint16_t limit;
+    uint64_t base;
+} __attribute__((packed));
+
+enum {
+    CPU_OFFLINE,
+    CPU_ONLINE,
+    CPU_ABANDONED, /* missed its startup window; must stay parked */
+};
+
+static struct smp_cpu cpus[NR_CPUS];
+static uint32_t cpu_count = 1;
+static int wake_vector = -1;
+static int flush_vector = -1;
+
+/* The boot CPU's descriptor table and selectors, adopted by every AP so
+   the IDT's code selector means the same thing everywhere. */
+static struct gdt_ptr boot_gdt;
+static uint16_t boot_cs;
+static uint16_t boot_ds;
+
+void smp_early_init(void) {
+    cpus[0].id = 0;
+    cpus[0].online = CPU_ONLINE;
+    wrmsr(MSR_GS_BASE, (uint64_t)(uintptr_t)&cpus[0]);
+}
+
+uint32_t smp_num_cpus(void) {
+    return cpu_count;
+}
+EXPORT_SYMBOL(smp_num_cpus);
+
+bool smp_cpu_online(uint32_t cpu) {
+    return cpu < NR_CPUS && cpus[cpu].online == CPU_ONLINE;
+}
+EXPORT_SYMBOL(smp_cpu_online);
+
+static void load_boot_segments(void) {
+    __asm__ volatile ("lgdt %0" : : "m"(boot_gdt));
+    __asm__ volatile (
+        "pushq %q0\n\t"
+        "leaq 1f(%%rip), %%rax\n\t"
+        "pushq %%rax\n\t"
+        "lretq\n"
+        "1:\n\t"
+        "mov %w1, %%ds\n\t"
+        "mov %w1, %%es\n\t"
+        "mov %w1, %%ss"
+        : : "r"((uint64_t)boot_cs), "r"(boot_ds) : "rax", "memory");
+}
+
+static void wake_irq(struct interrupt_frame *frame, void *ctx) {
+    (void)frame;
+    (void)ctx;
+}
+
+static void flush_irq(struct interrupt_frame *frame, void *ctx) {
+    (void)frame;
+    (void)ctx;
+    paging_flush_tlb();
+    __atomic_fetch_add(&cpus[smp_processor_id()].tlb_flushes, 1, __ATOMIC_RELEASE);
+}
+
+/* Interrupts stay off between the mailbox check and cpuidle_enter();
+   its "sti; hlt" or "sti; mwait" cannot lose a wakeup because sti only
+   takes effect after the instruction that follows it. */
+static __attribute__((noreturn)) void smp_ap_idle(struct smp_cpu *c) {
+    for (;;) {
+        interrupts_disable();
+        const uint32_t seq = __atomic_load_n(&c->call_seq, __ATOMIC_ACQUIRE);
+        if (seq == c->done_seq) {
+            cpuidle_enter(0);
+            continue;
+        }
+        interrupts_enable();
+        c->call_fn(c->call_arg);
+        __atomic_store_n(&c->done_seq, seq, __ATOMIC_RELEASE);
+    }
+}
+
+__attribute__((noreturn)) void smp_ap_main(uint32_t cpu);
+
+__attribute__((noreturn)) void smp_ap_main(uint32_t cpu) {
+    struct smp_cpu *c = &cpus[cpu];
+    uint32_t expected = CPU_OFFLINE;
+    if (!__atomic_compare_exchange_n(&c->online, &expected, CPU_ONLINE, false, __ATOMIC_ACQ_REL,
+                                     __ATOMIC_ACQUIRE)) {
+        for (;;) {
+            __asm__ volatile ("cli; hlt");
+        }
+    }
+    wrmsr(MSR_GS_BASE, (uint64_t)(uintptr_t)c);
+    load_boot_segments();
+#ifdef CONFIG_USERLAND
+    process_init_ap(cpu);
+#endif
+    interrupts_init_ap();
+    smp_ap_idle(c);
+}
+
+/* The trampoline page must be RAM nobody else owns; the allocators only
+   hand out memory above 1 MiB. */
+static bool trampoline_usable(void) {
+    const struct stivale2_mmap_tag *mmap = memory_get_mmap();
+    const uint64_t size = (uint64_t)(smp_trampoline_end - smp_trampoline_start);
+    for (uint64_t i = 0; mmap && i < mmap->entries; i++) {
+        const struct stivale2_mmap_entry *e = &mmap->memmap[i];
+        if (e->type == STIVALE2_MMAP_USABLE && e->base <= SMP_TRAMPOLINE &&
+            e->base + e->length >= SMP_TRAMPOLINE + size) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void patch(const char *field, const void *value, size_t len, uint8_t *trampoline) {
+    memcpy(trampoline + (field - smp_trampoline_start), value, len);
+}
+
+static bool start_ap(uint32_t cpu, uint32_t apic_id, bool legacy, uint8_t *trampoline) {
+    struct smp_cpu *c = &cpus[cpu];
+    uint8_t *stack = bump_alloc(SMP_STACK_SIZE, 16);
+    if (!stack) {
+        return false;
+    }
+    c->id = cpu;
+    c->apic_id = apic_id;
+    const uint64_t top = (uint64_t)(uintptr_t)(stack + SMP_STACK_SIZE);
+    patch(smp_trampoline_stack, &top, sizeof(top), trampoline);
+    patch(smp_trampoline_cpu, &cpu, sizeof(cpu), trampoline);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    lapic_send_ipi(apic_id, LAPIC_ICR_INIT | LAPIC_ICR_ASSERT);
+    if (legacy) {
+        tsc_udelay(LEGACY_INIT_DELAY_US);
+    }
+    const uint32_t sipi = LAPIC_ICR_STARTUP | (SMP_TRAMPOLINE >> 12);
+    for (int attempt = 0; attempt < 2; attempt++) {
+        lapic_send_ipi(apic_id, sipi);
+        const uint64_t start = tsc_read();
+        const uint64_t wait = (attempt ? STARTUP_TIMEOUT_US : SIPI_DELAY_US) * tsc_khz() / 1000;
+        while (tsc_read() - start < wait) {
+            if (__atomic_load_n(&c->online, __ATOMIC_ACQUIRE)) {
+                return true;
+            }
+            cpu_relax();
+        }
+    }
+    /* a straggler that gets here after all finds its slot taken */
+    uint32_t expected = CPU_OFFLINE;
+    return !__atomic_compare_exchange_n(&c->online, &expected, CPU_ABANDONED, false, __ATOMIC_ACQ_REL,
+                                        __ATOMIC_ACQUIRE);
+}
+
+uint32_t smp_boot_aps(const struct cpu_info *cpu) {
+    uint32_t ids[NR_CPUS];
+    const size_t count = acpi_cpu_apic_ids(ids, NR_CPUS);
+    const uint32_t self = lapic_id();
+    cpus[0].apic_id = self;
+    if (count <= 1) {
+        return cpu_count;
+    }
+
+    uint64_t cr3;
+    __asm__ volatile ("mov %%cr3, %0" : "=r"(cr3));
+    if (cr3 >> 32 || !trampoline_usable()) {
+        pr_warn("SMP: cannot place the AP trampoline, staying on one CPU\n");
+        return cpu_count;
+    }
+    __asm__ volatile ("sgdt %0" : "=m"(boot_gdt));
+    __asm__ volatile ("mov %%cs, %0" : "=r"(boot_cs));
+    __asm__ volatile ("mov %%ss, %0" : "=r"(boot_ds));
+    wake_vector = irq_alloc_vector();
+    if (wake_vector < 0 || !irq_register((uint8_t)wake_vector, wake_irq, 0)) {
+        return cpu_count;
+    }
+    flush_vector = irq_alloc_vector();
+    if (flush_vector < 0 || !irq_register((uint8_t)flush_vector, flush_irq, 0)) {
+        return cpu_count;
+    }
+
+    uintptr_t base = SMP_TRAMPOLINE;
+    __asm__ ("" : "+r"(base)); /* hide the low constant address from -Warray-bounds */
+    uint8_t *trampoline = (uint8_t *)base;
+    memcpy(trampoline, smp_trampoline_start, (size_t)(smp_trampoline_end - smp_trampoline_start));
+    const uint32_t cr3_low = (uint32_t)cr3;
+    const uint64_t entry = (uint64_t)(uintptr_t)smp_ap_main;
+    patch(smp_trampoline_cr3, &cr3_low, sizeof(cr3_low), trampoline);
+    patch(smp_trampoline_entry, &entry, sizeof(entry), trampoline);
+
+    /* CPUs with an integrated APIC (P6 on, AMD K8 on) and virtual ones
+       take the STARTUP IPI right after INIT. */
+    const bool legacy = !cpu->hypervisor && !(cpu->is_intel && cpu->family >= 6) &&
+                        !(cpu->is_amd && cpu->family >= 0xF);
+    const uint64_t t0 = tsc_read();
+    for (size_t i = 0; i < count && cpu_count < NR_CPUS; i++) {
+        if (ids[i] == self) {
+            continue;
+        }
+        if (ids[i] > 0xFE) {
+            pr_warn("SMP: APIC ID %u needs x2APIC, skipped\n", ids[i]);
+            continue;
+        }
+        if (!start_ap(cpu_count, ids[i], legacy, trampoline)) {
+            /* it may still be reading the trampoline, so leave it alone */
+            pr_warn("SMP: CPU with APIC ID %u did not start, stopping here\n", ids[i]);
+            break;
+        }
+        cpu_count++;
+    }
+    pr_info("SMP: %u CPUs online in %lu us\n", cpu_count, tsc_cycles_to_us(tsc_read() - t0));
+    return cpu_count;
+}
+
+bool smp_call(uint32_t cpu, smp_call_fn_t fn, void *arg) {
+    if (cpu == smp_processor_id() || !smp_cpu_online(cpu)) {
+        return false;
+    }
+    struct smp_cpu *c = &cpus[cpu];
+    smp_call_wait(cpu);
+    c->call_fn = fn;
+    c->call_arg = arg;
+    __atomic_store_n(&c->call_seq, c->call_seq + 1, __ATOMIC_RELEASE);
+    smp_kick(cpu);
+    return true;
+}
+EXPORT_SYMBOL(smp_call);
+
+void smp_call_wait(uint32_t cpu) {
+    if (!smp_cpu_online(cpu)) {
+        return;
+    }
+    const struct smp_cpu *c = &cpus[cpu];
+    while (__atomic_load_n(&c->done_seq, __ATOMIC_ACQUIRE) != c->call_seq) {
+        cpu_relax();
+    }
+}
+EXPORT_SYMBOL(smp_call_wait);
+
+void smp_kick(uint32_t cpu) {
+    if (cpu == smp_processor_id() || !smp_cpu_online(cpu) || wake_vector < 0) {
+        return;
+    }
+#ifdef CONFIG_PM_STUB
+    if (cpuidle_kick(cpu)) {
+        return;
+    }
+#endif
+    lapic_send_ipi(cpus[cpu].apic_id, LAPIC_ICR_FIXED | (uint32_t)wake_vector);
+}
+EXPORT_SYMBOL(smp_kick);
+
+void smp_flush_tlb_all(void) {
+    paging_flush_tlb();
+    const uint32_t count = __atomic_load_n(&cpu_count, __ATOMIC_ACQUIRE);
+    if (count == 1) {
+        return;
+    }
+    const uint32_t self = smp_processor_id();
+    uint32_t seen[NR_CPUS];
+    for (uint32_t cpu = 0; cpu < count; cpu++) {
+        if (cpu != self) {
+            seen[cpu] = __atomic_load_n(&cpus[cpu].tlb_flushes, __ATOMIC_ACQUIRE);
+            lapic_send_ipi(cpus[cpu].apic_id, LAPIC_ICR_FIXED | (uint32_t)flush_vector);
+        }
+    }
+    for (uint32_t cpu = 0; cpu < count; cpu++) {
+        while (cpu != self && __atomic_load_n(&cpus[cpu].tlb_flushes, __ATOMIC_ACQUIRE) == seen[cpu]) {
+            cpu_relax();
+        }
+    }
+}
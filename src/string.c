@@ -1,5 +1,9 @@
 #include <stddef.h>
 
+#include "bench.h"
+#include "module.h"
+#include "string.h"
+
 size_t strlen(const char *str) {
     size_t len = 0;
     if (!str) {
@@ -10,6 +14,7 @@ size_t strlen(const char *str) {
     }
     return len;
 }
+EXPORT_SYMBOL(strlen);
 
 int strcmp(const char *lhs, const char *rhs) {
     size_t i = 0;
@@ -21,6 +26,7 @@ int strcmp(const char *lhs, const char *rhs) {
     }
     return (unsigned char)lhs[i] - (unsigned char)rhs[i];
 }
+EXPORT_SYMBOL(strcmp);
 
 int strncmp(const char *lhs, const char *rhs, size_t count) {
     for (size_t i = 0; i < count; i++) {
@@ -33,3 +39,34 @@ int strncmp(const char *lhs, const char *rhs, size_t count) {
     }
     return 0;
 }
+EXPORT_SYMBOL(strncmp);
+
+#ifdef CONFIG_MICROBENCH
+static const char bench_str[] = "the quick brown fox jumps over the lazy dog, twice: the quick fox";
+
+static void bench_strlen_64(uint64_t loops) {
+    for (uint64_t i = 0; i < loops; i++) {
+        const char *s = bench_str;
+        bench_clobber(s);
+        const size_t len = strlen(s);
+        bench_clobber(&len);
+    }
+}
+
+BENCH(string, strlen_64, bench_strlen_64);
+
+static void bench_strcmp_64(uint64_t loops) {
+    static char copy[sizeof(bench_str)];
+    for (size_t i = 0; i < sizeof(bench_str); i++) {
+        copy[i] = bench_str[i];
+    }
+    for (uint64_t i = 0; i < loops; i++) {
+        const char *s = copy;
+        bench_clobber(s);
+        const int r = strcmp(bench_str, s);
+        bench_clobber(&r);
+    }
+}
+
+BENCH(string, strcmp_64, bench_strcmp_64);
+#endif
@@ -0,0 +1,109 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "console.h"
+#include "cpu.h"
+#include "gdt.h"
+#include "interrupts.h"
+#include "process.h"
+#include "syscall.h"
+#include "vdso.h"
+
+#ifdef CONFIG_USERLAND
+
+#define MSR_EFER 0xC0000080
+#define MSR_STAR 0xC0000081
+#define MSR_LSTAR 0xC0000082
+#define MSR_FMASK 0xC0000084
+#define MSR_KERNEL_GS_BASE 0xC0000102
+#define EFER_SCE 0x1
+
+#define RFLAGS_TF 0x100
+#define RFLAGS_IF 0x200
+#define RFLAGS_DF 0x400
+#define RFLAGS_AC 0x40000
+
+#define WRITE_CHUNK 256
+
+typedef long (*syscall_fn_t)(uint64_t a0, uint64_t a1, uint64_t a2);
+
+extern const char syscall_entry[];
+
+void syscall_init_cpu(void);
+void syscall_dispatch(struct interrupt_frame *frame);
+
+/* SYSRET takes user SS from STAR[63:48] + 8 and CS from + 16; SYSCALL
+   takes the kernel's from STAR[47:32] and + 8. */
+void syscall_init_cpu(void) {
+    wrmsr(MSR_EFER, rdmsr(MSR_EFER) | EFER_SCE);
+    wrmsr(MSR_STAR, ((uint64_t)GDT_USER_CS32 << 48) | ((uint64_t)GDT_KERNEL_CS << 32));
+    wrmsr(MSR_LSTAR, (uint64_t)(uintptr_t)syscall_entry);
+    wrmsr(MSR_FMASK, RFLAGS_TF | RFLAGS_IF | RFLAGS_DF | RFLAGS_AC);
+    /* swapgs on entry moves the kernel's base here while ring 3 runs */
+    wrmsr(MSR_KERNEL_GS_BASE, 0);
+}
+
+static long sys_exit(uint64_t status, uint64_t a1, uint64_t a2) {
+    (void)a1;
+    (void)a2;
+    process_exit((int)status);
+}
+
+static long sys_write(uint64_t fd, uint64_t buf, uint64_t len) {
+    if (fd != 1 && fd != 2) {
+        return SYSCALL_EBADF;
+    }
+    char chunk[WRITE_CHUNK + 1];
+    for (uint64_t done = 0; done < len;) {
+        const size_t n = len - done < WRITE_CHUNK ? (size_t)(len - done) : WRITE_CHUNK;
+        if (!user_copy_from(chunk, buf + done, n)) {
+            return done ? (long)done : SYSCALL_EFAULT;
+        }
+        chunk[n] = '\0';
+        console_write(chunk);
+        done += n;
+    }
+    return (long)len;
+}
+
+static long sys_getpid(uint64_t a0, uint64_t a1, uint64_t a2) {
+    (void)a0;
+    (void)a1;
+    (void)a2;
+    return (long)process_current()->pid;
+}
+
+static long sys_yield(uint64_t a0, uint64_t a1, uint64_t a2) {
+    (void)a0;
+    (void)a1;
+    (void)a2;
+    return (long)process_yield();
+}
+
+static long sys_clock_gettime(uint64_t a0, uint64_t a1, uint64_t a2) {
+    (void)a0;
+    (void)a1;
+    (void)a2;
+    const struct vdso_data *vd = vdso_data();
+    return vd ? (long)vdso_clock_ns(vd) : SYSCALL_ENOSYS;
+}
+
+static const syscall_fn_t syscall_table[NR_SYSCALLS] = {
+    [SYS_exit] = sys_exit,
+    [SYS_write] = sys_write,
+    [SYS_getpid] = sys_getpid,
+    [SYS_yield] = sys_yield,
+    [SYS_clock_gettime] = sys_clock_gettime,
+};
+
+void syscall_dispatch(struct interrupt_frame *frame) {
+    const uint64_t nr = frame->rax;
+    if (nr >= NR_SYSCALLS) {
+        frame->rax = (uint64_t)SYSCALL_ENOSYS;
+        return;
+    }
+    frame->rax = (uint64_t)syscall_table[nr](frame->rdi, frame->rsi, frame->rdx);
+}
+
+#endif /* CONFIG_USERLAND */
@@ -0,0 +1,131 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "memory.h"
+#include "serial.h"
+#include "smp.h"
+#include "string.h"
+#include "trace.h"
+#include "tsc.h"
+
+struct trace_cpu {
+    struct trace_record *records;
+    uint64_t head; /* records ever written */
+} __attribute__((aligned(64)));
+
+volatile uint8_t trace_event_enabled[TRACE_NR_EVENTS];
+
+static const struct trace_event_desc event_descs[TRACE_NR_EVENTS] = {
+#define TRACE_EVENT(name, phase, a0, a1, a2) { TRACE_ID_##name, phase, #name, { a0, a1, a2 } },
+#include "trace_events.h"
+#undef TRACE_EVENT
+};
+
+static struct trace_cpu trace_cpus[NR_CPUS];
+
+/* Interrupts and NMIs may trace in the middle of a write on the same CPU,
+   so the slot is claimed atomically before it is filled. */
+void trace_write(uint32_t id, uint64_t a0, uint64_t a1, uint64_t a2) {
+    struct trace_cpu *tc = &trace_cpus[smp_processor_id()];
+    if (!tc->records) {
+        return;
+    }
+    const uint64_t pos = __atomic_fetch_add(&tc->head, 1, __ATOMIC_RELAXED);
+    struct trace_record *r = &tc->records[pos & (TRACE_RECORDS_PER_CPU - 1)];
+    r->tsc = tsc_read();
+    r->id = id;
+    r->pad = 0;
+    r->args[0] = a0;
+    r->args[1] = a1;
+    r->args[2] = a2;
+}
+
+bool trace_cpu_init(uint32_t cpu) {
+    struct trace_cpu *tc = &trace_cpus[cpu];
+    if (!tc->records) {
+        tc->records = bump_alloc(TRACE_RECORDS_PER_CPU * sizeof(struct trace_record), 64);
+    }
+    return tc->records != 0;
+}
+
+/* token is "all", a full event name, or a subsystem: the part of an
+   event name before its first '_'. */
+static bool spec_matches(const char *name, const char *token, size_t len) {
+    if (len == 3 && strncmp(token, "all", 3) == 0) {
+        return true;
+    }
+    if (strncmp(name, token, len) != 0) {
+        return false;
+    }
+    if (name[len] == '\0') {
+        return true;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (token[i] == '_') {
+            return false;
+        }
+    }
+    return name[len] == '_';
+}
+
+uint32_t trace_enable(const char *spec) {
+    uint32_t enabled = 0;
+    while (*spec) {
+        size_t len = 0;
+        while (spec[len] && spec[len] != ',') {
+            len++;
+        }
+        for (uint32_t id = 0; id < TRACE_NR_EVENTS; id++) {
+            if (len && !trace_event_enabled[id] && spec_matches(event_descs[id].name, spec, len)) {
+                trace_event_enabled[id] = 1;
+                enabled++;
+            }
+        }
+        spec += spec[len] ? len + 1 : len;
+    }
+    return enabled;
+}
+
+void trace_disable_all(void) {
+    for (uint32_t id = 0; id < TRACE_NR_EVENTS; id++) {
+        trace_event_enabled[id] = 0;
+    }
+}
+
+bool trace_dump(void) {
+    if (!serial_aux_init()) {
+        return false;
+    }
+    uint32_t cpus = 0;
+    for (uint32_t cpu = 0; cpu < NR_CPUS; cpu++) {
+        cpus += trace_cpus[cpu].records != 0;
+    }
+    struct trace_file_header h = {
+        .nr_events = TRACE_NR_EVENTS,
+        .nr_cpus = cpus,
+        .tsc_khz = tsc_khz(),
+    };
+    memcpy(h.magic, TRACE_MAGIC, sizeof(h.magic));
+    serial_aux_write(&h, sizeof(h));
+    serial_aux_write(event_descs, sizeof(event_descs));
+
+    for (uint32_t cpu = 0; cpu < NR_CPUS; cpu++) {
+        const struct trace_cpu *tc = &trace_cpus[cpu];
+        if (!tc->records) {
+            continue;
+        }
+        const uint64_t head = tc->head;
+        const uint64_t first = head > TRACE_RECORDS_PER_CPU ? head - TRACE_RECORDS_PER_CPU : 0;
+        const struct trace_cpu_header ch = {
+            .cpu = cpu,
+            .count = (uint32_t)(head - first),
+            .overwritten = first,
+        };
+        serial_aux_write(&ch, sizeof(ch));
+        for (uint64_t pos = first; pos < head; pos++) {
+            serial_aux_write(&tc->records[pos & (TRACE_RECORDS_PER_CPU - 1)], sizeof(struct trace_record));
+        }
+    }
+    return true;
+}
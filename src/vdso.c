@@ -0,0 +1,39 @@
+#include <stdint.h>
+
+#include "cpu.h"
+#include "log.h"
+#include "memory.h"
+#include "paging.h"
+#include "tsc.h"
+#include "vdso.h"
+
+#ifdef CONFIG_USERLAND
+
+static struct vdso_data *vdso;
+
+void vdso_init(const struct cpu_info *cpu) {
+    vdso = page_alloc();
+    if (!vdso) {
+        pr_err("vdso: out of memory\n");
+        return;
+    }
+    memset(vdso, 0, PAGE_SIZE);
+    vdso->cpu = *cpu;
+    vdso->tsc_khz = tsc_khz();
+    vdso->shift = VDSO_SHIFT;
+    vdso->mult = (1000000ULL << VDSO_SHIFT) / vdso->tsc_khz;
+    vdso_set_clock(tsc_boot(), 0);
+    if (!cpu->tsc_invariant) {
+        pr_warn("vdso: TSC not invariant, user clock may drift across idle states\n");
+    }
+}
+
+void vdso_set_clock(uint64_t tsc, uint64_t ns) {
+    vdso_write_clock(vdso, tsc, ns);
+}
+
+const struct vdso_data *vdso_data(void) {
+    return vdso;
+}
+
+#endif /* CONFIG_USERLAND */
@@ -0,0 +1,225 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "string.h"
+
+#include "block.h"
+#include "console.h"
+#include "log.h"
+#include "memory.h"
+#include "page_cache.h"
+#include "vfs.h"
+
+#define VFS_MAX_FILESYSTEMS 4
+#define DCACHE_BUCKETS 256
+#define DCACHE_MAX_ENTRIES 4096
+
+struct dentry {
+    struct dentry *parent;
+    struct dentry *hash_next;
+    struct inode *inode;     /* NULL caches a failed lookup */
+    uint8_t len;
+    char name[VFS_NAME_MAX + 1];
+};
+
+struct mount {
+    char path[32];
+    size_t len;
+    struct dentry *root;
+};
+
+static const struct filesystem_type *filesystems[VFS_MAX_FILESYSTEMS];
+static size_t filesystem_count = 0;
+static struct mount mounts[VFS_MAX_MOUNTS];
+static size_t mount_count = 0;
+
+static struct object_pool dentry_pool = OBJECT_POOL("dentry", struct dentry);
+static struct dentry *dcache[DCACHE_BUCKETS];
+static struct vfs_stats stats;
+
+static uint32_t dentry_hash(const struct dentry *parent, const char *name, size_t len) {
+    uint32_t h = 2166136261u ^ (uint32_t)((uintptr_t)parent >> 4);
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (uint8_t)name[i]) * 16777619u;
+    }
+    return h % DCACHE_BUCKETS;
+}
+
+static struct dentry *dentry_alloc(struct dentry *parent, const char *name, size_t len, struct inode *inode) {
+    struct dentry *d = pool_alloc(&dentry_pool);
+    if (!d) {
+        return 0;
+    }
+    d->parent = parent;
+    d->hash_next = 0;
+    d->inode = inode;
+    d->len = (uint8_t)len;
+    memcpy(d->name, name, len);
+    d->name[len] = '\0';
+    return d;
+}
+
+static struct dentry *dcache_find(struct dentry *parent, const char *name, size_t len) {
+    for (struct dentry *d = dcache[dentry_hash(parent, name, len)]; d; d = d->hash_next) {
+        if (d->parent == parent && d->len == len && memcmp(d->name, name, len) == 0) {
+            return d;
+        }
+    }
+    return 0;
+}
+
+/* Look a component up in the dcache, falling back to the filesystem and
+   remembering the answer (negative ones too) for next time. */
+static struct dentry *lookup_component(struct dentry *parent, const char *name, size_t len) {
+    struct dentry *d = dcache_find(parent, name, len);
+    if (d) {
+        stats.dcache_hits++;
+        return d;
+    }
+    stats.dcache_misses++;
+
+    struct inode *dir = parent->inode;
+    if (!dir || !vfs_is_dir(dir) || !dir->i_op || !dir->i_op->lookup) {
+        return 0;
+    }
+    struct inode *inode = dir->i_op->lookup(dir, name, len);
+    if (stats.dentries >= DCACHE_MAX_ENTRIES) {
+        /* cache full: answer without remembering */
+        static struct dentry scratch;
+        scratch.parent = parent;
+        scratch.inode = inode;
+        return &scratch;
+    }
+
+    d = dentry_alloc(parent, name, len, inode);
+    if (!d) {
+        return 0;
+    }
+    uint32_t bucket = dentry_hash(parent, name, len);
+    d->hash_next = dcache[bucket];
+    dcache[bucket] = d;
+    stats.dentries++;
+    return d;
+}
+
+bool vfs_register_filesystem(const struct filesystem_type *fs) {
+    if (!fs || filesystem_count >= VFS_MAX_FILESYSTEMS) {
+        return false;
+    }
+    filesystems[filesystem_count++] = fs;
+    return true;
+}
+
+bool vfs_mount(struct block_device *dev, const char *path) {
+    size_t len = strlen(path);
+    if (mount_count >= VFS_MAX_MOUNTS || len >= sizeof(mounts[0].path)) {
+        return false;
+    }
+    for (size_t i = 0; i < filesystem_count; i++) {
+        struct inode *root = filesystems[i]->mount(dev);
+        if (!root) {
+            continue;
+        }
+        struct mount *m = &mounts[mount_count];
+        memcpy(m->path, path, len + 1);
+        while (len > 1 && m->path[len - 1] == '/') {
+            m->path[--len] = '\0';
+        }
+        m->len = len;
+        m->root = dentry_alloc(0, "/", 1, root);
+        if (!m->root) {
+            return false;
+        }
+        mount_count++;
+        pr_info("vfs: mounted %s (%s) on %s\n", dev->name, filesystems[i]->name, m->path);
+        return true;
+    }
+    return false;
+}
+
+/* Try every registered filesystem on every block device, mounting hits on
+   /mnt/<device>. */
+void vfs_automount(void) {
+    char path[16] = "/mnt/";
+    struct block_device *dev;
+    for (size_t i = 0; (dev = block_device_at(i)) != 0; i++) {
+        size_t n = strlen(dev->name);
+        memcpy(path + 5, dev->name, n + 1);
+        vfs_mount(dev, path);
+    }
+}
+
+static struct mount *find_mount(const char *path, const char **rest) {
+    struct mount *best = 0;
+    for (size_t i = 0; i < mount_count; i++) {
+        struct mount *m = &mounts[i];
+        bool root_mount = m->len == 1 && m->path[0] == '/';
+        if (strncmp(path, m->path, m->len) != 0) {
+            continue;
+        }
+        if (!root_mount && path[m->len] != '/' && path[m->len] != '\0') {
+            continue;
+        }
+        if (!best || m->len > best->len) {
+            best = m;
+        }
+    }
+    if (best) {
+        *rest = path + (best->len == 1 ? 0 : best->len);
+    }
+    return best;
+}
+
+struct inode *vfs_lookup(const char *path) {
+    if (!path || path[0] != '/') {
+        return 0;
+    }
+    const char *p = path;
+    struct mount *m = find_mount(path, &p);
+    if (!m) {
+        return 0;
+    }
+
+    struct dentry *d = m->root;
+    while (*p) {
+        while (*p == '/') {
+            p++;
+        }
+        if (!*p) {
+            break;
+        }
+        const char *name = p;
+        while (*p && *p != '/') {
+            p++;
+        }
+        size_t len = (size_t)(p - name);
+        if (len > VFS_NAME_MAX) {
+            return 0;
+        }
+        if (len == 1 && name[0] == '.') {
+            continue;
+        }
+        if (len == 2 && name[0] == '.' && name[1] == '.') {
+            d = d->parent ? d->parent : d;
+            continue;
+        }
+        d = lookup_component(d, name, len);
+        if (!d || !d->inode) {
+            return 0;
+        }
+    }
+    return d->inode;
+}
+
+size_t vfs_read(struct inode *inode, uint64_t offset, void *buf, size_t len) {
+    if (!inode || vfs_is_dir(inode)) {
+        return 0;
+    }
+    return page_cache_read(inode, offset, buf, len);
+}
+
+void vfs_get_stats(struct vfs_stats *out) {
+    if (out) {
+        *out = stats;
+    }
+}
@@ -0,0 +1,104 @@
+/*
+ * Random sequences of bump, page and pool operations. Every live block is
+ * filled with its own tag and checked when it is freed, so overlapping
+ * or reused-while-live memory shows up as a mismatch.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host.h"
+
+#define ARENA_SIZE (16u << 20)
+#define MAX_LIVE 256
+
+struct block {
+    uint8_t *p;
+    size_t size;
+    int pool; /* -1 for whole pages */
+    uint8_t tag;
+};
+
+static struct object_pool pools[] = {
+    OBJECT_POOL("fuzz16", char[16]),
+    OBJECT_POOL("fuzz48", char[40]),
+    OBJECT_POOL("fuzz512", char[500]),
+};
+
+static uint8_t *arena;
+static struct block live[MAX_LIVE];
+static size_t nr_live;
+
+static void check_range(const uint8_t *p, size_t size) {
+    if (p < arena || p + size > arena + ARENA_SIZE) {
+        abort();
+    }
+}
+
+static void track(uint8_t *p, size_t size, int pool, uint8_t tag) {
+    check_range(p, size);
+    memset(p, tag, size);
+    live[nr_live++] = (struct block){ p, size, pool, tag };
+}
+
+static void release(size_t i) {
+    struct block *b = &live[i];
+    for (size_t j = 0; j < b->size; j++) {
+        if (b->p[j] != b->tag) {
+            abort();
+        }
+    }
+    if (b->pool < 0) {
+        page_free(b->p);
+    } else {
+        pool_free(&pools[b->pool], b->p);
+    }
+    live[i] = live[--nr_live];
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    if (!arena) {
+        arena = host_memory_init(ARENA_SIZE, NULL);
+        if (!arena) {
+            return 0;
+        }
+    }
+    for (size_t i = 0; i + 1 < size; i += 2) {
+        const uint8_t op = data[i] % 5;
+        const uint8_t arg = data[i + 1];
+        if (op == 0 && nr_live < MAX_LIVE) {
+            uint8_t *p = page_alloc();
+            if (p) {
+                if ((uintptr_t)p & 4095) {
+                    abort();
+                }
+                track(p, 4096, -1, arg);
+            }
+        } else if (op == 1 && nr_live < MAX_LIVE) {
+            const int pool = arg % 3;
+            uint8_t *p = pool_alloc(&pools[pool]);
+            if (p) {
+                track(p, pools[pool].object_size, pool, arg);
+            }
+        } else if (op == 2 && nr_live) {
+            release(arg % nr_live);
+        } else if (op == 3) {
+            /* bump memory is never returned; only placement is checked */
+            const size_t align = (size_t)1 << (arg % 13);
+            uint8_t *p = bump_alloc(arg, align);
+            if (p) {
+                check_range(p, arg);
+                if ((uintptr_t)p & (align - 1)) {
+                    abort();
+                }
+            }
+        } else if (op == 4 && memory_free_pages() > ARENA_SIZE / 4096) {
+            abort();
+        }
+    }
+    while (nr_live) {
+        release(nr_live - 1);
+    }
+    return 0;
+}
@@ -0,0 +1,162 @@
+/*
+ * The module loader's ELF validator. Input is either a raw image or a
+ * list of byte patches to a small valid object, which reaches the section,
+ * symbol and relocation checks far more often than random bytes. Whatever
+ * elf_check_rel() accepts is then walked the way module.c uses it: the
+ * image and the section block are exactly sized, so ASan reports any
+ * access the validator should have refused.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "elf.h"
+#include "host.h"
+
+#define TEXT_OFF 384
+#define SYMTAB_OFF 400
+#define RELA_OFF 472
+#define STRTAB_OFF 520 /* last, so an unterminated name runs off the image */
+#define TEMPLATE_SIZE 530
+
+static uint8_t template[TEMPLATE_SIZE] __attribute__((aligned(8)));
+
+static void build_template(void) {
+    Elf64_Ehdr *eh = (Elf64_Ehdr *)template;
+    memcpy(eh->e_ident, ELF_MAGIC, 4);
+    eh->e_ident[4] = ELFCLASS64;
+    eh->e_ident[5] = ELFDATA2LSB;
+    eh->e_type = ET_REL;
+    eh->e_machine = EM_X86_64;
+    eh->e_shoff = sizeof(*eh);
+    eh->e_shentsize = sizeof(Elf64_Shdr);
+    eh->e_shnum = 5;
+
+    Elf64_Shdr *sh = (Elf64_Shdr *)(template + eh->e_shoff);
+    sh[1] = (Elf64_Shdr){ .sh_type = SHT_PROGBITS, .sh_flags = SHF_ALLOC | SHF_EXECINSTR, .sh_offset = TEXT_OFF,
+                          .sh_size = 16, .sh_addralign = 16 };
+    sh[2] = (Elf64_Shdr){ .sh_type = SHT_SYMTAB, .sh_offset = SYMTAB_OFF, .sh_size = 3 * sizeof(Elf64_Sym),
+                          .sh_link = 3, .sh_info = 1, .sh_addralign = 8, .sh_entsize = sizeof(Elf64_Sym) };
+    sh[3] = (Elf64_Shdr){ .sh_type = SHT_STRTAB, .sh_offset = STRTAB_OFF, .sh_size = 10, .sh_addralign = 1 };
+    sh[4] = (Elf64_Shdr){ .sh_type = SHT_RELA, .sh_flags = SHF_INFO_LINK, .sh_offset = RELA_OFF,
+                          .sh_size = 2 * sizeof(Elf64_Rela), .sh_link = 2, .sh_info = 1, .sh_addralign = 8,
+                          .sh_entsize = sizeof(Elf64_Rela) };
+
+    Elf64_Sym *syms = (Elf64_Sym *)(template + SYMTAB_OFF);
+    syms[1] = (Elf64_Sym){ .st_name = 1, .st_info = STB_GLOBAL << 4, .st_shndx = 1 };
+    syms[2] = (Elf64_Sym){ .st_name = 6, .st_info = STB_GLOBAL << 4, .st_shndx = SHN_UNDEF };
+    memcpy(template + STRTAB_OFF, "\0init\0ext", 10);
+
+    Elf64_Rela *r = (Elf64_Rela *)(template + RELA_OFF);
+    r[0] = (Elf64_Rela){ 1, ((uint64_t)2 << 32) | R_X86_64_PLT32, -4 };
+    r[1] = (Elf64_Rela){ 8, ((uint64_t)1 << 32) | R_X86_64_64, 0 };
+}
+
+static uint32_t width_of(uint32_t type) {
+    switch (type) {
+    case R_X86_64_NONE:
+        return 0;
+    case R_X86_64_64:
+    case R_X86_64_PC64:
+        return 8;
+    case R_X86_64_32:
+    case R_X86_64_32S:
+    case R_X86_64_PC32:
+    case R_X86_64_PLT32:
+        return 4;
+    default:
+        abort();
+    }
+}
+
+/* What load_module() touches once the image has been accepted. */
+static void walk(const uint8_t *image) {
+    const Elf64_Ehdr *eh = (const Elf64_Ehdr *)image;
+    const Elf64_Shdr *sh = (const Elf64_Shdr *)(image + eh->e_shoff);
+    uint64_t *addr = calloc(eh->e_shnum + 1, sizeof(*addr));
+    uint64_t total = 0;
+    for (uint16_t i = 0; i < eh->e_shnum; i++) {
+        const uint64_t align = sh[i].sh_addralign ? sh[i].sh_addralign : 1;
+        /* the block is page aligned; a larger alignment cannot be kept */
+        if ((align & (align - 1)) || align > 4096) {
+            abort();
+        }
+        if (sh[i].sh_flags & SHF_ALLOC) {
+            total = (total + align - 1) & ~(align - 1);
+            addr[i] = total;
+            total += sh[i].sh_size;
+        }
+    }
+    /* an image may declare more NOBITS than the kernel could place */
+    uint8_t *block = total <= (1u << 20) ? malloc(total ? total : 1) : NULL;
+
+    uint16_t symndx = 0;
+    while (sh[symndx].sh_type != SHT_SYMTAB) {
+        symndx++;
+    }
+    const Elf64_Sym *syms = (const Elf64_Sym *)(image + sh[symndx].sh_offset);
+    const char *strings = (const char *)(image + sh[sh[symndx].sh_link].sh_offset);
+    const uint64_t strings_size = sh[sh[symndx].sh_link].sh_size;
+    const size_t nsyms = sh[symndx].sh_size / sizeof(Elf64_Sym);
+    for (size_t i = 1; i < nsyms; i++) {
+        if (syms[i].st_name + strlen(strings + syms[i].st_name) >= strings_size) {
+            abort();
+        }
+        if (syms[i].st_shndx < SHN_LORESERVE && syms[i].st_shndx >= eh->e_shnum) {
+            abort();
+        }
+    }
+
+    for (uint16_t i = 0; block && i < eh->e_shnum; i++) {
+        if (sh[i].sh_type != SHT_RELA || sh[i].sh_info >= eh->e_shnum || !(sh[sh[i].sh_info].sh_flags & SHF_ALLOC)) {
+            continue;
+        }
+        const Elf64_Rela *r = (const Elf64_Rela *)(image + sh[i].sh_offset);
+        for (size_t j = 0; j < sh[i].sh_size / sizeof(*r); j++) {
+            if (ELF64_R_SYM(r[j].r_info) >= nsyms) {
+                abort();
+            }
+            memset(block + addr[sh[i].sh_info] + r[j].r_offset, 0xAA, width_of(ELF64_R_TYPE(r[j].r_info)));
+        }
+    }
+    free(block);
+    free(addr);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    static int initialized;
+    if (!initialized) {
+        build_template();
+        if (elf_check_rel(template, sizeof(template))) {
+            abort();
+        }
+        initialized = 1;
+    }
+
+    size_t len = size;
+    const uint8_t *src = data;
+    uint8_t patched[TEMPLATE_SIZE];
+    if (size && (data[0] & 1) == 0) {
+        /* up to four (offset lo, offset hi, xor) triples against the
+           template; more would rarely leave it loadable */
+        memcpy(patched, template, sizeof(patched));
+        const size_t end = 1 + 3 * (size_t)((data[0] >> 1) % 4 + 1);
+        for (size_t i = 1; i + 2 < size && i < end; i += 3) {
+            patched[(data[i] | data[i + 1] << 8) % TEMPLATE_SIZE] ^= data[i + 2];
+        }
+        src = patched;
+        len = sizeof(patched);
+    }
+
+    /* exactly len bytes, so any read past the image is reported */
+    uint8_t *image = malloc(len ? len : 1);
+    if (!image) {
+        return 0;
+    }
+    memcpy(image, src, len);
+    if (!elf_check_rel(image, len)) {
+        walk(image);
+    }
+    free(image);
+    return 0;
+}
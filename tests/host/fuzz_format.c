@@ -0,0 +1,43 @@
+/* Arbitrary format strings through the kernel's snprintf(); every
+   conversion gets a valid string argument, so %s and %p are safe and the
+   integer conversions print its address bits. */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host.h"
+
+#define MAX_ARGS 16
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    char *fmt = malloc(size + 1);
+    if (!fmt) {
+        return 0;
+    }
+    memcpy(fmt, data, size);
+    fmt[size] = '\0';
+    /* each % takes an argument, and so does each * width or precision */
+    size_t consumed = 0;
+    for (size_t i = 0; i < size; i++) {
+        consumed += fmt[i] == '%' || fmt[i] == '*';
+    }
+    if (consumed > MAX_ARGS) {
+        free(fmt);
+        return 0;
+    }
+
+    static const char arg[] = "arg";
+    const size_t room = size * 20 + 1;
+    char *out = malloc(room);
+    if (out) {
+        const int n = ksnprintf(out, room, fmt, arg, arg, arg, arg, arg, arg, arg, arg, arg, arg, arg, arg, arg,
+                                arg, arg, arg);
+        const size_t len = strlen(out);
+        if (n < 0 || len >= room || len > (size_t)n) {
+            abort();
+        }
+        free(out);
+    }
+    free(fmt);
+    return 0;
+}
@@ -0,0 +1,93 @@
+/*
+ * Stand-in for libFuzzer when the compiler has none: replays the files
+ * named on the command line, or runs -runs=N random inputs of up to
+ * -max_len=N bytes from -seed=N, under the same sanitizers.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static int run_file(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return 1;
+    }
+    uint8_t *buf = NULL;
+    size_t len = 0;
+    size_t cap = 0;
+    int c;
+    while ((c = fgetc(f)) != EOF) {
+        if (len == cap) {
+            cap = cap ? cap * 2 : 4096;
+            uint8_t *grown = realloc(buf, cap);
+            if (!grown) {
+                free(buf);
+                fclose(f);
+                return 1;
+            }
+            buf = grown;
+        }
+        buf[len++] = (uint8_t)c;
+    }
+    fclose(f);
+    LLVMFuzzerTestOneInput(buf, len);
+    free(buf);
+    return 0;
+}
+
+/* Favor the bytes the targets branch on so short runs still reach them. */
+static uint8_t random_byte(void) {
+    static const char interesting[] = "%sx%\0/etc/motd";
+    const int r = rand();
+    if (r % 4 == 0) {
+        return (uint8_t)interesting[(r >> 2) % (sizeof(interesting) - 1)];
+    }
+    return (uint8_t)(r >> 8);
+}
+
+int main(int argc, char **argv) {
+    unsigned long runs = 100000;
+    unsigned long max_len = 256;
+    unsigned seed = 1;
+    int files = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "-runs=", 6) == 0) {
+            runs = strtoul(argv[i] + 6, NULL, 10);
+        } else if (strncmp(argv[i], "-max_len=", 9) == 0) {
+            max_len = strtoul(argv[i] + 9, NULL, 10);
+        } else if (strncmp(argv[i], "-seed=", 6) == 0) {
+            seed = (unsigned)strtoul(argv[i] + 6, NULL, 10);
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "%s: ignoring %s\n", argv[0], argv[i]);
+        } else {
+            files++;
+            if (run_file(argv[i])) {
+                return 1;
+            }
+        }
+    }
+    if (files) {
+        printf("%s: %d inputs replayed\n", argv[0], files);
+        return 0;
+    }
+
+    srand(seed);
+    uint8_t *buf = malloc(max_len + 1);
+    if (!buf) {
+        return 1;
+    }
+    for (unsigned long r = 0; r < runs; r++) {
+        const size_t len = max_len ? (size_t)rand() % (max_len + 1) : 0;
+        for (size_t i = 0; i < len; i++) {
+            buf[i] = random_byte();
+        }
+        LLVMFuzzerTestOneInput(buf, len);
+    }
+    free(buf);
+    printf("%s: %lu random inputs, seed %u\n", argv[0], runs, seed);
+    return 0;
+}
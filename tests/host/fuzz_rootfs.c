@@ -0,0 +1,37 @@
+/* rootfs lookups with arbitrary paths: a hit must be an exact match. */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host.h"
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    static bool initialized;
+    if (!initialized) {
+        rootfs_init();
+        initialized = true;
+    }
+    char *path = malloc(size + 1);
+    if (!path) {
+        return 0;
+    }
+    memcpy(path, data, size);
+    path[size] = '\0';
+
+    const char *content = NULL;
+    size_t len = 0;
+    if (rootfs_read(path, &content, &len)) {
+        size_t count = 0;
+        const struct rootfs_entry *list = rootfs_entries(&count);
+        bool found = false;
+        for (size_t i = 0; i < count; i++) {
+            found |= strcmp(list[i].path, path) == 0 && list[i].data == content && list[i].size == len;
+        }
+        if (!found) {
+            abort();
+        }
+    }
+    free(path);
+    return 0;
+}
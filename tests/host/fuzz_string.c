@@ -0,0 +1,49 @@
+/* kstr* and kmem* against the C library on two strings cut from the input. */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host.h"
+
+static int sign(int v) {
+    return (v > 0) - (v < 0);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    char *buf = malloc(size + 2);
+    if (!buf) {
+        return 0;
+    }
+    memcpy(buf, data, size);
+    buf[size] = '\0';
+    buf[size + 1] = '\0';
+    const char *a = buf;
+    const char *b = buf + strlen(buf) + 1;
+    const size_t n = size ? data[0] : 0;
+
+    if (kstrlen(a) != strlen(a) || kstrlen(b) != strlen(b) ||
+        sign(kstrcmp(a, b)) != sign(strcmp(a, b)) ||
+        sign(kstrncmp(a, b, n)) != sign(strncmp(a, b, n))) {
+        abort();
+    }
+
+    const size_t half = size / 2;
+    if (sign(kmemcmp(data, data + half, half)) != sign(memcmp(data, data + half, half))) {
+        abort();
+    }
+    uint8_t *dst = malloc(size + 1);
+    if (dst) {
+        if (kmemcpy(dst, data, size) != dst || memcmp(dst, data, size) != 0) {
+            abort();
+        }
+        kmemset(dst, n, size);
+        for (size_t i = 0; i < size; i++) {
+            if (dst[i] != (uint8_t)n) {
+                abort();
+            }
+        }
+        free(dst);
+    }
+    free(buf);
+    return 0;
+}
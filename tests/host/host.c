@@ -0,0 +1,71 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host.h"
+#include "stivale2.h"
+
+#define STIVALE2_STRUCT_TAG_MEMMAP_ID 0x2187f79e8612de07ULL
+
+/* provided by boot.S and link.ld in the kernel */
+uint32_t multiboot_magic;
+uint32_t multiboot_info;
+char __kernel_end[1];
+
+/* log.c rate limits against the TSC; report it uncalibrated */
+uint64_t tsc_khz(void) {
+    return 0;
+}
+
+
+static struct {
+    struct stivale2_mmap_tag tag;
+    struct stivale2_mmap_entry entry;
+} host_mmap;
+static struct stivale2_struct_tag_cmdline host_cmdline;
+static struct stivale2_struct host_boot;
+
+uint8_t *host_memory_init(size_t size, const char *cmdline) {
+    static uint8_t *arena;
+    static size_t arena_size;
+    if (arena_size < size) {
+        free(arena);
+        arena = aligned_alloc(4096, size);
+        arena_size = arena ? size : 0;
+        if (!arena) {
+            return NULL;
+        }
+    }
+    host_mmap.tag.tag.identifier = STIVALE2_STRUCT_TAG_MEMMAP_ID;
+    host_mmap.tag.tag.next = 0;
+    host_mmap.tag.entries = 1;
+    host_mmap.entry.base = (uint64_t)(uintptr_t)arena;
+    host_mmap.entry.length = size;
+    host_mmap.entry.type = STIVALE2_MMAP_USABLE;
+    host_boot.tags = (uint64_t)(uintptr_t)&host_mmap;
+    if (cmdline) {
+        host_cmdline.tag.identifier = STIVALE2_STRUCT_TAG_CMDLINE_ID;
+        host_cmdline.tag.next = 0;
+        host_cmdline.cmdline = (uint64_t)(uintptr_t)cmdline;
+        host_mmap.tag.tag.next = (uint64_t)(uintptr_t)&host_cmdline;
+    }
+    memory_init(&host_boot);
+    return arena;
+}
+
+static void flush_stdout(struct format_buf *b) {
+    fwrite(b->data, 1, b->len, stdout);
+    b->len = 0;
+}
+
+/* kernel code logs through kprint(); on the host it goes to stdout */
+void kprint(const char *fmt, ...) {
+    char buf[256];
+    struct format_buf b = { buf, sizeof(buf), 0, flush_stdout };
+    va_list args;
+    va_start(args, fmt);
+    vformat(&b, fmt, args);
+    va_end(args);
+    flush_stdout(&b);
+}
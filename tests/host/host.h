@@ -0,0 +1,33 @@
+/*
+ * What the tests, fuzzers and benchmarks see of the kernel libraries.
+ * The kernel's mem, str and snprintf functions are compiled as k-prefixed
+ * symbols (see KERNEL_CFLAGS in the Makefile) so they never replace the C
+ * library's, which serve as the reference implementation.
+ */
+#ifndef HOST_H
+#define HOST_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "format.h"
+#include "log.h"
+#include "memory.h"
+#include "rootfs.h"
+
+void *kmemset(void *dest, int c, size_t n);
+void *kmemcpy(void *dest, const void *src, size_t n);
+int kmemcmp(const void *a, const void *b, size_t n);
+size_t kstrlen(const char *str);
+int kstrcmp(const char *lhs, const char *rhs);
+int kstrncmp(const char *lhs, const char *rhs, size_t count);
+
+/* Hand memory_init() a Stivale2 map with one usable region of `size`
+   bytes, page aligned and owned by the harness; returns its base. */
+uint8_t *host_memory_init(size_t size, const char *cmdline);
+
+int kvsnprintf(char *buf, size_t size, const char *fmt, va_list args) __attribute__((format(printf, 3, 0)));
+int ksnprintf(char *buf, size_t size, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+
+#endif /* HOST_H */
@@ -0,0 +1,22 @@
+/*
+ * Forced in front of every kernel source built for the host. User mode
+ * may not cli/sti and the harness is single threaded, so the interrupt
+ * helpers the spinlocks use become no-ops; the rest of interrupts.h is
+ * not needed by the libraries under test.
+ */
+#ifndef KERNEL_SHIM_H
+#define KERNEL_SHIM_H
+
+#include <stdint.h>
+
+#define INTERRUPTS_H
+
+static inline uint64_t irq_save(void) {
+    return 0;
+}
+
+static inline void irq_restore(uint64_t flags) {
+    (void)flags;
+}
+
+#endif /* KERNEL_SHIM_H */
@@ -0,0 +1,259 @@
+/*
+ * Host microbenchmarks in the shape of Google Benchmark: each case runs
+ * with growing iteration counts until it has taken --min_time seconds,
+ * then reports time per iteration. Kernel routines are listed next to
+ * the C library's so a change can be judged against a known-good floor.
+ *
+ *   microbench [--benchmark_filter=substring] [--min_time=seconds]
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "host.h"
+
+#define MAX_SIZE 65536
+#define ARENA_SIZE (64u << 20)
+
+struct microbench {
+    const char *name;
+    void (*fn)(size_t arg, uint64_t iters);
+    bool bytes; /* arg is a byte count, so report throughput */
+    size_t args[6]; /* 0-terminated; a case without args runs once with 0 */
+};
+
+static uint8_t src[MAX_SIZE];
+static uint8_t dst[MAX_SIZE];
+static char str_a[MAX_SIZE + 1];
+static char str_b[MAX_SIZE + 1];
+
+static void clobber(const void *p) {
+    __asm__ volatile ("" : : "r"(p) : "memory");
+}
+
+static void bm_kmemcpy(size_t n, uint64_t iters) {
+    for (uint64_t i = 0; i < iters; i++) {
+        kmemcpy(dst, src, n);
+        clobber(dst);
+    }
+}
+
+static void bm_memcpy(size_t n, uint64_t iters) {
+    for (uint64_t i = 0; i < iters; i++) {
+        memcpy(dst, src, n);
+        clobber(dst);
+    }
+}
+
+static void bm_kmemset(size_t n, uint64_t iters) {
+    for (uint64_t i = 0; i < iters; i++) {
+        kmemset(dst, (int)i, n);
+        clobber(dst);
+    }
+}
+
+static void bm_memset(size_t n, uint64_t iters) {
+    for (uint64_t i = 0; i < iters; i++) {
+        memset(dst, (int)i, n);
+        clobber(dst);
+    }
+}
+
+static void bm_kmemcmp(size_t n, uint64_t iters) {
+    memcpy(dst, src, n);
+    for (uint64_t i = 0; i < iters; i++) {
+        int r = kmemcmp(dst, src, n);
+        clobber(&r);
+        clobber(dst);
+    }
+}
+
+static void bm_memcmp(size_t n, uint64_t iters) {
+    memcpy(dst, src, n);
+    for (uint64_t i = 0; i < iters; i++) {
+        int r = memcmp(dst, src, n);
+        clobber(&r);
+        clobber(dst);
+    }
+}
+
+static void set_strings(size_t n) {
+    memset(str_a, 'z', n);
+    memset(str_b, 'z', n);
+    str_a[n] = '\0';
+    str_b[n] = '\0';
+}
+
+static void bm_kstrlen(size_t n, uint64_t iters) {
+    set_strings(n);
+    for (uint64_t i = 0; i < iters; i++) {
+        clobber(str_a);
+        size_t r = kstrlen(str_a);
+        clobber(&r);
+    }
+}
+
+static void bm_strlen(size_t n, uint64_t iters) {
+    set_strings(n);
+    for (uint64_t i = 0; i < iters; i++) {
+        clobber(str_a);
+        size_t r = strlen(str_a);
+        clobber(&r);
+    }
+}
+
+static void bm_kstrcmp(size_t n, uint64_t iters) {
+    set_strings(n);
+    for (uint64_t i = 0; i < iters; i++) {
+        clobber(str_a);
+        int r = kstrcmp(str_a, str_b);
+        clobber(&r);
+    }
+}
+
+static void bm_strcmp(size_t n, uint64_t iters) {
+    set_strings(n);
+    for (uint64_t i = 0; i < iters; i++) {
+        clobber(str_a);
+        int r = strcmp(str_a, str_b);
+        clobber(&r);
+    }
+}
+
+static void bm_bump_alloc(size_t n, uint64_t iters) {
+    host_memory_init(ARENA_SIZE, NULL);
+    for (uint64_t i = 0; i < iters; i++) {
+        void *p = bump_alloc(n, 16);
+        if (!p) {
+            host_memory_init(ARENA_SIZE, NULL);
+        }
+        clobber(p);
+    }
+}
+
+static void bm_page_alloc_free(size_t n, uint64_t iters) {
+    (void)n;
+    host_memory_init(ARENA_SIZE, NULL);
+    for (uint64_t i = 0; i < iters; i++) {
+        page_free(page_alloc());
+    }
+}
+
+static void bm_pool_alloc_free(size_t n, uint64_t iters) {
+    static struct object_pool pool = OBJECT_POOL("microbench", uint64_t[8]);
+    (void)n;
+    for (uint64_t i = 0; i < iters; i++) {
+        pool_free(&pool, pool_alloc(&pool));
+    }
+}
+
+/* one typical console line, as the kernel's format.snprintf_line bench */
+#define LINE_FORMAT "pci: %02x:%02x.%x %04x:%04x bound to %s, bar0 %#lx\n"
+#define LINE_ARGS(i) (unsigned)((i) & 0xFF), 3u, 0u, 0x1AF4u, 0x1041u, "virtio-net", 0xFEBC1000UL + (i)
+
+static void bm_ksnprintf(size_t n, uint64_t iters) {
+    char line[128];
+    (void)n;
+    for (uint64_t i = 0; i < iters; i++) {
+        int r = ksnprintf(line, sizeof(line), LINE_FORMAT, LINE_ARGS(i));
+        clobber(line);
+        clobber(&r);
+    }
+}
+
+static void bm_snprintf(size_t n, uint64_t iters) {
+    char line[128];
+    (void)n;
+    for (uint64_t i = 0; i < iters; i++) {
+        int r = snprintf(line, sizeof(line), LINE_FORMAT, LINE_ARGS(i));
+        clobber(line);
+        clobber(&r);
+    }
+}
+
+static const struct microbench benches[] = {
+    { "kmemcpy", bm_kmemcpy, true, { 8, 64, 512, 4096, 65536 } },
+    { "memcpy", bm_memcpy, true, { 8, 64, 512, 4096, 65536 } },
+    { "kmemset", bm_kmemset, true, { 8, 64, 512, 4096, 65536 } },
+    { "memset", bm_memset, true, { 8, 64, 512, 4096, 65536 } },
+    { "kmemcmp", bm_kmemcmp, true, { 8, 64, 512, 4096, 65536 } },
+    { "memcmp", bm_memcmp, true, { 8, 64, 512, 4096, 65536 } },
+    { "kstrlen", bm_kstrlen, true, { 8, 64, 512, 4096 } },
+    { "strlen", bm_strlen, true, { 8, 64, 512, 4096 } },
+    { "kstrcmp", bm_kstrcmp, true, { 8, 64, 512, 4096 } },
+    { "strcmp", bm_strcmp, true, { 8, 64, 512, 4096 } },
+    { "bump_alloc", bm_bump_alloc, false, { 16, 4096 } },
+    { "page_alloc_free", bm_page_alloc_free, false, { 0 } },
+    { "pool_alloc_free", bm_pool_alloc_free, false, { 0 } },
+    { "ksnprintf_line", bm_ksnprintf, false, { 0 } },
+    { "snprintf_line", bm_snprintf, false, { 0 } },
+};
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void run(const struct microbench *b, size_t arg, double min_time) {
+    char label[64];
+    if (arg) {
+        snprintf(label, sizeof(label), "%s/%zu", b->name, arg);
+    } else {
+        snprintf(label, sizeof(label), "%s", b->name);
+    }
+    uint64_t iters = 1;
+    double elapsed;
+    for (;;) {
+        const double start = now();
+        b->fn(arg, iters);
+        elapsed = now() - start;
+        if (elapsed >= min_time || iters >= (1ULL << 40)) {
+            break;
+        }
+        /* aim a little past min_time, as Google Benchmark does */
+        const double scale = elapsed > 0 ? min_time * 1.4 / elapsed : 10;
+        iters = (uint64_t)((double)iters * (scale > 10 ? 10 : scale)) + 1;
+    }
+    const double ns = elapsed * 1e9 / (double)iters;
+    printf("%-28s %12.2f ns %14llu", label, ns, (unsigned long long)iters);
+    if (b->bytes) {
+        printf(" %10.2f GB/s", (double)arg / ns);
+    }
+    printf("\n");
+}
+
+int main(int argc, char **argv) {
+    const char *filter = "";
+    double min_time = 0.1;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--benchmark_filter=", 19) == 0) {
+            filter = argv[i] + 19;
+        } else if (strncmp(argv[i], "--min_time=", 11) == 0) {
+            min_time = strtod(argv[i] + 11, NULL);
+        } else {
+            fprintf(stderr, "usage: %s [--benchmark_filter=substring] [--min_time=seconds]\n", argv[0]);
+            return 2;
+        }
+    }
+    for (size_t i = 0; i < sizeof(src); i++) {
+        src[i] = (uint8_t)(i * 13 + 1);
+    }
+
+    printf("%-28s %15s %14s\n", "Benchmark", "Time", "Iterations");
+    printf("----------------------------------------------------------------------------\n");
+    for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        const struct microbench *b = &benches[i];
+        for (size_t a = 0; a < 6 && (a == 0 || b->args[a]); a++) {
+            char label[64];
+            snprintf(label, sizeof(label), "%s/%zu", b->name, b->args[a]);
+            if (strstr(label, filter)) {
+                run(b, b->args[a], min_time);
+            }
+        }
+    }
+    return 0;
+}
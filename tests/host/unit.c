@@ -0,0 +1,344 @@
+/*
+ * Unit tests for the freestanding libraries, checked against the C
+ * library where one exists. Exit status is the number of failed checks.
+ */
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "host.h"
+#include "vdso.h"
+
+static int checks;
+static int failures;
+
+#define CHECK(cond)                                                          \
+    do {                                                                     \
+        checks++;                                                            \
+        if (!(cond)) {                                                       \
+            failures++;                                                      \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+        }                                                                    \
+    } while (0)
+
+#define CHECK_STR(got, want)                                                 \
+    do {                                                                     \
+        checks++;                                                            \
+        if (strcmp((got), (want)) != 0) {                                    \
+            failures++;                                                      \
+            fprintf(stderr, "%s:%d: got \"%s\", want \"%s\"\n", __FILE__, __LINE__, (got), (want)); \
+        }                                                                    \
+    } while (0)
+
+static int sign(int v) {
+    return (v > 0) - (v < 0);
+}
+
+static void test_string(void) {
+    CHECK(kstrlen("") == 0);
+    CHECK(kstrlen(NULL) == 0);
+    CHECK(kstrlen("zkernel") == 7);
+
+    static const char *const words[] = { "", "a", "ab", "abc", "abd", "b", "\x80", "\xff", "a\x80" };
+    const size_t n = sizeof(words) / sizeof(words[0]);
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = 0; j < n; j++) {
+            CHECK(sign(kstrcmp(words[i], words[j])) == sign(strcmp(words[i], words[j])));
+            for (size_t len = 0; len < 4; len++) {
+                CHECK(sign(kstrncmp(words[i], words[j], len)) == sign(strncmp(words[i], words[j], len)));
+            }
+        }
+    }
+}
+
+static void test_mem(void) {
+    unsigned char src[300], a[300], b[300];
+    for (size_t i = 0; i < sizeof(src); i++) {
+        src[i] = (unsigned char)(i * 7 + 3);
+    }
+    for (size_t off = 0; off < 8; off++) {
+        for (size_t len = 0; len + off <= 256; len += len < 32 ? 1 : 37) {
+            memset(a, 0xAA, sizeof(a));
+            memset(b, 0xAA, sizeof(b));
+            CHECK(kmemcpy(a + off, src, len) == a + off);
+            memcpy(b + off, src, len);
+            CHECK(memcmp(a, b, sizeof(a)) == 0);
+
+            CHECK(kmemset(a + off, 0x5C, len) == a + off);
+            memset(b + off, 0x5C, len);
+            CHECK(memcmp(a, b, sizeof(a)) == 0);
+        }
+    }
+
+    memcpy(a, src, sizeof(a));
+    memcpy(b, src, sizeof(b));
+    CHECK(kmemcmp(a, b, sizeof(a)) == 0);
+    CHECK(kmemcmp(a, b, 0) == 0);
+    b[200] = 0xFF;
+    CHECK(sign(kmemcmp(a, b, sizeof(a))) == sign(memcmp(a, b, sizeof(a))));
+    CHECK(sign(kmemcmp(b, a, sizeof(a))) == sign(memcmp(b, a, sizeof(a))));
+    CHECK(kmemcmp(a, b, 200) == 0);
+}
+
+static void test_memory(void) {
+    const size_t arena_size = 64 * 4096;
+    uint8_t *arena = host_memory_init(arena_size, "trace=irq perf=cycles");
+    CHECK(arena != NULL);
+    CHECK_STR(memory_get_cmdline(), "trace=irq perf=cycles");
+    CHECK(memory_free_pages() == 64);
+
+    uint8_t *p = bump_alloc(3, 1);
+    CHECK(p == arena);
+    uint8_t *q = bump_alloc(16, 16);
+    CHECK(q == arena + 16);
+    CHECK(bump_alloc(arena_size, 1) == NULL);
+
+    /* the partly used first page is not counted */
+    CHECK(memory_free_pages() == 63);
+    uint8_t *page = page_alloc();
+    CHECK(page == arena + 4096);
+    CHECK(((uintptr_t)page & 4095) == 0);
+    page_free(page);
+    CHECK(memory_free_pages() == 63);
+    CHECK(page_alloc() == page);
+    page_free(NULL);
+
+    struct object_pool pool = OBJECT_POOL("unit", char[20]);
+    CHECK(pool.object_size == 32);
+    void *objs[200];
+    for (size_t i = 0; i < 200; i++) {
+        objs[i] = pool_alloc(&pool);
+        CHECK(objs[i] != NULL);
+        memset(objs[i], (int)i, pool.object_size);
+    }
+    CHECK(pool.in_use == 200);
+    for (size_t i = 0; i < 200; i++) {
+        CHECK(((uint8_t *)objs[i])[pool.object_size - 1] == (uint8_t)i);
+        pool_free(&pool, objs[i]);
+    }
+    CHECK(pool.in_use == 0);
+    CHECK(pool_alloc(&pool) == objs[199]);
+
+    /* drain: the allocators report exhaustion instead of running over */
+    size_t pages = 0;
+    while (page_alloc()) {
+        pages++;
+    }
+    CHECK(pages > 0);
+    CHECK(memory_free_pages() == 0);
+
+    char long_cmdline[400];
+    memset(long_cmdline, 'x', sizeof(long_cmdline) - 1);
+    long_cmdline[sizeof(long_cmdline) - 1] = '\0';
+    host_memory_init(arena_size, long_cmdline);
+    CHECK(strlen(memory_get_cmdline()) == 255);
+    host_memory_init(arena_size, NULL);
+    CHECK_STR(memory_get_cmdline(), "");
+}
+
+static void test_rootfs(void) {
+    rootfs_init();
+    size_t count = 0;
+    const struct rootfs_entry *list = rootfs_entries(&count);
+    CHECK(count > 0);
+    for (size_t i = 0; i < count; i++) {
+        CHECK(list[i].size == strlen(list[i].data));
+        const char *data = NULL;
+        size_t size = 0;
+        CHECK(rootfs_read(list[i].path, &data, &size));
+        CHECK(data == list[i].data && size == list[i].size);
+    }
+    CHECK(rootfs_read("/etc/motd", NULL, NULL));
+    CHECK(!rootfs_read("/etc/motd/", NULL, NULL));
+    CHECK(!rootfs_read("/etc", NULL, NULL));
+    CHECK(!rootfs_read("", NULL, NULL));
+    CHECK(!rootfs_read(NULL, NULL, NULL));
+    CHECK(rootfs_entries(NULL) == list);
+}
+
+/* the kernel formatter must agree with the C library on everything both do */
+#define CHECK_FORMAT(...)                                                    \
+    do {                                                                     \
+        char got[256], want[256];                                            \
+        const int n = ksnprintf(got, sizeof(got), __VA_ARGS__);              \
+        CHECK(n == snprintf(want, sizeof(want), __VA_ARGS__));               \
+        CHECK_STR(got, want);                                                \
+    } while (0)
+
+struct collect {
+    struct format_buf b;
+    char out[512];
+    size_t len;
+    int flushes;
+};
+
+static void collect_flush(struct format_buf *b) {
+    struct collect *c = (struct collect *)b;
+    memcpy(c->out + c->len, b->data, b->len);
+    c->len += b->len;
+    c->flushes++;
+    b->len = 0;
+}
+
+static size_t collect_format(struct collect *c, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    const size_t n = vformat(&c->b, fmt, args);
+    va_end(args);
+    collect_flush(&c->b);
+    c->out[c->len] = '\0';
+    return n;
+}
+
+static void test_format(void) {
+    static const char *const int_formats[] = {
+        "%d", "%i", "%5d", "%-5d|", "%05d", "%+d", "% d", "%+05d", "%.3d", "%8.3d", "%-8.3d|", "%08.3d",
+        "%.0d", "%u", "%x", "%X", "%#x", "%#X", "%#08x", "%-#8x|", "%.0x", "%#.0x", "%o", "%#o", "%.0o",
+        "%#.0o", "%#5o", "%hhd", "%hhu", "%hd", "%hx",
+    };
+    static const int int_values[] = { 0, 1, -1, 7, 42, -42, 255, 300, 70000, 0xABCD, INT_MAX, INT_MIN };
+    for (size_t f = 0; f < sizeof(int_formats) / sizeof(int_formats[0]); f++) {
+        for (size_t v = 0; v < sizeof(int_values) / sizeof(int_values[0]); v++) {
+            CHECK_FORMAT(int_formats[f], int_values[v]);
+        }
+    }
+    static const char *const long_formats[] = {
+        "%ld", "%lu", "%lx", "%#lx", "%020ld", "%-20lu|", "%.18lx", "%lo", "%lld", "%llX", "%zu", "%zx",
+        "%td", "%jd", "%ju",
+    };
+    static const long long_values[] = { 0, 1, -1, 4096, -4096, 0x123456789AL, LONG_MAX, LONG_MIN };
+    for (size_t f = 0; f < sizeof(long_formats) / sizeof(long_formats[0]); f++) {
+        for (size_t v = 0; v < sizeof(long_values) / sizeof(long_values[0]); v++) {
+            CHECK_FORMAT(long_formats[f], long_values[v]);
+        }
+    }
+
+    CHECK_FORMAT("[%s|%10s|%-10s|%.2s|%5.1s]", "abc", "abc", "abc", "abc", "abc");
+    CHECK_FORMAT("[%*d|%-*d|%*d|%.*d|%.*d]", 6, 42, 6, 42, -6, 42, 4, 7, -1, 7);
+    CHECK_FORMAT("[%*s|%.*s]", 4, "x", 2, "xyz");
+    CHECK_FORMAT("[%c|%3c|%-3c|%%]", 'a', 'b', 'c');
+    CHECK_FORMAT("PCI %02x:%02x.%x id %04x:%04x bar %#lx", 0, 3, 1, 0x1AF4, 0x1041, 0xFEBC1000UL);
+    CHECK_FORMAT("%s", "");
+    CHECK_FORMAT("no conversions");
+
+    /* what the C library leaves undefined or does differently */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat"
+#pragma GCC diagnostic ignored "-Wformat-overflow"
+    char buf[128];
+    CHECK(ksnprintf(buf, sizeof(buf), "plain") == 5);
+    CHECK_STR(buf, "plain");
+    ksnprintf(buf, sizeof(buf), "%p %p", (void *)0x2A, (void *)NULL);
+    CHECK_STR(buf, "0x000000000000002a 0x0000000000000000");
+    ksnprintf(buf, sizeof(buf), "[%20p]", (void *)0x1000);
+    CHECK_STR(buf, "[  0x0000000000001000]");
+    ksnprintf(buf, sizeof(buf), "[%s]", (const char *)NULL);
+    CHECK_STR(buf, "[(null)]");
+    ksnprintf(buf, sizeof(buf), "100%% %q %lq");
+    CHECK_STR(buf, "100% ? ?");
+    CHECK(ksnprintf(buf, sizeof(buf), "end%") == 4);
+    CHECK_STR(buf, "end?");
+    CHECK(ksnprintf(buf, sizeof(buf), "end%-08") == 4);
+    CHECK_STR(buf, "end?");
+    CHECK(ksnprintf(buf, 4, "%s", "truncated") == 9);
+    CHECK_STR(buf, "tru");
+    CHECK(ksnprintf(buf, 6, "%08x", 0xBEEF) == 8);
+    CHECK_STR(buf, "0000b");
+    CHECK(ksnprintf(NULL, 0, "%d", 12345) == 5);
+    CHECK(ksnprintf(buf, 1, "%d", 12345) == 5);
+    CHECK_STR(buf, "");
+    CHECK(ksnprintf(buf, sizeof(buf), "%99999999999d", 1) == FORMAT_WIDTH_MAX);
+    CHECK(ksnprintf(buf, sizeof(buf), "%.*d", 1 << 30, 1) == FORMAT_WIDTH_MAX);
+    CHECK(ksnprintf(buf, sizeof(buf), "%*d", INT_MIN, 1) == FORMAT_WIDTH_MAX);
+    CHECK(buf[0] == '1' && buf[1] == ' ');
+#pragma GCC diagnostic pop
+
+    /* a small buffer with a flush hands out every chunk, as kprint does */
+    char small[7];
+    struct collect c = { { small, sizeof(small), 0, collect_flush }, "", 0, 0 };
+    CHECK(collect_format(&c, "%s=%-12d|%#lx\n", "counter", -5, 0xDEADBEEFUL) == 32);
+    CHECK_STR(c.out, "counter=-5          |0xdeadbeef\n");
+    CHECK(c.flushes == 5);
+}
+
+static void test_log(void) {
+    log_setup("console=ttyS0 quiet");
+    CHECK(log_level == LOG_WARN);
+    log_setup("loglevel=debug");
+    CHECK(log_level == LOG_DEBUG);
+    log_setup("loglevel=3 loglevel=9 loglevel=");
+    CHECK(log_level == LOG_ERR);
+    log_setup(NULL);
+    CHECK(log_level == LOG_ERR);
+
+    /* filtered messages do not evaluate their arguments */
+    int evaluated = 0;
+    pr_info("%d\n", ++evaluated);
+    pr_debug("%d\n", ++evaluated);
+    CHECK(evaluated == 0);
+    log_level = LOG_DEBUG;
+    pr_debug("%d\n", ++evaluated);
+    CHECK(evaluated == (LOG_COMPILE_LEVEL >= LOG_DEBUG));
+    log_level = LOG_COMPILE_LEVEL;
+
+    struct ratelimit rs = { SPINLOCK_INIT, "unit", 0, 0, 0 };
+    int allowed = 0;
+    for (int i = 0; i < 3 * LOG_RATELIMIT_BURST; i++) {
+        allowed += log_ratelimit(&rs);
+    }
+    CHECK(allowed == LOG_RATELIMIT_BURST);
+    CHECK(rs.missed == 2 * LOG_RATELIMIT_BURST);
+}
+
+/* A timer signal rebases the clock between two bases that describe the
+   same time, landing anywhere inside the reader; a reader that mixed one
+   base's tsc with the other's ns would be off by VDSO_TEST_OFFSET. */
+#define VDSO_TEST_OFFSET (1ULL << 62)
+#define VDSO_TEST_REBASES 4000
+
+static struct vdso_data vdso_page = { .shift = 32, .mult = 1ULL << 32 };
+static volatile sig_atomic_t vdso_rebases;
+
+static void vdso_rebase(int sig) {
+    (void)sig;
+    const uint64_t base = (vdso_rebases & 1) ? VDSO_TEST_OFFSET : 0;
+    vdso_write_clock(&vdso_page, base, base);
+    vdso_rebases++;
+}
+
+static void test_vdso(void) {
+    vdso_write_clock(&vdso_page, 0, 0);
+    const uint64_t now = vdso_clock_ns(&vdso_page);
+    CHECK(rdtsc_ordered() - now < VDSO_TEST_OFFSET / 2);
+
+    struct sigaction sa = { .sa_handler = vdso_rebase };
+    struct sigaction old;
+    sigaction(SIGALRM, &sa, &old);
+    struct itimerval tick = { { 0, 20 }, { 0, 20 } };
+    setitimer(ITIMER_REAL, &tick, NULL);
+    uint64_t torn = 0;
+    while (vdso_rebases < VDSO_TEST_REBASES) {
+        const uint64_t ns = vdso_clock_ns(&vdso_page);
+        torn += rdtsc_ordered() - ns >= VDSO_TEST_OFFSET / 2;
+    }
+    const struct itimerval off = { { 0, 0 }, { 0, 0 } };
+    setitimer(ITIMER_REAL, &off, NULL);
+    sigaction(SIGALRM, &old, NULL);
+    CHECK(torn == 0);
+    CHECK(vdso_page.seq == 2 * ((uint32_t)vdso_rebases + 1));
+}
+
+int main(void) {
+    test_string();
+    test_mem();
+    test_memory();
+    test_rootfs();
+    test_format();
+    test_log();
+    test_vdso();
+    printf("unit: %d checks, %d failed\n", checks, failures);
+    return failures != 0;
+}
@@ -0,0 +1,51 @@
+#include "lib.h"
+
+int main(int argc, char **argv);
+
+/* "init bench <op>" serves the user.* microbenchmarks: each resume
+   carries a count of operations to run before yielding back. */
+static void bench(const char *op) {
+    volatile uint64_t sink;
+    for (;;) {
+        uint64_t n = sys_yield();
+        if (ustreq(op, "clock_syscall")) {
+            for (; n; n--) {
+                sink = (uint64_t)sys_clock_gettime();
+            }
+        } else if (ustreq(op, "clock_vdso")) {
+            for (; n; n--) {
+                sink = clock_ns();
+            }
+        } else if (ustreq(op, "mutex")) {
+            static struct umutex m;
+            for (; n; n--) {
+                umutex_lock(&m);
+                umutex_unlock(&m);
+            }
+            sink = m.state;
+        } else if (ustreq(op, "getcpu")) {
+            for (; n; n--) {
+                sink = (uint64_t)getcpu();
+            }
+        } else {
+            for (; n; n--) {
+                sink = (uint64_t)sys_getpid();
+            }
+        }
+    }
+    (void)sink;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && ustreq(argv[1], "bench")) {
+        bench(argc > 2 ? argv[2] : "getpid");
+    }
+    puts_fd(1, "init: Bootstrapping tiny rootfs... (pid ");
+    put_u64(1, (uint64_t)sys_getpid());
+    puts_fd(1, ", ");
+    put_u64(1, clock_ns() / 1000000);
+    puts_fd(1, " ms after boot on a ");
+    puts_fd(1, vdso()->cpu.vendor);
+    puts_fd(1, " CPU)\n");
+    return 0;
+}
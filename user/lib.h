@@ -0,0 +1,115 @@
+#ifndef USER_LIB_H
+#define USER_LIB_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "syscall.h"
+#include "vdso.h"
+
+/* System call stubs and the few helpers user programs need; there is no
+   libc. SSE is off (-mgeneral-regs-only) because the kernel does not
+   save FPU state across processes. */
+
+static inline long syscall3(long nr, long a0, long a1, long a2) {
+    long ret;
+    __asm__ volatile ("syscall"
+                      : "=a"(ret)
+                      : "a"(nr), "D"(a0), "S"(a1), "d"(a2)
+                      : "rcx", "r11", "memory");
+    return ret;
+}
+
+static inline __attribute__((noreturn)) void sys_exit(int status) {
+    syscall3(SYS_exit, status, 0, 0);
+    __builtin_unreachable();
+}
+
+static inline long sys_write(int fd, const void *buf, size_t len) {
+    return syscall3(SYS_write, fd, (long)buf, (long)len);
+}
+
+static inline long sys_getpid(void) {
+    return syscall3(SYS_getpid, 0, 0, 0);
+}
+
+static inline uint64_t sys_yield(void) {
+    return (uint64_t)syscall3(SYS_yield, 0, 0, 0);
+}
+
+static inline long sys_clock_gettime(void) {
+    return syscall3(SYS_clock_gettime, 0, 0, 0);
+}
+
+/* The kernel's struct mutex protocol (include/futex.h): 0 free, 1 locked,
+   2 contended. A process is a single thread, so nothing could wake a
+   sleeper: until user threads exist there is no futex system call and a
+   contended lock spins. */
+struct umutex {
+    uint32_t state;
+};
+
+static inline void umutex_lock(struct umutex *m) {
+    uint32_t c = 0;
+    if (__atomic_compare_exchange_n(&m->state, &c, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return;
+    }
+    while (__atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE) != 0) {
+        cpu_relax();
+    }
+}
+
+static inline void umutex_unlock(struct umutex *m) {
+    __atomic_store_n(&m->state, 0, __ATOMIC_RELEASE);
+}
+
+static inline const struct vdso_data *vdso(void) {
+    return (const struct vdso_data *)VDSO_DATA_ADDR;
+}
+
+/* Monotonic nanoseconds without entering the kernel. */
+static inline uint64_t clock_ns(void) {
+    return vdso_clock_ns(vdso());
+}
+
+/* The CPU the caller runs on, from the TSC_AUX value the kernel sets;
+   -1 when the CPU has no RDTSCP. */
+static inline int getcpu(void) {
+    if (!vdso()->cpu.rdtscp) {
+        return -1;
+    }
+    uint32_t aux;
+    __asm__ volatile ("rdtscp" : "=c"(aux) : : "eax", "edx");
+    return (int)aux;
+}
+
+static inline size_t ustrlen(const char *s) {
+    size_t n = 0;
+    while (s[n]) {
+        n++;
+    }
+    return n;
+}
+
+static inline int ustreq(const char *a, const char *b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+static inline void puts_fd(int fd, const char *s) {
+    sys_write(fd, s, ustrlen(s));
+}
+
+static inline void put_u64(int fd, uint64_t v) {
+    char buf[21];
+    char *p = buf + sizeof(buf);
+    do {
+        *--p = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    sys_write(fd, p, (size_t)(buf + sizeof(buf) - p));
+}
+
+#endif /* USER_LIB_H */